@@ -0,0 +1,796 @@
+#include "AabbTree.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace {
+
+inline XMFLOAT3 Min3(const XMFLOAT3 &a, const XMFLOAT3 &b) {
+  return XMFLOAT3((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z));
+}
+
+inline XMFLOAT3 Max3(const XMFLOAT3 &a, const XMFLOAT3 &b) {
+  return XMFLOAT3((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z));
+}
+
+// Half the surface area, only ever compared against other areas
+inline float Area(const XMFLOAT3 &vMin, const XMFLOAT3 &vMax) {
+  float dx = vMax.x - vMin.x, dy = vMax.y - vMin.y, dz = vMax.z - vMin.z;
+  return dx * dy + dy * dz + dz * dx;
+}
+
+inline float UnionArea(const XMFLOAT3 &aMin, const XMFLOAT3 &aMax, const XMFLOAT3 &bMin, const XMFLOAT3 &bMax) {
+  return Area(Min3(aMin, bMin), Max3(aMax, bMax));
+}
+
+inline float Centroid(const XMFLOAT3 &vMin, const XMFLOAT3 &vMax, int iAxis) {
+  return 0.5f * ((&vMin.x)[iAxis] + (&vMax.x)[iAxis]);
+}
+
+} // namespace
+
+AabbTree::AabbTree() {
+  m_iRoot = NULL_NODE;
+  m_iFreeList = NULL_NODE;
+  m_uProxyCount = 0;
+  m_fFatMargin = 0.1f;
+  m_fRebuiltCost = 0.0f;
+}
+
+int AabbTree::AllocateNode() {
+  int iNode;
+
+  if (m_iFreeList == NULL_NODE) {
+    iNode = (int)m_aNodes.size();
+    m_aNodes.emplace_back();
+  } else {
+    iNode = m_iFreeList;
+    m_iFreeList = m_aNodes[iNode].Parent;
+  }
+
+  Node &node = m_aNodes[iNode];
+  node.Parent = NULL_NODE;
+  node.Child1 = NULL_NODE;
+  node.Child2 = NULL_NODE;
+  node.Height = 0;
+  node.UserData = 0;
+  return iNode;
+}
+
+void AabbTree::FreeNode(int iNode) {
+  m_aNodes[iNode].Parent = m_iFreeList;
+  m_aNodes[iNode].Height = -1;
+  m_iFreeList = iNode;
+}
+
+int AabbTree::Insert(_In_ const BoundingBox &box, _In_ UINT uUserData) {
+  int iLeaf = AllocateNode();
+  Node &leaf = m_aNodes[iLeaf];
+
+  leaf.Min = XMFLOAT3(box.Center.x - box.Extents.x - m_fFatMargin, box.Center.y - box.Extents.y - m_fFatMargin,
+                      box.Center.z - box.Extents.z - m_fFatMargin);
+  leaf.Max = XMFLOAT3(box.Center.x + box.Extents.x + m_fFatMargin, box.Center.y + box.Extents.y + m_fFatMargin,
+                      box.Center.z + box.Extents.z + m_fFatMargin);
+  leaf.UserData = uUserData;
+
+  InsertLeaf(iLeaf);
+  ++m_uProxyCount;
+  return iLeaf;
+}
+
+void AabbTree::Remove(_In_ int iProxy) {
+  RemoveLeaf(iProxy);
+  FreeNode(iProxy);
+  --m_uProxyCount;
+}
+
+BOOL AabbTree::Move(_In_ int iProxy, _In_ const BoundingBox &box, _In_ const XMFLOAT3 &vDisplacement) {
+  Node &leaf = m_aNodes[iProxy];
+  XMFLOAT3 vMin(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+  XMFLOAT3 vMax(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+
+  if (leaf.Min.x <= vMin.x && leaf.Min.y <= vMin.y && leaf.Min.z <= vMin.z &&
+      leaf.Max.x >= vMax.x && leaf.Max.y >= vMax.y && leaf.Max.z >= vMax.z)
+    return FALSE;
+
+  RemoveLeaf(iProxy);
+
+  // Fatten, then stretch the box along the motion so the next few moves stay inside it
+  leaf.Min = XMFLOAT3(vMin.x - m_fFatMargin, vMin.y - m_fFatMargin, vMin.z - m_fFatMargin);
+  leaf.Max = XMFLOAT3(vMax.x + m_fFatMargin, vMax.y + m_fFatMargin, vMax.z + m_fFatMargin);
+  for (int c = 0; c < 3; ++c) {
+    float d = 2.0f * (&vDisplacement.x)[c];
+    if (d < 0.0f)
+      (&leaf.Min.x)[c] += d;
+    else
+      (&leaf.Max.x)[c] += d;
+  }
+
+  InsertLeaf(iProxy);
+  return TRUE;
+}
+
+void AabbTree::SetLeafBox(_In_ int iProxy, _In_ const BoundingBox &box) {
+  Node &leaf = m_aNodes[iProxy];
+
+  leaf.Min = XMFLOAT3(box.Center.x - box.Extents.x - m_fFatMargin, box.Center.y - box.Extents.y - m_fFatMargin,
+                      box.Center.z - box.Extents.z - m_fFatMargin);
+  leaf.Max = XMFLOAT3(box.Center.x + box.Extents.x + m_fFatMargin, box.Center.y + box.Extents.y + m_fFatMargin,
+                      box.Center.z + box.Extents.z + m_fFatMargin);
+}
+
+void AabbTree::Refit() {
+  std::vector<int> aOrder;
+
+  if (m_iRoot == NULL_NODE)
+    return;
+
+  // Pre-order, so walking it backwards visits children before their parents
+  aOrder.reserve(2 * m_uProxyCount);
+  aOrder.push_back(m_iRoot);
+  for (size_t i = 0; i < aOrder.size(); ++i) {
+    const Node &node = m_aNodes[aOrder[i]];
+    if (!node.IsLeaf()) {
+      aOrder.push_back(node.Child1);
+      aOrder.push_back(node.Child2);
+    }
+  }
+
+  for (auto it = aOrder.rbegin(); it != aOrder.rend(); ++it) {
+    Node &node = m_aNodes[*it];
+    if (!node.IsLeaf()) {
+      const Node &child1 = m_aNodes[node.Child1];
+      const Node &child2 = m_aNodes[node.Child2];
+      node.Min = Min3(child1.Min, child2.Min);
+      node.Max = Max3(child1.Max, child2.Max);
+    }
+  }
+}
+
+void AabbTree::InsertLeaf(int iLeaf) {
+
+  if (m_iRoot == NULL_NODE) {
+    m_iRoot = iLeaf;
+    m_aNodes[iLeaf].Parent = NULL_NODE;
+    return;
+  }
+
+  // Descend towards the sibling with the lowest surface area cost
+  XMFLOAT3 vLeafMin = m_aNodes[iLeaf].Min;
+  XMFLOAT3 vLeafMax = m_aNodes[iLeaf].Max;
+  int iIndex = m_iRoot;
+
+  while (!m_aNodes[iIndex].IsLeaf()) {
+    const Node &node = m_aNodes[iIndex];
+    const Node &child1 = m_aNodes[node.Child1];
+    const Node &child2 = m_aNodes[node.Child2];
+    float fArea = Area(node.Min, node.Max);
+    float fCombinedArea = UnionArea(node.Min, node.Max, vLeafMin, vLeafMax);
+
+    // Cost of pairing the leaf with this node, and the cost pushed down to the children
+    float fCost = 2.0f * fCombinedArea;
+    float fInheritanceCost = 2.0f * (fCombinedArea - fArea);
+
+    float fCost1 = UnionArea(child1.Min, child1.Max, vLeafMin, vLeafMax) + fInheritanceCost;
+    if (!child1.IsLeaf())
+      fCost1 -= Area(child1.Min, child1.Max);
+    float fCost2 = UnionArea(child2.Min, child2.Max, vLeafMin, vLeafMax) + fInheritanceCost;
+    if (!child2.IsLeaf())
+      fCost2 -= Area(child2.Min, child2.Max);
+
+    if (fCost < fCost1 && fCost < fCost2)
+      break;
+
+    iIndex = fCost1 < fCost2 ? node.Child1 : node.Child2;
+  }
+
+  int iSibling = iIndex;
+  int iOldParent = m_aNodes[iSibling].Parent;
+  int iNewParent = AllocateNode();
+  Node &newParent = m_aNodes[iNewParent];
+  Node &sibling = m_aNodes[iSibling];
+
+  newParent.Parent = iOldParent;
+  newParent.Min = Min3(vLeafMin, sibling.Min);
+  newParent.Max = Max3(vLeafMax, sibling.Max);
+  newParent.Height = sibling.Height + 1;
+  newParent.Child1 = iSibling;
+  newParent.Child2 = iLeaf;
+  sibling.Parent = iNewParent;
+  m_aNodes[iLeaf].Parent = iNewParent;
+
+  if (iOldParent != NULL_NODE) {
+    Node &oldParent = m_aNodes[iOldParent];
+    if (oldParent.Child1 == iSibling)
+      oldParent.Child1 = iNewParent;
+    else
+      oldParent.Child2 = iNewParent;
+  } else {
+    m_iRoot = iNewParent;
+  }
+
+  FixUpwards(iNewParent);
+}
+
+void AabbTree::RemoveLeaf(int iLeaf) {
+
+  if (iLeaf == m_iRoot) {
+    m_iRoot = NULL_NODE;
+    return;
+  }
+
+  int iParent = m_aNodes[iLeaf].Parent;
+  int iGrandParent = m_aNodes[iParent].Parent;
+  int iSibling = m_aNodes[iParent].Child1 == iLeaf ? m_aNodes[iParent].Child2 : m_aNodes[iParent].Child1;
+
+  if (iGrandParent != NULL_NODE) {
+    Node &grandParent = m_aNodes[iGrandParent];
+    if (grandParent.Child1 == iParent)
+      grandParent.Child1 = iSibling;
+    else
+      grandParent.Child2 = iSibling;
+    m_aNodes[iSibling].Parent = iGrandParent;
+    FreeNode(iParent);
+
+    FixUpwards(iGrandParent);
+  } else {
+    m_iRoot = iSibling;
+    m_aNodes[iSibling].Parent = NULL_NODE;
+    FreeNode(iParent);
+  }
+}
+
+void AabbTree::FixUpwards(int iNode) {
+
+  while (iNode != NULL_NODE) {
+    iNode = Balance(iNode);
+
+    Node &node = m_aNodes[iNode];
+    const Node &child1 = m_aNodes[node.Child1];
+    const Node &child2 = m_aNodes[node.Child2];
+
+    node.Height = 1 + (std::max)(child1.Height, child2.Height);
+    node.Min = Min3(child1.Min, child2.Min);
+    node.Max = Max3(child1.Max, child2.Max);
+
+    iNode = node.Parent;
+  }
+}
+
+// Rotates the taller grandchild up when the children heights differ by more than one.
+// Returns the node now at the position of iA.
+int AabbTree::Balance(int iA) {
+  Node &A = m_aNodes[iA];
+
+  if (A.IsLeaf() || A.Height < 2)
+    return iA;
+
+  int iB = A.Child1;
+  int iC = A.Child2;
+  Node &B = m_aNodes[iB];
+  Node &C = m_aNodes[iC];
+  int iBalance = C.Height - B.Height;
+
+  if (iBalance > 1) {
+    // Rotate C up
+    int iF = C.Child1;
+    int iG = C.Child2;
+    Node &F = m_aNodes[iF];
+    Node &G = m_aNodes[iG];
+
+    C.Child1 = iA;
+    C.Parent = A.Parent;
+    A.Parent = iC;
+
+    if (C.Parent != NULL_NODE) {
+      if (m_aNodes[C.Parent].Child1 == iA)
+        m_aNodes[C.Parent].Child1 = iC;
+      else
+        m_aNodes[C.Parent].Child2 = iC;
+    } else {
+      m_iRoot = iC;
+    }
+
+    if (F.Height > G.Height) {
+      C.Child2 = iF;
+      A.Child2 = iG;
+      G.Parent = iA;
+      A.Min = Min3(B.Min, G.Min);
+      A.Max = Max3(B.Max, G.Max);
+      C.Min = Min3(A.Min, F.Min);
+      C.Max = Max3(A.Max, F.Max);
+      A.Height = 1 + (std::max)(B.Height, G.Height);
+      C.Height = 1 + (std::max)(A.Height, F.Height);
+    } else {
+      C.Child2 = iG;
+      A.Child2 = iF;
+      F.Parent = iA;
+      A.Min = Min3(B.Min, F.Min);
+      A.Max = Max3(B.Max, F.Max);
+      C.Min = Min3(A.Min, G.Min);
+      C.Max = Max3(A.Max, G.Max);
+      A.Height = 1 + (std::max)(B.Height, F.Height);
+      C.Height = 1 + (std::max)(A.Height, G.Height);
+    }
+
+    return iC;
+  }
+
+  if (iBalance < -1) {
+    // Rotate B up
+    int iD = B.Child1;
+    int iE = B.Child2;
+    Node &D = m_aNodes[iD];
+    Node &E = m_aNodes[iE];
+
+    B.Child1 = iA;
+    B.Parent = A.Parent;
+    A.Parent = iB;
+
+    if (B.Parent != NULL_NODE) {
+      if (m_aNodes[B.Parent].Child1 == iA)
+        m_aNodes[B.Parent].Child1 = iB;
+      else
+        m_aNodes[B.Parent].Child2 = iB;
+    } else {
+      m_iRoot = iB;
+    }
+
+    if (D.Height > E.Height) {
+      B.Child2 = iD;
+      A.Child1 = iE;
+      E.Parent = iA;
+      A.Min = Min3(C.Min, E.Min);
+      A.Max = Max3(C.Max, E.Max);
+      B.Min = Min3(A.Min, D.Min);
+      B.Max = Max3(A.Max, D.Max);
+      A.Height = 1 + (std::max)(C.Height, E.Height);
+      B.Height = 1 + (std::max)(A.Height, D.Height);
+    } else {
+      B.Child2 = iE;
+      A.Child1 = iD;
+      D.Parent = iA;
+      A.Min = Min3(C.Min, D.Min);
+      A.Max = Max3(C.Max, D.Max);
+      B.Min = Min3(A.Min, E.Min);
+      B.Max = Max3(A.Max, E.Max);
+      A.Height = 1 + (std::max)(C.Height, D.Height);
+      B.Height = 1 + (std::max)(A.Height, E.Height);
+    }
+
+    return iB;
+  }
+
+  return iA;
+}
+
+void AabbTree::Rebuild() {
+  std::vector<int> aLeaves;
+
+  if (m_iRoot == NULL_NODE)
+    return;
+
+  // Leaves keep their indices, which are the proxy handles; internal nodes are recycled
+  aLeaves.reserve(m_uProxyCount);
+  for (int i = 0; i < (int)m_aNodes.size(); ++i) {
+    if (m_aNodes[i].Height == 0)
+      aLeaves.push_back(i);
+    else if (m_aNodes[i].Height > 0)
+      FreeNode(i);
+  }
+
+  m_iRoot = BuildTopDown(aLeaves.data(), (UINT)aLeaves.size());
+  m_aNodes[m_iRoot].Parent = NULL_NODE;
+  m_fRebuiltCost = GetCost();
+}
+
+BOOL AabbTree::RebuildIfDegraded(_In_ float fThreshold) {
+
+  if (m_uProxyCount < 2)
+    return FALSE;
+
+  // The first call has no reference cost, rebuild to establish one
+  if (m_fRebuiltCost > 0.0f && GetCost() <= fThreshold * m_fRebuiltCost)
+    return FALSE;
+
+  Rebuild();
+  return TRUE;
+}
+
+// Binned SAH split over the centroids along the longest centroid axis.
+int AabbTree::BuildTopDown(int *pLeaves, UINT uCount) {
+  static const int NUM_BINS = 16;
+
+  if (uCount == 1)
+    return pLeaves[0];
+
+  XMFLOAT3 vCentroidMin(FLT_MAX, FLT_MAX, FLT_MAX), vCentroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (UINT i = 0; i < uCount; ++i) {
+    const Node &leaf = m_aNodes[pLeaves[i]];
+    XMFLOAT3 c(0.5f * (leaf.Min.x + leaf.Max.x), 0.5f * (leaf.Min.y + leaf.Max.y), 0.5f * (leaf.Min.z + leaf.Max.z));
+    vCentroidMin = Min3(vCentroidMin, c);
+    vCentroidMax = Max3(vCentroidMax, c);
+  }
+
+  int iAxis = 0;
+  float aExtent[3] = {vCentroidMax.x - vCentroidMin.x, vCentroidMax.y - vCentroidMin.y,
+                      vCentroidMax.z - vCentroidMin.z};
+  if (aExtent[1] > aExtent[iAxis])
+    iAxis = 1;
+  if (aExtent[2] > aExtent[iAxis])
+    iAxis = 2;
+
+  UINT uMid = uCount / 2;
+  float fAxisMin = (&vCentroidMin.x)[iAxis];
+
+  if (aExtent[iAxis] > 0.0f) {
+    struct Bin {
+      XMFLOAT3 Min, Max;
+      UINT Count;
+    } aBins[NUM_BINS];
+    float fScale = NUM_BINS / aExtent[iAxis];
+    float aRightArea[NUM_BINS];
+    UINT aRightCount[NUM_BINS];
+
+    auto BinIndex = [&](int iLeaf) {
+      const Node &leaf = m_aNodes[iLeaf];
+      int iBin = (int)((Centroid(leaf.Min, leaf.Max, iAxis) - fAxisMin) * fScale);
+      return (std::min)(iBin, NUM_BINS - 1);
+    };
+
+    for (auto &bin : aBins) {
+      bin.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+      bin.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      bin.Count = 0;
+    }
+    for (UINT i = 0; i < uCount; ++i) {
+      Bin &bin = aBins[BinIndex(pLeaves[i])];
+      bin.Min = Min3(bin.Min, m_aNodes[pLeaves[i]].Min);
+      bin.Max = Max3(bin.Max, m_aNodes[pLeaves[i]].Max);
+      ++bin.Count;
+    }
+
+    // Sweep from the right to get the area and count right of every split plane
+    XMFLOAT3 vMin = aBins[NUM_BINS - 1].Min, vMax = aBins[NUM_BINS - 1].Max;
+    UINT n = 0;
+    for (int b = NUM_BINS - 1; b > 0; --b) {
+      vMin = Min3(vMin, aBins[b].Min);
+      vMax = Max3(vMax, aBins[b].Max);
+      n += aBins[b].Count;
+      aRightArea[b] = n ? Area(vMin, vMax) : 0.0f;
+      aRightCount[b] = n;
+    }
+
+    // Split between bins b - 1 and b
+    float fBestCost = FLT_MAX;
+    int iBestSplit = 0;
+    vMin = aBins[0].Min;
+    vMax = aBins[0].Max;
+    n = 0;
+    for (int b = 1; b < NUM_BINS; ++b) {
+      vMin = Min3(vMin, aBins[b - 1].Min);
+      vMax = Max3(vMax, aBins[b - 1].Max);
+      n += aBins[b - 1].Count;
+      if (n == 0 || aRightCount[b] == 0)
+        continue;
+      float fCost = n * Area(vMin, vMax) + aRightCount[b] * aRightArea[b];
+      if (fCost < fBestCost) {
+        fBestCost = fCost;
+        iBestSplit = b;
+      }
+    }
+
+    if (iBestSplit > 0)
+      uMid = (UINT)(std::partition(pLeaves, pLeaves + uCount, [&](int iLeaf) { return BinIndex(iLeaf) < iBestSplit; }) -
+                    pLeaves);
+  }
+
+  // Coincident centroids, or no split separated anything, fall back to the median
+  if (uMid == 0 || uMid == uCount || aExtent[iAxis] <= 0.0f) {
+    uMid = uCount / 2;
+    std::nth_element(pLeaves, pLeaves + uMid, pLeaves + uCount, [&](int a, int b) {
+      return Centroid(m_aNodes[a].Min, m_aNodes[a].Max, iAxis) < Centroid(m_aNodes[b].Min, m_aNodes[b].Max, iAxis);
+    });
+  }
+
+  int iChild1 = BuildTopDown(pLeaves, uMid);
+  int iChild2 = BuildTopDown(pLeaves + uMid, uCount - uMid);
+  int iNode = AllocateNode();
+  Node &node = m_aNodes[iNode];
+  Node &child1 = m_aNodes[iChild1];
+  Node &child2 = m_aNodes[iChild2];
+
+  node.Child1 = iChild1;
+  node.Child2 = iChild2;
+  node.Min = Min3(child1.Min, child2.Min);
+  node.Max = Max3(child1.Max, child2.Max);
+  node.Height = 1 + (std::max)(child1.Height, child2.Height);
+  child1.Parent = iNode;
+  child2.Parent = iNode;
+  return iNode;
+}
+
+float AabbTree::GetCost() const {
+
+  if (m_iRoot == NULL_NODE || m_aNodes[m_iRoot].IsLeaf())
+    return 0.0f;
+
+  float fRootArea = Area(m_aNodes[m_iRoot].Min, m_aNodes[m_iRoot].Max);
+  float fTotalArea = 0.0f;
+
+  for (const auto &node : m_aNodes) {
+    if (node.Height > 0)
+      fTotalArea += Area(node.Min, node.Max);
+  }
+
+  return fRootArea > 0.0f ? fTotalArea / fRootArea : 0.0f;
+}
+
+void AabbTree::GetFatBox(_In_ int iProxy, _Out_ BoundingBox *pBox) const {
+  const Node &leaf = m_aNodes[iProxy];
+
+  BoundingBox::CreateFromPoints(*pBox, XMLoadFloat3(&leaf.Min), XMLoadFloat3(&leaf.Max));
+}
+
+void AabbTree::AppendSubtree(int iNode, std::vector<UINT> *pResults) const {
+  std::vector<int> aStack;
+
+  aStack.reserve(64);
+  aStack.push_back(iNode);
+
+  while (!aStack.empty()) {
+    const Node &node = m_aNodes[aStack.back()];
+    aStack.pop_back();
+
+    if (node.IsLeaf())
+      pResults->push_back(node.UserData);
+    else {
+      aStack.push_back(node.Child2);
+      aStack.push_back(node.Child1);
+    }
+  }
+}
+
+void AabbTree::QueryFrustum(
+  _In_reads_(6) const XMFLOAT4 *pPlanes,
+  _Inout_ std::vector<UINT> *pResults,
+  _In_ int iRoot
+) const {
+
+  // Each entry carries the planes its box still straddles, children inherit them
+  struct Entry {
+    int Node;
+    UINT PlaneMask;
+  };
+  std::vector<Entry> aStack;
+
+  if (iRoot == NULL_NODE)
+    iRoot = m_iRoot;
+  if (iRoot == NULL_NODE)
+    return;
+
+  aStack.reserve(64);
+  aStack.push_back({iRoot, 0x3f});
+
+  while (!aStack.empty()) {
+    Entry entry = aStack.back();
+    const Node &node = m_aNodes[entry.Node];
+    bool bOutside = false;
+
+    aStack.pop_back();
+
+    for (int p = 0; p < 6 && !bOutside; ++p) {
+      if (!(entry.PlaneMask & (1u << p)))
+        continue;
+
+      const XMFLOAT4 &P = pPlanes[p];
+      float fDist = 0.5f * ((node.Min.x + node.Max.x) * P.x + (node.Min.y + node.Max.y) * P.y +
+                            (node.Min.z + node.Max.z) * P.z) + P.w;
+      float fRadius = 0.5f * ((node.Max.x - node.Min.x) * fabsf(P.x) + (node.Max.y - node.Min.y) * fabsf(P.y) +
+                              (node.Max.z - node.Min.z) * fabsf(P.z));
+
+      if (fDist > fRadius)
+        bOutside = true;
+      else if (fDist < -fRadius)
+        entry.PlaneMask &= ~(1u << p);
+    }
+
+    if (bOutside)
+      continue;
+
+    if (entry.PlaneMask == 0)
+      AppendSubtree(entry.Node, pResults);
+    else if (node.IsLeaf())
+      pResults->push_back(node.UserData);
+    else {
+      aStack.push_back({node.Child2, entry.PlaneMask});
+      aStack.push_back({node.Child1, entry.PlaneMask});
+    }
+  }
+}
+
+void AabbTree::QuerySphere(
+  _In_ const BoundingSphere &sphere,
+  _Inout_ std::vector<UINT> *pResults,
+  _In_ int iRoot
+) const {
+  std::vector<int> aStack;
+  float fRadiusSq = sphere.Radius * sphere.Radius;
+
+  if (iRoot == NULL_NODE)
+    iRoot = m_iRoot;
+  if (iRoot == NULL_NODE)
+    return;
+
+  aStack.reserve(64);
+  aStack.push_back(iRoot);
+
+  while (!aStack.empty()) {
+    const Node &node = m_aNodes[aStack.back()];
+    float fDistSq = 0.0f;
+
+    aStack.pop_back();
+
+    for (int c = 0; c < 3; ++c) {
+      float v = (&sphere.Center.x)[c];
+      float d = (std::max)((&node.Min.x)[c] - v, 0.0f) + (std::max)(v - (&node.Max.x)[c], 0.0f);
+      fDistSq += d * d;
+    }
+
+    if (fDistSq > fRadiusSq)
+      continue;
+
+    if (node.IsLeaf())
+      pResults->push_back(node.UserData);
+    else {
+      aStack.push_back(node.Child2);
+      aStack.push_back(node.Child1);
+    }
+  }
+}
+
+BOOL AabbTree::RayCast(
+  _In_ const XMFLOAT3 &vOrigin,
+  _In_ const XMFLOAT3 &vDirection,
+  _In_ float fMaxDist,
+  _Out_ UINT *pUserData,
+  _Out_ float *pDist
+) const {
+
+  struct Entry {
+    int Node;
+    float Enter;
+  };
+  std::vector<Entry> aStack;
+  float aInvDir[3];
+  float fBest = fMaxDist;
+  int iBestLeaf = NULL_NODE;
+
+  *pUserData = 0;
+  *pDist = 0.0f;
+
+  if (m_iRoot == NULL_NODE)
+    return FALSE;
+
+  for (int c = 0; c < 3; ++c) {
+    float d = (&vDirection.x)[c];
+    aInvDir[c] = fabsf(d) > 1e-20f ? 1.0f / d : (d < 0.0f ? -1e20f : 1e20f);
+  }
+
+  // Slab test, returns the entry distance or a negative value on a miss
+  auto Intersect = [&](const Node &node) {
+    float fEnter = 0.0f, fExit = fBest;
+    for (int c = 0; c < 3; ++c) {
+      float o = (&vOrigin.x)[c];
+      float t0 = ((&node.Min.x)[c] - o) * aInvDir[c];
+      float t1 = ((&node.Max.x)[c] - o) * aInvDir[c];
+      fEnter = (std::max)(fEnter, (std::min)(t0, t1));
+      fExit = (std::min)(fExit, (std::max)(t0, t1));
+    }
+    return fEnter <= fExit ? fEnter : -1.0f;
+  };
+
+  float fRootEnter = Intersect(m_aNodes[m_iRoot]);
+  if (fRootEnter < 0.0f)
+    return FALSE;
+
+  aStack.reserve(64);
+  aStack.push_back({m_iRoot, fRootEnter});
+
+  while (!aStack.empty()) {
+    Entry entry = aStack.back();
+    aStack.pop_back();
+
+    // A closer hit was found since this node was pushed
+    if (entry.Enter > fBest)
+      continue;
+
+    const Node &node = m_aNodes[entry.Node];
+    if (node.IsLeaf()) {
+      fBest = entry.Enter;
+      iBestLeaf = entry.Node;
+      continue;
+    }
+
+    float fEnter1 = Intersect(m_aNodes[node.Child1]);
+    float fEnter2 = Intersect(m_aNodes[node.Child2]);
+
+    // Push the farther child first so the nearer one is visited first
+    if (fEnter1 >= 0.0f && fEnter2 >= 0.0f) {
+      if (fEnter1 < fEnter2) {
+        aStack.push_back({node.Child2, fEnter2});
+        aStack.push_back({node.Child1, fEnter1});
+      } else {
+        aStack.push_back({node.Child1, fEnter1});
+        aStack.push_back({node.Child2, fEnter2});
+      }
+    } else if (fEnter1 >= 0.0f) {
+      aStack.push_back({node.Child1, fEnter1});
+    } else if (fEnter2 >= 0.0f) {
+      aStack.push_back({node.Child2, fEnter2});
+    }
+  }
+
+  if (iBestLeaf == NULL_NODE)
+    return FALSE;
+
+  *pUserData = m_aNodes[iBestLeaf].UserData;
+  *pDist = fBest;
+  return TRUE;
+}
+
+void AabbTree::GetSubtreeRoots(_In_ UINT uMinCount, _Out_ std::vector<int> *pRoots) const {
+
+  pRoots->clear();
+  if (m_iRoot == NULL_NODE)
+    return;
+
+  pRoots->push_back(m_iRoot);
+
+  // Keep splitting the tallest subtree, a rough stand-in for the largest one
+  while (pRoots->size() < uMinCount) {
+    size_t iTallest = 0;
+    for (size_t i = 1; i < pRoots->size(); ++i) {
+      if (m_aNodes[(*pRoots)[i]].Height > m_aNodes[(*pRoots)[iTallest]].Height)
+        iTallest = i;
+    }
+
+    const Node &node = m_aNodes[(*pRoots)[iTallest]];
+    if (node.IsLeaf())
+      break;
+
+    (*pRoots)[iTallest] = node.Child1;
+    pRoots->push_back(node.Child2);
+  }
+}
+
+void AabbTree::QueryFrustumParallel(
+  _In_reads_(6) const XMFLOAT4 *pPlanes,
+  _In_opt_ JobSystem *pJobSystem,
+  _Inout_ std::vector<UINT> *pResults
+) const {
+
+  std::vector<int> aRoots;
+  std::vector<std::vector<UINT>> aResults;
+  const UINT uNumThreads = pJobSystem ? pJobSystem->GetActiveWorkerCount() + 1 : 1;
+
+  // A few subtrees per thread so the faster workers pick up the slack
+  GetSubtreeRoots(uNumThreads * 4, &aRoots);
+  aResults.resize(aRoots.size());
+
+  auto QueryRange = [&](uint32_t uBegin, uint32_t uEnd) {
+    for (uint32_t i = uBegin; i < uEnd; ++i)
+      QueryFrustum(pPlanes, &aResults[i], aRoots[i]);
+  };
+
+  if (uNumThreads > 1 && aRoots.size() > 1)
+    pJobSystem->ParallelFor(0, (uint32_t)aRoots.size(), 1, QueryRange);
+  else
+    QueryRange(0, (uint32_t)aRoots.size());
+
+  for (const auto &aRootResults : aResults)
+    pResults->insert(pResults->end(), aRootResults.begin(), aRootResults.end());
+}
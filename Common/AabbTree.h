@@ -0,0 +1,129 @@
+#pragma once
+#include "D3D12Types.h"
+#include <vector>
+
+class JobSystem;
+
+///
+/// Dynamic AABB tree over scene instances. Leaves hold fattened boxes so small motions
+/// do not touch the tree; insertion picks the sibling by surface area cost and keeps the
+/// tree balanced with rotations. When incremental updates have degraded it, the tree can
+/// be rebuilt top-down with a binned SAH.
+///
+class AabbTree {
+public:
+  static const int NULL_NODE = -1;
+
+  AabbTree();
+
+  /// Margin added to every side of a leaf box, and how far a moved box is predicted ahead.
+  void SetFatMargin(_In_ float fMargin);
+
+  /// Returns the proxy handle of the new leaf.
+  int Insert(_In_ const DirectX::BoundingBox &box, _In_ UINT uUserData);
+  void Remove(_In_ int iProxy);
+
+  /// Reinserts the leaf only if the new box escaped its fattened box. Returns TRUE when the
+  /// tree changed.
+  BOOL Move(_In_ int iProxy, _In_ const DirectX::BoundingBox &box, _In_ const DirectX::XMFLOAT3 &vDisplacement);
+
+  /// Bulk update: overwrite leaf boxes with SetLeafBox, keeping the topology, then Refit
+  /// the internal nodes bottom-up once.
+  void SetLeafBox(_In_ int iProxy, _In_ const DirectX::BoundingBox &box);
+  void Refit();
+
+  /// Full top-down rebuild, and a rebuild only when the SAH cost grew by more than
+  /// fThreshold times the cost measured right after the last rebuild.
+  void Rebuild();
+  BOOL RebuildIfDegraded(_In_ float fThreshold = 1.5f);
+
+  /// Sum of the internal node surface areas over the root area, lower is better.
+  float GetCost() const;
+  int GetHeight() const;
+  UINT GetProxyCount() const;
+  UINT GetUserData(_In_ int iProxy) const;
+  void GetFatBox(_In_ int iProxy, _Out_ DirectX::BoundingBox *pBox) const;
+
+  /// Appends the user data of every leaf that is not outside the six outward facing planes.
+  /// iRoot selects a subtree, see GetSubtreeRoots.
+  void QueryFrustum(
+    _In_reads_(6) const DirectX::XMFLOAT4 *pPlanes,
+    _Inout_ std::vector<UINT> *pResults,
+    _In_ int iRoot = NULL_NODE
+  ) const;
+
+  /// Appends the user data of every leaf overlapping the sphere.
+  void QuerySphere(
+    _In_ const DirectX::BoundingSphere &sphere,
+    _Inout_ std::vector<UINT> *pResults,
+    _In_ int iRoot = NULL_NODE
+  ) const;
+
+  /// Nearest leaf box hit by the ray within fMaxDist, front to back. The caller refines the
+  /// hit against the actual geometry.
+  BOOL RayCast(
+    _In_ const DirectX::XMFLOAT3 &vOrigin,
+    _In_ const DirectX::XMFLOAT3 &vDirection,
+    _In_ float fMaxDist,
+    _Out_ UINT *pUserData,
+    _Out_ float *pDist
+  ) const;
+
+  /// Splits the tree into at least uMinCount disjoint subtrees (fewer if it has fewer
+  /// leaves) which can be traversed concurrently.
+  void GetSubtreeRoots(_In_ UINT uMinCount, _Out_ std::vector<int> *pRoots) const;
+
+  /// Frustum query with the subtrees distributed over the job system workers, the results
+  /// come in subtree order. Without a job system the subtrees are queried in turn.
+  void QueryFrustumParallel(
+    _In_reads_(6) const DirectX::XMFLOAT4 *pPlanes,
+    _In_opt_ JobSystem *pJobSystem,
+    _Inout_ std::vector<UINT> *pResults
+  ) const;
+
+private:
+  struct Node {
+    DirectX::XMFLOAT3 Min;
+    DirectX::XMFLOAT3 Max;
+    int Parent;     // Next free node while on the free list
+    int Child1;
+    int Child2;
+    int Height;     // Leaf is 0, free node is -1
+    UINT UserData;
+
+    bool IsLeaf() const { return Child1 == NULL_NODE; }
+  };
+
+  int AllocateNode();
+  void FreeNode(int iNode);
+  void InsertLeaf(int iLeaf);
+  void RemoveLeaf(int iLeaf);
+  int Balance(int iNode);
+  void FixUpwards(int iNode);
+  int BuildTopDown(int *pLeaves, UINT uCount);
+  void AppendSubtree(int iNode, std::vector<UINT> *pResults) const;
+
+  std::vector<Node> m_aNodes;
+  int m_iRoot;
+  int m_iFreeList;
+  UINT m_uProxyCount;
+  float m_fFatMargin;
+  float m_fRebuiltCost;
+};
+
+/// Inline implementation
+inline void AabbTree::SetFatMargin(_In_ float fMargin) {
+  m_fFatMargin = fMargin;
+}
+
+inline int AabbTree::GetHeight() const {
+  return m_iRoot == NULL_NODE ? 0 : m_aNodes[m_iRoot].Height;
+}
+
+inline UINT AabbTree::GetProxyCount() const {
+  return m_uProxyCount;
+}
+
+inline UINT AabbTree::GetUserData(_In_ int iProxy) const {
+  return m_aNodes[iProxy].UserData;
+}
@@ -0,0 +1,212 @@
+#include "CommandRecorder.h"
+#include <cstring>
+
+//
+// NullCommandRecorder implementation
+//
+NullCommandRecorder::NullCommandRecorder() {
+  Reset();
+}
+
+void NullCommandRecorder::Reset() {
+  m_aCommandData.clear();
+  memset(m_auCommandCounts, 0, sizeof(m_auCommandCounts));
+  m_uNumCommands = 0;
+}
+
+BYTE *NullCommandRecorder::BeginCommand(NULL_COMMAND_OP Op, SIZE_T uSize) {
+  SIZE_T uOffset = m_aCommandData.size();
+  NULL_COMMAND_HEADER header = {Op, (UINT)((sizeof(NULL_COMMAND_HEADER) + uSize + 3) & ~(SIZE_T)3)};
+
+  // Capacity is kept across Reset, after the first frames recording does not allocate
+  m_aCommandData.resize(uOffset + header.Size);
+  ++m_auCommandCounts[Op];
+  ++m_uNumCommands;
+
+  return Write(m_aCommandData.data() + uOffset, header);
+}
+
+template <class T> BYTE *NullCommandRecorder::Write(BYTE *pDest, const T &Value) {
+  memcpy(pDest, &Value, sizeof(T));
+  return pDest + sizeof(T);
+}
+
+BYTE *NullCommandRecorder::WriteArray(BYTE *pDest, const void *pSrc, SIZE_T uSize) {
+  if (uSize > 0)
+    memcpy(pDest, pSrc, uSize);
+  return pDest + uSize;
+}
+
+void NullCommandRecorder::SetPipelineState(_In_ ID3D12PipelineState *pPipelineState) {
+  Write(BeginCommand(NULL_COMMAND_OP_SET_PIPELINE_STATE, sizeof(pPipelineState)), pPipelineState);
+}
+
+void NullCommandRecorder::SetGraphicsRootSignature(_In_opt_ ID3D12RootSignature *pRootSignature) {
+  Write(BeginCommand(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_SIGNATURE, sizeof(pRootSignature)), pRootSignature);
+}
+
+void NullCommandRecorder::SetDescriptorHeaps(
+    _In_ UINT NumDescriptorHeaps, _In_reads_(NumDescriptorHeaps) ID3D12DescriptorHeap *const *ppDescriptorHeaps) {
+  SIZE_T uArraySize = sizeof(*ppDescriptorHeaps) * NumDescriptorHeaps;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_SET_DESCRIPTOR_HEAPS, sizeof(UINT) + uArraySize);
+  p = Write(p, NumDescriptorHeaps);
+  WriteArray(p, ppDescriptorHeaps, uArraySize);
+}
+
+void NullCommandRecorder::SetGraphicsRootDescriptorTable(_In_ UINT RootParameterIndex,
+                                                         _In_ D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) {
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE, sizeof(UINT) + sizeof(BaseDescriptor));
+  p = Write(p, RootParameterIndex);
+  Write(p, BaseDescriptor);
+}
+
+void NullCommandRecorder::SetGraphicsRootConstantBufferView(_In_ UINT RootParameterIndex,
+                                                            _In_ D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) {
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_CONSTANT_BUFFER_VIEW, sizeof(UINT) + sizeof(BufferLocation));
+  p = Write(p, RootParameterIndex);
+  Write(p, BufferLocation);
+}
+
+void NullCommandRecorder::SetGraphicsRoot32BitConstant(_In_ UINT RootParameterIndex, _In_ UINT SrcData,
+                                                       _In_ UINT DestOffsetIn32BitValues) {
+  const UINT aArgs[] = {RootParameterIndex, SrcData, DestOffsetIn32BitValues};
+  Write(BeginCommand(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT, sizeof(aArgs)), aArgs);
+}
+
+void NullCommandRecorder::IASetPrimitiveTopology(_In_ D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) {
+  Write(BeginCommand(NULL_COMMAND_OP_IA_SET_PRIMITIVE_TOPOLOGY, sizeof(PrimitiveTopology)), PrimitiveTopology);
+}
+
+void NullCommandRecorder::IASetVertexBuffers(_In_ UINT StartSlot, _In_ UINT NumViews,
+                                             _In_reads_opt_(NumViews) const D3D12_VERTEX_BUFFER_VIEW *pViews) {
+  SIZE_T uArraySize = pViews ? sizeof(*pViews) * NumViews : 0;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_IA_SET_VERTEX_BUFFERS, 2 * sizeof(UINT) + uArraySize);
+  p = Write(p, StartSlot);
+  p = Write(p, NumViews);
+  WriteArray(p, pViews, uArraySize);
+}
+
+void NullCommandRecorder::IASetIndexBuffer(_In_opt_ const D3D12_INDEX_BUFFER_VIEW *pView) {
+  D3D12_INDEX_BUFFER_VIEW view = pView ? *pView : D3D12_INDEX_BUFFER_VIEW{};
+  Write(BeginCommand(NULL_COMMAND_OP_IA_SET_INDEX_BUFFER, sizeof(view)), view);
+}
+
+void NullCommandRecorder::RSSetViewports(_In_ UINT NumViewports,
+                                         _In_reads_(NumViewports) const D3D12_VIEWPORT *pViewports) {
+  SIZE_T uArraySize = sizeof(*pViewports) * NumViewports;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_RS_SET_VIEWPORTS, sizeof(UINT) + uArraySize);
+  p = Write(p, NumViewports);
+  WriteArray(p, pViewports, uArraySize);
+}
+
+void NullCommandRecorder::RSSetScissorRects(_In_ UINT NumRects, _In_reads_(NumRects) const D3D12_RECT *pRects) {
+  SIZE_T uArraySize = sizeof(*pRects) * NumRects;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_RS_SET_SCISSOR_RECTS, sizeof(UINT) + uArraySize);
+  p = Write(p, NumRects);
+  WriteArray(p, pRects, uArraySize);
+}
+
+void NullCommandRecorder::OMSetRenderTargets(
+    _In_ UINT NumRenderTargetDescriptors, _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pRenderTargetDescriptors,
+    _In_ BOOL RTsSingleHandleToDescriptorRange, _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pDepthStencilDescriptor) {
+  // A single handle stands for the whole range
+  UINT uNumHandles = pRenderTargetDescriptors ? (RTsSingleHandleToDescriptorRange ? 1 : NumRenderTargetDescriptors) : 0;
+  SIZE_T uArraySize = sizeof(D3D12_CPU_DESCRIPTOR_HANDLE) * uNumHandles;
+  D3D12_CPU_DESCRIPTOR_HANDLE hDepthStencil = pDepthStencilDescriptor ? *pDepthStencilDescriptor
+                                                                      : D3D12_CPU_DESCRIPTOR_HANDLE{};
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_OM_SET_RENDER_TARGETS,
+                         sizeof(UINT) + sizeof(BOOL) + sizeof(hDepthStencil) + uArraySize);
+  p = Write(p, NumRenderTargetDescriptors);
+  p = Write(p, RTsSingleHandleToDescriptorRange);
+  p = Write(p, hDepthStencil);
+  WriteArray(p, pRenderTargetDescriptors, uArraySize);
+}
+
+void NullCommandRecorder::OMSetStencilRef(_In_ UINT StencilRef) {
+  Write(BeginCommand(NULL_COMMAND_OP_OM_SET_STENCIL_REF, sizeof(StencilRef)), StencilRef);
+}
+
+void NullCommandRecorder::ClearRenderTargetView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView,
+                                                _In_ const FLOAT ColorRGBA[4], _In_ UINT NumRects,
+                                                _In_reads_opt_(NumRects) const D3D12_RECT *pRects) {
+  SIZE_T uArraySize = pRects ? sizeof(*pRects) * NumRects : 0;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_CLEAR_RENDER_TARGET_VIEW,
+                         sizeof(RenderTargetView) + 4 * sizeof(FLOAT) + sizeof(UINT) + uArraySize);
+  p = Write(p, RenderTargetView);
+  p = WriteArray(p, ColorRGBA, 4 * sizeof(FLOAT));
+  p = Write(p, NumRects);
+  WriteArray(p, pRects, uArraySize);
+}
+
+void NullCommandRecorder::ClearDepthStencilView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView,
+                                                _In_ D3D12_CLEAR_FLAGS ClearFlags, _In_ FLOAT Depth,
+                                                _In_ UINT8 Stencil, _In_ UINT NumRects,
+                                                _In_reads_opt_(NumRects) const D3D12_RECT *pRects) {
+  SIZE_T uArraySize = pRects ? sizeof(*pRects) * NumRects : 0;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_CLEAR_DEPTH_STENCIL_VIEW, sizeof(DepthStencilView) + sizeof(ClearFlags) +
+                                                                       sizeof(FLOAT) + 2 * sizeof(UINT) + uArraySize);
+  p = Write(p, DepthStencilView);
+  p = Write(p, ClearFlags);
+  p = Write(p, Depth);
+  p = Write(p, (UINT)Stencil);
+  p = Write(p, NumRects);
+  WriteArray(p, pRects, uArraySize);
+}
+
+void NullCommandRecorder::ResourceBarrier(_In_ UINT NumBarriers,
+                                          _In_reads_(NumBarriers) const D3D12_RESOURCE_BARRIER *pBarriers) {
+  SIZE_T uArraySize = sizeof(*pBarriers) * NumBarriers;
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_RESOURCE_BARRIER, sizeof(UINT) + uArraySize);
+  p = Write(p, NumBarriers);
+  WriteArray(p, pBarriers, uArraySize);
+}
+
+void NullCommandRecorder::DrawInstanced(_In_ UINT VertexCountPerInstance, _In_ UINT InstanceCount,
+                                        _In_ UINT StartVertexLocation, _In_ UINT StartInstanceLocation) {
+  const UINT aArgs[] = {VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation};
+  Write(BeginCommand(NULL_COMMAND_OP_DRAW_INSTANCED, sizeof(aArgs)), aArgs);
+}
+
+void NullCommandRecorder::DrawIndexedInstanced(_In_ UINT IndexCountPerInstance, _In_ UINT InstanceCount,
+                                               _In_ UINT StartIndexLocation, _In_ INT BaseVertexLocation,
+                                               _In_ UINT StartInstanceLocation) {
+  const UINT aArgs[] = {IndexCountPerInstance, InstanceCount, StartIndexLocation, (UINT)BaseVertexLocation,
+                        StartInstanceLocation};
+  Write(BeginCommand(NULL_COMMAND_OP_DRAW_INDEXED_INSTANCED, sizeof(aArgs)), aArgs);
+}
+
+void NullCommandRecorder::ExecuteIndirect(_In_ ID3D12CommandSignature *pCommandSignature, _In_ UINT MaxCommandCount,
+                                          _In_ ID3D12Resource *pArgumentBuffer, _In_ UINT64 ArgumentBufferOffset,
+                                          _In_opt_ ID3D12Resource *pCountBuffer, _In_ UINT64 CountBufferOffset) {
+  BYTE *p = BeginCommand(NULL_COMMAND_OP_EXECUTE_INDIRECT, sizeof(pCommandSignature) + sizeof(UINT) +
+                                                               2 * sizeof(ID3D12Resource *) + 2 * sizeof(UINT64));
+  p = Write(p, pCommandSignature);
+  p = Write(p, MaxCommandCount);
+  p = Write(p, pArgumentBuffer);
+  p = Write(p, ArgumentBufferOffset);
+  p = Write(p, pCountBuffer);
+  Write(p, CountBufferOffset);
+}
+
+ID3D12GraphicsCommandList *NullCommandRecorder::GetCommandList() const {
+  return nullptr;
+}
+
+UINT NullCommandRecorder::GetStateChangeCount() const {
+  static const NULL_COMMAND_OP s_aStateOps[] = {
+    NULL_COMMAND_OP_SET_PIPELINE_STATE,
+    NULL_COMMAND_OP_SET_GRAPHICS_ROOT_SIGNATURE,
+    NULL_COMMAND_OP_SET_DESCRIPTOR_HEAPS,
+    NULL_COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE,
+    NULL_COMMAND_OP_SET_GRAPHICS_ROOT_CONSTANT_BUFFER_VIEW,
+    NULL_COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT,
+    NULL_COMMAND_OP_IA_SET_PRIMITIVE_TOPOLOGY,
+    NULL_COMMAND_OP_IA_SET_VERTEX_BUFFERS,
+    NULL_COMMAND_OP_IA_SET_INDEX_BUFFER,
+  };
+  UINT uCount = 0;
+
+  for (NULL_COMMAND_OP Op : s_aStateOps)
+    uCount += m_auCommandCounts[Op];
+  return uCount;
+}
@@ -0,0 +1,357 @@
+#pragma once
+#include "D3D12Types.h"
+#include <vector>
+
+///
+/// The part of ID3D12GraphicsCommandList the render paths record with. Recording through
+/// it lets the same draw code fill a real command list or a NullCommandRecorder, which
+/// needs no device, so scheduling and draw submission can be measured without a GPU.
+/// Opening and closing the list stays with whoever owns it.
+///
+class ICommandRecorder {
+public:
+  virtual ~ICommandRecorder() = default;
+
+  virtual void SetPipelineState(_In_ ID3D12PipelineState *pPipelineState) = 0;
+  virtual void SetGraphicsRootSignature(_In_opt_ ID3D12RootSignature *pRootSignature) = 0;
+  virtual void SetDescriptorHeaps(_In_ UINT NumDescriptorHeaps,
+                                  _In_reads_(NumDescriptorHeaps) ID3D12DescriptorHeap *const *ppDescriptorHeaps) = 0;
+  virtual void SetGraphicsRootDescriptorTable(_In_ UINT RootParameterIndex,
+                                              _In_ D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) = 0;
+  virtual void SetGraphicsRootConstantBufferView(_In_ UINT RootParameterIndex,
+                                                 _In_ D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) = 0;
+  virtual void SetGraphicsRoot32BitConstant(_In_ UINT RootParameterIndex, _In_ UINT SrcData,
+                                            _In_ UINT DestOffsetIn32BitValues) = 0;
+
+  virtual void IASetPrimitiveTopology(_In_ D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) = 0;
+  virtual void IASetVertexBuffers(_In_ UINT StartSlot, _In_ UINT NumViews,
+                                  _In_reads_opt_(NumViews) const D3D12_VERTEX_BUFFER_VIEW *pViews) = 0;
+  virtual void IASetIndexBuffer(_In_opt_ const D3D12_INDEX_BUFFER_VIEW *pView) = 0;
+
+  virtual void RSSetViewports(_In_ UINT NumViewports, _In_reads_(NumViewports) const D3D12_VIEWPORT *pViewports) = 0;
+  virtual void RSSetScissorRects(_In_ UINT NumRects, _In_reads_(NumRects) const D3D12_RECT *pRects) = 0;
+
+  virtual void OMSetRenderTargets(_In_ UINT NumRenderTargetDescriptors,
+                                  _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pRenderTargetDescriptors,
+                                  _In_ BOOL RTsSingleHandleToDescriptorRange,
+                                  _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pDepthStencilDescriptor) = 0;
+  virtual void OMSetStencilRef(_In_ UINT StencilRef) = 0;
+
+  virtual void ClearRenderTargetView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView, _In_ const FLOAT ColorRGBA[4],
+                                     _In_ UINT NumRects, _In_reads_opt_(NumRects) const D3D12_RECT *pRects) = 0;
+  virtual void ClearDepthStencilView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView, _In_ D3D12_CLEAR_FLAGS ClearFlags,
+                                     _In_ FLOAT Depth, _In_ UINT8 Stencil, _In_ UINT NumRects,
+                                     _In_reads_opt_(NumRects) const D3D12_RECT *pRects) = 0;
+  virtual void ResourceBarrier(_In_ UINT NumBarriers, _In_reads_(NumBarriers) const D3D12_RESOURCE_BARRIER *pBarriers) = 0;
+
+  virtual void DrawInstanced(_In_ UINT VertexCountPerInstance, _In_ UINT InstanceCount,
+                             _In_ UINT StartVertexLocation, _In_ UINT StartInstanceLocation) = 0;
+  virtual void DrawIndexedInstanced(_In_ UINT IndexCountPerInstance, _In_ UINT InstanceCount,
+                                    _In_ UINT StartIndexLocation, _In_ INT BaseVertexLocation,
+                                    _In_ UINT StartInstanceLocation) = 0;
+  virtual void ExecuteIndirect(_In_ ID3D12CommandSignature *pCommandSignature, _In_ UINT MaxCommandCount,
+                               _In_ ID3D12Resource *pArgumentBuffer, _In_ UINT64 ArgumentBufferOffset,
+                               _In_opt_ ID3D12Resource *pCountBuffer, _In_ UINT64 CountBufferOffset) = 0;
+
+  /// The command list recorded into, nullptr when there is none.
+  virtual ID3D12GraphicsCommandList *GetCommandList() const = 0;
+};
+
+///
+/// Records straight into a command list, it does not take a reference.
+///
+class D3D12CommandRecorder final : public ICommandRecorder {
+public:
+  explicit D3D12CommandRecorder(_In_opt_ ID3D12GraphicsCommandList *pd3dCommandList = nullptr);
+
+  void SetCommandList(_In_opt_ ID3D12GraphicsCommandList *pd3dCommandList);
+
+  void SetPipelineState(_In_ ID3D12PipelineState *pPipelineState) override;
+  void SetGraphicsRootSignature(_In_opt_ ID3D12RootSignature *pRootSignature) override;
+  void SetDescriptorHeaps(_In_ UINT NumDescriptorHeaps,
+                          _In_reads_(NumDescriptorHeaps) ID3D12DescriptorHeap *const *ppDescriptorHeaps) override;
+  void SetGraphicsRootDescriptorTable(_In_ UINT RootParameterIndex,
+                                      _In_ D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) override;
+  void SetGraphicsRootConstantBufferView(_In_ UINT RootParameterIndex,
+                                         _In_ D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override;
+  void SetGraphicsRoot32BitConstant(_In_ UINT RootParameterIndex, _In_ UINT SrcData,
+                                    _In_ UINT DestOffsetIn32BitValues) override;
+
+  void IASetPrimitiveTopology(_In_ D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) override;
+  void IASetVertexBuffers(_In_ UINT StartSlot, _In_ UINT NumViews,
+                          _In_reads_opt_(NumViews) const D3D12_VERTEX_BUFFER_VIEW *pViews) override;
+  void IASetIndexBuffer(_In_opt_ const D3D12_INDEX_BUFFER_VIEW *pView) override;
+
+  void RSSetViewports(_In_ UINT NumViewports, _In_reads_(NumViewports) const D3D12_VIEWPORT *pViewports) override;
+  void RSSetScissorRects(_In_ UINT NumRects, _In_reads_(NumRects) const D3D12_RECT *pRects) override;
+
+  void OMSetRenderTargets(_In_ UINT NumRenderTargetDescriptors,
+                          _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pRenderTargetDescriptors,
+                          _In_ BOOL RTsSingleHandleToDescriptorRange,
+                          _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pDepthStencilDescriptor) override;
+  void OMSetStencilRef(_In_ UINT StencilRef) override;
+
+  void ClearRenderTargetView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView, _In_ const FLOAT ColorRGBA[4],
+                             _In_ UINT NumRects, _In_reads_opt_(NumRects) const D3D12_RECT *pRects) override;
+  void ClearDepthStencilView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView, _In_ D3D12_CLEAR_FLAGS ClearFlags,
+                             _In_ FLOAT Depth, _In_ UINT8 Stencil, _In_ UINT NumRects,
+                             _In_reads_opt_(NumRects) const D3D12_RECT *pRects) override;
+  void ResourceBarrier(_In_ UINT NumBarriers, _In_reads_(NumBarriers) const D3D12_RESOURCE_BARRIER *pBarriers) override;
+
+  void DrawInstanced(_In_ UINT VertexCountPerInstance, _In_ UINT InstanceCount,
+                     _In_ UINT StartVertexLocation, _In_ UINT StartInstanceLocation) override;
+  void DrawIndexedInstanced(_In_ UINT IndexCountPerInstance, _In_ UINT InstanceCount,
+                            _In_ UINT StartIndexLocation, _In_ INT BaseVertexLocation,
+                            _In_ UINT StartInstanceLocation) override;
+  void ExecuteIndirect(_In_ ID3D12CommandSignature *pCommandSignature, _In_ UINT MaxCommandCount,
+                       _In_ ID3D12Resource *pArgumentBuffer, _In_ UINT64 ArgumentBufferOffset,
+                       _In_opt_ ID3D12Resource *pCountBuffer, _In_ UINT64 CountBufferOffset) override;
+
+  ID3D12GraphicsCommandList *GetCommandList() const override;
+
+private:
+  ID3D12GraphicsCommandList *m_pd3dCommandList;
+};
+
+enum NULL_COMMAND_OP : UINT {
+  NULL_COMMAND_OP_SET_PIPELINE_STATE,
+  NULL_COMMAND_OP_SET_GRAPHICS_ROOT_SIGNATURE,
+  NULL_COMMAND_OP_SET_DESCRIPTOR_HEAPS,
+  NULL_COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE,
+  NULL_COMMAND_OP_SET_GRAPHICS_ROOT_CONSTANT_BUFFER_VIEW,
+  NULL_COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT,
+  NULL_COMMAND_OP_IA_SET_PRIMITIVE_TOPOLOGY,
+  NULL_COMMAND_OP_IA_SET_VERTEX_BUFFERS,
+  NULL_COMMAND_OP_IA_SET_INDEX_BUFFER,
+  NULL_COMMAND_OP_RS_SET_VIEWPORTS,
+  NULL_COMMAND_OP_RS_SET_SCISSOR_RECTS,
+  NULL_COMMAND_OP_OM_SET_RENDER_TARGETS,
+  NULL_COMMAND_OP_OM_SET_STENCIL_REF,
+  NULL_COMMAND_OP_CLEAR_RENDER_TARGET_VIEW,
+  NULL_COMMAND_OP_CLEAR_DEPTH_STENCIL_VIEW,
+  NULL_COMMAND_OP_RESOURCE_BARRIER,
+  NULL_COMMAND_OP_DRAW_INSTANCED,
+  NULL_COMMAND_OP_DRAW_INDEXED_INSTANCED,
+  NULL_COMMAND_OP_EXECUTE_INDIRECT,
+  NULL_COMMAND_OP_COUNT
+};
+
+/// Every recorded command starts with one, the arguments follow packed in declaration
+/// order, arrays after their count. Size covers the header and is a multiple of 4.
+struct NULL_COMMAND_HEADER {
+  NULL_COMMAND_OP Op;
+  UINT Size;
+};
+
+///
+/// Captures the commands into memory instead of a command list, for benchmarking the CPU
+/// side without a device. Objects are recorded as their pointers, no reference is taken.
+/// A recorder belongs to one thread at a time, like a command list.
+///
+class NullCommandRecorder final : public ICommandRecorder {
+public:
+  NullCommandRecorder();
+
+  /// Drops the commands and the counts, the memory is kept.
+  void Reset();
+
+  void SetPipelineState(_In_ ID3D12PipelineState *pPipelineState) override;
+  void SetGraphicsRootSignature(_In_opt_ ID3D12RootSignature *pRootSignature) override;
+  void SetDescriptorHeaps(_In_ UINT NumDescriptorHeaps,
+                          _In_reads_(NumDescriptorHeaps) ID3D12DescriptorHeap *const *ppDescriptorHeaps) override;
+  void SetGraphicsRootDescriptorTable(_In_ UINT RootParameterIndex,
+                                      _In_ D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) override;
+  void SetGraphicsRootConstantBufferView(_In_ UINT RootParameterIndex,
+                                         _In_ D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override;
+  void SetGraphicsRoot32BitConstant(_In_ UINT RootParameterIndex, _In_ UINT SrcData,
+                                    _In_ UINT DestOffsetIn32BitValues) override;
+
+  void IASetPrimitiveTopology(_In_ D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) override;
+  void IASetVertexBuffers(_In_ UINT StartSlot, _In_ UINT NumViews,
+                          _In_reads_opt_(NumViews) const D3D12_VERTEX_BUFFER_VIEW *pViews) override;
+  void IASetIndexBuffer(_In_opt_ const D3D12_INDEX_BUFFER_VIEW *pView) override;
+
+  void RSSetViewports(_In_ UINT NumViewports, _In_reads_(NumViewports) const D3D12_VIEWPORT *pViewports) override;
+  void RSSetScissorRects(_In_ UINT NumRects, _In_reads_(NumRects) const D3D12_RECT *pRects) override;
+
+  void OMSetRenderTargets(_In_ UINT NumRenderTargetDescriptors,
+                          _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pRenderTargetDescriptors,
+                          _In_ BOOL RTsSingleHandleToDescriptorRange,
+                          _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pDepthStencilDescriptor) override;
+  void OMSetStencilRef(_In_ UINT StencilRef) override;
+
+  void ClearRenderTargetView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView, _In_ const FLOAT ColorRGBA[4],
+                             _In_ UINT NumRects, _In_reads_opt_(NumRects) const D3D12_RECT *pRects) override;
+  void ClearDepthStencilView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView, _In_ D3D12_CLEAR_FLAGS ClearFlags,
+                             _In_ FLOAT Depth, _In_ UINT8 Stencil, _In_ UINT NumRects,
+                             _In_reads_opt_(NumRects) const D3D12_RECT *pRects) override;
+  void ResourceBarrier(_In_ UINT NumBarriers, _In_reads_(NumBarriers) const D3D12_RESOURCE_BARRIER *pBarriers) override;
+
+  void DrawInstanced(_In_ UINT VertexCountPerInstance, _In_ UINT InstanceCount,
+                     _In_ UINT StartVertexLocation, _In_ UINT StartInstanceLocation) override;
+  void DrawIndexedInstanced(_In_ UINT IndexCountPerInstance, _In_ UINT InstanceCount,
+                            _In_ UINT StartIndexLocation, _In_ INT BaseVertexLocation,
+                            _In_ UINT StartInstanceLocation) override;
+  void ExecuteIndirect(_In_ ID3D12CommandSignature *pCommandSignature, _In_ UINT MaxCommandCount,
+                       _In_ ID3D12Resource *pArgumentBuffer, _In_ UINT64 ArgumentBufferOffset,
+                       _In_opt_ ID3D12Resource *pCountBuffer, _In_ UINT64 CountBufferOffset) override;
+
+  ID3D12GraphicsCommandList *GetCommandList() const override;
+
+  /// The recorded commands, walk them with NextCommand.
+  const BYTE *GetCommandData() const;
+  SIZE_T GetCommandDataSize() const;
+  static const NULL_COMMAND_HEADER *NextCommand(_In_ const NULL_COMMAND_HEADER *pCommand);
+
+  UINT GetCommandCount() const;
+  UINT GetCommandCount(_In_ NULL_COMMAND_OP Op) const;
+  /// Draw calls, an ExecuteIndirect counts as one.
+  UINT GetDrawCount() const;
+  /// Pipeline, root signature, descriptor heap, root argument and input assembler changes.
+  UINT GetStateChangeCount() const;
+
+private:
+  // Appends a command of uSize bytes, header included, and returns where its arguments go
+  BYTE *BeginCommand(NULL_COMMAND_OP Op, SIZE_T uSize);
+  template <class T> static BYTE *Write(BYTE *pDest, const T &Value);
+  static BYTE *WriteArray(BYTE *pDest, const void *pSrc, SIZE_T uSize);
+
+  std::vector<BYTE> m_aCommandData;
+  UINT m_auCommandCounts[NULL_COMMAND_OP_COUNT];
+  UINT m_uNumCommands;
+};
+
+/// Inline implementation
+inline D3D12CommandRecorder::D3D12CommandRecorder(_In_opt_ ID3D12GraphicsCommandList *pd3dCommandList)
+    : m_pd3dCommandList(pd3dCommandList) {}
+
+inline void D3D12CommandRecorder::SetCommandList(_In_opt_ ID3D12GraphicsCommandList *pd3dCommandList) {
+  m_pd3dCommandList = pd3dCommandList;
+}
+
+inline void D3D12CommandRecorder::SetPipelineState(_In_ ID3D12PipelineState *pPipelineState) {
+  m_pd3dCommandList->SetPipelineState(pPipelineState);
+}
+
+inline void D3D12CommandRecorder::SetGraphicsRootSignature(_In_opt_ ID3D12RootSignature *pRootSignature) {
+  m_pd3dCommandList->SetGraphicsRootSignature(pRootSignature);
+}
+
+inline void D3D12CommandRecorder::SetDescriptorHeaps(
+    _In_ UINT NumDescriptorHeaps, _In_reads_(NumDescriptorHeaps) ID3D12DescriptorHeap *const *ppDescriptorHeaps) {
+  m_pd3dCommandList->SetDescriptorHeaps(NumDescriptorHeaps, ppDescriptorHeaps);
+}
+
+inline void D3D12CommandRecorder::SetGraphicsRootDescriptorTable(_In_ UINT RootParameterIndex,
+                                                                 _In_ D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) {
+  m_pd3dCommandList->SetGraphicsRootDescriptorTable(RootParameterIndex, BaseDescriptor);
+}
+
+inline void D3D12CommandRecorder::SetGraphicsRootConstantBufferView(_In_ UINT RootParameterIndex,
+                                                                    _In_ D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) {
+  m_pd3dCommandList->SetGraphicsRootConstantBufferView(RootParameterIndex, BufferLocation);
+}
+
+inline void D3D12CommandRecorder::SetGraphicsRoot32BitConstant(_In_ UINT RootParameterIndex, _In_ UINT SrcData,
+                                                               _In_ UINT DestOffsetIn32BitValues) {
+  m_pd3dCommandList->SetGraphicsRoot32BitConstant(RootParameterIndex, SrcData, DestOffsetIn32BitValues);
+}
+
+inline void D3D12CommandRecorder::IASetPrimitiveTopology(_In_ D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) {
+  m_pd3dCommandList->IASetPrimitiveTopology(PrimitiveTopology);
+}
+
+inline void D3D12CommandRecorder::IASetVertexBuffers(_In_ UINT StartSlot, _In_ UINT NumViews,
+                                                     _In_reads_opt_(NumViews) const D3D12_VERTEX_BUFFER_VIEW *pViews) {
+  m_pd3dCommandList->IASetVertexBuffers(StartSlot, NumViews, pViews);
+}
+
+inline void D3D12CommandRecorder::IASetIndexBuffer(_In_opt_ const D3D12_INDEX_BUFFER_VIEW *pView) {
+  m_pd3dCommandList->IASetIndexBuffer(pView);
+}
+
+inline void D3D12CommandRecorder::RSSetViewports(_In_ UINT NumViewports,
+                                                 _In_reads_(NumViewports) const D3D12_VIEWPORT *pViewports) {
+  m_pd3dCommandList->RSSetViewports(NumViewports, pViewports);
+}
+
+inline void D3D12CommandRecorder::RSSetScissorRects(_In_ UINT NumRects, _In_reads_(NumRects) const D3D12_RECT *pRects) {
+  m_pd3dCommandList->RSSetScissorRects(NumRects, pRects);
+}
+
+inline void D3D12CommandRecorder::OMSetRenderTargets(
+    _In_ UINT NumRenderTargetDescriptors, _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pRenderTargetDescriptors,
+    _In_ BOOL RTsSingleHandleToDescriptorRange, _In_opt_ const D3D12_CPU_DESCRIPTOR_HANDLE *pDepthStencilDescriptor) {
+  m_pd3dCommandList->OMSetRenderTargets(NumRenderTargetDescriptors, pRenderTargetDescriptors,
+                                        RTsSingleHandleToDescriptorRange, pDepthStencilDescriptor);
+}
+
+inline void D3D12CommandRecorder::OMSetStencilRef(_In_ UINT StencilRef) {
+  m_pd3dCommandList->OMSetStencilRef(StencilRef);
+}
+
+inline void D3D12CommandRecorder::ClearRenderTargetView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView,
+                                                        _In_ const FLOAT ColorRGBA[4], _In_ UINT NumRects,
+                                                        _In_reads_opt_(NumRects) const D3D12_RECT *pRects) {
+  m_pd3dCommandList->ClearRenderTargetView(RenderTargetView, ColorRGBA, NumRects, pRects);
+}
+
+inline void D3D12CommandRecorder::ClearDepthStencilView(_In_ D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView,
+                                                        _In_ D3D12_CLEAR_FLAGS ClearFlags, _In_ FLOAT Depth,
+                                                        _In_ UINT8 Stencil, _In_ UINT NumRects,
+                                                        _In_reads_opt_(NumRects) const D3D12_RECT *pRects) {
+  m_pd3dCommandList->ClearDepthStencilView(DepthStencilView, ClearFlags, Depth, Stencil, NumRects, pRects);
+}
+
+inline void D3D12CommandRecorder::ResourceBarrier(_In_ UINT NumBarriers,
+                                                  _In_reads_(NumBarriers) const D3D12_RESOURCE_BARRIER *pBarriers) {
+  m_pd3dCommandList->ResourceBarrier(NumBarriers, pBarriers);
+}
+
+inline void D3D12CommandRecorder::DrawInstanced(_In_ UINT VertexCountPerInstance, _In_ UINT InstanceCount,
+                                                _In_ UINT StartVertexLocation, _In_ UINT StartInstanceLocation) {
+  m_pd3dCommandList->DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
+}
+
+inline void D3D12CommandRecorder::DrawIndexedInstanced(_In_ UINT IndexCountPerInstance, _In_ UINT InstanceCount,
+                                                       _In_ UINT StartIndexLocation, _In_ INT BaseVertexLocation,
+                                                       _In_ UINT StartInstanceLocation) {
+  m_pd3dCommandList->DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation,
+                                          StartInstanceLocation);
+}
+
+inline void D3D12CommandRecorder::ExecuteIndirect(_In_ ID3D12CommandSignature *pCommandSignature, _In_ UINT MaxCommandCount,
+                                                  _In_ ID3D12Resource *pArgumentBuffer, _In_ UINT64 ArgumentBufferOffset,
+                                                  _In_opt_ ID3D12Resource *pCountBuffer, _In_ UINT64 CountBufferOffset) {
+  m_pd3dCommandList->ExecuteIndirect(pCommandSignature, MaxCommandCount, pArgumentBuffer, ArgumentBufferOffset,
+                                     pCountBuffer, CountBufferOffset);
+}
+
+inline ID3D12GraphicsCommandList *D3D12CommandRecorder::GetCommandList() const {
+  return m_pd3dCommandList;
+}
+
+inline const BYTE *NullCommandRecorder::GetCommandData() const {
+  return m_aCommandData.data();
+}
+
+inline SIZE_T NullCommandRecorder::GetCommandDataSize() const {
+  return m_aCommandData.size();
+}
+
+inline const NULL_COMMAND_HEADER *NullCommandRecorder::NextCommand(_In_ const NULL_COMMAND_HEADER *pCommand) {
+  return reinterpret_cast<const NULL_COMMAND_HEADER *>(reinterpret_cast<const BYTE *>(pCommand) + pCommand->Size);
+}
+
+inline UINT NullCommandRecorder::GetCommandCount() const {
+  return m_uNumCommands;
+}
+
+inline UINT NullCommandRecorder::GetCommandCount(_In_ NULL_COMMAND_OP Op) const {
+  return m_auCommandCounts[Op];
+}
+
+inline UINT NullCommandRecorder::GetDrawCount() const {
+  return m_auCommandCounts[NULL_COMMAND_OP_DRAW_INSTANCED] + m_auCommandCounts[NULL_COMMAND_OP_DRAW_INDEXED_INSTANCED] +
+         m_auCommandCounts[NULL_COMMAND_OP_EXECUTE_INDIRECT];
+}
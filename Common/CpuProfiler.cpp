@@ -0,0 +1,209 @@
+#include "CpuProfiler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+struct CPU_PROFILER_EVENT {
+  const char *pName;
+  uint64_t uStart;
+  uint64_t uEnd;
+};
+
+// Written by its own thread only. The event count is published after the event, and the
+// capture after the counts are cleared, so the exporter never sees a torn event.
+struct CPU_PROFILER_THREAD_BUFFER {
+  uint32_t uThreadIndex;
+  char szName[CpuProfiler::MAX_THREAD_NAME];
+  std::atomic<uint64_t> uCapture{0};
+  std::atomic<uint32_t> uNumEvents{0};
+  std::atomic<uint32_t> uNumDropped{0};
+  CPU_PROFILER_EVENT aEvents[CpuProfiler::MAX_EVENTS_PER_THREAD];
+};
+
+// Thread registration and the capture controls
+std::mutex &GetProfilerLock() {
+  static std::mutex s_Lock;
+  return s_Lock;
+}
+
+std::vector<std::unique_ptr<CPU_PROFILER_THREAD_BUFFER>> &GetThreadBuffers() {
+  static std::vector<std::unique_ptr<CPU_PROFILER_THREAD_BUFFER>> s_aThreadBuffers;
+  return s_aThreadBuffers;
+}
+
+std::atomic<uint64_t> s_uCapture(0);
+uint64_t s_uCaptureStartTicks = 0;
+uint64_t s_uCaptureEndTicks = 0;
+std::chrono::steady_clock::time_point s_CaptureStartTime;
+std::chrono::steady_clock::time_point s_CaptureEndTime;
+
+thread_local CPU_PROFILER_THREAD_BUFFER *t_pThreadBuffer = nullptr;
+thread_local char t_szThreadName[CpuProfiler::MAX_THREAD_NAME] = {};
+
+CPU_PROFILER_THREAD_BUFFER *RegisterThread() {
+  std::lock_guard<std::mutex> lock(GetProfilerLock());
+  auto &aThreadBuffers = GetThreadBuffers();
+  std::unique_ptr<CPU_PROFILER_THREAD_BUFFER> pBuffer(new CPU_PROFILER_THREAD_BUFFER);
+
+  pBuffer->uThreadIndex = (uint32_t)aThreadBuffers.size() + 1;
+  if (t_szThreadName[0])
+    memcpy(pBuffer->szName, t_szThreadName, sizeof(pBuffer->szName));
+  else
+    snprintf(pBuffer->szName, sizeof(pBuffer->szName), "Thread %u", pBuffer->uThreadIndex);
+
+  t_pThreadBuffer = pBuffer.get();
+  aThreadBuffers.push_back(std::move(pBuffer));
+  return t_pThreadBuffer;
+}
+
+void WriteJsonString(FILE *fp, const char *pString) {
+  fputc('"', fp);
+  for (; *pString; ++pString) {
+    if (*pString == '"' || *pString == '\\')
+      fputc('\\', fp);
+    if ((unsigned char)*pString >= 0x20)
+      fputc(*pString, fp);
+  }
+  fputc('"', fp);
+}
+} // namespace
+
+std::atomic<bool> CpuProfiler::s_bCapturing(false);
+
+void CpuProfiler::BeginCapture() {
+  std::lock_guard<std::mutex> lock(GetProfilerLock());
+
+  // Every thread drops its old events with its first marker of the new capture
+  s_uCapture.fetch_add(1, std::memory_order_release);
+  s_CaptureStartTime = std::chrono::steady_clock::now();
+  s_uCaptureStartTicks = Now();
+  s_bCapturing.store(true, std::memory_order_release);
+}
+
+void CpuProfiler::EndCapture() {
+  std::lock_guard<std::mutex> lock(GetProfilerLock());
+
+  if (s_bCapturing.load(std::memory_order_relaxed)) {
+    s_bCapturing.store(false, std::memory_order_release);
+    s_uCaptureEndTicks = Now();
+    s_CaptureEndTime = std::chrono::steady_clock::now();
+  }
+}
+
+void CpuProfiler::SetThreadName(const char *pName) {
+  snprintf(t_szThreadName, sizeof(t_szThreadName), "%s", pName);
+
+  if (t_pThreadBuffer) {
+    std::lock_guard<std::mutex> lock(GetProfilerLock());
+    memcpy(t_pThreadBuffer->szName, t_szThreadName, sizeof(t_szThreadName));
+  }
+}
+
+void CpuProfiler::Record(const char *pName, uint64_t uStart, uint64_t uEnd) {
+  CPU_PROFILER_THREAD_BUFFER *pBuffer = t_pThreadBuffer;
+  uint64_t uCapture = s_uCapture.load(std::memory_order_acquire);
+  uint32_t uNumEvents;
+
+  if (pBuffer == nullptr)
+    pBuffer = RegisterThread();
+
+  if (pBuffer->uCapture.load(std::memory_order_relaxed) != uCapture) {
+    pBuffer->uNumEvents.store(0, std::memory_order_relaxed);
+    pBuffer->uNumDropped.store(0, std::memory_order_relaxed);
+    pBuffer->uCapture.store(uCapture, std::memory_order_release);
+  }
+
+  uNumEvents = pBuffer->uNumEvents.load(std::memory_order_relaxed);
+  if (uNumEvents >= MAX_EVENTS_PER_THREAD) {
+    pBuffer->uNumDropped.store(pBuffer->uNumDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+
+  pBuffer->aEvents[uNumEvents] = {pName, uStart, uEnd};
+  pBuffer->uNumEvents.store(uNumEvents + 1, std::memory_order_release);
+}
+
+uint32_t CpuProfiler::GetEventCount() {
+  std::lock_guard<std::mutex> lock(GetProfilerLock());
+  uint64_t uCapture = s_uCapture.load(std::memory_order_relaxed);
+  uint32_t uCount = 0;
+
+  for (auto &pBuffer : GetThreadBuffers()) {
+    if (pBuffer->uCapture.load(std::memory_order_acquire) == uCapture)
+      uCount += pBuffer->uNumEvents.load(std::memory_order_acquire);
+  }
+  return uCount;
+}
+
+uint32_t CpuProfiler::GetDroppedEventCount() {
+  std::lock_guard<std::mutex> lock(GetProfilerLock());
+  uint64_t uCapture = s_uCapture.load(std::memory_order_relaxed);
+  uint32_t uCount = 0;
+
+  for (auto &pBuffer : GetThreadBuffers()) {
+    if (pBuffer->uCapture.load(std::memory_order_acquire) == uCapture)
+      uCount += pBuffer->uNumDropped.load(std::memory_order_relaxed);
+  }
+  return uCount;
+}
+
+bool CpuProfiler::ExportChromeTrace(const char *pFileName) {
+  std::lock_guard<std::mutex> lock(GetProfilerLock());
+  uint64_t uCapture = s_uCapture.load(std::memory_order_relaxed);
+  FILE *fp;
+  bool bFirst = true;
+
+  if (uCapture == 0 || s_bCapturing.load(std::memory_order_relaxed))
+    return false;
+
+  // Counter ticks over the capture against the steady clock give the tick length
+  double fCaptureNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(s_CaptureEndTime -
+                                                                                   s_CaptureStartTime).count();
+  double fNsPerTick = fCaptureNs > 0.0 && s_uCaptureEndTicks > s_uCaptureStartTicks
+                          ? fCaptureNs / (double)(s_uCaptureEndTicks - s_uCaptureStartTicks)
+                          : 1.0;
+
+#if defined(_MSC_VER)
+  if (fopen_s(&fp, pFileName, "w") != 0)
+    fp = nullptr;
+#else
+  fp = fopen(pFileName, "w");
+#endif
+  if (fp == nullptr)
+    return false;
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  for (auto &pBuffer : GetThreadBuffers()) {
+    if (pBuffer->uCapture.load(std::memory_order_acquire) != uCapture)
+      continue;
+
+    uint32_t uNumEvents = pBuffer->uNumEvents.load(std::memory_order_acquire);
+
+    fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+            bFirst ? "" : ",", pBuffer->uThreadIndex);
+    WriteJsonString(fp, pBuffer->szName);
+    fprintf(fp, "}}");
+    bFirst = false;
+
+    for (uint32_t i = 0; i < uNumEvents; ++i) {
+      const CPU_PROFILER_EVENT &event = pBuffer->aEvents[i];
+
+      // Scopes opened before the capture started are left out
+      if (event.uStart < s_uCaptureStartTicks)
+        continue;
+
+      fprintf(fp, ",\n{\"name\":");
+      WriteJsonString(fp, event.pName);
+      fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", pBuffer->uThreadIndex,
+              (event.uStart - s_uCaptureStartTicks) * fNsPerTick * 1e-3, (event.uEnd - event.uStart) * fNsPerTick * 1e-3);
+    }
+  }
+
+  fprintf(fp, "\n]}\n");
+  return fclose(fp) == 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+///
+/// Scoped CPU timing markers for every thread, exported as a Chrome trace (chrome://tracing
+/// or ui.perfetto.dev). Markers are only recorded between BeginCapture and EndCapture; a
+/// thread appends to a buffer of its own without locking, so recording a marker costs two
+/// time stamp counter reads and a store. Time stamps are converted to nanoseconds with the
+/// counter rate measured over the capture, which assumes an invariant TSC.
+///
+/// Like JobSystem it only depends on the standard library.
+///
+class CpuProfiler {
+public:
+  enum { MAX_EVENTS_PER_THREAD = 1 << 15, MAX_THREAD_NAME = 32 };
+
+  /// Drops what the last capture recorded. Markers recorded once a thread buffer is full
+  /// are dropped and counted rather than overwriting older ones.
+  static void BeginCapture();
+  static void EndCapture();
+  static bool IsCapturing();
+
+  /// Writes the last capture as Chrome trace JSON. Called once the capture ended.
+  static bool ExportChromeTrace(const char *pFileName);
+  /// Markers recorded by the last capture, and those dropped by full thread buffers.
+  static uint32_t GetEventCount();
+  static uint32_t GetDroppedEventCount();
+
+  /// Names the calling thread in the trace, copied.
+  static void SetThreadName(const char *pName);
+
+  static uint64_t Now();
+  /// pName must outlive the capture, a string literal as a rule.
+  static void Record(const char *pName, uint64_t uStart, uint64_t uEnd);
+
+private:
+  static std::atomic<bool> s_bCapturing;
+};
+
+/// Times the enclosing scope while a capture runs.
+class CpuProfileScope {
+public:
+  explicit CpuProfileScope(const char *pName);
+  ~CpuProfileScope();
+  CpuProfileScope(const CpuProfileScope &) = delete;
+  CpuProfileScope &operator=(const CpuProfileScope &) = delete;
+
+private:
+  const char *m_pName;
+  uint64_t m_uStart;
+};
+
+#define CPU_PROFILE_CONCAT_(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_(a, b)
+#define CPU_PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+
+/// Inline implementation
+inline bool CpuProfiler::IsCapturing() {
+  return s_bCapturing.load(std::memory_order_relaxed);
+}
+
+inline uint64_t CpuProfiler::Now() {
+  return __rdtsc();
+}
+
+inline CpuProfileScope::CpuProfileScope(const char *pName) {
+  m_pName = CpuProfiler::IsCapturing() ? pName : nullptr;
+  m_uStart = m_pName ? CpuProfiler::Now() : 0;
+}
+
+inline CpuProfileScope::~CpuProfileScope() {
+  if (m_pName)
+    CpuProfiler::Record(m_pName, m_uStart, CpuProfiler::Now());
+}
@@ -0,0 +1,138 @@
+#include "CpuTopology.h"
+#include <algorithm>
+#include <memory>
+
+namespace {
+// Calls Function on every record GetLogicalProcessorInformationEx returns, the records are
+// variable sized.
+template <class FUNCTION>
+HRESULT ForEachProcessorRecord(LOGICAL_PROCESSOR_RELATIONSHIP Relationship, FUNCTION Function) {
+  DWORD cbBuffer = 0;
+
+  if (GetLogicalProcessorInformationEx(Relationship, nullptr, &cbBuffer) ||
+      GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    return HRESULT_FROM_WIN32(GetLastError());
+
+  std::unique_ptr<BYTE[]> buffer(new BYTE[cbBuffer]);
+  if (!GetLogicalProcessorInformationEx(
+          Relationship, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.get()), &cbBuffer))
+    return HRESULT_FROM_WIN32(GetLastError());
+
+  for (DWORD byteOffset = 0; byteOffset < cbBuffer;) {
+    auto pInfo = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *>(buffer.get() + byteOffset);
+    Function(*pInfo);
+    byteOffset += pInfo->Size;
+  }
+  return S_OK;
+}
+
+template <class FUNCTION>
+void ForEachProcessorInMask(const GROUP_AFFINITY &affinity, FUNCTION Function) {
+  for (BYTE n = 0; n < sizeof(KAFFINITY) * 8; ++n) {
+    if (affinity.Mask & ((KAFFINITY)1 << n))
+      Function(affinity.Group, n);
+  }
+}
+} // namespace
+
+HRESULT CpuTopology::Initialize() {
+  HRESULT hr;
+
+  m_aProcessors.clear();
+  m_uNumCores = 0;
+  m_uNumCacheDomains = 0;
+  m_uNumNodes = 0;
+
+  // The cores enumerate every logical processor of the machine
+  hr = ForEachProcessorRecord(RelationProcessorCore, [this](const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX &info) {
+    UINT uSmtIndex = 0;
+    for (WORD g = 0; g < info.Processor.GroupCount; ++g) {
+      ForEachProcessorInMask(info.Processor.GroupMask[g], [&](WORD Group, BYTE Number) {
+        m_aProcessors.push_back({Group, Number, m_uNumCores, uSmtIndex++, 0, 0});
+      });
+    }
+    ++m_uNumCores;
+  });
+  if (FAILED(hr))
+    return hr;
+
+  // Only the highest cache level reported makes the domains
+  std::vector<GROUP_AFFINITY> aCacheDomains;
+  BYTE uLastLevel = 0;
+
+  hr = ForEachProcessorRecord(RelationCache, [&](const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX &info) {
+    if (info.Cache.Type == CacheInstruction || info.Cache.Level < uLastLevel)
+      return;
+    if (info.Cache.Level > uLastLevel) {
+      uLastLevel = info.Cache.Level;
+      aCacheDomains.clear();
+    }
+    aCacheDomains.push_back(info.Cache.GroupMask);
+  });
+  if (FAILED(hr))
+    return hr;
+
+  for (const auto &affinity : aCacheDomains) {
+    ForEachProcessorInMask(affinity, [&](WORD Group, BYTE Number) {
+      UINT uIndex = FindLogicalProcessor(Group, Number);
+      if (uIndex < m_aProcessors.size())
+        m_aProcessors[uIndex].CacheDomain = m_uNumCacheDomains;
+    });
+    ++m_uNumCacheDomains;
+  }
+
+  hr = ForEachProcessorRecord(RelationNumaNode, [this](const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX &info) {
+    ForEachProcessorInMask(info.NumaNode.GroupMask, [&](WORD Group, BYTE Number) {
+      UINT uIndex = FindLogicalProcessor(Group, Number);
+      if (uIndex < m_aProcessors.size())
+        m_aProcessors[uIndex].Node = info.NumaNode.NodeNumber;
+    });
+    m_uNumNodes = (std::max)(m_uNumNodes, (UINT)info.NumaNode.NodeNumber + 1);
+  });
+  if (FAILED(hr))
+    return hr;
+
+  m_uNumCacheDomains = (std::max)(m_uNumCacheDomains, 1u);
+  m_uNumNodes = (std::max)(m_uNumNodes, 1u);
+
+  return m_aProcessors.empty() ? E_FAIL : S_OK;
+}
+
+UINT CpuTopology::BuildPinningOrder(_In_ CPU_PINNING_POLICY ePolicy, _Out_ std::vector<UINT> *pOrder) const {
+
+  pOrder->clear();
+  if (ePolicy == CPU_PINNING_NONE)
+    return 0;
+
+  for (UINT i = 0; i < (UINT)m_aProcessors.size(); ++i) {
+    if (ePolicy != CPU_PINNING_PHYSICAL_CORES || m_aProcessors[i].SmtIndex == 0)
+      pOrder->push_back(i);
+  }
+
+  std::stable_sort(pOrder->begin(), pOrder->end(), [this](UINT a, UINT b) {
+    const CPU_LOGICAL_PROCESSOR &pa = m_aProcessors[a], &pb = m_aProcessors[b];
+    if (pa.SmtIndex != pb.SmtIndex)
+      return pa.SmtIndex < pb.SmtIndex;
+    if (pa.Node != pb.Node)
+      return pa.Node < pb.Node;
+    if (pa.CacheDomain != pb.CacheDomain)
+      return pa.CacheDomain < pb.CacheDomain;
+    return pa.Core < pb.Core;
+  });
+
+  return (UINT)pOrder->size();
+}
+
+void CpuTopology::GetGroupAffinity(_In_ const CPU_LOGICAL_PROCESSOR &processor, _Out_ GROUP_AFFINITY *pAffinity) {
+  ZeroMemory(pAffinity, sizeof(*pAffinity));
+  pAffinity->Group = processor.Group;
+  pAffinity->Mask = (KAFFINITY)1 << processor.Number;
+}
+
+UINT CpuTopology::FindLogicalProcessor(WORD Group, BYTE Number) const {
+  for (UINT i = 0; i < (UINT)m_aProcessors.size(); ++i) {
+    if (m_aProcessors[i].Group == Group && m_aProcessors[i].Number == Number)
+      return i;
+  }
+  return UINT(-1);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <windows.h>
+#include <vector>
+
+/// One logical processor and where it sits in the machine.
+struct CPU_LOGICAL_PROCESSOR {
+  WORD Group;       // Processor group and number within it, as GROUP_AFFINITY takes them
+  BYTE Number;
+  UINT Core;        // Physical core, logical processors of a core are SMT siblings
+  UINT SmtIndex;    // 0 for the first logical processor of its core
+  UINT CacheDomain; // Last level cache shared with the other processors of the domain
+  UINT Node;        // NUMA node
+};
+
+enum CPU_PINNING_POLICY {
+  CPU_PINNING_NONE,           // Let the scheduler place the threads
+  CPU_PINNING_CORES_FIRST,    // One thread per core first, SMT siblings once every core has one
+  CPU_PINNING_PHYSICAL_CORES, // Never two threads on the same core
+};
+
+///
+/// Processor topology of the whole machine, every processor group included: cores, SMT
+/// siblings, last level cache domains and NUMA nodes.
+///
+class CpuTopology {
+public:
+  HRESULT Initialize();
+
+  UINT GetLogicalProcessorCount() const;
+  UINT GetCoreCount() const;
+  UINT GetCacheDomainCount() const;
+  UINT GetNodeCount() const;
+  const CPU_LOGICAL_PROCESSOR &GetLogicalProcessor(UINT uIndex) const;
+
+  /// Logical processors, as indices, in the order threads should be pinned to them. Threads
+  /// are packed node by node and cache domain by cache domain so the ones sharing the
+  /// frame's data also share caches and memory. Returns the number of indices written,
+  /// which is the core count for CPU_PINNING_PHYSICAL_CORES and 0 for CPU_PINNING_NONE.
+  UINT BuildPinningOrder(_In_ CPU_PINNING_POLICY ePolicy, _Out_ std::vector<UINT> *pOrder) const;
+
+  static void GetGroupAffinity(_In_ const CPU_LOGICAL_PROCESSOR &processor, _Out_ GROUP_AFFINITY *pAffinity);
+
+private:
+  UINT FindLogicalProcessor(WORD Group, BYTE Number) const;
+
+  std::vector<CPU_LOGICAL_PROCESSOR> m_aProcessors;
+  UINT m_uNumCores = 0;
+  UINT m_uNumCacheDomains = 0;
+  UINT m_uNumNodes = 0;
+};
+
+/// Inline implementation
+inline UINT CpuTopology::GetLogicalProcessorCount() const {
+  return (UINT)m_aProcessors.size();
+}
+
+inline UINT CpuTopology::GetCoreCount() const {
+  return m_uNumCores;
+}
+
+inline UINT CpuTopology::GetCacheDomainCount() const {
+  return m_uNumCacheDomains;
+}
+
+inline UINT CpuTopology::GetNodeCount() const {
+  return m_uNumNodes;
+}
+
+inline const CPU_LOGICAL_PROCESSOR &CpuTopology::GetLogicalProcessor(UINT uIndex) const {
+  return m_aProcessors[uIndex];
+}
@@ -1,4 +1,5 @@
 #include "D3D12RendererContext.hpp"
+#include "CpuProfiler.h"
 #include <dxgi1_6.h>
 //
 // D3D12RendererContext implementation.
@@ -12,7 +13,8 @@ D3D12RendererContext::D3D12RendererContext()
       m_pSwapChain(nullptr),
       m_pRTVDescriptorHeap(nullptr), m_pDSVDescriptorHeap(nullptr),
       m_pd3dDepthStencilBuffer(nullptr),
-      m_iCurrentBackBuffer(0), m_ScreenViewport{0, 0, 0, 0, 0, 0}, m_ScissorRect{0, 0, 0, 0} {
+      m_iCurrentBackBuffer(0), m_ScreenViewport{0, 0, 0, 0, 0, 0}, m_ScissorRect{0, 0, 0, 0},
+      m_fLastPresentMs(0.0f) {
 
   m_BackBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
   m_SwapChainFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -31,6 +33,11 @@ D3D12RendererContext::D3D12RendererContext()
 
   m_aDeviceConfig.SwapChainBackBufferFormatSRGB = FALSE;
 
+  m_aDeviceConfig.FrameCount = 0;
+  m_aDeviceConfig.FramePipeliningMode = FRAME_PIPELINING_MODE_THROUGHPUT;
+  m_aDeviceConfig.FrameUploadRingSize = 0;
+  m_aDeviceConfig.FrameUploadRingMaxSize = 0;
+
   m_aDeviceRuntimeSettings.TearingSupport = FALSE;
 
   memset(m_pd3dSwapChainBuffer, 0, sizeof(m_pd3dSwapChainBuffer));
@@ -87,6 +94,7 @@ HRESULT D3D12RendererContext::Initialize(HWND hwnd, int cx, int cy) {
   V_RETURN(CreateDevice());
   V_RETURN(CreateMemAllocator());
   V_RETURN(CreateCommandObjects());
+  V_RETURN(CreateFrameContexts());
   V_RETURN(CreateSwapChain(hwnd));
   V_RETURN(CreateRtvAndDsvDescriptorHeaps());
 
@@ -104,6 +112,8 @@ void D3D12RendererContext::Destroy() {
   }
 
   OnDestroy();
+
+  m_FrameContexts.Destroy();
 }
 
 HRESULT D3D12RendererContext::CreateDevice() {
@@ -300,6 +310,18 @@ HRESULT D3D12RendererContext::CreateCommandObjects() {
   return hr;
 }
 
+HRESULT D3D12RendererContext::CreateFrameContexts() {
+  HRESULT hr = S_OK;
+
+  if (m_aDeviceConfig.FrameCount > 0) {
+    V_RETURN(m_FrameContexts.Initialize(m_pd3dDevice, m_pSyncFence, m_aDeviceConfig.FrameCount,
+                                        m_aDeviceConfig.FramePipeliningMode, m_aDeviceConfig.FrameUploadRingSize,
+                                        m_aDeviceConfig.FrameUploadRingMaxSize));
+  }
+
+  return hr;
+}
+
 HRESULT D3D12RendererContext::CreateSwapChain(HWND hwnd) {
 
   HRESULT hr;
@@ -439,7 +461,9 @@ HRESULT D3D12RendererContext::Present() {
   UINT presentFlags = (!m_aDeviceConfig.VsyncEnabled && m_aDeviceRuntimeSettings.TearingSupport && !m_bFullscreenMode)
                           ? DXGI_PRESENT_ALLOW_TEARING
                           : 0;
+  m_PresentTimer.Reset();
   V_RETURN(m_pSwapChain->Present(0, presentFlags));
+  m_fLastPresentMs = (float)(m_PresentTimer.GetTime() * 1000.0);
   m_iCurrentBackBuffer = (m_iCurrentBackBuffer + 1) % s_iSwapChainBufferCount;
   return hr;
 }
@@ -658,13 +682,19 @@ RECT D3D12RendererContext::GetSwapchainContainingOutputDesktopCoordinates() cons
 }
 
 void D3D12RendererContext::Update(float fTime, float fElapsedTime) {
+  CPU_PROFILE_SCOPE("OnFrameMoved");
   this->OnFrameMoved(fTime, fElapsedTime);
 }
 
 void D3D12RendererContext::RenderFrame(float fTime, float fElaspedTime) {
+  CPU_PROFILE_SCOPE("OnRenderFrame");
   this->OnRenderFrame(fTime, fElaspedTime);
 }
 
+float D3D12RendererContext::GetLastFrameWaitMs() const {
+  return m_FrameContexts.GetLastWaitMs() + m_fLastPresentMs;
+}
+
 LRESULT D3D12RendererContext::MsgProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
   return this->OnMsgProc(hwnd, msg, wp, lp);
 }
@@ -6,6 +6,7 @@
 #include <vector>
 #include "D3D12MemAllocator.hpp"
 #include "SyncFence.hpp"
+#include "FrameContextManager.h"
 
 class D3D12RendererContext {
 
@@ -20,6 +21,8 @@ public:
   HRESULT ResizeFrame(int cx, int cy);
   HRESULT SetFullscreenMode(BOOL bFullScreen);
   RECT GetSwapchainContainingOutputDesktopCoordinates() const;
+  /// CPU time the last frame spent blocked on the GPU, in the frame contexts and in Present.
+  float GetLastFrameWaitMs() const;
 
   LRESULT MsgProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
 
@@ -53,6 +56,7 @@ protected:
   HRESULT CreateSwapChain(HWND hwnd);
   HRESULT CreateRtvAndDsvDescriptorHeaps();
   HRESULT CreateMsaaRenderBuffer();
+  HRESULT CreateFrameContexts();
 
   VOID PrepareNextFrame(_In_opt_ ID3D12GraphicsCommandList *pCommandList = nullptr);
   VOID EndRenderFrame(_In_opt_ ID3D12GraphicsCommandList *pCommandList = nullptr);
@@ -91,6 +95,15 @@ protected:
     // Default is FALSE
     BOOL SwapChainBackBufferFormatSRGB;
 
+    /// Frames in flight (non-mandatory), 0 creates no frame contexts for
+    /// samples keeping frame resources of their own.
+    /// Default is 0, the count and mode may change at runtime through m_FrameContexts.
+    UINT FrameCount;
+    FRAME_PIPELINING_MODE FramePipeliningMode;
+    /// Upload ring shared by the frames, 0 creates none.
+    UINT64 FrameUploadRingSize;
+    UINT64 FrameUploadRingMaxSize;
+
   } m_aDeviceConfig;
 
   // The following settings is mutable when the renderer context
@@ -127,6 +140,7 @@ protected:
   ID3D12GraphicsCommandList4 *m_pd3dCommandList;
 
   SyncFence *m_pSyncFence;
+  FrameContextManager m_FrameContexts;
 
   IDXGISwapChain *m_pSwapChain;
 
@@ -144,4 +158,7 @@ protected:
   D3D12_RECT m_ScissorRect;
 
   D3D12_CLEAR_VALUE m_aRTVDefaultClearValue;
+
+  DXUT::CDXUTTimer m_PresentTimer;
+  float m_fLastPresentMs;
 };
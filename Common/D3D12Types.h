@@ -0,0 +1,17 @@
+#pragma once
+
+///
+/// D3D12 and DirectXMath declarations for code that records, batches or culls draws without
+/// a device. Headers only: what includes this instead of d3dUtils.h calls no D3D12 or DXGI
+/// export and links neither library. Outside of Windows the declarations come from the
+/// DirectX-Headers and DirectXMath packages.
+///
+#if defined(_WIN32)
+#include <windows.h>
+#include <d3d12.h>
+#else
+#include <wsl/winadapter.h>
+#include <directx/d3d12.h>
+#endif
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
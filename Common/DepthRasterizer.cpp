@@ -0,0 +1,231 @@
+#include "DepthRasterizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+DepthRasterizer::DepthRasterizer() {
+  m_uWidth = 0;
+  m_uHeight = 0;
+  m_uTilesX = 0;
+  m_uTilesY = 0;
+}
+
+void DepthRasterizer::Resize(_In_ UINT uWidth, _In_ UINT uHeight) {
+  m_uWidth = uWidth;
+  m_uHeight = uHeight;
+  m_uTilesX = (uWidth + TILE_WIDTH - 1) / TILE_WIDTH;
+  m_uTilesY = (uHeight + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+  m_aDepth.resize(m_uTilesX * m_uTilesY * TILE_SIZE);
+  m_aTileMaxDepth.resize(m_uTilesX * m_uTilesY);
+  Clear();
+}
+
+void DepthRasterizer::Clear() {
+  std::fill(m_aDepth.begin(), m_aDepth.end(), 1.0f);
+  std::fill(m_aTileMaxDepth.begin(), m_aTileMaxDepth.end(), 1.0f);
+}
+
+void DepthRasterizer::RasterizeTriangles(
+  _In_reads_(uNumVertices) const XMFLOAT3 *pPositions,
+  _In_ UINT uNumVertices,
+  _In_reads_(uNumIndices) const UINT *pIndices,
+  _In_ UINT uNumIndices,
+  _In_ FXMMATRIX WorldViewProj
+) {
+
+  m_aScreenVertices.resize(uNumVertices);
+
+  for (UINT i = 0; i < uNumVertices; ++i) {
+    XMFLOAT4 vClip;
+    XMStoreFloat4(&vClip, XMVector3Transform(XMLoadFloat3(&pPositions[i]), WorldViewProj));
+
+    XMFLOAT4 &v = m_aScreenVertices[i];
+    if (vClip.w <= 1e-5f || vClip.z < 0.0f) {
+      v.w = -1.0f;
+      continue;
+    }
+
+    float fInvW = 1.0f / vClip.w;
+    v.x = (vClip.x * fInvW * 0.5f + 0.5f) * m_uWidth;
+    v.y = (0.5f - vClip.y * fInvW * 0.5f) * m_uHeight;
+    v.z = vClip.z * fInvW;
+    v.w = 1.0f;
+  }
+
+  for (UINT i = 0; i + 2 < uNumIndices; i += 3) {
+    const XMFLOAT4 &v0 = m_aScreenVertices[pIndices[i]];
+    const XMFLOAT4 &v1 = m_aScreenVertices[pIndices[i + 1]];
+    const XMFLOAT4 &v2 = m_aScreenVertices[pIndices[i + 2]];
+
+    if (v0.w < 0.0f || v1.w < 0.0f || v2.w < 0.0f)
+      continue;
+
+    RasterizeTriangle(v0, v1, v2);
+  }
+}
+
+void DepthRasterizer::RasterizeTriangle(const XMFLOAT4 &v0, const XMFLOAT4 &v1, const XMFLOAT4 &v2) {
+  const XMFLOAT4 *a = &v0, *b = &v1, *c = &v2;
+  float fArea = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+
+  // Make the winding positive so inside is where all the edge functions are non-negative
+  if (fArea < 0.0f) {
+    std::swap(b, c);
+    fArea = -fArea;
+  }
+  if (fArea < 1e-8f)
+    return;
+
+  int ix0 = (std::max)(0, (int)floorf((std::min)({a->x, b->x, c->x})));
+  int ix1 = (std::min)((int)m_uWidth - 1, (int)ceilf((std::max)({a->x, b->x, c->x})));
+  int iy0 = (std::max)(0, (int)floorf((std::min)({a->y, b->y, c->y})));
+  int iy1 = (std::min)((int)m_uHeight - 1, (int)ceilf((std::max)({a->y, b->y, c->y})));
+  if (ix0 > ix1 || iy0 > iy1)
+    return;
+
+  // E(x, y) = A * x + B * y + C for the edges a->b, b->c and c->a
+  const XMFLOAT4 *aEdge[3][2] = {{a, b}, {b, c}, {c, a}};
+  __m128 vA[3], vB[3], vC[3];
+  for (int e = 0; e < 3; ++e) {
+    const XMFLOAT4 *p = aEdge[e][0], *q = aEdge[e][1];
+    float A = p->y - q->y;
+    float B = q->x - p->x;
+    vA[e] = _mm_set1_ps(A);
+    vB[e] = _mm_set1_ps(B);
+    vC[e] = _mm_set1_ps(-(A * p->x + B * p->y));
+  }
+
+  // Depth plane z(x, y) = dzdx * x + dzdy * y + zc
+  float fInvArea = 1.0f / fArea;
+  float dzdx = ((b->z - a->z) * (c->y - a->y) - (c->z - a->z) * (b->y - a->y)) * fInvArea;
+  float dzdy = ((c->z - a->z) * (b->x - a->x) - (b->z - a->z) * (c->x - a->x)) * fInvArea;
+  float zc = a->z - dzdx * a->x - dzdy * a->y;
+  __m128 vDzDx = _mm_set1_ps(dzdx);
+
+  const __m128 vZero = _mm_setzero_ps();
+  const __m128 vLaneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+  for (int ty = iy0 / TILE_HEIGHT; ty <= iy1 / TILE_HEIGHT; ++ty) {
+    for (int tx = ix0 / TILE_WIDTH; tx <= ix1 / TILE_WIDTH; ++tx) {
+      float *pTile = GetTile(tx, ty);
+
+      for (int r = 0; r < TILE_HEIGHT; ++r) {
+        int y = ty * TILE_HEIGHT + r;
+        if (y < iy0 || y > iy1)
+          continue;
+
+        float py = y + 0.5f;
+        __m128 vRow[3];
+        for (int e = 0; e < 3; ++e)
+          vRow[e] = _mm_add_ps(_mm_mul_ps(vB[e], _mm_set1_ps(py)), vC[e]);
+        __m128 vRowZ = _mm_set1_ps(dzdy * py + zc);
+
+        for (int h = 0; h < TILE_WIDTH; h += 4) {
+          int x = tx * TILE_WIDTH + h;
+          if (x + 3 < ix0 || x > ix1)
+            continue;
+
+          __m128 px = _mm_add_ps(_mm_set1_ps((float)x), vLaneOffsets);
+          __m128 vInside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(vA[0], px), vRow[0]), vZero);
+          vInside = _mm_and_ps(vInside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(vA[1], px), vRow[1]), vZero));
+          vInside = _mm_and_ps(vInside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(vA[2], px), vRow[2]), vZero));
+          if (_mm_movemask_ps(vInside) == 0)
+            continue;
+
+          float *pDepth = pTile + r * TILE_WIDTH + h;
+          __m128 vZ = _mm_add_ps(_mm_mul_ps(vDzDx, px), vRowZ);
+          __m128 vDepth = _mm_loadu_ps(pDepth);
+          __m128 vNearest = _mm_min_ps(vDepth, vZ);
+          _mm_storeu_ps(pDepth, _mm_or_ps(_mm_and_ps(vInside, vNearest), _mm_andnot_ps(vInside, vDepth)));
+        }
+      }
+    }
+  }
+}
+
+void DepthRasterizer::UpdateTileDepths() {
+
+  for (UINT t = 0; t < m_uTilesX * m_uTilesY; ++t) {
+    const float *pTile = &m_aDepth[t * TILE_SIZE];
+    __m128 vMax = _mm_loadu_ps(pTile);
+
+    for (int i = 4; i < TILE_SIZE; i += 4)
+      vMax = _mm_max_ps(vMax, _mm_loadu_ps(pTile + i));
+
+    vMax = _mm_max_ps(vMax, _mm_shuffle_ps(vMax, vMax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vMax = _mm_max_ps(vMax, _mm_shuffle_ps(vMax, vMax, _MM_SHUFFLE(2, 3, 0, 1)));
+    m_aTileMaxDepth[t] = _mm_cvtss_f32(vMax);
+  }
+}
+
+BOOL DepthRasterizer::IsVisible(_In_ const BoundingBox &box, _In_ FXMMATRIX WorldViewProj) const {
+  XMFLOAT3 aCorners[BoundingBox::CORNER_COUNT];
+  float fMinX = FLT_MAX, fMinY = FLT_MAX, fMinZ = FLT_MAX;
+  float fMaxX = -FLT_MAX, fMaxY = -FLT_MAX;
+
+  box.GetCorners(aCorners);
+
+  for (const auto &vCorner : aCorners) {
+    XMFLOAT4 vClip;
+    XMStoreFloat4(&vClip, XMVector3Transform(XMLoadFloat3(&vCorner), WorldViewProj));
+
+    // Reaches the near plane, nothing can be in front of it
+    if (vClip.w <= 1e-5f || vClip.z < 0.0f)
+      return TRUE;
+
+    float fInvW = 1.0f / vClip.w;
+    float x = (vClip.x * fInvW * 0.5f + 0.5f) * m_uWidth;
+    float y = (0.5f - vClip.y * fInvW * 0.5f) * m_uHeight;
+    fMinX = (std::min)(fMinX, x);
+    fMaxX = (std::max)(fMaxX, x);
+    fMinY = (std::min)(fMinY, y);
+    fMaxY = (std::max)(fMaxY, y);
+    fMinZ = (std::min)(fMinZ, vClip.z * fInvW);
+  }
+
+  if (fMaxX < 0.0f || fMaxY < 0.0f || fMinX >= m_uWidth || fMinY >= m_uHeight)
+    return FALSE;
+
+  int ix0 = (std::max)(0, (int)floorf(fMinX));
+  int ix1 = (std::min)((int)m_uWidth - 1, (int)floorf(fMaxX));
+  int iy0 = (std::max)(0, (int)floorf(fMinY));
+  int iy1 = (std::min)((int)m_uHeight - 1, (int)floorf(fMaxY));
+
+  const __m128 vMinZ = _mm_set1_ps(fMinZ);
+  const __m128i vX0 = _mm_set1_epi32(ix0 - 1);
+  const __m128i vX1 = _mm_set1_epi32(ix1 + 1);
+  const __m128i vLaneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+
+  for (int ty = iy0 / TILE_HEIGHT; ty <= iy1 / TILE_HEIGHT; ++ty) {
+    for (int tx = ix0 / TILE_WIDTH; tx <= ix1 / TILE_WIDTH; ++tx) {
+
+      // Every pixel of the tile is nearer than the box
+      if (m_aTileMaxDepth[ty * m_uTilesX + tx] < fMinZ)
+        continue;
+
+      const float *pTile = GetTile(tx, ty);
+
+      for (int r = 0; r < TILE_HEIGHT; ++r) {
+        int y = ty * TILE_HEIGHT + r;
+        if (y < iy0 || y > iy1)
+          continue;
+
+        for (int h = 0; h < TILE_WIDTH; h += 4) {
+          int x = tx * TILE_WIDTH + h;
+          __m128i vX = _mm_add_epi32(_mm_set1_epi32(x), vLaneOffsets);
+          __m128 vInRect = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(vX, vX0), _mm_cmplt_epi32(vX, vX1)));
+          __m128 vBehind = _mm_cmpge_ps(_mm_loadu_ps(pTile + r * TILE_WIDTH + h), vMinZ);
+
+          if (_mm_movemask_ps(_mm_and_ps(vInRect, vBehind)))
+            return TRUE;
+        }
+      }
+    }
+  }
+
+  return FALSE;
+}
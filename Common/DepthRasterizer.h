@@ -0,0 +1,79 @@
+#pragma once
+#include "D3D12Types.h"
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+///
+/// Small CPU depth buffer for software occlusion culling. Occluder triangles are rasterized
+/// 4 pixels at a time with SSE into 8x8 tiles, keeping the nearest depth. Occludee boxes are
+/// then tested against the farthest depth of every tile they cover, falling back to the
+/// pixels only where a tile is not conclusive. Depth follows D3D, 0 near and 1 far.
+///
+class DepthRasterizer {
+public:
+  enum {
+    TILE_WIDTH = 8,
+    TILE_HEIGHT = 8,
+    TILE_SIZE = TILE_WIDTH * TILE_HEIGHT
+  };
+
+  DepthRasterizer();
+
+  void Resize(_In_ UINT uWidth, _In_ UINT uHeight);
+  UINT GetWidth() const;
+  UINT GetHeight() const;
+
+  void Clear();
+
+  /// Indexed triangle list, both windings are drawn. Triangles crossing the near plane
+  /// are dropped, which only makes the occluders smaller.
+  void RasterizeTriangles(
+    _In_reads_(uNumVertices) const DirectX::XMFLOAT3 *pPositions,
+    _In_ UINT uNumVertices,
+    _In_reads_(uNumIndices) const UINT *pIndices,
+    _In_ UINT uNumIndices,
+    _In_ DirectX::FXMMATRIX WorldViewProj
+  );
+
+  /// Must be called after the last occluder and before testing.
+  void UpdateTileDepths();
+
+  /// FALSE when the box is certainly hidden behind the occluders or off screen.
+  BOOL IsVisible(_In_ const DirectX::BoundingBox &box, _In_ DirectX::FXMMATRIX WorldViewProj) const;
+
+private:
+  void RasterizeTriangle(const DirectX::XMFLOAT4 &v0, const DirectX::XMFLOAT4 &v1, const DirectX::XMFLOAT4 &v2);
+
+  float *GetTile(UINT tx, UINT ty);
+  const float *GetTile(UINT tx, UINT ty) const;
+
+  UINT m_uWidth;
+  UINT m_uHeight;
+  UINT m_uTilesX;
+  UINT m_uTilesY;
+
+  // Tile-major, row-major inside a tile
+  std::vector<float> m_aDepth;
+  // Farthest depth of every tile
+  std::vector<float> m_aTileMaxDepth;
+  // Screen space x, y, z of the current occluder, w < 0 marks a vertex in front of the near plane
+  std::vector<DirectX::XMFLOAT4> m_aScreenVertices;
+};
+
+/// Inline implementation
+inline UINT DepthRasterizer::GetWidth() const {
+  return m_uWidth;
+}
+
+inline UINT DepthRasterizer::GetHeight() const {
+  return m_uHeight;
+}
+
+inline float *DepthRasterizer::GetTile(UINT tx, UINT ty) {
+  return &m_aDepth[(ty * m_uTilesX + tx) * TILE_SIZE];
+}
+
+inline const float *DepthRasterizer::GetTile(UINT tx, UINT ty) const {
+  return &m_aDepth[(ty * m_uTilesX + tx) * TILE_SIZE];
+}
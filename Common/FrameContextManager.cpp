@@ -0,0 +1,132 @@
+#include "FrameContextManager.h"
+#include "SyncFence.hpp"
+#include <algorithm>
+
+FrameContextManager::FrameContextManager() {
+  m_pSyncFence = nullptr;
+  ZeroMemory(m_aFrames, sizeof(m_aFrames));
+  m_bHasUploadRing = FALSE;
+  m_uFrameCount = 3;
+  m_eMode = FRAME_PIPELINING_MODE_THROUGHPUT;
+  m_uFrameNumber = 0;
+  m_uFrameIndex = 0;
+  m_fLastWaitMs = 0.0f;
+}
+
+FrameContextManager::~FrameContextManager() {
+  Destroy();
+}
+
+void FrameContextManager::Destroy() {
+
+  for (auto &frame : m_aFrames) {
+    SAFE_RELEASE(frame.CommandAllocator);
+    frame.FencePoint = 0;
+  }
+
+  m_UploadRing.Destroy();
+  m_bHasUploadRing = FALSE;
+
+  SAFE_RELEASE(m_pSyncFence);
+  m_UploadRingFence.pSyncFence = nullptr;
+  m_uFrameNumber = 0;
+  m_uFrameIndex = 0;
+}
+
+HRESULT FrameContextManager::Initialize(
+  _In_ ID3D12Device *pDevice,
+  _In_ SyncFence *pSyncFence,
+  _In_ UINT uFrameCount,
+  _In_ FRAME_PIPELINING_MODE eMode,
+  _In_ UINT64 uUploadRingSize,
+  _In_ UINT64 uMaxUploadRingSize
+) {
+
+  HRESULT hr = S_OK;
+  char nameBuf[64];
+
+  if (pDevice == nullptr || pSyncFence == nullptr)
+    V_RETURN(E_INVALIDARG);
+
+  Destroy();
+
+  SAFE_ADDREF(pSyncFence);
+  m_pSyncFence = pSyncFence;
+  m_UploadRingFence.pSyncFence = pSyncFence;
+
+  for (UINT i = 0; i < s_uMaxFrameCount; ++i) {
+    V_RETURN(pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                             IID_PPV_ARGS(&m_aFrames[i].CommandAllocator)));
+    sprintf_s(nameBuf, "FrameCommandAllocators[%u]", i);
+    DX_SetDebugName(m_aFrames[i].CommandAllocator, nameBuf);
+  }
+
+  if (uUploadRingSize > 0) {
+    V_RETURN(m_UploadRing.Initialize(pDevice, &m_UploadRingFence, uUploadRingSize, uMaxUploadRingSize));
+    m_bHasUploadRing = TRUE;
+  }
+
+  SetFrameCount(uFrameCount);
+  SetPipeliningMode(eMode);
+  return hr;
+}
+
+void FrameContextManager::SetFrameCount(_In_ UINT uFrameCount) {
+  m_uFrameCount = (std::max)(1u, (std::min)(uFrameCount, (UINT)s_uMaxFrameCount));
+}
+
+void FrameContextManager::SetPipeliningMode(_In_ FRAME_PIPELINING_MODE eMode) {
+  m_eMode = eMode == FRAME_PIPELINING_MODE_LATENCY ? FRAME_PIPELINING_MODE_LATENCY : FRAME_PIPELINING_MODE_THROUGHPUT;
+}
+
+UINT FrameContextManager::GetMaxFramesInFlight() const {
+  return m_eMode == FRAME_PIPELINING_MODE_LATENCY ? (std::min)(m_uFrameCount, 2u) : m_uFrameCount;
+}
+
+HRESULT FrameContextManager::BeginFrame() {
+
+  HRESULT hr = S_OK;
+  UINT64 uFrame = m_uFrameNumber;
+  UINT uMaxFramesInFlight = GetMaxFramesInFlight();
+  FRAME_CONTEXT *pFrame = &m_aFrames[uFrame % s_uMaxFrameCount];
+  UINT64 uWaitPoint = pFrame->FencePoint;
+
+  if (m_pSyncFence == nullptr)
+    V_RETURN2("FrameContextManager: not initialized!", E_FAIL);
+
+  // Frame N may start once frame N - n is complete, n the frames allowed in flight. The
+  // context it takes over is at least as old, the wait covers it too.
+  if (uFrame >= uMaxFramesInFlight)
+    uWaitPoint = (std::max)(uWaitPoint, m_aFrames[(uFrame - uMaxFramesInFlight) % s_uMaxFrameCount].FencePoint);
+
+  m_WaitTimer.Reset();
+  if (uWaitPoint > m_pSyncFence->GetCompletedSyncPoint())
+    V_RETURN(m_pSyncFence->WaitForSyncPoint(uWaitPoint));
+  m_fLastWaitMs = (float)(m_WaitTimer.GetTime() * 1000.0);
+
+  V_RETURN(pFrame->CommandAllocator->Reset());
+
+  m_uFrameIndex = (UINT)(uFrame % s_uMaxFrameCount);
+  m_uFrameNumber = uFrame + 1;
+  return hr;
+}
+
+HRESULT FrameContextManager::EndFrame(_In_ ID3D12CommandQueue *pCommandQueue) {
+
+  HRESULT hr;
+  FRAME_CONTEXT *pFrame = &m_aFrames[m_uFrameIndex];
+
+  V_RETURN(m_pSyncFence->Signal(pCommandQueue, &pFrame->FencePoint));
+
+  if (m_bHasUploadRing)
+    m_UploadRing.FinishFrame(pFrame->FencePoint);
+  return hr;
+}
+
+UINT64 FrameContextManager::UploadRingFence::GetCompletedFencePoint() const {
+  return pSyncFence->GetCompletedSyncPoint();
+}
+
+HRESULT FrameContextManager::UploadRingFence::WaitForFencePoint(_In_ UINT64 uFencePoint) {
+  return pSyncFence->WaitForSyncPoint(uFencePoint);
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "d3dUtils.h"
+#include "DXUTmisc.h"
+#include "UploadRingBuffer.h"
+
+class SyncFence;
+
+enum FRAME_PIPELINING_MODE {
+  /// The CPU records up to the frame count ahead of the GPU, stalls on either side are
+  /// absorbed at the cost of input showing that many frames late.
+  FRAME_PIPELINING_MODE_THROUGHPUT = 0,
+  /// The CPU records at most one frame ahead: frame N+1 is recorded while the GPU runs
+  /// frame N and nothing more is queued behind it.
+  FRAME_PIPELINING_MODE_LATENCY,
+  FRAME_PIPELINING_MODE_COUNT
+};
+
+struct FRAME_CONTEXT {
+  ID3D12CommandAllocator *CommandAllocator;
+  UINT64 FencePoint;   // Signaled after the frame's last submission, 0 before its first use
+};
+
+///
+/// The frames in flight of a renderer. Every frame records with a context of its own, holding
+/// the direct command allocator and the fence point the frame was signaled with, and all of
+/// them share one upload ring for transient data. BeginFrame only blocks when starting the
+/// frame would put more frames in flight than the frame count and pipelining mode allow, so
+/// recording frame N+1 overlaps with the GPU running frame N.
+///
+/// The frame count may change at any time, the contexts are always allocated for
+/// s_uMaxFrameCount and the count only moves the point BeginFrame waits for.
+///
+class FrameContextManager {
+public:
+  static const UINT s_uMaxFrameCount = 4;
+
+  FrameContextManager();
+  ~FrameContextManager();
+
+  /// uUploadRingSize 0 creates no upload ring, see UploadRingBuffer::Initialize for the sizes.
+  HRESULT Initialize(
+    _In_ ID3D12Device *pDevice,
+    _In_ SyncFence *pSyncFence,
+    _In_ UINT uFrameCount,
+    _In_ FRAME_PIPELINING_MODE eMode,
+    _In_ UINT64 uUploadRingSize,
+    _In_ UINT64 uMaxUploadRingSize
+  );
+  /// The GPU must be done with every frame.
+  void Destroy();
+
+  /// Clamped to [1, s_uMaxFrameCount], 1 finishes every frame before the next one starts.
+  /// Takes effect with the next BeginFrame.
+  void SetFrameCount(_In_ UINT uFrameCount);
+  UINT GetFrameCount() const;
+  void SetPipeliningMode(_In_ FRAME_PIPELINING_MODE eMode);
+  FRAME_PIPELINING_MODE GetPipeliningMode() const;
+  /// Frames which may be in flight once a frame begins, the current one included.
+  UINT GetMaxFramesInFlight() const;
+
+  /// Waits until the frame may start, makes the next context current and resets its allocator.
+  HRESULT BeginFrame();
+  /// Signals the queue after the frame's last submission and finishes the upload ring frame.
+  HRESULT EndFrame(_In_ ID3D12CommandQueue *pCommandQueue);
+
+  /// Index of the current context, below s_uMaxFrameCount whatever the frame count, so per
+  /// frame data kept beside the contexts can be sized with s_uMaxFrameCount.
+  UINT GetFrameIndex() const;
+  FRAME_CONTEXT *GetCurrentFrame();
+  ID3D12CommandAllocator *GetCommandAllocator() const;
+  /// nullptr when created without one.
+  UploadRingBuffer *GetUploadRing();
+  /// Frames begun so far.
+  UINT64 GetFrameNumber() const;
+  /// CPU time the last BeginFrame spent waiting for the GPU.
+  float GetLastWaitMs() const;
+
+private:
+  // The upload ring retires its frames on the SyncFence the frames are signaled on
+  class UploadRingFence final : public IUploadRingFence {
+  public:
+    SyncFence *pSyncFence = nullptr;
+
+    UINT64 GetCompletedFencePoint() const override;
+    HRESULT WaitForFencePoint(_In_ UINT64 uFencePoint) override;
+  };
+
+  SyncFence *m_pSyncFence;
+  FRAME_CONTEXT m_aFrames[s_uMaxFrameCount];
+  UploadRingFence m_UploadRingFence;
+  UploadRingBuffer m_UploadRing;
+  BOOL m_bHasUploadRing;
+
+  UINT m_uFrameCount;
+  FRAME_PIPELINING_MODE m_eMode;
+  UINT64 m_uFrameNumber;
+  UINT m_uFrameIndex;
+
+  DXUT::CDXUTTimer m_WaitTimer;
+  float m_fLastWaitMs;
+};
+
+/// Inline implementation
+inline UINT FrameContextManager::GetFrameCount() const {
+  return m_uFrameCount;
+}
+
+inline FRAME_PIPELINING_MODE FrameContextManager::GetPipeliningMode() const {
+  return m_eMode;
+}
+
+inline UINT FrameContextManager::GetFrameIndex() const {
+  return m_uFrameIndex;
+}
+
+inline FRAME_CONTEXT *FrameContextManager::GetCurrentFrame() {
+  return &m_aFrames[m_uFrameIndex];
+}
+
+inline ID3D12CommandAllocator *FrameContextManager::GetCommandAllocator() const {
+  return m_aFrames[m_uFrameIndex].CommandAllocator;
+}
+
+inline UploadRingBuffer *FrameContextManager::GetUploadRing() {
+  return m_bHasUploadRing ? &m_UploadRing : nullptr;
+}
+
+inline UINT64 FrameContextManager::GetFrameNumber() const {
+  return m_uFrameNumber;
+}
+
+inline float FrameContextManager::GetLastWaitMs() const {
+  return m_fLastWaitMs;
+}
@@ -0,0 +1,87 @@
+#include "FrameTimeStats.h"
+#include <algorithm>
+#include <cstdio>
+
+FrameTimeStats::FrameTimeStats() {
+  Reset();
+}
+
+void FrameTimeStats::Reset() {
+  ZeroMemory(m_aSamples, sizeof(m_aSamples));
+  ZeroMemory(m_aHistograms, sizeof(m_aHistograms));
+  m_uNextSample = 0;
+  m_uNumSamples = 0;
+  m_uTotalFrames = 0;
+}
+
+UINT FrameTimeStats::GetBucket(float fMs) {
+  float fBucket = fMs * (1000.0f / s_uBucketWidthUs);
+  return fBucket <= 0.0f ? 0 : fBucket >= (float)s_uNumBuckets ? (UINT)s_uNumBuckets : (UINT)fBucket;
+}
+
+void FrameTimeStats::AddFrame(_In_ float fCpuMs, _In_ float fPresentMs) {
+  const float afFrame[FRAME_TIME_SERIES_COUNT] = {fCpuMs, fPresentMs};
+
+  for (int i = 0; i < FRAME_TIME_SERIES_COUNT; ++i) {
+    // The oldest frame leaves the window once it is full
+    if (m_uNumSamples == s_uWindowSize)
+      --m_aHistograms[i][GetBucket(m_aSamples[i][m_uNextSample])];
+
+    m_aSamples[i][m_uNextSample] = afFrame[i];
+    ++m_aHistograms[i][GetBucket(afFrame[i])];
+  }
+
+  m_uNextSample = (m_uNextSample + 1) % s_uWindowSize;
+  m_uNumSamples = (std::min)(m_uNumSamples + 1, (UINT)s_uWindowSize);
+  ++m_uTotalFrames;
+}
+
+FRAME_TIME_PERCENTILES FrameTimeStats::GetPercentiles(_In_ FRAME_TIME_SERIES eSeries) const {
+  const float afRanks[] = {0.50f, 0.95f, 0.99f};
+  float afValues[_countof(afRanks)] = {};
+  const UINT *aHistogram = m_aHistograms[eSeries];
+  float fMax = 0.0f;
+  UINT uBucket = 0, uCount = 0;
+
+  for (UINT i = 0; i < m_uNumSamples; ++i)
+    fMax = (std::max)(fMax, m_aSamples[eSeries][i]);
+
+  // The percentile is the upper edge of the bucket holding the frame of its rank
+  for (int i = 0; i < _countof(afRanks) && m_uNumSamples > 0; ++i) {
+    UINT uRank = (std::max)(1u, (UINT)(afRanks[i] * m_uNumSamples + 0.999f));
+
+    for (; uCount + aHistogram[uBucket] < uRank; ++uBucket)
+      uCount += aHistogram[uBucket];
+
+    afValues[i] = uBucket < s_uNumBuckets ? (std::min)(fMax, (uBucket + 1) * s_uBucketWidthUs * 1e-3f) : fMax;
+  }
+
+  return {afValues[0], afValues[1], afValues[2], fMax};
+}
+
+HRESULT FrameTimeStats::WriteCsv(_In_z_ const char *pFileName) const {
+  FRAME_TIME_PERCENTILES aPercentiles[FRAME_TIME_SERIES_COUNT];
+  UINT uFirstSample = (m_uNextSample + s_uWindowSize - m_uNumSamples) % s_uWindowSize;
+  FILE *fp;
+
+  if (fopen_s(&fp, pFileName, "w") != 0 || fp == nullptr)
+    return E_FAIL;
+
+  for (int i = 0; i < FRAME_TIME_SERIES_COUNT; ++i)
+    aPercentiles[i] = GetPercentiles((FRAME_TIME_SERIES)i);
+
+  // The first column is the frame number, or the statistic on the summary rows
+  fprintf(fp, "frame,cpu_ms,present_ms\n");
+  fprintf(fp, "p50,%.3f,%.3f\n", aPercentiles[0].P50, aPercentiles[1].P50);
+  fprintf(fp, "p95,%.3f,%.3f\n", aPercentiles[0].P95, aPercentiles[1].P95);
+  fprintf(fp, "p99,%.3f,%.3f\n", aPercentiles[0].P99, aPercentiles[1].P99);
+  fprintf(fp, "max,%.3f,%.3f\n", aPercentiles[0].Max, aPercentiles[1].Max);
+
+  for (UINT i = 0; i < m_uNumSamples; ++i) {
+    UINT uSample = (uFirstSample + i) % s_uWindowSize;
+    fprintf(fp, "%llu,%.3f,%.3f\n", m_uTotalFrames - m_uNumSamples + i, m_aSamples[FRAME_TIME_CPU][uSample],
+            m_aSamples[FRAME_TIME_PRESENT][uSample]);
+  }
+
+  return fclose(fp) == 0 ? S_OK : E_FAIL;
+}
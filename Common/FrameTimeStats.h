@@ -0,0 +1,51 @@
+#pragma once
+#include <windows.h>
+
+enum FRAME_TIME_SERIES {
+  FRAME_TIME_CPU = 0,       // CPU time of the frame, without the waits for the GPU and the swap chain
+  FRAME_TIME_PRESENT,       // Present to present interval
+  FRAME_TIME_SERIES_COUNT
+};
+
+struct FRAME_TIME_PERCENTILES {
+  float P50, P95, P99, Max; // Milliseconds
+};
+
+///
+/// Frame times of the last s_uWindowSize frames, kept both as samples and as one histogram
+/// per series. Adding a frame moves a sample in and out of the histograms and reading the
+/// percentiles scans the buckets, neither sorts. Percentiles are accurate to the bucket
+/// width, the maximum is exact; frames past the histogram range read as the maximum.
+///
+class FrameTimeStats {
+public:
+  static const UINT s_uWindowSize = 1024;
+  static const UINT s_uBucketWidthUs = 50;
+  static const UINT s_uNumBuckets = 2000; // 100 ms
+
+  FrameTimeStats();
+
+  void Reset();
+  void AddFrame(_In_ float fCpuMs, _In_ float fPresentMs);
+
+  /// Frames in the window, at most s_uWindowSize.
+  UINT GetFrameCount() const;
+  FRAME_TIME_PERCENTILES GetPercentiles(_In_ FRAME_TIME_SERIES eSeries) const;
+
+  /// Writes the percentiles of both series, then the frames of the window oldest first.
+  HRESULT WriteCsv(_In_z_ const char *pFileName) const;
+
+private:
+  static UINT GetBucket(float fMs);
+
+  float m_aSamples[FRAME_TIME_SERIES_COUNT][s_uWindowSize];
+  UINT m_aHistograms[FRAME_TIME_SERIES_COUNT][s_uNumBuckets + 1]; // The last one takes the rest
+  UINT m_uNextSample;
+  UINT m_uNumSamples;
+  UINT64 m_uTotalFrames;
+};
+
+/// Inline implementation
+inline UINT FrameTimeStats::GetFrameCount() const {
+  return m_uNumSamples;
+}
@@ -0,0 +1,365 @@
+#include "FrustumCuller.h"
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC emits VEX encoded code for AVX intrinsics regardless of /arch
+#define AVX2_KERNEL
+#else
+#include <cpuid.h>
+// GCC and Clang only emit it in functions targeting AVX2
+#define AVX2_KERNEL __attribute__((target("avx2,fma")))
+#endif
+
+using namespace DirectX;
+
+static void CpuId(int info[4], int leaf, int subleaf) {
+#if defined(_MSC_VER)
+  __cpuidex(info, leaf, subleaf);
+#else
+  unsigned int a, b, c, d;
+  __cpuid_count(leaf, subleaf, a, b, c, d);
+  info[0] = (int)a;
+  info[1] = (int)b;
+  info[2] = (int)c;
+  info[3] = (int)d;
+#endif
+}
+
+static UINT64 GetEnabledXState() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  unsigned int lo, hi;
+  __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((UINT64)hi << 32) | lo;
+#endif
+}
+
+// Writes base + i for every set bit i of mask, lowest first.
+static UINT CompactMask(UINT mask, UINT base, UINT *pVisible) {
+  UINT n = 0;
+
+  while (mask) {
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+#else
+    UINT bit = (UINT)__builtin_ctz(mask);
+#endif
+    pVisible[n++] = base + bit;
+    mask &= mask - 1;
+  }
+  return n;
+}
+
+void FrustumCuller::Resize(_In_ UINT uNumBoxes) {
+  // A full group may be loaded starting at any box, whatever the slice alignment
+  UINT uPadded = uNumBoxes + 8;
+
+  m_uNumBoxes = uNumBoxes;
+
+  // Padding lanes are masked out of the results, zero them so they never hold garbage
+  m_aCenterX.assign(uPadded, 0.0f);
+  m_aCenterY.assign(uPadded, 0.0f);
+  m_aCenterZ.assign(uPadded, 0.0f);
+  m_aExtentX.assign(uPadded, 0.0f);
+  m_aExtentY.assign(uPadded, 0.0f);
+  m_aExtentZ.assign(uPadded, 0.0f);
+}
+
+BOOL FrustumCuller::IsAVX2Supported() {
+  static const BOOL s_bSupported = []() -> BOOL {
+    int info[4];
+
+    CpuId(info, 0, 0);
+    if (info[0] < 7)
+      return FALSE;
+
+    // FMA, OSXSAVE and AVX, then the OS must preserve the YMM state
+    CpuId(info, 1, 0);
+    if ((info[2] & (1 << 12)) == 0 || (info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+      return FALSE;
+    if ((GetEnabledXState() & 0x6) != 0x6)
+      return FALSE;
+
+    CpuId(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  }();
+
+  return s_bSupported;
+}
+
+FrustumCuller::KERNEL FrustumCuller::ResolveKernel(KERNEL eKernel) const {
+  if (eKernel == KERNEL_AUTO)
+    return IsAVX2Supported() ? KERNEL_AVX2 : KERNEL_SSE;
+  if (eKernel == KERNEL_AVX2 && !IsAVX2Supported())
+    return KERNEL_SSE;
+  return eKernel;
+}
+
+UINT FrustumCuller::Cull(
+  _In_reads_(6) const XMFLOAT4 *pPlanes,
+  _In_ UINT uFirst,
+  _In_ UINT uCount,
+  _Out_writes_to_(uCount, return) UINT *pVisible,
+  _In_ KERNEL eKernel
+) const {
+
+  if (uFirst >= m_uNumBoxes)
+    return 0;
+  uCount = (std::min)(uCount, m_uNumBoxes - uFirst);
+
+  switch (ResolveKernel(eKernel)) {
+  case KERNEL_SCALAR:
+    return CullScalar(pPlanes, uFirst, uCount, pVisible);
+  case KERNEL_AVX2:
+    return CullAVX2(pPlanes, uFirst, uCount, pVisible);
+  default:
+    return CullSSE(pPlanes, uFirst, uCount, pVisible);
+  }
+}
+
+void FrustumCuller::CullViews(
+  _In_reads_(6 * uNumViews) const XMFLOAT4 *pPlanes,
+  _In_ UINT uNumViews,
+  _In_ UINT uFirst,
+  _In_ UINT uCount,
+  _Out_writes_(uCount) UINT *pViewMasks,
+  _In_ KERNEL eKernel
+) const {
+
+  if (uFirst >= m_uNumBoxes)
+    return;
+  uCount = (std::min)(uCount, m_uNumBoxes - uFirst);
+  uNumViews = (std::min)(uNumViews, MAX_VIEWS);
+
+  switch (ResolveKernel(eKernel)) {
+  case KERNEL_SCALAR:
+    CullViewsScalar(pPlanes, uNumViews, uFirst, uCount, pViewMasks);
+    break;
+  case KERNEL_AVX2:
+    CullViewsAVX2(pPlanes, uNumViews, uFirst, uCount, pViewMasks);
+    break;
+  default:
+    CullViewsSSE(pPlanes, uNumViews, uFirst, uCount, pViewMasks);
+    break;
+  }
+}
+
+UINT FrustumCuller::CullScalar(const XMFLOAT4 *pPlanes, UINT uFirst, UINT uCount, UINT *pVisible) const {
+  UINT n = 0;
+
+  for (UINT i = uFirst; i < uFirst + uCount; ++i) {
+    bool bOutside = false;
+
+    for (int p = 0; p < 6 && !bOutside; ++p) {
+      const XMFLOAT4 &P = pPlanes[p];
+      float fDist = m_aCenterX[i] * P.x + m_aCenterY[i] * P.y + m_aCenterZ[i] * P.z + P.w;
+      float fRadius = m_aExtentX[i] * fabsf(P.x) + m_aExtentY[i] * fabsf(P.y) + m_aExtentZ[i] * fabsf(P.z);
+      bOutside = fDist > fRadius;
+    }
+
+    if (!bOutside)
+      pVisible[n++] = i;
+  }
+
+  return n;
+}
+
+UINT FrustumCuller::CullSSE(const XMFLOAT4 *pPlanes, UINT uFirst, UINT uCount, UINT *pVisible) const {
+  const __m128 vAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 vPlane[6][4], vAbsNormal[6][3];
+  UINT n = 0;
+
+  for (int p = 0; p < 6; ++p) {
+    vPlane[p][0] = _mm_set1_ps(pPlanes[p].x);
+    vPlane[p][1] = _mm_set1_ps(pPlanes[p].y);
+    vPlane[p][2] = _mm_set1_ps(pPlanes[p].z);
+    vPlane[p][3] = _mm_set1_ps(pPlanes[p].w);
+    for (int c = 0; c < 3; ++c)
+      vAbsNormal[p][c] = _mm_and_ps(vPlane[p][c], vAbsMask);
+  }
+
+  for (UINT i = uFirst; i < uFirst + uCount; i += 4) {
+    __m128 cx = _mm_loadu_ps(&m_aCenterX[i]);
+    __m128 cy = _mm_loadu_ps(&m_aCenterY[i]);
+    __m128 cz = _mm_loadu_ps(&m_aCenterZ[i]);
+    __m128 ex = _mm_loadu_ps(&m_aExtentX[i]);
+    __m128 ey = _mm_loadu_ps(&m_aExtentY[i]);
+    __m128 ez = _mm_loadu_ps(&m_aExtentZ[i]);
+    __m128 vOutside = _mm_setzero_ps();
+
+    for (int p = 0; p < 6; ++p) {
+      __m128 vDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, vPlane[p][0]), _mm_mul_ps(cy, vPlane[p][1])),
+                                _mm_add_ps(_mm_mul_ps(cz, vPlane[p][2]), vPlane[p][3]));
+      __m128 vRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, vAbsNormal[p][0]), _mm_mul_ps(ey, vAbsNormal[p][1])),
+                                  _mm_mul_ps(ez, vAbsNormal[p][2]));
+      vOutside = _mm_or_ps(vOutside, _mm_cmpgt_ps(vDist, vRadius));
+    }
+
+    UINT mask = ~(UINT)_mm_movemask_ps(vOutside) & 0xf;
+    UINT uRemaining = uFirst + uCount - i;
+    if (uRemaining < 4)
+      mask &= (1u << uRemaining) - 1;
+
+    n += CompactMask(mask, i, pVisible + n);
+  }
+
+  return n;
+}
+
+// The AVX2 kernels live in the same translation unit and are only dispatched to after the
+// CPUID check.
+AVX2_KERNEL UINT FrustumCuller::CullAVX2(const XMFLOAT4 *pPlanes, UINT uFirst, UINT uCount, UINT *pVisible) const {
+  const __m256 vAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 vPlane[6][4], vAbsNormal[6][3];
+  UINT n = 0;
+
+  for (int p = 0; p < 6; ++p) {
+    vPlane[p][0] = _mm256_set1_ps(pPlanes[p].x);
+    vPlane[p][1] = _mm256_set1_ps(pPlanes[p].y);
+    vPlane[p][2] = _mm256_set1_ps(pPlanes[p].z);
+    vPlane[p][3] = _mm256_set1_ps(pPlanes[p].w);
+    for (int c = 0; c < 3; ++c)
+      vAbsNormal[p][c] = _mm256_and_ps(vPlane[p][c], vAbsMask);
+  }
+
+  for (UINT i = uFirst; i < uFirst + uCount; i += 8) {
+    __m256 cx = _mm256_loadu_ps(&m_aCenterX[i]);
+    __m256 cy = _mm256_loadu_ps(&m_aCenterY[i]);
+    __m256 cz = _mm256_loadu_ps(&m_aCenterZ[i]);
+    __m256 ex = _mm256_loadu_ps(&m_aExtentX[i]);
+    __m256 ey = _mm256_loadu_ps(&m_aExtentY[i]);
+    __m256 ez = _mm256_loadu_ps(&m_aExtentZ[i]);
+    __m256 vOutside = _mm256_setzero_ps();
+
+    for (int p = 0; p < 6; ++p) {
+      __m256 vDist = _mm256_fmadd_ps(cx, vPlane[p][0],
+                     _mm256_fmadd_ps(cy, vPlane[p][1],
+                     _mm256_fmadd_ps(cz, vPlane[p][2], vPlane[p][3])));
+      __m256 vRadius = _mm256_fmadd_ps(ex, vAbsNormal[p][0],
+                       _mm256_fmadd_ps(ey, vAbsNormal[p][1],
+                       _mm256_mul_ps(ez, vAbsNormal[p][2])));
+      vOutside = _mm256_or_ps(vOutside, _mm256_cmp_ps(vDist, vRadius, _CMP_GT_OQ));
+    }
+
+    UINT mask = ~(UINT)_mm256_movemask_ps(vOutside) & 0xff;
+    UINT uRemaining = uFirst + uCount - i;
+    if (uRemaining < 8)
+      mask &= (1u << uRemaining) - 1;
+
+    n += CompactMask(mask, i, pVisible + n);
+  }
+
+  _mm256_zeroupper();
+
+  return n;
+}
+
+void FrustumCuller::CullViewsScalar(const XMFLOAT4 *pPlanes, UINT uNumViews, UINT uFirst, UINT uCount,
+                                    UINT *pViewMasks) const {
+  for (UINT i = uFirst; i < uFirst + uCount; ++i) {
+    UINT mask = 0;
+
+    for (UINT v = 0; v < uNumViews; ++v) {
+      const XMFLOAT4 *pViewPlanes = pPlanes + 6 * v;
+      bool bOutside = false;
+
+      for (int p = 0; p < 6 && !bOutside; ++p) {
+        const XMFLOAT4 &P = pViewPlanes[p];
+        float fDist = m_aCenterX[i] * P.x + m_aCenterY[i] * P.y + m_aCenterZ[i] * P.z + P.w;
+        float fRadius = m_aExtentX[i] * fabsf(P.x) + m_aExtentY[i] * fabsf(P.y) + m_aExtentZ[i] * fabsf(P.z);
+        bOutside = fDist > fRadius;
+      }
+
+      if (!bOutside)
+        mask |= 1u << v;
+    }
+
+    pViewMasks[i - uFirst] = mask;
+  }
+}
+
+void FrustumCuller::CullViewsSSE(const XMFLOAT4 *pPlanes, UINT uNumViews, UINT uFirst, UINT uCount,
+                                 UINT *pViewMasks) const {
+  const __m128 vAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  for (UINT i = uFirst; i < uFirst + uCount; i += 4) {
+    __m128 cx = _mm_loadu_ps(&m_aCenterX[i]);
+    __m128 cy = _mm_loadu_ps(&m_aCenterY[i]);
+    __m128 cz = _mm_loadu_ps(&m_aCenterZ[i]);
+    __m128 ex = _mm_loadu_ps(&m_aExtentX[i]);
+    __m128 ey = _mm_loadu_ps(&m_aExtentY[i]);
+    __m128 ez = _mm_loadu_ps(&m_aExtentZ[i]);
+    UINT aMasks[4] = {};
+
+    // Bit b of the visible mask is the box in lane b, spread it into the per-box view masks
+    for (UINT v = 0; v < uNumViews; ++v) {
+      const XMFLOAT4 *pViewPlanes = pPlanes + 6 * v;
+      __m128 vOutside = _mm_setzero_ps();
+
+      for (int p = 0; p < 6; ++p) {
+        __m128 nx = _mm_set1_ps(pViewPlanes[p].x);
+        __m128 ny = _mm_set1_ps(pViewPlanes[p].y);
+        __m128 nz = _mm_set1_ps(pViewPlanes[p].z);
+        __m128 vDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, nx), _mm_mul_ps(cy, ny)),
+                                  _mm_add_ps(_mm_mul_ps(cz, nz), _mm_set1_ps(pViewPlanes[p].w)));
+        __m128 vRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_and_ps(nx, vAbsMask)),
+                                               _mm_mul_ps(ey, _mm_and_ps(ny, vAbsMask))),
+                                    _mm_mul_ps(ez, _mm_and_ps(nz, vAbsMask)));
+        vOutside = _mm_or_ps(vOutside, _mm_cmpgt_ps(vDist, vRadius));
+      }
+
+      UINT visible = ~(UINT)_mm_movemask_ps(vOutside) & 0xf;
+      for (int b = 0; b < 4; ++b)
+        aMasks[b] |= ((visible >> b) & 1u) << v;
+    }
+
+    UINT uLanes = (std::min)(4u, uFirst + uCount - i);
+    for (UINT b = 0; b < uLanes; ++b)
+      pViewMasks[i - uFirst + b] = aMasks[b];
+  }
+}
+
+AVX2_KERNEL void FrustumCuller::CullViewsAVX2(const XMFLOAT4 *pPlanes, UINT uNumViews, UINT uFirst, UINT uCount,
+                                  UINT *pViewMasks) const {
+  const __m256 vAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+  for (UINT i = uFirst; i < uFirst + uCount; i += 8) {
+    __m256 cx = _mm256_loadu_ps(&m_aCenterX[i]);
+    __m256 cy = _mm256_loadu_ps(&m_aCenterY[i]);
+    __m256 cz = _mm256_loadu_ps(&m_aCenterZ[i]);
+    __m256 ex = _mm256_loadu_ps(&m_aExtentX[i]);
+    __m256 ey = _mm256_loadu_ps(&m_aExtentY[i]);
+    __m256 ez = _mm256_loadu_ps(&m_aExtentZ[i]);
+    UINT aMasks[8] = {};
+
+    for (UINT v = 0; v < uNumViews; ++v) {
+      const XMFLOAT4 *pViewPlanes = pPlanes + 6 * v;
+      __m256 vOutside = _mm256_setzero_ps();
+
+      for (int p = 0; p < 6; ++p) {
+        __m256 nx = _mm256_set1_ps(pViewPlanes[p].x);
+        __m256 ny = _mm256_set1_ps(pViewPlanes[p].y);
+        __m256 nz = _mm256_set1_ps(pViewPlanes[p].z);
+        __m256 vDist = _mm256_fmadd_ps(cx, nx,
+                       _mm256_fmadd_ps(cy, ny,
+                       _mm256_fmadd_ps(cz, nz, _mm256_set1_ps(pViewPlanes[p].w))));
+        __m256 vRadius = _mm256_fmadd_ps(ex, _mm256_and_ps(nx, vAbsMask),
+                         _mm256_fmadd_ps(ey, _mm256_and_ps(ny, vAbsMask),
+                         _mm256_mul_ps(ez, _mm256_and_ps(nz, vAbsMask))));
+        vOutside = _mm256_or_ps(vOutside, _mm256_cmp_ps(vDist, vRadius, _CMP_GT_OQ));
+      }
+
+      UINT visible = ~(UINT)_mm256_movemask_ps(vOutside) & 0xff;
+      for (int b = 0; b < 8; ++b)
+        aMasks[b] |= ((visible >> b) & 1u) << v;
+    }
+
+    UINT uLanes = (std::min)(8u, uFirst + uCount - i);
+    for (UINT b = 0; b < uLanes; ++b)
+      pViewMasks[i - uFirst + b] = aMasks[b];
+  }
+
+  _mm256_zeroupper();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "D3D12Types.h"
+#include <vector>
+
+///
+/// Batch AABB vs. frustum culling. Boxes are stored as structure of arrays so that
+/// the SIMD kernels test 4 (SSE) or 8 (AVX2) boxes against a plane per instruction.
+///
+class FrustumCuller {
+public:
+  enum KERNEL {
+    KERNEL_AUTO,    // Widest kernel the CPU supports
+    KERNEL_SCALAR,
+    KERNEL_SSE,
+    KERNEL_AVX2,
+  };
+
+  static constexpr UINT MAX_VIEWS = 32;
+
+  void Resize(_In_ UINT uNumBoxes);
+  UINT GetCount() const;
+
+  void SetBox(_In_ UINT uIndex, _In_ const DirectX::BoundingBox &box);
+
+  /// Test boxes [uFirst, uFirst + uCount) against six outward facing planes, in the form
+  /// DirectX::BoundingBox::ContainedBy takes, and write the indices of the boxes that are
+  /// not entirely outside to pVisible, which must hold uCount entries. Returns the number
+  /// of indices written. Slices writing to disjoint outputs may run concurrently.
+  UINT Cull(
+    _In_reads_(6) const DirectX::XMFLOAT4 *pPlanes,
+    _In_ UINT uFirst,
+    _In_ UINT uCount,
+    _Out_writes_to_(uCount, return) UINT *pVisible,
+    _In_ KERNEL eKernel = KERNEL_AUTO
+  ) const;
+
+  /// Test boxes [uFirst, uFirst + uCount) against uNumViews frustums at once, each given as
+  /// six consecutive planes in pPlanes. Bit v of pViewMasks[k] is set when box uFirst + k
+  /// is visible in view v; pViewMasks must hold uCount entries. Every box is loaded once
+  /// for all the views.
+  void CullViews(
+    _In_reads_(6 * uNumViews) const DirectX::XMFLOAT4 *pPlanes,
+    _In_ UINT uNumViews,
+    _In_ UINT uFirst,
+    _In_ UINT uCount,
+    _Out_writes_(uCount) UINT *pViewMasks,
+    _In_ KERNEL eKernel = KERNEL_AUTO
+  ) const;
+
+  static BOOL IsAVX2Supported();
+
+private:
+  UINT CullScalar(const DirectX::XMFLOAT4 *pPlanes, UINT uFirst, UINT uCount, UINT *pVisible) const;
+  UINT CullSSE(const DirectX::XMFLOAT4 *pPlanes, UINT uFirst, UINT uCount, UINT *pVisible) const;
+  UINT CullAVX2(const DirectX::XMFLOAT4 *pPlanes, UINT uFirst, UINT uCount, UINT *pVisible) const;
+  void CullViewsScalar(const DirectX::XMFLOAT4 *pPlanes, UINT uNumViews, UINT uFirst, UINT uCount, UINT *pViewMasks) const;
+  void CullViewsSSE(const DirectX::XMFLOAT4 *pPlanes, UINT uNumViews, UINT uFirst, UINT uCount, UINT *pViewMasks) const;
+  void CullViewsAVX2(const DirectX::XMFLOAT4 *pPlanes, UINT uNumViews, UINT uFirst, UINT uCount, UINT *pViewMasks) const;
+
+  KERNEL ResolveKernel(KERNEL eKernel) const;
+
+  UINT m_uNumBoxes = 0;
+
+  // Padded by one group so the wide kernels can always load 8 boxes
+  std::vector<float> m_aCenterX, m_aCenterY, m_aCenterZ;
+  std::vector<float> m_aExtentX, m_aExtentY, m_aExtentZ;
+};
+
+/// Inline implementation
+inline UINT FrustumCuller::GetCount() const {
+  return m_uNumBoxes;
+}
+
+inline void FrustumCuller::SetBox(_In_ UINT uIndex, _In_ const DirectX::BoundingBox &box) {
+  m_aCenterX[uIndex] = box.Center.x;
+  m_aCenterY[uIndex] = box.Center.y;
+  m_aCenterZ[uIndex] = box.Center.z;
+  m_aExtentX[uIndex] = box.Extents.x;
+  m_aExtentY[uIndex] = box.Extents.y;
+  m_aExtentZ[uIndex] = box.Extents.z;
+}
@@ -0,0 +1,60 @@
+#include "IndirectDrawBuilder.h"
+#include <cstring>
+
+void IndirectDrawBuilder::GetArgumentDescs(_In_ UINT uRootParameterIndex,
+                                           _Out_writes_(NUM_ARGUMENT_DESCS) D3D12_INDIRECT_ARGUMENT_DESC *pDescs) {
+  memset(pDescs, 0, NUM_ARGUMENT_DESCS * sizeof(D3D12_INDIRECT_ARGUMENT_DESC));
+
+  pDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+  pDescs[0].VertexBuffer.Slot = 0;
+  pDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+  pDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+  pDescs[2].Constant.RootParameterIndex = uRootParameterIndex;
+  pDescs[2].Constant.DestOffsetIn32BitValues = 0;
+  pDescs[2].Constant.Num32BitValuesToSet = 1;
+  pDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+}
+
+void IndirectDrawBuilder::Reset() {
+  m_aDraws.clear();
+  m_VBV = {};
+  m_IBV = {};
+  m_uAddedDraws = 0;
+}
+
+void IndirectDrawBuilder::SetBuffers(_In_ const D3D12_VERTEX_BUFFER_VIEW &VBV, _In_ const D3D12_INDEX_BUFFER_VIEW &IBV) {
+  m_VBV = VBV;
+  m_IBV = IBV;
+}
+
+void IndirectDrawBuilder::AddDraw(_In_ UINT uRootConstant, _In_ UINT uIndexCount, _In_ UINT uStartIndex,
+                                  _In_ INT iBaseVertex, _In_ UINT uInstanceCount, _In_ UINT uStartInstance) {
+  ++m_uAddedDraws;
+  if (uIndexCount == 0 || uInstanceCount == 0)
+    return;
+
+  // Meshes sharing the buffers often draw consecutive index ranges, the views are compared
+  // rather than tracked since SetBuffers may be handed the same ones again
+  if (!m_aDraws.empty()) {
+    INDIRECT_DRAW_ARGS &prev = m_aDraws.back();
+
+    if (prev.RootConstant == uRootConstant && prev.Draw.BaseVertexLocation == iBaseVertex &&
+        prev.Draw.InstanceCount == uInstanceCount && prev.Draw.StartInstanceLocation == uStartInstance &&
+        prev.Draw.StartIndexLocation + prev.Draw.IndexCountPerInstance == uStartIndex &&
+        !memcmp(&prev.VBV, &m_VBV, sizeof(m_VBV)) && !memcmp(&prev.IBV, &m_IBV, sizeof(m_IBV))) {
+      prev.Draw.IndexCountPerInstance += uIndexCount;
+      return;
+    }
+  }
+
+  INDIRECT_DRAW_ARGS args;
+  args.VBV = m_VBV;
+  args.IBV = m_IBV;
+  args.RootConstant = uRootConstant;
+  args.Draw.IndexCountPerInstance = uIndexCount;
+  args.Draw.InstanceCount = uInstanceCount;
+  args.Draw.StartIndexLocation = uStartIndex;
+  args.Draw.BaseVertexLocation = iBaseVertex;
+  args.Draw.StartInstanceLocation = uStartInstance;
+  m_aDraws.push_back(args);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "D3D12Types.h"
+#include <vector>
+
+/// One command of an ExecuteIndirect argument buffer, the arguments in the order
+/// IndirectDrawBuilder::GetArgumentDescs lists them. Every member is naturally aligned
+/// without padding, which is how the GPU reads consecutive arguments.
+struct INDIRECT_DRAW_ARGS {
+  D3D12_VERTEX_BUFFER_VIEW VBV;   // Vertex buffer slot 0
+  D3D12_INDEX_BUFFER_VIEW IBV;
+  UINT RootConstant;              // One 32-bit root constant, a material index for instance
+  D3D12_DRAW_INDEXED_ARGUMENTS Draw;
+};
+static_assert(sizeof(INDIRECT_DRAW_ARGS) == 56, "Indirect arguments must be tightly packed");
+
+///
+/// Builds the argument buffer of an indexed ExecuteIndirect on the CPU. Draws are added
+/// after the buffers they read, and a draw continuing the previous one - same buffers, root
+/// constant, base vertex and instances, with the next index range - extends it instead of
+/// taking a command of its own. Draws without indices are dropped.
+///
+/// Like InstanceBatcher it needs no device, the arguments are plain memory until the caller
+/// copies them to an upload buffer.
+///
+class IndirectDrawBuilder {
+public:
+  enum { NUM_ARGUMENT_DESCS = 4 };
+
+  /// Arguments of the command signature matching INDIRECT_DRAW_ARGS, the root constant goes
+  /// to uRootParameterIndex. The signature's stride is sizeof(INDIRECT_DRAW_ARGS).
+  static void GetArgumentDescs(_In_ UINT uRootParameterIndex,
+                               _Out_writes_(NUM_ARGUMENT_DESCS) D3D12_INDIRECT_ARGUMENT_DESC *pDescs);
+
+  /// Drops the draws, the memory is kept.
+  void Reset();
+
+  /// Buffers of the draws added next.
+  void SetBuffers(_In_ const D3D12_VERTEX_BUFFER_VIEW &VBV, _In_ const D3D12_INDEX_BUFFER_VIEW &IBV);
+  void AddDraw(_In_ UINT uRootConstant, _In_ UINT uIndexCount, _In_ UINT uStartIndex, _In_ INT iBaseVertex,
+               _In_ UINT uInstanceCount = 1, _In_ UINT uStartInstance = 0);
+
+  UINT GetDrawCount() const;
+  const INDIRECT_DRAW_ARGS *GetDraws() const;
+  /// Draws AddDraw was called with, before merging.
+  UINT GetAddedDrawCount() const;
+
+private:
+  std::vector<INDIRECT_DRAW_ARGS> m_aDraws;
+  D3D12_VERTEX_BUFFER_VIEW m_VBV = {};
+  D3D12_INDEX_BUFFER_VIEW m_IBV = {};
+  UINT m_uAddedDraws = 0;
+};
+
+/// Inline implementation
+inline UINT IndirectDrawBuilder::GetDrawCount() const {
+  return (UINT)m_aDraws.size();
+}
+
+inline const INDIRECT_DRAW_ARGS *IndirectDrawBuilder::GetDraws() const {
+  return m_aDraws.data();
+}
+
+inline UINT IndirectDrawBuilder::GetAddedDrawCount() const {
+  return m_uAddedDraws;
+}
@@ -0,0 +1,76 @@
+#include "InstanceBatcher.h"
+#include <cstring>
+
+InstanceBatcher::InstanceBatcher() {
+  Begin(0);
+}
+
+void InstanceBatcher::Begin(_In_ UINT uInstanceDataSize) {
+  m_uInstanceDataSize = uInstanceDataSize;
+  m_aDraws.clear();
+  m_aDrawData.clear();
+  m_aBatches.clear();
+  m_aInstanceData.clear();
+}
+
+void InstanceBatcher::Add(_In_ UINT uMeshKey, _In_ const INSTANCE_DRAW_STATE &State,
+                          _In_reads_bytes_(m_uInstanceDataSize) const void *pInstanceData) {
+  const BYTE *pData = reinterpret_cast<const BYTE *>(pInstanceData);
+
+  m_aDraws.push_back({uMeshKey, State});
+  m_aDrawData.insert(m_aDrawData.end(), pData, pData + m_uInstanceDataSize);
+}
+
+BOOL InstanceBatcher::IsSameBatch(const INSTANCE_BATCH &Batch, UINT uMeshKey, const INSTANCE_DRAW_STATE &State) {
+  if (Batch.MeshKey != uMeshKey || Batch.State.pQueryHeap || State.pQueryHeap)
+    return FALSE;
+
+  if (Batch.State.pPredicationBuffer != State.pPredicationBuffer)
+    return FALSE;
+
+  return !State.pPredicationBuffer || (Batch.State.uPredicationOffset == State.uPredicationOffset &&
+                                       Batch.State.PredicationOp == State.PredicationOp);
+}
+
+void InstanceBatcher::End(_In_ BOOL bBatch) {
+  const UINT uNumDraws = (UINT)m_aDraws.size();
+  UINT uFirstInstance = 0;
+
+  m_aBatches.clear();
+  m_aDrawBatches.resize(uNumDraws);
+
+  // Linear in the batches, which are about as many as the unique meshes
+  for (UINT i = 0; i < uNumDraws; ++i) {
+    const DRAW &draw = m_aDraws[i];
+    UINT uBatch = 0;
+
+    for (; bBatch && uBatch < m_aBatches.size(); ++uBatch) {
+      if (IsSameBatch(m_aBatches[uBatch], draw.MeshKey, draw.State))
+        break;
+    }
+    if (!bBatch || uBatch == m_aBatches.size()) {
+      uBatch = (UINT)m_aBatches.size();
+      m_aBatches.push_back({draw.MeshKey, draw.State, 0, 0});
+    }
+
+    m_aDrawBatches[i] = uBatch;
+    ++m_aBatches[uBatch].NumInstances;
+  }
+
+  for (auto &batch : m_aBatches) {
+    batch.FirstInstance = uFirstInstance;
+    uFirstInstance += batch.NumInstances;
+    batch.NumInstances = 0;
+  }
+
+  // Stable within a batch, its instances keep the order they were added in
+  m_aInstanceData.resize(m_aDrawData.size());
+  for (UINT i = 0; i < uNumDraws; ++i) {
+    INSTANCE_BATCH &batch = m_aBatches[m_aDrawBatches[i]];
+    UINT uInstance = batch.FirstInstance + batch.NumInstances++;
+
+    if (m_uInstanceDataSize > 0)
+      memcpy(&m_aInstanceData[uInstance * m_uInstanceDataSize], &m_aDrawData[i * m_uInstanceDataSize],
+             m_uInstanceDataSize);
+  }
+}
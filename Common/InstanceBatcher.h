@@ -0,0 +1,90 @@
+#pragma once
+#include "D3D12Types.h"
+#include <vector>
+
+/// GPU state of a single draw that instancing can not share. A draw with an occlusion
+/// query never joins a batch, the query has to bracket that draw alone.
+struct INSTANCE_DRAW_STATE {
+  ID3D12Resource *pPredicationBuffer;   // nullptr when the draw is not predicated
+  UINT64 uPredicationOffset;
+  D3D12_PREDICATION_OP PredicationOp;
+  ID3D12QueryHeap *pQueryHeap;          // nullptr when the draw is not queried
+  D3D12_QUERY_TYPE QueryType;
+  UINT uQueryIndex;
+};
+
+/// Instances drawn with one DrawIndexedInstanced per subset of the mesh. Their data is
+/// contiguous in the batcher's instance data, starting at FirstInstance.
+struct INSTANCE_BATCH {
+  UINT MeshKey;
+  INSTANCE_DRAW_STATE State;
+  UINT FirstInstance;
+  UINT NumInstances;
+};
+
+///
+/// Groups repeated draws of the same mesh into instanced batches. Every draw is added with
+/// a mesh key, which the caller maps to a mesh and the subsets and materials it draws, its
+/// draw state and a fixed size block of instance data. End puts draws with the same key and
+/// state into one batch, in the order the batches first appear, and packs the instance data
+/// batch by batch so that each batch reads a single range. Draws whose state differs from
+/// every other draw, like predication on their own query result, end up in batches of one:
+/// the per draw fallback. Submission then costs a draw per batch rather than per instance.
+///
+class InstanceBatcher {
+public:
+  InstanceBatcher();
+
+  /// Starts a new set of draws, each carrying uInstanceDataSize bytes of instance data. The
+  /// memory of the previous set is kept.
+  void Begin(_In_ UINT uInstanceDataSize);
+  void Add(_In_ UINT uMeshKey, _In_ const INSTANCE_DRAW_STATE &State,
+           _In_reads_bytes_(m_uInstanceDataSize) const void *pInstanceData);
+  /// Builds the batches of the draws added since Begin. Without bBatch every draw gets a
+  /// batch of its own, in the order it was added.
+  void End(_In_ BOOL bBatch = TRUE);
+
+  UINT GetBatchCount() const;
+  const INSTANCE_BATCH &GetBatch(_In_ UINT uBatch) const;
+
+  /// Instance data of all the batches, GetInstanceCount blocks of GetInstanceDataSize bytes.
+  const BYTE *GetInstanceData() const;
+  UINT GetInstanceCount() const;
+  UINT GetInstanceDataSize() const;
+
+private:
+  static BOOL IsSameBatch(const INSTANCE_BATCH &Batch, UINT uMeshKey, const INSTANCE_DRAW_STATE &State);
+
+  struct DRAW {
+    UINT MeshKey;
+    INSTANCE_DRAW_STATE State;
+  };
+
+  UINT m_uInstanceDataSize;
+  std::vector<DRAW> m_aDraws;
+  std::vector<BYTE> m_aDrawData;       // Instance data of the draws as they were added
+  std::vector<UINT> m_aDrawBatches;    // Scratch, batch of every draw
+  std::vector<INSTANCE_BATCH> m_aBatches;
+  std::vector<BYTE> m_aInstanceData;   // Instance data in batch order
+};
+
+/// Inline implementation
+inline UINT InstanceBatcher::GetBatchCount() const {
+  return (UINT)m_aBatches.size();
+}
+
+inline const INSTANCE_BATCH &InstanceBatcher::GetBatch(_In_ UINT uBatch) const {
+  return m_aBatches[uBatch];
+}
+
+inline const BYTE *InstanceBatcher::GetInstanceData() const {
+  return m_aInstanceData.data();
+}
+
+inline UINT InstanceBatcher::GetInstanceCount() const {
+  return (UINT)m_aDraws.size();
+}
+
+inline UINT InstanceBatcher::GetInstanceDataSize() const {
+  return m_uInstanceDataSize;
+}
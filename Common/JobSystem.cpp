@@ -0,0 +1,360 @@
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+thread_local const JobSystem *t_pJobSystem = nullptr;
+thread_local int t_iWorkerIndex = -1;
+thread_local uint32_t t_uRandomState = 0;
+
+// Number of failed attempts to find work before a worker goes to sleep
+const int s_iIdleSpinCount = 64;
+
+uint32_t NextRandom() {
+  // xorshift32, seeded from the thread's address
+  uint32_t x = t_uRandomState;
+  if (x == 0)
+    x = (uint32_t)(uintptr_t)&t_uRandomState | 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  t_uRandomState = x;
+  return x;
+}
+} // namespace
+
+// Owner only
+bool JobSystem::WorkerDeque::Push(Job *pJob) {
+  int64_t b = Bottom.load(std::memory_order_relaxed);
+  int64_t t = Top.load(std::memory_order_acquire);
+
+  if (b - t >= DEQUE_CAPACITY)
+    return false;
+
+  aJobs[b & (DEQUE_CAPACITY - 1)].store(pJob, std::memory_order_relaxed);
+  Bottom.store(b + 1, std::memory_order_release);
+  return true;
+}
+
+// Owner only
+JobSystem::Job *JobSystem::WorkerDeque::Pop() {
+  int64_t b = Bottom.load(std::memory_order_relaxed) - 1;
+  Bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = Top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    Bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job *pJob = aJobs[b & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+  if (t == b) {
+    // Last job, race the thieves for it
+    if (!Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      pJob = nullptr;
+    Bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return pJob;
+}
+
+// Any thread
+JobSystem::Job *JobSystem::WorkerDeque::Steal() {
+  int64_t t = Top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = Bottom.load(std::memory_order_acquire);
+
+  if (t >= b)
+    return nullptr;
+
+  Job *pJob = aJobs[t & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+  if (!Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    return nullptr;
+  return pJob;
+}
+
+JobSystem::JobSystem()
+    : m_uNumWorkers(0), m_uNumActiveWorkers(0), m_uInjectedCount(0), m_uSubmitEpoch(0), m_uSleepers(0), m_bQuit(false) {}
+
+JobSystem::~JobSystem() {
+  Shutdown();
+}
+
+void JobSystem::Initialize(uint32_t uNumWorkers) {
+  Shutdown();
+
+  if (uNumWorkers == 0) {
+    uint32_t uHardwareThreads = std::thread::hardware_concurrency();
+    uNumWorkers = uHardwareThreads > 1 ? uHardwareThreads - 1 : 1;
+  }
+
+  m_uNumWorkers = uNumWorkers;
+  m_uNumActiveWorkers.store(uNumWorkers);
+  m_aDeques.reset(new WorkerDeque[uNumWorkers + 1]);
+  for (uint32_t i = 0; i <= uNumWorkers; ++i) {
+    m_aDeques[i].Top.store(0, std::memory_order_relaxed);
+    m_aDeques[i].Bottom.store(0, std::memory_order_relaxed);
+    m_aDeques[i].Domain.store(0, std::memory_order_relaxed);
+  }
+  m_bQuit.store(false);
+
+  t_pJobSystem = this;
+  t_iWorkerIndex = 0;
+
+  m_aThreads.reserve(uNumWorkers);
+  for (uint32_t i = 1; i <= uNumWorkers; ++i)
+    m_aThreads.emplace_back(&JobSystem::WorkerThreadProc, this, (int)i);
+}
+
+void JobSystem::Shutdown() {
+  if (!m_aDeques)
+    return;
+
+  // Drain everything still queued so no counter is left pending
+  for (Job *pJob; (pJob = GetJob(GetCurrentWorkerIndex())) != nullptr;)
+    Execute(pJob);
+
+  {
+    std::lock_guard<std::mutex> lock(m_SleepLock);
+    m_bQuit.store(true);
+  }
+  m_WakeCondition.notify_all();
+  m_ParkCondition.notify_all();
+
+  for (auto &thread : m_aThreads)
+    thread.join();
+  m_aThreads.clear();
+
+  // Jobs still running above may have queued more, or released parked ones, before their
+  // worker saw the quit flag. Their deques can still be stolen from.
+  for (Job *pJob; (pJob = GetJob(GetCurrentWorkerIndex())) != nullptr;)
+    Execute(pJob);
+
+  if (t_pJobSystem == this) {
+    t_pJobSystem = nullptr;
+    t_iWorkerIndex = -1;
+  }
+  m_aDeques.reset();
+  m_uNumWorkers = 0;
+  m_uNumActiveWorkers.store(0);
+}
+
+std::thread::native_handle_type JobSystem::GetWorkerNativeHandle(uint32_t uWorker) {
+  return m_aThreads[uWorker - 1].native_handle();
+}
+
+void JobSystem::SetWorkerDomains(const uint32_t *pDomains) {
+  for (uint32_t i = 0; i <= m_uNumWorkers; ++i)
+    m_aDeques[i].Domain.store(pDomains[i], std::memory_order_relaxed);
+}
+
+void JobSystem::SetActiveWorkerCount(uint32_t uNumActive) {
+  {
+    std::lock_guard<std::mutex> lock(m_SleepLock);
+    m_uNumActiveWorkers.store((std::min)(uNumActive, m_uNumWorkers), std::memory_order_relaxed);
+  }
+  m_ParkCondition.notify_all();
+  // Sleepers beyond the new count must move over to the park condition
+  m_WakeCondition.notify_all();
+}
+
+int JobSystem::GetCurrentWorkerIndex() const {
+  return t_pJobSystem == this ? t_iWorkerIndex : -1;
+}
+
+void JobSystem::Run(JobFunction Function, JobCounter *pCounter, JobCounter *pDependency) {
+  Job *pJob = new Job{std::move(Function), pCounter};
+
+  if (pCounter)
+    pCounter->m_uValue.fetch_add(1, std::memory_order_relaxed);
+
+  if (pDependency) {
+    std::lock_guard<std::mutex> lock(pDependency->m_Lock);
+    if (pDependency->m_uValue.load(std::memory_order_acquire) != 0) {
+      pDependency->m_aWaitingJobs.push_back(pJob);
+      return;
+    }
+  }
+
+  Submit(pJob);
+}
+
+void JobSystem::Wait(JobCounter *pCounter) {
+  int iWorkerIndex = GetCurrentWorkerIndex();
+
+  while (pCounter->m_uValue.load(std::memory_order_acquire) != 0) {
+    Job *pJob = GetJob(iWorkerIndex);
+    if (pJob)
+      Execute(pJob);
+    else
+      std::this_thread::yield();
+  }
+
+  // The last decrement may still be releasing the lock, do not let the counter die before
+  std::lock_guard<std::mutex> lock(pCounter->m_Lock);
+}
+
+void JobSystem::ParallelFor(uint32_t uBegin, uint32_t uEnd, uint32_t uGrain, const RangeFunction &Function) {
+  if (uEnd <= uBegin)
+    return;
+
+  JobCounter counter;
+  SplitRange(uBegin, uEnd, (std::max)(uGrain, 1u), Function, &counter);
+  Wait(&counter);
+}
+
+void JobSystem::SplitRange(uint32_t uBegin, uint32_t uEnd, uint32_t uGrain, const RangeFunction &Function,
+                           JobCounter *pCounter) {
+  // Hand the upper halves out and keep going with the lower one
+  while (uEnd - uBegin > uGrain) {
+    uint32_t uMid = uBegin + (uEnd - uBegin) / 2;
+    Run([=, &Function]() { SplitRange(uMid, uEnd, uGrain, Function, pCounter); }, pCounter);
+    uEnd = uMid;
+  }
+
+  Function(uBegin, uEnd);
+}
+
+void JobSystem::Submit(Job *pJob) {
+  int iWorkerIndex = GetCurrentWorkerIndex();
+
+  if (iWorkerIndex >= 0) {
+    // A full deque means plenty of queued work, running it inline is fine
+    if (!m_aDeques[iWorkerIndex].Push(pJob)) {
+      Execute(pJob);
+      return;
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(m_InjectionLock);
+    m_InjectionQueue.push_back(pJob);
+    m_uInjectedCount.fetch_add(1, std::memory_order_release);
+  }
+
+  WakeWorkers();
+}
+
+JobSystem::Job *JobSystem::GetJob(int iWorkerIndex) {
+  Job *pJob = nullptr;
+
+  if (iWorkerIndex >= 0 && (pJob = m_aDeques[iWorkerIndex].Pop()) != nullptr)
+    return pJob;
+
+  if (m_uInjectedCount.load(std::memory_order_acquire) != 0) {
+    std::lock_guard<std::mutex> lock(m_InjectionLock);
+    if (!m_InjectionQueue.empty()) {
+      pJob = m_InjectionQueue.front();
+      m_InjectionQueue.pop_front();
+      m_uInjectedCount.fetch_sub(1, std::memory_order_relaxed);
+      return pJob;
+    }
+  }
+
+  // Steal, starting from a random victim so thieves spread out. Victims of the thief's own
+  // domain go first, what they work on is more likely in a cache the thief shares.
+  uint32_t uNumDeques = m_uNumWorkers + 1;
+  uint32_t uStart = NextRandom() % uNumDeques;
+  uint32_t uDomain = iWorkerIndex >= 0 ? m_aDeques[iWorkerIndex].Domain.load(std::memory_order_relaxed) : 0;
+  for (int iPass = 0; iPass < 2; ++iPass) {
+    for (uint32_t i = 0; i < uNumDeques; ++i) {
+      uint32_t uVictim = (uStart + i) % uNumDeques;
+      if ((int)uVictim == iWorkerIndex ||
+          (m_aDeques[uVictim].Domain.load(std::memory_order_relaxed) == uDomain) != (iPass == 0))
+        continue;
+      if ((pJob = m_aDeques[uVictim].Steal()) != nullptr)
+        return pJob;
+    }
+  }
+
+  return nullptr;
+}
+
+void JobSystem::Execute(Job *pJob) {
+  pJob->Function();
+
+  if (pJob->pCounter)
+    Complete(pJob->pCounter);
+  delete pJob;
+}
+
+void JobSystem::Complete(JobCounter *pCounter) {
+  uint32_t uValue = pCounter->m_uValue.load(std::memory_order_relaxed);
+
+  // Only the decrement to zero takes the lock, it releases the parked dependents
+  for (;;) {
+    if (uValue == 1) {
+      std::vector<Job *> aReleased;
+      {
+        std::lock_guard<std::mutex> lock(pCounter->m_Lock);
+        if (pCounter->m_uValue.fetch_sub(1, std::memory_order_acq_rel) == 1)
+          aReleased.swap(pCounter->m_aWaitingJobs);
+      }
+      for (Job *pJob : aReleased)
+        Submit(pJob);
+      return;
+    }
+    if (pCounter->m_uValue.compare_exchange_weak(uValue, uValue - 1, std::memory_order_acq_rel,
+                                                 std::memory_order_relaxed))
+      return;
+  }
+}
+
+void JobSystem::WakeWorkers() {
+  m_uSubmitEpoch.fetch_add(1, std::memory_order_seq_cst);
+
+  if (m_uSleepers.load(std::memory_order_seq_cst) != 0) {
+    std::lock_guard<std::mutex> lock(m_SleepLock);
+    m_WakeCondition.notify_one();
+  }
+}
+
+void JobSystem::WorkerThreadProc(int iWorkerIndex) {
+  t_pJobSystem = this;
+  t_iWorkerIndex = iWorkerIndex;
+
+  char szThreadName[CpuProfiler::MAX_THREAD_NAME];
+  snprintf(szThreadName, sizeof(szThreadName), "Job worker %d", iWorkerIndex);
+  CpuProfiler::SetThreadName(szThreadName);
+
+  while (!m_bQuit.load(std::memory_order_acquire)) {
+
+    if ((uint32_t)iWorkerIndex > m_uNumActiveWorkers.load(std::memory_order_relaxed)) {
+      // Thieves would get to them eventually, but not before the frame is waiting on them
+      for (Job *pJob; (pJob = m_aDeques[iWorkerIndex].Pop()) != nullptr;)
+        Execute(pJob);
+
+      std::unique_lock<std::mutex> lock(m_SleepLock);
+      m_ParkCondition.wait(lock, [&]() {
+        return m_bQuit.load(std::memory_order_relaxed) ||
+               (uint32_t)iWorkerIndex <= m_uNumActiveWorkers.load(std::memory_order_relaxed);
+      });
+      continue;
+    }
+
+    uint64_t uEpoch = m_uSubmitEpoch.load(std::memory_order_seq_cst);
+    Job *pJob = nullptr;
+
+    for (int i = 0; i < s_iIdleSpinCount && !pJob; ++i) {
+      pJob = GetJob(iWorkerIndex);
+      if (!pJob)
+        std::this_thread::yield();
+    }
+
+    if (pJob) {
+      Execute(pJob);
+      continue;
+    }
+
+    // Nothing was submitted since the epoch was sampled, sleep until something is
+    std::unique_lock<std::mutex> lock(m_SleepLock);
+    m_uSleepers.fetch_add(1, std::memory_order_seq_cst);
+    m_WakeCondition.wait(lock, [&]() {
+      return m_bQuit.load(std::memory_order_relaxed) || m_uSubmitEpoch.load(std::memory_order_seq_cst) != uEpoch ||
+             (uint32_t)iWorkerIndex > m_uNumActiveWorkers.load(std::memory_order_relaxed);
+    });
+    m_uSleepers.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  t_pJobSystem = nullptr;
+  t_iWorkerIndex = -1;
+}
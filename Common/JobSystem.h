@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+
+///
+/// Work-stealing job system built on the C++ standard library only, so it is usable by
+/// every sample and outside of Windows. Every worker owns a Chase-Lev deque: it pushes and
+/// pops at the bottom while idle workers steal from the top. Jobs submitted from threads
+/// that do not belong to the system go through a shared injection queue.
+///
+class JobSystem;
+
+/// Number of jobs still pending. A counter must outlive the jobs it tracks, waiting on it
+/// before it goes out of scope is enough.
+class JobCounter {
+public:
+  JobCounter();
+  JobCounter(const JobCounter &) = delete;
+  JobCounter &operator=(const JobCounter &) = delete;
+
+  uint32_t GetValue() const;
+  bool IsDone() const;
+
+private:
+  friend class JobSystem;
+  struct Job;
+
+  std::atomic<uint32_t> m_uValue;
+  // Guards the last decrement against jobs being parked on the counter
+  std::mutex m_Lock;
+  std::vector<Job *> m_aWaitingJobs;
+};
+
+class JobSystem {
+public:
+  typedef std::function<void()> JobFunction;
+  typedef std::function<void(uint32_t uBegin, uint32_t uEnd)> RangeFunction;
+
+  enum { DEQUE_CAPACITY = 4096 };
+
+  JobSystem();
+  ~JobSystem();
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  /// The calling thread becomes worker 0 and helps while it waits. uNumWorkers background
+  /// threads are started, 0 picks one less than the hardware threads.
+  void Initialize(uint32_t uNumWorkers = 0);
+  void Shutdown();
+
+  /// Background threads, the initializing thread not included.
+  uint32_t GetWorkerCount() const;
+
+  /// Only the first uNumActive background threads take jobs, the others drain their own
+  /// deque and park until they are let back in. Starts out with every thread active.
+  void SetActiveWorkerCount(uint32_t uNumActive);
+  uint32_t GetActiveWorkerCount() const;
+
+  /// Native handle of background thread uWorker, 1..GetWorkerCount(), for placing it.
+  std::thread::native_handle_type GetWorkerNativeHandle(uint32_t uWorker);
+
+  /// Group the workers by the cache or memory domain they run in, pDomains holds one entry
+  /// per worker, the initializing thread first. Thieves try victims of their own domain
+  /// before crossing to another one.
+  void SetWorkerDomains(const uint32_t *pDomains);
+
+  /// Queue a job. pCounter, when given, is incremented now and decremented once the job
+  /// has run. With pDependency the job is only queued after that counter reaches zero.
+  void Run(JobFunction Function, JobCounter *pCounter = nullptr, JobCounter *pDependency = nullptr);
+
+  /// Run other jobs until the counter reaches zero.
+  void Wait(JobCounter *pCounter);
+
+  /// Calls Function on disjoint subranges of [uBegin, uEnd) no longer than uGrain and
+  /// returns when all of them are done. The range is split in halves recursively, so
+  /// thieves take the largest remaining pieces.
+  void ParallelFor(uint32_t uBegin, uint32_t uEnd, uint32_t uGrain, const RangeFunction &Function);
+
+  /// 0 for the initializing thread, 1..GetWorkerCount() for the background threads and
+  /// -1 for threads not belonging to this system.
+  int GetCurrentWorkerIndex() const;
+
+private:
+  typedef JobCounter::Job Job;
+
+  struct WorkerDeque {
+    alignas(64) std::atomic<int64_t> Top;
+    alignas(64) std::atomic<int64_t> Bottom;
+    alignas(64) std::atomic<Job *> aJobs[DEQUE_CAPACITY];
+    std::atomic<uint32_t> Domain;
+
+    bool Push(Job *pJob);
+    Job *Pop();
+    Job *Steal();
+  };
+
+  void WorkerThreadProc(int iWorkerIndex);
+  void Submit(Job *pJob);
+  Job *GetJob(int iWorkerIndex);
+  void Execute(Job *pJob);
+  void Complete(JobCounter *pCounter);
+  void WakeWorkers();
+  void SplitRange(uint32_t uBegin, uint32_t uEnd, uint32_t uGrain, const RangeFunction &Function,
+                  JobCounter *pCounter);
+
+  uint32_t m_uNumWorkers;
+  std::atomic<uint32_t> m_uNumActiveWorkers;
+  std::unique_ptr<WorkerDeque[]> m_aDeques;
+  std::vector<std::thread> m_aThreads;
+
+  std::mutex m_InjectionLock;
+  std::deque<Job *> m_InjectionQueue;
+  std::atomic<uint32_t> m_uInjectedCount;
+
+  // Idle workers sleep until the submit epoch changes
+  std::mutex m_SleepLock;
+  std::condition_variable m_WakeCondition;
+  // Workers beyond the active count wait here, apart so they never swallow a wake up
+  std::condition_variable m_ParkCondition;
+  std::atomic<uint64_t> m_uSubmitEpoch;
+  std::atomic<uint32_t> m_uSleepers;
+  std::atomic<bool> m_bQuit;
+};
+
+struct JobCounter::Job {
+  JobSystem::JobFunction Function;
+  JobCounter *pCounter;
+};
+
+/// Inline implementation
+inline JobCounter::JobCounter() : m_uValue(0) {}
+
+inline uint32_t JobCounter::GetValue() const {
+  return m_uValue.load(std::memory_order_acquire);
+}
+
+inline bool JobCounter::IsDone() const {
+  return GetValue() == 0;
+}
+
+inline uint32_t JobSystem::GetWorkerCount() const {
+  return m_uNumWorkers;
+}
+
+inline uint32_t JobSystem::GetActiveWorkerCount() const {
+  return m_uNumActiveWorkers.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,111 @@
+#include "RadixSort.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cstring>
+
+void RadixSorter::Sort(uint64_t *pKeys, uint32_t *pValues, uint32_t uCount, JobSystem *pJobSystem) {
+  uint32_t uNumBlocks = 1;
+  uint32_t aPasses[NUM_PASSES];
+  uint32_t uNumPasses = 0;
+
+  m_uLastPassCount = 0;
+  if (uCount < 2)
+    return;
+
+  // Blocks of at least a quarter of the threshold, one per thread
+  if (pJobSystem && uCount >= PARALLEL_THRESHOLD)
+    uNumBlocks = (std::min)({(uint32_t)MAX_BLOCKS, pJobSystem->GetActiveWorkerCount() + 1,
+                             uCount / (PARALLEL_THRESHOLD / 4)});
+
+  m_aKeyScratch.resize(uCount);
+  m_aValueScratch.resize(uCount);
+  m_aBlockCounts.resize(uNumBlocks * NUM_PASSES * NUM_DIGITS);
+  m_aBlockOffsets.resize(uNumBlocks * NUM_DIGITS);
+
+  auto ForEachBlock = [&](const std::function<void(uint32_t, uint32_t, uint32_t)> &Function) {
+    auto BlockRange = [&](uint32_t uBlockBegin, uint32_t uBlockEnd) {
+      for (uint32_t b = uBlockBegin; b < uBlockEnd; ++b)
+        Function(b, (uint32_t)((uint64_t)uCount * b / uNumBlocks), (uint32_t)((uint64_t)uCount * (b + 1) / uNumBlocks));
+    };
+
+    if (uNumBlocks == 1)
+      BlockRange(0, 1);
+    else
+      pJobSystem->ParallelFor(0, uNumBlocks, 1, BlockRange);
+  };
+
+  // The digit counts of every pass at once, as a whole they do not depend on the order
+  ForEachBlock([&](uint32_t b, uint32_t uBegin, uint32_t uEnd) {
+    uint32_t *aCounts = &m_aBlockCounts[b * NUM_PASSES * NUM_DIGITS];
+
+    memset(aCounts, 0, NUM_PASSES * NUM_DIGITS * sizeof(uint32_t));
+    for (uint32_t i = uBegin; i < uEnd; ++i) {
+      uint64_t uKey = pKeys[i];
+      for (uint32_t p = 0; p < NUM_PASSES; ++p, uKey >>= DIGIT_BITS)
+        ++aCounts[p * NUM_DIGITS + (uKey & (NUM_DIGITS - 1))];
+    }
+  });
+
+  for (uint32_t p = 0; p < NUM_PASSES; ++p) {
+    bool bUniform = false;
+
+    for (uint32_t d = 0; d < NUM_DIGITS && !bUniform; ++d) {
+      uint32_t uTotal = 0;
+      for (uint32_t b = 0; b < uNumBlocks; ++b)
+        uTotal += m_aBlockCounts[(b * NUM_PASSES + p) * NUM_DIGITS + d];
+      bUniform = uTotal == uCount;
+    }
+
+    if (!bUniform)
+      aPasses[uNumPasses++] = p;
+  }
+
+  uint64_t *pSrcKeys = pKeys, *pDstKeys = m_aKeyScratch.data();
+  uint32_t *pSrcValues = pValues, *pDstValues = m_aValueScratch.data();
+
+  for (uint32_t j = 0; j < uNumPasses; ++j) {
+    const uint32_t p = aPasses[j];
+    const uint32_t uShift = p * DIGIT_BITS;
+
+    // Blocks hold other keys once a pass moved them, a single block holds all of them
+    if (j > 0 && uNumBlocks > 1) {
+      ForEachBlock([&](uint32_t b, uint32_t uBegin, uint32_t uEnd) {
+        uint32_t *aCounts = &m_aBlockCounts[(b * NUM_PASSES + p) * NUM_DIGITS];
+
+        memset(aCounts, 0, NUM_DIGITS * sizeof(uint32_t));
+        for (uint32_t i = uBegin; i < uEnd; ++i)
+          ++aCounts[(pSrcKeys[i] >> uShift) & (NUM_DIGITS - 1)];
+      });
+    }
+
+    // Digit major, block minor, so every block writes its keys of a digit after the
+    // blocks before it
+    uint32_t uOffset = 0;
+    for (uint32_t d = 0; d < NUM_DIGITS; ++d) {
+      for (uint32_t b = 0; b < uNumBlocks; ++b) {
+        m_aBlockOffsets[b * NUM_DIGITS + d] = uOffset;
+        uOffset += m_aBlockCounts[(b * NUM_PASSES + p) * NUM_DIGITS + d];
+      }
+    }
+
+    ForEachBlock([&](uint32_t b, uint32_t uBegin, uint32_t uEnd) {
+      uint32_t *aOffsets = &m_aBlockOffsets[b * NUM_DIGITS];
+
+      for (uint32_t i = uBegin; i < uEnd; ++i) {
+        uint32_t uDst = aOffsets[(pSrcKeys[i] >> uShift) & (NUM_DIGITS - 1)]++;
+        pDstKeys[uDst] = pSrcKeys[i];
+        pDstValues[uDst] = pSrcValues[i];
+      }
+    });
+
+    std::swap(pSrcKeys, pDstKeys);
+    std::swap(pSrcValues, pDstValues);
+  }
+
+  if (pSrcKeys != pKeys) {
+    memcpy(pKeys, pSrcKeys, uCount * sizeof(uint64_t));
+    memcpy(pValues, pSrcValues, uCount * sizeof(uint32_t));
+  }
+
+  m_uLastPassCount = uNumPasses;
+}
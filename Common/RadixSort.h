@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+///
+/// Stable LSD radix sort of 64-bit keys carrying a 32-bit value each, 8 bits per pass.
+/// Passes whose digit is the same for every key are skipped, so keys that only vary in a
+/// few fields take a few passes. With a JobSystem, inputs past PARALLEL_THRESHOLD are split
+/// into blocks: the blocks count their digits in parallel, one prefix sum over the block
+/// counts gives every block its own output offsets and the blocks scatter in parallel,
+/// which keeps the sort stable.
+///
+/// Like JobSystem it only depends on the standard library.
+///
+class RadixSorter {
+public:
+  enum {
+    DIGIT_BITS = 8,
+    NUM_DIGITS = 1 << DIGIT_BITS,
+    NUM_PASSES = 64 / DIGIT_BITS,
+    PARALLEL_THRESHOLD = 1 << 14,
+    MAX_BLOCKS = 16
+  };
+
+  /// Sorts pKeys ascending and moves pValues along, both hold uCount entries. The scratch
+  /// memory is kept for the next call, a sorter is used by one thread at a time.
+  void Sort(uint64_t *pKeys, uint32_t *pValues, uint32_t uCount, JobSystem *pJobSystem = nullptr);
+
+  /// Passes the last Sort ran, the others were skipped.
+  uint32_t GetLastPassCount() const;
+
+private:
+  std::vector<uint64_t> m_aKeyScratch;
+  std::vector<uint32_t> m_aValueScratch;
+  std::vector<uint32_t> m_aBlockCounts;  // [block][pass][digit]
+  std::vector<uint32_t> m_aBlockOffsets; // [block][digit], of the pass being scattered
+  uint32_t m_uLastPassCount = 0;
+};
+
+/// Inline implementation
+inline uint32_t RadixSorter::GetLastPassCount() const {
+  return m_uLastPassCount;
+}
@@ -1,3 +1,4 @@
+#include "CpuProfiler.h"
 #include "D3D12MemAllocator.hpp"
 #include "ResourceUploadBatch.hpp"
 #include "SyncFence.hpp"
@@ -60,6 +61,7 @@ public:
   }
 
   HRESULT End(_In_ ID3D12CommandQueue *commitQueue, _Out_ std::future<HRESULT> *waitable) {
+    CPU_PROFILE_SCOPE("ResourceUploadBatch::End");
     HRESULT hr;
 
     // Sanity check
@@ -16,6 +16,8 @@
 #include "SDKmesh.h"
 #include <ResourceUploadBatch.hpp>
 #include <Texture.h>
+#include <CpuProfiler.h>
+#include <IndirectDrawBuilder.h>
 
 using namespace DirectX;
 
@@ -133,6 +135,53 @@ HRESULT CDXUTSDKMesh::GetResourceDescriptorHeap(_In_ ID3D12Device* pDev12, BOOL
     return hr;
 }
 
+//--------------------------------------------------------------------------------------
+// Material-major copy of the texture views for bindless rendering, material m's texture t
+// at m * TS_COUNT + t.  Textures a material lacks get a null view, which samples zero.
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTSDKMesh::GetBindlessDescriptorHeap(_In_ ID3D12Device* pDev12, BOOL bShaderVisible, _Out_ ID3D12DescriptorHeap **ppHeap) const {
+
+    HRESULT hr = S_OK;
+    D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+    heapDesc.Flags = bShaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    heapDesc.NumDescriptors = GetBindlessDescriptorCount();
+    UINT uCbvSrvUavIncrementSize;
+
+    if(pDev12 == nullptr || ppHeap == nullptr || heapDesc.NumDescriptors == 0)
+        return E_INVALIDARG;
+
+    V_RETURN(pDev12->CreateDescriptorHeap(
+        &heapDesc,
+        IID_PPV_ARGS(ppHeap)
+    ));
+
+    uCbvSrvUavIncrementSize = pDev12->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC nullSrvDesc = {};
+    nullSrvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    nullSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    nullSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    nullSrvDesc.Texture2D.MipLevels = 1;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE handle((*ppHeap)->GetCPUDescriptorHandleForHeapStart());
+
+    for(UINT m = 0; m < m_Packets.MaterialTable.Size(); ++m) {
+        auto pMat = &m_pMaterialArray[m];
+        ID3D12Resource* apTextures[TS_COUNT] = { pMat->pDiffuseTexture12, pMat->pNormalTexture12, pMat->pSpecularTexture12 };
+
+        for(UINT t = 0; t < TS_COUNT; ++t) {
+            if(m_Packets.MaterialTable.TextureMask[m] & (1u << t))
+                pDev12->CreateShaderResourceView(apTextures[t], nullptr, handle);
+            else
+                pDev12->CreateShaderResourceView(nullptr, &nullSrvDesc, handle);
+            handle.Offset(1, uCbvSrvUavIncrementSize);
+        }
+    }
+
+    return hr;
+}
+
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 void CDXUTSDKMesh::LoadMaterials( ResourceUploadBatch* pUploadBatch, SDKMESH_MATERIAL* pMaterials, UINT numMaterials,
@@ -302,6 +351,96 @@ HRESULT CDXUTSDKMesh::CreateIndexBuffer( ResourceUploadBatch* pUploadBatch, SDKM
 }
 
 
+//--------------------------------------------------------------------------------------
+// Locate the float3 POSITION element of a vertex buffer declaration
+static bool FindPositionElement( const SDKMESH_VERTEX_BUFFER_HEADER* pHeader, UINT* pOffset )
+{
+    const WORD DECL_END_STREAM = 0xFF;
+    const BYTE DECLTYPE_FLOAT3 = 2;
+    const BYTE DECLUSAGE_POSITION = 0;
+
+    for( UINT i = 0; i < MAX_VERTEX_ELEMENTS && pHeader->Decl[i].Stream != DECL_END_STREAM; i++ )
+    {
+        auto pElement = &pHeader->Decl[i];
+        if( pElement->Usage == DECLUSAGE_POSITION && pElement->UsageIndex == 0 && pElement->Type == DECLTYPE_FLOAT3 )
+        {
+            *pOffset = pElement->Offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//--------------------------------------------------------------------------------------
+// Vertex buffers without a float3 position are skipped, the depth pass then binds the
+// interleaved stream of their meshes instead.  Meshes sharing a vertex buffer share its
+// position stream.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT CDXUTSDKMesh::CreatePositionStreams( ResourceUploadBatch* pUploadBatch )
+{
+    HRESULT hr = S_OK;
+
+    if( !m_pMeshHeader || !m_ppVertices )
+        return E_FAIL;
+
+    for( auto &pVB : m_PositionStreams )
+        SAFE_RELEASE( pVB );
+    m_PositionStreams.assign( m_pMeshHeader->NumVertexBuffers, nullptr );
+
+    std::vector<XMFLOAT3> Positions;
+    UINT64 TotalBytes = 0;
+
+    for( UINT i = 0; i < m_pMeshHeader->NumVertexBuffers; i++ )
+    {
+        auto pHeader = &m_pVertexBufferArray[i];
+        UINT Offset;
+
+        if( !FindPositionElement( pHeader, &Offset ) || pHeader->StrideBytes < Offset + sizeof( XMFLOAT3 ) )
+            continue;
+
+        const UINT64 NumVertices = pHeader->NumVertices;
+        const BYTE* pSrc = m_ppVertices[i] + Offset;
+        Positions.resize( ( size_t )NumVertices );
+        for( UINT64 v = 0; v < NumVertices; v++, pSrc += pHeader->StrideBytes )
+            memcpy( &Positions[( size_t )v], pSrc, sizeof( XMFLOAT3 ) );
+
+        CD3DX12_RESOURCE_DESC vbDesc = CD3DX12_RESOURCE_DESC::Buffer( NumVertices * sizeof( XMFLOAT3 ) );
+        ID3D12Resource* pVB = nullptr;
+
+        V_RETURN( pUploadBatch->GetDevice()->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &vbDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr,
+            IID_PPV_ARGS(&pVB)
+        ) );
+        DX_SetDebugName( pVB, "CDXUTSDKMesh Positions" );
+
+        D3D12_SUBRESOURCE_DATA InitData;
+        InitData.pData = Positions.data();
+        InitData.RowPitch = vbDesc.Width;
+        InitData.SlicePitch = vbDesc.Width;
+
+        pUploadBatch->Enqueue( pVB, 0, 1, &InitData );
+        pUploadBatch->ResourceBarrier( 1, &CD3DX12_RESOURCE_BARRIER::Transition(
+            pVB, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER ) );
+
+        m_PositionStreams[i] = pVB;
+        TotalBytes += vbDesc.Width;
+    }
+
+    DX_TRACEA( "CDXUTSDKMesh: created %llu bytes of position-only vertex streams\n", TotalBytes );
+
+    // Pick up the new streams in the mesh packets
+    CompileDrawPackets();
+
+    return hr;
+}
+
+
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 HRESULT CDXUTSDKMesh::CreateFromFile( ResourceUploadBatch* pUploadBatch,
@@ -367,6 +506,7 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ResourceUploadBatch* pUploadBatch,
                                         bool bCopyStatic,
                                         SDKMESH_CALLBACKS12* pLoaderCallbacks12 )
 {
+    CPU_PROFILE_SCOPE( "SDKMesh load" );
     XMFLOAT3 lower; 
     XMFLOAT3 upper; 
     
@@ -582,7 +722,15 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ResourceUploadBatch* pUploadBatch,
 
     }
     // Update 
-        
+
+    FlattenFrames();
+
+    if( pUploadBatch )
+    {
+        BuildMaterialTable();
+        CompileDrawPackets();
+    }
+
     return S_OK;
 }
 
@@ -699,19 +847,212 @@ void CDXUTSDKMesh::TransformFrameAbsolute( UINT iFrame, double fTime )
 
 #define MAX_D3D12_VERTEX_STREAMS D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT
 
+//--------------------------------------------------------------------------------------
+// Gather the descriptor offsets and bindable flags of every material into a dense table
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::BuildMaterialTable()
+{
+    m_Packets.MaterialTable.Clear();
+
+    if( !m_pDev12 || !m_pMeshHeader || !m_pMaterialArray )
+        return;
+
+    m_Packets.CbvSrvUavDescriptorSize = m_pDev12->GetDescriptorHandleIncrementSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+
+    const UINT NumMaterials = m_pMeshHeader->NumMaterials;
+    for( auto &a : m_Packets.MaterialTable.HeapIndex )
+        a.resize( NumMaterials );
+    m_Packets.MaterialTable.TextureMask.resize( NumMaterials );
+
+    for( UINT m = 0; m < NumMaterials; m++ )
+    {
+        auto pMat = &m_pMaterialArray[m];
+        UINT Mask = 0;
+
+        m_Packets.MaterialTable.HeapIndex[TS_DIFFUSE][m] = pMat->DiffuseHeapIndex;
+        m_Packets.MaterialTable.HeapIndex[TS_NORMAL][m] = pMat->NormalHeapIndex;
+        m_Packets.MaterialTable.HeapIndex[TS_SPECULAR][m] = pMat->SpecularHeapIndex;
+
+        if( !IsErrorResource( pMat->pDiffuseTexture12 ) )
+            Mask |= 1u << TS_DIFFUSE;
+        if( !IsErrorResource( pMat->pNormalTexture12 ) )
+            Mask |= 1u << TS_NORMAL;
+        if( !IsErrorResource( pMat->pSpecularTexture12 ) )
+            Mask |= 1u << TS_SPECULAR;
+        m_Packets.MaterialTable.TextureMask[m] = Mask;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Resolve buffer views, topologies, descriptor offsets and draw arguments of every subset
+// once after loading, SDKMESH_PACKET_SET::AddDraw merges contiguous subsets of a material
+// into one draw.  Meshes whose buffers failed to create leave the packets empty and
+// RenderMesh falls back to the per-subset path.
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::CompileDrawPackets()
+{
+    m_Packets.Clear();
+
+    if( !m_pDev12 || !m_pMeshHeader )
+        return;
+
+    SDKMESH_PACKET_SET Packets;
+    Packets.MeshPackets.reserve( m_pMeshHeader->NumMeshes );
+    Packets.DrawPackets.reserve( m_pMeshHeader->NumTotalSubsets );
+
+    for( UINT iMesh = 0; iMesh < m_pMeshHeader->NumMeshes; iMesh++ )
+    {
+        auto pMesh = &m_pMeshArray[iMesh];
+        SDKMESH_MESH_PACKET MeshPacket = {};
+
+        if( pMesh->NumVertexBuffers > MAX_VERTEX_STREAMS )
+            return;
+
+        MeshPacket.NumVertexBuffers = pMesh->NumVertexBuffers;
+        for( UINT i = 0; i < pMesh->NumVertexBuffers; i++ )
+        {
+            auto pVBHeader = &m_pVertexBufferArray[ pMesh->VertexBuffers[i] ];
+            if( !pVBHeader->pVB12 )
+                return;
+
+            MeshPacket.VBV[i].BufferLocation = pVBHeader->pVB12->GetGPUVirtualAddress();
+            MeshPacket.VBV[i].StrideInBytes = ( UINT )pVBHeader->StrideBytes;
+            MeshPacket.VBV[i].SizeInBytes = ( UINT )pVBHeader->SizeBytes;
+        }
+
+        auto pIBHeader = &m_pIndexBufferArray[ pMesh->IndexBuffer ];
+        if( !pIBHeader->pIB12 )
+            return;
+
+        MeshPacket.IBV.BufferLocation = pIBHeader->pIB12->GetGPUVirtualAddress();
+        MeshPacket.IBV.Format = pIBHeader->IndexType == IT_32BIT ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+        MeshPacket.IBV.SizeInBytes = ( UINT )pIBHeader->SizeBytes;
+
+        for( UINT i = 0; i < pMesh->NumVertexBuffers; i++ )
+        {
+            UINT iVB = pMesh->VertexBuffers[i];
+            if( iVB < m_PositionStreams.size() && m_PositionStreams[iVB] )
+            {
+                MeshPacket.PositionVBV.BufferLocation = m_PositionStreams[iVB]->GetGPUVirtualAddress();
+                MeshPacket.PositionVBV.StrideInBytes = sizeof( XMFLOAT3 );
+                MeshPacket.PositionVBV.SizeInBytes = ( UINT )( m_pVertexBufferArray[iVB].NumVertices * sizeof( XMFLOAT3 ) );
+                break;
+            }
+        }
+
+        // Moved to world space below, meshes no frame holds keep their local center
+        MeshPacket.BoundsCenter = pMesh->BoundingBoxCenter;
+
+        Packets.AddMesh( MeshPacket );
+
+        for( UINT subset = 0; subset < pMesh->NumSubsets; subset++ )
+        {
+            auto pSubset = &m_pSubsetArray[ pMesh->pSubsets[subset] ];
+            SDKMESH_DRAW_PACKET Draw;
+
+            if( pSubset->MaterialID >= m_Packets.MaterialTable.Size() )
+                return;
+
+            Draw.PrimType = GetPrimitiveType12( ( SDKMESH_PRIMITIVE_TYPE )pSubset->PrimitiveType );
+            Draw.IndexCount = ( UINT )pSubset->IndexCount;
+            Draw.IndexStart = ( UINT )pSubset->IndexStart;
+            Draw.VertexStart = ( INT )pSubset->VertexStart;
+            Draw.MaterialID = pSubset->MaterialID;
+
+            Packets.AddDraw( Draw );
+        }
+
+        UINT NumDrawPackets = Packets.MeshPackets.back().NumDrawPackets;
+        if( NumDrawPackets < pMesh->NumSubsets )
+        {
+            DX_TRACEA( "CDXUTSDKMesh: mesh \"%s\" merged %u subsets into %u draws\n", pMesh->Name,
+                       pMesh->NumSubsets, NumDrawPackets );
+        }
+    }
+
+    m_Packets.MeshPackets = std::move( Packets.MeshPackets );
+    m_Packets.DrawPackets = std::move( Packets.DrawPackets );
+
+    UpdatePacketBoundsCenters();
+}
+
+//--------------------------------------------------------------------------------------
+// Move the bounds centers of the mesh packets to world space with the world pose of the
+// frames, as TransformFrameBounds does.  A mesh held by several frames takes the first one
+// in traversal order, the frame meshes are walked backwards so that it is written last.
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::UpdatePacketBoundsCenters()
+{
+    for( size_t i = m_FrameMeshes.size(); i-- > 0; )
+    {
+        UINT iMesh = m_FrameMeshes[i];
+        if( iMesh >= m_Packets.NumMeshes() )
+            continue;
+
+        XMMATRIX mWorld = XMLoadFloat4x4( &m_pWorldPoseFrameMatrices[ m_FrameOrder[i] ] );
+        XMVECTOR vCenter = XMVector3Transform( XMLoadFloat3( &m_pMeshArray[iMesh].BoundingBoxCenter ), mWorld );
+        XMStoreFloat3( &m_Packets.MeshPackets[iMesh].BoundsCenter, vCenter );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Replay the compiled packets of a mesh, or its subsets when it has none.
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 void CDXUTSDKMesh::RenderMesh( UINT iMesh,
                                bool bAdjacent,
-                               ID3D12GraphicsCommandList* pd3dCommandList,
+                               ICommandRecorder* pRecorder,
                                D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                                UINT iDiffuseSlot,
                                UINT iNormalSlot,
-                               UINT iSpecularSlot )
+                               UINT iSpecularSlot,
+                               UINT NumInstances )
 {
     if( 0 < GetOutstandingBufferResources() )
         return;
 
+    if( bAdjacent || !m_bUseDrawPackets || iMesh >= m_Packets.NumMeshes() )
+    {
+        RenderMeshUncompiled( iMesh, bAdjacent, pRecorder, hDescriptorStart, iDiffuseSlot, iNormalSlot,
+                              iSpecularSlot, NumInstances );
+        return;
+    }
+
+    m_Packets.RenderMesh( iMesh, pRecorder, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot, NumInstances );
+}
+
+//--------------------------------------------------------------------------------------
+// Depth-only replay of a mesh.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderMeshDepth( UINT iMesh,
+                                    ICommandRecorder* pRecorder )
+{
+    if( 0 < GetOutstandingBufferResources() )
+        return;
+
+    if( !m_bUseDrawPackets || iMesh >= m_Packets.NumMeshes() )
+    {
+        RenderMeshUncompiled( iMesh, false, pRecorder, D3D12_GPU_DESCRIPTOR_HANDLE{}, INVALID_SAMPLER_SLOT,
+                              INVALID_SAMPLER_SLOT, INVALID_SAMPLER_SLOT, 1, true );
+        return;
+    }
+
+    m_Packets.RenderMeshDepth( iMesh, pRecorder );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderMeshUncompiled( UINT iMesh,
+                                         bool bAdjacent,
+                                         ICommandRecorder* pRecorder,
+                                         D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                         UINT iDiffuseSlot,
+                                         UINT iNormalSlot,
+                                         UINT iSpecularSlot,
+                                         UINT NumInstances,
+                                         bool bDepthOnly )
+{
     auto pMesh = &m_pMeshArray[iMesh];
 
     D3D12_VERTEX_BUFFER_VIEW VBV[MAX_D3D12_VERTEX_STREAMS];
@@ -748,20 +1089,18 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
     IBV.Format = ibFormat;
     IBV.SizeInBytes = (UINT)pIndexBufferArray[ pMesh->IndexBuffer ].SizeBytes;
 
-    pd3dCommandList->IASetVertexBuffers( 0, pMesh->NumVertexBuffers, VBV );
-    pd3dCommandList->IASetIndexBuffer( &IBV );
+    pRecorder->IASetVertexBuffers( 0, pMesh->NumVertexBuffers, VBV );
+    pRecorder->IASetIndexBuffer( &IBV );
 
     SDKMESH_SUBSET* pSubset = nullptr;
-    SDKMESH_MATERIAL* pMat = nullptr;
+    UINT MaterialID;
+    UINT TextureMask;
     D3D12_PRIMITIVE_TOPOLOGY PrimType;
 
-    ID3D12Device *pd3dDevice;
     UINT uCbvSrvUavIncrementSize;
     CD3DX12_GPU_DESCRIPTOR_HANDLE handle0, handle;
 
-    pd3dCommandList->GetDevice(IID_PPV_ARGS(&pd3dDevice));
-    uCbvSrvUavIncrementSize = pd3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    SAFE_RELEASE(pd3dDevice);
+    uCbvSrvUavIncrementSize = m_Packets.CbvSrvUavDescriptorSize;
     handle0 = hDescriptorStart;
 
     for( UINT subset = 0; subset < pMesh->NumSubsets; subset++ )
@@ -788,20 +1127,24 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
             }
         }
 
-        pd3dCommandList->IASetPrimitiveTopology( PrimType );
+        pRecorder->IASetPrimitiveTopology( PrimType );
 
-        pMat = &m_pMaterialArray[ pSubset->MaterialID ];
-        if( iDiffuseSlot != INVALID_SAMPLER_SLOT && !IsErrorResource( pMat->pDiffuseTexture12 ) ) {
-            handle.InitOffsetted(handle0, pMat->DiffuseHeapIndex, uCbvSrvUavIncrementSize);
-            pd3dCommandList->SetGraphicsRootDescriptorTable( iDiffuseSlot,  handle);
+        MaterialID = pSubset->MaterialID;
+        TextureMask = IsBindlessMaterialsEnabled() ? 0 : m_Packets.MaterialTable.TextureMask[MaterialID];
+        // The depth pass binds no material, like the packets' depth replay
+        if( IsBindlessMaterialsEnabled() && !bDepthOnly )
+            pRecorder->SetGraphicsRoot32BitConstant( m_Packets.MaterialIndexSlot, MaterialID, 0 );
+        if( iDiffuseSlot != INVALID_SAMPLER_SLOT && ( TextureMask & ( 1u << TS_DIFFUSE ) ) ) {
+            handle.InitOffsetted(handle0, m_Packets.MaterialTable.HeapIndex[TS_DIFFUSE][MaterialID], uCbvSrvUavIncrementSize);
+            pRecorder->SetGraphicsRootDescriptorTable( iDiffuseSlot,  handle);
         }
-        if( iNormalSlot != INVALID_SAMPLER_SLOT && !IsErrorResource( pMat->pNormalTexture12 ) ) {
-            handle.InitOffsetted(handle0, pMat->NormalHeapIndex, uCbvSrvUavIncrementSize);
-            pd3dCommandList->SetGraphicsRootDescriptorTable( iNormalSlot, handle );
+        if( iNormalSlot != INVALID_SAMPLER_SLOT && ( TextureMask & ( 1u << TS_NORMAL ) ) ) {
+            handle.InitOffsetted(handle0, m_Packets.MaterialTable.HeapIndex[TS_NORMAL][MaterialID], uCbvSrvUavIncrementSize);
+            pRecorder->SetGraphicsRootDescriptorTable( iNormalSlot, handle );
         }
-        if( iSpecularSlot != INVALID_SAMPLER_SLOT && !IsErrorResource( pMat->pSpecularTexture12 ) ) {
-            handle.InitOffsetted(handle0, pMat->SpecularHeapIndex, uCbvSrvUavIncrementSize);
-            pd3dCommandList->SetGraphicsRootDescriptorTable( iSpecularSlot, handle );
+        if( iSpecularSlot != INVALID_SAMPLER_SLOT && ( TextureMask & ( 1u << TS_SPECULAR ) ) ) {
+            handle.InitOffsetted(handle0, m_Packets.MaterialTable.HeapIndex[TS_SPECULAR][MaterialID], uCbvSrvUavIncrementSize);
+            pRecorder->SetGraphicsRootDescriptorTable( iSpecularSlot, handle );
         }
 
         UINT IndexCount = ( UINT )pSubset->IndexCount;
@@ -813,43 +1156,147 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
             IndexStart *= 2;
         }
 
-        pd3dCommandList->DrawIndexedInstanced( IndexCount, 1, IndexStart, VertexStart, 0 );
+        pRecorder->DrawIndexedInstanced( IndexCount, NumInstances, IndexStart, VertexStart, 0 );
     }
 }
 
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
-void CDXUTSDKMesh::RenderFrame( UINT iFrame,
-                                bool bAdjacent,
-                                ID3D12GraphicsCommandList* pd3dCommandList,
-                                D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
-                                UINT iDiffuseSlot,
-                                UINT iNormalSlot,
-                                UINT iSpecularSlot )
-{
-    if( !m_pStaticMeshData || !m_pFrameArray )
+void CDXUTSDKMesh::RenderMeshList( const UINT* pMeshes,
+                                   UINT NumMeshes,
+                                   bool bAdjacent,
+                                   bool bDepthOnly,
+                                   ICommandRecorder* pRecorder,
+                                   D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                   UINT iDiffuseSlot,
+                                   UINT iNormalSlot,
+                                   UINT iSpecularSlot )
+{
+    for( UINT i = 0; i < NumMeshes; i++ )
+    {
+        if( bDepthOnly )
+            RenderMeshDepth( pMeshes[i], pRecorder );
+        else
+            RenderMesh( pMeshes[i], bAdjacent, pRecorder, hDescriptorStart, iDiffuseSlot, iNormalSlot,
+                        iSpecularSlot );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Flatten the frame hierarchy into the order the recursive traversal used ( self, children,
+// siblings ) and initialize the world pose of every frame from the static hierarchy, so that
+// draw lists can be culled before any animation is applied.
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::FlattenFrames()
+{
+    m_FrameOrder.clear();
+    m_FrameMeshes.clear();
+
+    if( !m_pMeshHeader || !m_pFrameArray || !m_pWorldPoseFrameMatrices || 0 == m_pMeshHeader->NumFrames )
         return;
 
-    if( m_pFrameArray[iFrame].Mesh != INVALID_MESH )
+    const UINT NumFrames = m_pMeshHeader->NumFrames;
+    std::vector<std::pair<UINT, UINT>> Stack;   // ( frame, parent frame )
+    Stack.emplace_back( 0, INVALID_FRAME );
+
+    for( UINT Visited = 0; !Stack.empty() && Visited < NumFrames; Visited++ )
     {
-        RenderMesh( m_pFrameArray[iFrame].Mesh,
-                    bAdjacent,
-                    pd3dCommandList,
-                    hDescriptorStart,
-                    iDiffuseSlot,
-                    iNormalSlot,
-                    iSpecularSlot );
+        UINT iFrame = Stack.back().first;
+        UINT iParent = Stack.back().second;
+        Stack.pop_back();
+
+        if( iFrame >= NumFrames )
+            continue;
+
+        auto pFrame = &m_pFrameArray[iFrame];
+        XMMATRIX mLocalWorld = XMLoadFloat4x4( &pFrame->Matrix );
+        if( iParent != INVALID_FRAME )
+            mLocalWorld = XMMatrixMultiply( mLocalWorld, XMLoadFloat4x4( &m_pWorldPoseFrameMatrices[iParent] ) );
+        XMStoreFloat4x4( &m_pWorldPoseFrameMatrices[iFrame], mLocalWorld );
+
+        if( pFrame->Mesh != INVALID_MESH && pFrame->Mesh < m_pMeshHeader->NumMeshes )
+        {
+            m_FrameOrder.push_back( iFrame );
+            m_FrameMeshes.push_back( pFrame->Mesh );
+        }
+
+        // Siblings go first so that the children are popped before them
+        if( pFrame->SiblingFrame != INVALID_FRAME )
+            Stack.emplace_back( pFrame->SiblingFrame, iParent );
+        if( pFrame->ChildFrame != INVALID_FRAME )
+            Stack.emplace_back( pFrame->ChildFrame, iFrame );
     }
+}
 
-    // Render our children
-    if( m_pFrameArray[iFrame].ChildFrame != INVALID_FRAME )
-        RenderFrame( m_pFrameArray[iFrame].ChildFrame, bAdjacent, pd3dCommandList, hDescriptorStart, iDiffuseSlot, 
-                     iNormalSlot, iSpecularSlot );
+//--------------------------------------------------------------------------------------
+// Transform the bounding boxes of all frame meshes to world space into the SoA culler.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::TransformFrameBounds( CXMMATRIX World, FrustumCuller* pBounds ) const
+{
+    const UINT NumItems = ( UINT )m_FrameMeshes.size();
 
-    // Render our siblings
-    if( m_pFrameArray[iFrame].SiblingFrame != INVALID_FRAME )
-        RenderFrame( m_pFrameArray[iFrame].SiblingFrame, bAdjacent, pd3dCommandList, hDescriptorStart, iDiffuseSlot, 
-                     iNormalSlot, iSpecularSlot );
+    pBounds->Resize( NumItems );
+
+    for( UINT i = 0; i < NumItems; i++ )
+    {
+        auto pMesh = &m_pMeshArray[ m_FrameMeshes[i] ];
+        BoundingBox LocalBounds( pMesh->BoundingBoxCenter, pMesh->BoundingBoxExtents );
+        BoundingBox WorldBounds;
+        XMMATRIX mWorld = XMMatrixMultiply( XMLoadFloat4x4( &m_pWorldPoseFrameMatrices[ m_FrameOrder[i] ] ), World );
+        LocalBounds.Transform( WorldBounds, mWorld );
+        pBounds->SetBox( i, WorldBounds );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Test the frame meshes against the frustum in one batched sweep and collect the survivors.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::BuildDrawList( const SDKMESH_FRUSTUM& Frustum, CXMMATRIX World, SDKMESH_DRAW_LIST* pDrawList ) const
+{
+    const UINT NumItems = ( UINT )m_FrameMeshes.size();
+
+    TransformFrameBounds( World, &pDrawList->Bounds );
+
+    pDrawList->Meshes.clear();
+    pDrawList->Visible.resize( NumItems );
+    pDrawList->NumTotal = NumItems;
+
+    UINT NumVisible = pDrawList->Bounds.Cull( Frustum.Planes, 0, NumItems, pDrawList->Visible.data() );
+
+    pDrawList->Meshes.reserve( NumVisible );
+    for( UINT i = 0; i < NumVisible; i++ )
+        pDrawList->Meshes.push_back( m_FrameMeshes[ pDrawList->Visible[i] ] );
+}
+
+//--------------------------------------------------------------------------------------
+// Every frame mesh is transformed and loaded once, then tested against all the views.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::BuildViewMasks( const SDKMESH_FRUSTUM* pFrustums, UINT NumViews, CXMMATRIX World,
+                                   SDKMESH_VIEW_MASKS* pViewMasks ) const
+{
+    static_assert( sizeof( SDKMESH_FRUSTUM ) == 6 * sizeof( XMFLOAT4 ), "Frustum planes must be packed" );
+
+    const UINT NumItems = ( UINT )m_FrameMeshes.size();
+
+    assert( NumViews <= FrustumCuller::MAX_VIEWS );
+
+    TransformFrameBounds( World, &pViewMasks->Bounds );
+
+    pViewMasks->NumViews = NumViews;
+    pViewMasks->Masks.resize( NumItems );
+    pViewMasks->Bounds.CullViews( pFrustums[0].Planes, NumViews, 0, NumItems, pViewMasks->Masks.data() );
+}
+
+//--------------------------------------------------------------------------------------
+// Split the view masks into per-view draw lists of the frame meshes.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::BuildDrawLists( const SDKMESH_VIEW_MASKS* pViewMasks, SDKMESH_DRAW_LIST* pDrawLists ) const
+{
+    pViewMasks->BuildDrawLists( m_FrameMeshes.data(), pDrawLists );
 }
 
 //--------------------------------------------------------------------------------------
@@ -860,6 +1307,7 @@ CDXUTSDKMesh::CDXUTSDKMesh() noexcept :
     m_hFileMappingObject(0),
     m_pDev12(nullptr),
     m_pd3dCommandList(nullptr),
+    m_bUseDrawPackets(true),
     m_pStaticMeshData(nullptr),
     m_pHeapData(nullptr),
     m_pAnimationData(nullptr),
@@ -1027,6 +1475,10 @@ void CDXUTSDKMesh::Destroy()
         }
     }
 
+    for( auto &pVB : m_PositionStreams )
+        SAFE_RELEASE( pVB );
+    m_PositionStreams.clear();
+
     if( m_pAdjacencyIndexBufferArray )
     {
         for( UINT64 i = 0; i < m_pMeshHeader->NumIndexBuffers; i++ )
@@ -1046,6 +1498,11 @@ void CDXUTSDKMesh::Destroy()
     SAFE_DELETE_ARRAY( m_ppVertices );
     SAFE_DELETE_ARRAY( m_ppIndices );
 
+    m_Packets.MaterialTable.Clear();
+    m_Packets.Clear();
+    m_FrameOrder.clear();
+    m_FrameMeshes.clear();
+
     m_pMeshHeader = nullptr;
     m_pVertexBufferArray = nullptr;
     m_pIndexBufferArray = nullptr;
@@ -1086,9 +1543,24 @@ void CDXUTSDKMesh::TransformMesh( CXMMATRIX world, double fTime )
         for( UINT i = 0; i < m_pAnimationHeader->NumFrames; i++ )
             TransformFrameAbsolute( i, fTime );
     }
+
+    // The world pose of the frames moved, the sort depths follow it
+    UpdatePacketBoundsCenters();
 }
 
 
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::Render( ICommandRecorder* pRecorder,
+                           D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                           UINT iDiffuseSlot,
+                           UINT iNormalSlot,
+                           UINT iSpecularSlot )
+{
+    RenderMeshList( m_FrameMeshes.data(), ( UINT )m_FrameMeshes.size(), false, false, pRecorder,
+                    hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+}
+
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 void CDXUTSDKMesh::Render( ID3D12GraphicsCommandList* pd3dCommandList,
@@ -1097,7 +1569,20 @@ void CDXUTSDKMesh::Render( ID3D12GraphicsCommandList* pd3dCommandList,
                            UINT iNormalSlot,
                            UINT iSpecularSlot )
 {
-    RenderFrame( 0, false, pd3dCommandList, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    Render( &Recorder, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderAdjacent( ICommandRecorder* pRecorder,
+                                   D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                   UINT iDiffuseSlot,
+                                   UINT iNormalSlot,
+                                   UINT iSpecularSlot )
+{
+    RenderMeshList( m_FrameMeshes.data(), ( UINT )m_FrameMeshes.size(), true, false, pRecorder,
+                    hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
 }
 
 //--------------------------------------------------------------------------------------
@@ -1108,9 +1593,200 @@ void CDXUTSDKMesh::RenderAdjacent( ID3D12GraphicsCommandList* pd3dCommandList,
                                    UINT iNormalSlot,
                                    UINT iSpecularSlot )
 {
-    RenderFrame( 0, true, pd3dCommandList, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderAdjacent( &Recorder, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+// Every draw of the frame meshes is issued once for all the instances.  Not routed through
+// RenderMeshList, derived classes redirecting it do not see instanced draws.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderInstanced( ICommandRecorder* pRecorder,
+                                    UINT NumInstances,
+                                    D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                    UINT iDiffuseSlot,
+                                    UINT iNormalSlot,
+                                    UINT iSpecularSlot )
+{
+    if( 0 == NumInstances )
+        return;
+
+    for( UINT iMesh : m_FrameMeshes )
+        RenderMesh( iMesh, false, pRecorder, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot, NumInstances );
 }
 
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderInstanced( ID3D12GraphicsCommandList* pd3dCommandList,
+                                    UINT NumInstances,
+                                    D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                    UINT iDiffuseSlot,
+                                    UINT iNormalSlot,
+                                    UINT iSpecularSlot )
+{
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderInstanced( &Recorder, NumInstances, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderDepth( ICommandRecorder* pRecorder )
+{
+    RenderMeshList( m_FrameMeshes.data(), ( UINT )m_FrameMeshes.size(), false, true, pRecorder,
+                    D3D12_GPU_DESCRIPTOR_HANDLE{}, INVALID_SAMPLER_SLOT, INVALID_SAMPLER_SLOT, INVALID_SAMPLER_SLOT );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderDepth( ID3D12GraphicsCommandList* pd3dCommandList )
+{
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderDepth( &Recorder );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderDrawList( const SDKMESH_DRAW_LIST* pDrawList,
+                                   ICommandRecorder* pRecorder,
+                                   D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                   UINT iDiffuseSlot,
+                                   UINT iNormalSlot,
+                                   UINT iSpecularSlot )
+{
+    RenderMeshList( pDrawList->Meshes.data(), pDrawList->NumVisible(), false, false, pRecorder,
+                    hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderDrawList( const SDKMESH_DRAW_LIST* pDrawList,
+                                   ID3D12GraphicsCommandList* pd3dCommandList,
+                                   D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                   UINT iDiffuseSlot,
+                                   UINT iNormalSlot,
+                                   UINT iSpecularSlot )
+{
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderDrawList( pDrawList, &Recorder, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderDrawListDepth( const SDKMESH_DRAW_LIST* pDrawList,
+                                        ICommandRecorder* pRecorder )
+{
+    RenderMeshList( pDrawList->Meshes.data(), pDrawList->NumVisible(), false, true, pRecorder,
+                    D3D12_GPU_DESCRIPTOR_HANDLE{}, INVALID_SAMPLER_SLOT, INVALID_SAMPLER_SLOT, INVALID_SAMPLER_SLOT );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderDrawListDepth( const SDKMESH_DRAW_LIST* pDrawList,
+                                        ID3D12GraphicsCommandList* pd3dCommandList )
+{
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderDrawListDepth( pDrawList, &Recorder );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sorting needs the draw packets, the list is left empty without them.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::BuildSortedDrawList( const UINT* pMeshes, UINT NumMeshes, const SDKMESH_SORT_PARAMS& Params,
+                                        SDKMESH_SORTED_DRAW_LIST* pSortedList, JobSystem* pJobSystem ) const
+{
+    if( !m_bUseDrawPackets )
+    {
+        pSortedList->Keys.clear();
+        pSortedList->Draws.clear();
+        return;
+    }
+
+    m_Packets.BuildSortedDrawList( pMeshes, NumMeshes, Params, pSortedList, pJobSystem );
+}
+
+//--------------------------------------------------------------------------------------
+// Without draw packets every mesh is drawn directly.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::BuildIndirectDraws( const UINT* pMeshes, UINT NumMeshes, bool bDepthOnly,
+                                       IndirectDrawBuilder* pBuilder, std::vector<UINT>* pDirectMeshes ) const
+{
+    if( 0 < GetOutstandingBufferResources() )
+        return;
+
+    if( !m_bUseDrawPackets )
+    {
+        pDirectMeshes->insert( pDirectMeshes->end(), pMeshes, pMeshes + NumMeshes );
+        return;
+    }
+
+    m_Packets.BuildIndirectDraws( pMeshes, NumMeshes, bDepthOnly, pBuilder, pDirectMeshes );
+}
+
+//--------------------------------------------------------------------------------------
+// Replay a range of sorted draws.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderSortedDrawList( const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                         UINT FirstDraw,
+                                         UINT EndDraw,
+                                         ICommandRecorder* pRecorder,
+                                         D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                         UINT iDiffuseSlot,
+                                         UINT iNormalSlot,
+                                         UINT iSpecularSlot )
+{
+    if( 0 < GetOutstandingBufferResources() )
+        return;
+
+    m_Packets.RenderSortedDrawList( pSortedList, FirstDraw, EndDraw, pRecorder, hDescriptorStart, iDiffuseSlot, iNormalSlot,
+                                    iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderSortedDrawList( const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                         UINT FirstDraw,
+                                         UINT EndDraw,
+                                         ID3D12GraphicsCommandList* pd3dCommandList,
+                                         D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                         UINT iDiffuseSlot,
+                                         UINT iNormalSlot,
+                                         UINT iSpecularSlot )
+{
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderSortedDrawList( pSortedList, FirstDraw, EndDraw, &Recorder, hDescriptorStart, iDiffuseSlot, iNormalSlot,
+                          iSpecularSlot );
+}
+
+//--------------------------------------------------------------------------------------
+// Depth-only replay of a range of sorted draws.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderSortedDrawListDepth( const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                              UINT FirstDraw,
+                                              UINT EndDraw,
+                                              ICommandRecorder* pRecorder )
+{
+    if( 0 < GetOutstandingBufferResources() )
+        return;
+
+    m_Packets.RenderSortedDrawListDepth( pSortedList, FirstDraw, EndDraw, pRecorder );
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void CDXUTSDKMesh::RenderSortedDrawListDepth( const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                              UINT FirstDraw,
+                                              UINT EndDraw,
+                                              ID3D12GraphicsCommandList* pd3dCommandList )
+{
+    D3D12CommandRecorder Recorder( pd3dCommandList );
+    RenderSortedDrawListDepth( pSortedList, FirstDraw, EndDraw, &Recorder );
+}
 
 //--------------------------------------------------------------------------------------
 D3D12_PRIMITIVE_TOPOLOGY CDXUTSDKMesh::GetPrimitiveType12( _In_ SDKMESH_PRIMITIVE_TYPE PrimType )
@@ -1265,6 +1941,14 @@ SDKMESH_MESH* CDXUTSDKMesh::GetMesh( _In_ UINT iMesh ) const
     return &m_pMeshArray[ iMesh ];
 }
 
+//--------------------------------------------------------------------------------------
+UINT CDXUTSDKMesh::GetNumDraws( _In_ UINT iMesh ) const
+{
+    if( iMesh < m_Packets.NumMeshes() )
+        return m_Packets.MeshPackets[ iMesh ].NumDrawPackets;
+    return GetNumSubsets( iMesh );
+}
+
 //--------------------------------------------------------------------------------------
 UINT CDXUTSDKMesh::GetNumSubsets( _In_ UINT iMesh ) const
 {
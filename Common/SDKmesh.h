@@ -280,8 +280,12 @@ static_assert( sizeof(SDKANIMATION_FRAME_DATA) == 112, "SDK Mesh structure size
 #ifndef _CONVERTER_APP_
 
 #include <forward_list>
+#include <DirectXCollision.h>
+#include "SDKmeshPackets.h"
 
 class ResourceUploadBatch;
+class JobSystem;
+class IndirectDrawBuilder;
 
 //--------------------------------------------------------------------------------------
 // AsyncLoading callbacks
@@ -330,6 +334,17 @@ private:
 
     std::vector<SDKMESH_TEXTURE_CACHE_ENTRY> m_TextureCache;
 
+    // Compiled draw state, indexed by mesh
+    SDKMESH_PACKET_SET m_Packets;
+    bool m_bUseDrawPackets;
+
+    // Position-only copies of the vertex buffers for depth passes, indexed by vertex buffer
+    std::vector<ID3D12Resource*> m_PositionStreams;
+
+    // Flattened frame hierarchy, the frames carrying a mesh in traversal order
+    std::vector<UINT> m_FrameOrder;
+    std::vector<UINT> m_FrameMeshes;
+
 protected:
     //These are the pointers to the two chunks of data loaded in from the mesh file
     BYTE* m_pStaticMeshData;
@@ -392,21 +407,45 @@ protected:
     void TransformFrame( _In_ UINT iFrame, _In_ DirectX::CXMMATRIX parentWorld, _In_ double fTime );
     void TransformFrameAbsolute( _In_ UINT iFrame, _In_ double fTime );
 
+    //Draw packets
+    void BuildMaterialTable();
+    void CompileDrawPackets();
+    void UpdatePacketBoundsCenters();
+
     //Direct3D 12 rendering helpers
+    void RenderMeshUncompiled( _In_ UINT iMesh,
+                               _In_ bool bAdjacent,
+                               _In_ ICommandRecorder* pRecorder,
+                               _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                               _In_ UINT iDiffuseSlot,
+                               _In_ UINT iNormalSlot,
+                               _In_ UINT iSpecularSlot,
+                               _In_ UINT NumInstances = 1,
+                               _In_ bool bDepthOnly = false );
     void RenderMesh( _In_ UINT iMesh,
                      _In_ bool bAdjacent,
-                     _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                     _In_ ICommandRecorder* pRecorder,
                      _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                      _In_ UINT iDiffuseSlot,
                      _In_ UINT iNormalSlot,
-                     _In_ UINT iSpecularSlot );
-    void RenderFrame( _In_ UINT iFrame,
-                      _In_ bool bAdjacent,
-                      _In_ ID3D12GraphicsCommandList* pd3dCommandList,
-                      _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
-                      _In_ UINT iDiffuseSlot,
-                      _In_ UINT iNormalSlot,
-                      _In_ UINT iSpecularSlot );
+                     _In_ UINT iSpecularSlot,
+                     _In_ UINT NumInstances = 1 );
+    void RenderMeshDepth( _In_ UINT iMesh,
+                          _In_ ICommandRecorder* pRecorder );
+    // Every public render entry point ends up here, derived classes may redirect the draws
+    virtual void RenderMeshList( _In_reads_(NumMeshes) const UINT* pMeshes,
+                                 _In_ UINT NumMeshes,
+                                 _In_ bool bAdjacent,
+                                 _In_ bool bDepthOnly,
+                                 _In_ ICommandRecorder* pRecorder,
+                                 _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                 _In_ UINT iDiffuseSlot,
+                                 _In_ UINT iNormalSlot,
+                                 _In_ UINT iSpecularSlot );
+
+    //Frame hierarchy
+    void FlattenFrames();
+    void TransformFrameBounds( _In_ DirectX::CXMMATRIX World, _Inout_ FrustumCuller* pBounds ) const;
 
 public:
     CDXUTSDKMesh() noexcept;
@@ -418,6 +457,13 @@ public:
     // When you not provide SDKMESH_CALLBACK12, you must call this to reclare the resource view descriptor heap, or you
     // can not bind to the correct descriptor heap(s).
     HRESULT GetResourceDescriptorHeap(_In_ ID3D12Device* pDev12, BOOL bShaderVisible, _Out_ ID3D12DescriptorHeap **ppHeap) const;
+    // Descriptors of the bindless material path, TS_COUNT per material with material m's
+    // texture t at m * TS_COUNT + t.  The whole range is bound once and indexed in the shader.
+    HRESULT GetBindlessDescriptorHeap(_In_ ID3D12Device* pDev12, BOOL bShaderVisible, _Out_ ID3D12DescriptorHeap **ppHeap) const;
+    UINT GetBindlessDescriptorCount() const { return m_Packets.MaterialTable.Size() * TS_COUNT; }
+    // Split the positions out of every vertex buffer into a tightly packed float3 stream for
+    // depth-only passes.  Must be called after Create and before the upload batch is ended.
+    HRESULT CreatePositionStreams( _In_ ResourceUploadBatch* pUploadBatch );
     virtual HRESULT LoadAnimation( _In_z_ const WCHAR* szFileName );
     virtual void Destroy();
 
@@ -426,16 +472,137 @@ public:
     void TransformMesh( _In_ DirectX::CXMMATRIX world, _In_ double fTime );
 
     //Direct3D 12 Rendering
-    virtual void Render( _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+    // Every render entry point records through an ICommandRecorder; the command list
+    // overloads wrap the list in a D3D12CommandRecorder.
+    virtual void Render( _In_ ICommandRecorder* pRecorder,
                          _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                          _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
                          _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
                          _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
-    virtual void RenderAdjacent( _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+    void Render( _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                 _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                 _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                 _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                 _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    virtual void RenderAdjacent( _In_ ICommandRecorder* pRecorder,
                                  _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                                  _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
                                  _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
                                  _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    void RenderAdjacent( _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                         _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                         _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                         _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                         _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    // Instanced rendering, the pipeline fetches the per-instance data by SV_InstanceID.
+    void RenderInstanced( _In_ ICommandRecorder* pRecorder,
+                          _In_ UINT NumInstances,
+                          _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                          _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                          _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                          _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    void RenderInstanced( _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                          _In_ UINT NumInstances,
+                          _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                          _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                          _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                          _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    // Depth-only rendering, binds the position streams and no material state.  The pipeline is
+    // expected to read a single float3 POSITION at offset 0 of slot 0.
+    void RenderDepth( _In_ ICommandRecorder* pRecorder );
+    void RenderDepth( _In_ ID3D12GraphicsCommandList* pd3dCommandList );
+
+    // Culled rendering.  BuildDrawList only reads the mesh, so several views may be culled
+    // concurrently as long as each uses its own draw list.
+    void BuildDrawList( _In_ const SDKMESH_FRUSTUM& Frustum,
+                        _In_ DirectX::CXMMATRIX World,
+                        _Inout_ SDKMESH_DRAW_LIST* pDrawList ) const;
+    // Multi-view culling.  BuildViewMasks tests each frame mesh once against all the views,
+    // up to FrustumCuller::MAX_VIEWS; BuildDrawLists then hands every view only its set bits.
+    void BuildViewMasks( _In_reads_(NumViews) const SDKMESH_FRUSTUM* pFrustums,
+                         _In_ UINT NumViews,
+                         _In_ DirectX::CXMMATRIX World,
+                         _Inout_ SDKMESH_VIEW_MASKS* pViewMasks ) const;
+    void BuildDrawLists( _In_ const SDKMESH_VIEW_MASKS* pViewMasks,
+                         _Out_writes_(pViewMasks->NumViews) SDKMESH_DRAW_LIST* pDrawLists ) const;
+    void RenderDrawList( _In_ const SDKMESH_DRAW_LIST* pDrawList,
+                         _In_ ICommandRecorder* pRecorder,
+                         _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                         _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                         _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                         _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    void RenderDrawList( _In_ const SDKMESH_DRAW_LIST* pDrawList,
+                         _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                         _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                         _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                         _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                         _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    void RenderDrawListDepth( _In_ const SDKMESH_DRAW_LIST* pDrawList,
+                              _In_ ICommandRecorder* pRecorder );
+    void RenderDrawListDepth( _In_ const SDKMESH_DRAW_LIST* pDrawList,
+                              _In_ ID3D12GraphicsCommandList* pd3dCommandList );
+
+    // Sorted rendering, draw packets only: without them BuildSortedDrawList leaves the list
+    // empty.  A range of the sorted draws may be played back on its own, the first draw of a
+    // range sets all of its state.
+    void BuildSortedDrawList( _In_reads_(NumMeshes) const UINT* pMeshes,
+                              _In_ UINT NumMeshes,
+                              _In_ const SDKMESH_SORT_PARAMS& Params,
+                              _Inout_ SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                              _In_opt_ JobSystem* pJobSystem = nullptr ) const;
+    void RenderSortedDrawList( _In_ const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                               _In_ UINT FirstDraw,
+                               _In_ UINT EndDraw,
+                               _In_ ICommandRecorder* pRecorder,
+                               _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                               _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                               _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                               _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    void RenderSortedDrawList( _In_ const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                               _In_ UINT FirstDraw,
+                               _In_ UINT EndDraw,
+                               _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                               _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                               _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
+                               _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
+                               _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
+    void RenderSortedDrawListDepth( _In_ const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                    _In_ UINT FirstDraw,
+                                    _In_ UINT EndDraw,
+                                    _In_ ICommandRecorder* pRecorder );
+    void RenderSortedDrawListDepth( _In_ const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                    _In_ UINT FirstDraw,
+                                    _In_ UINT EndDraw,
+                                    _In_ ID3D12GraphicsCommandList* pd3dCommandList );
+
+    // Indirect rendering, draw packets only.  The draw packets of the meshes are added to
+    // the builder as ExecuteIndirect arguments, with the material index as the root constant
+    // (0 when depth only) and the position stream as the vertex buffer of depth-only draws.
+    // An ExecuteIndirect sets a single vertex buffer and no topology, so meshes with several
+    // streams or non triangle list draws are appended to pDirectMeshes instead, to be drawn
+    // with RenderMesh or RenderMeshDepth.
+    void BuildIndirectDraws( _In_reads_(NumMeshes) const UINT* pMeshes,
+                             _In_ UINT NumMeshes,
+                             _In_ bool bDepthOnly,
+                             _Inout_ IndirectDrawBuilder* pBuilder,
+                             _Inout_ std::vector<UINT>* pDirectMeshes ) const;
+    UINT GetNumDrawPackets( _In_ UINT iMesh ) const
+    {
+        return iMesh < m_Packets.NumMeshes() ? m_Packets.MeshPackets[iMesh].NumDrawPackets : 0;
+    }
+
+    // Mesh indices in the order the unculled Render* calls visit them
+    const std::vector<UINT>& GetFrameMeshes() const { return m_FrameMeshes; }
+
+    // Toggle the precompiled draw packet path, the per-subset path is used when disabled.
+    void EnableDrawPackets( _In_ bool bEnable ) { m_bUseDrawPackets = bEnable; }
+    bool IsDrawPacketsEnabled() const { return m_bUseDrawPackets; }
+
+    // Bindless materials: every draw passes its material index as a single 32-bit root
+    // constant at MaterialIndexSlot instead of binding per-slot descriptor tables, so the
+    // texture slots of the Render* calls are ignored.  INVALID_SAMPLER_SLOT restores the tables.
+    void EnableBindlessMaterials( _In_ UINT MaterialIndexSlot ) { m_Packets.MaterialIndexSlot = MaterialIndexSlot; }
+    bool IsBindlessMaterialsEnabled() const { return m_Packets.IsBindlessMaterialsEnabled(); }
 
     //Helpers (D3D12 specific)
     static D3D12_PRIMITIVE_TOPOLOGY GetPrimitiveType12( _In_ SDKMESH_PRIMITIVE_TYPE PrimType );
@@ -463,6 +630,7 @@ public:
     SDKMESH_MATERIAL* GetMaterial( _In_ UINT iMaterial ) const;
     SDKMESH_MESH*     GetMesh( _In_ UINT iMesh ) const;
     UINT              GetNumSubsets( _In_ UINT iMesh ) const;
+    UINT              GetNumDraws( _In_ UINT iMesh ) const; // Draw calls after subset merging
     SDKMESH_SUBSET*   GetSubset( _In_ UINT iMesh, _In_ UINT iSubset ) const;
     UINT              GetVertexStride( _In_ UINT iMesh, _In_ UINT iVB ) const;
     UINT              GetNumFrames() const;
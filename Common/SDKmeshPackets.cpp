@@ -0,0 +1,494 @@
+//--------------------------------------------------------------------------------------
+// File: SDKmeshPackets.cpp
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkId=320437
+//--------------------------------------------------------------------------------------
+#include "SDKmeshPackets.h"
+#include "IndirectDrawBuilder.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Only list topologies can be concatenated into a single draw
+static bool IsListTopology( D3D12_PRIMITIVE_TOPOLOGY PrimType )
+{
+    switch( PrimType )
+    {
+    case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
+    case D3D_PRIMITIVE_TOPOLOGY_LINELIST:
+    case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:
+    case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ:
+    case D3D_PRIMITIVE_TOPOLOGY_LINELIST_ADJ:
+        return true;
+    default:
+        return PrimType >= D3D_PRIMITIVE_TOPOLOGY_1_CONTROL_POINT_PATCHLIST &&
+               PrimType <= D3D_PRIMITIVE_TOPOLOGY_32_CONTROL_POINT_PATCHLIST;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Whether Next continues Prev's index range so that both can be issued as one draw,
+// materials are not compared.
+static bool IsContiguousDraw( const SDKMESH_DRAW_PACKET& Prev, const SDKMESH_DRAW_PACKET& Next )
+{
+    return Prev.PrimType == Next.PrimType &&
+           Prev.VertexStart == Next.VertexStart &&
+           Prev.IndexStart + Prev.IndexCount == Next.IndexStart &&
+           IsListTopology( Next.PrimType );
+}
+
+//--------------------------------------------------------------------------------------
+// Lowest set bit of a non-zero mask
+static UINT LowestBit( UINT Mask )
+{
+#if defined(_MSC_VER)
+    unsigned long Bit;
+    _BitScanForward( &Bit, Mask );
+    return ( UINT )Bit;
+#else
+    return ( UINT )__builtin_ctz( Mask );
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+static D3D12_GPU_DESCRIPTOR_HANDLE OffsetDescriptor( D3D12_GPU_DESCRIPTOR_HANDLE hStart, INT HeapIndex, UINT DescriptorSize )
+{
+    D3D12_GPU_DESCRIPTOR_HANDLE Handle;
+    Handle.ptr = ( UINT64 )( ( INT64 )hStart.ptr + ( INT64 )HeapIndex * ( INT64 )DescriptorSize );
+    return Handle;
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_FRUSTUM::CreateFromMatrix( FXMMATRIX ViewProj )
+{
+    // Columns of the matrix, clip = v * ViewProj
+    XMMATRIX C = XMMatrixTranspose( ViewProj );
+
+    // Negated so that the normals point out of the volume
+    XMStoreFloat4( &Planes[0], XMPlaneNormalize( XMVectorNegate( XMVectorAdd( C.r[3], C.r[0] ) ) ) );   // Left
+    XMStoreFloat4( &Planes[1], XMPlaneNormalize( XMVectorSubtract( C.r[0], C.r[3] ) ) );                // Right
+    XMStoreFloat4( &Planes[2], XMPlaneNormalize( XMVectorNegate( XMVectorAdd( C.r[3], C.r[1] ) ) ) );   // Bottom
+    XMStoreFloat4( &Planes[3], XMPlaneNormalize( XMVectorSubtract( C.r[1], C.r[3] ) ) );                // Top
+    XMStoreFloat4( &Planes[4], XMPlaneNormalize( XMVectorNegate( C.r[2] ) ) );                          // Near
+    XMStoreFloat4( &Planes[5], XMPlaneNormalize( XMVectorSubtract( C.r[2], C.r[3] ) ) );                // Far
+}
+
+//--------------------------------------------------------------------------------------
+// Only the set bits of each mask are visited, so the cost follows the number of visible
+// mesh/view pairs.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_VIEW_MASKS::BuildDrawLists( const UINT* pItemMeshes, SDKMESH_DRAW_LIST* pDrawLists ) const
+{
+    const UINT NumItems = ( UINT )Masks.size();
+
+    for( UINT v = 0; v < NumViews; v++ )
+    {
+        pDrawLists[v].Meshes.clear();
+        pDrawLists[v].NumTotal = NumItems;
+    }
+
+    for( UINT i = 0; i < NumItems; i++ )
+    {
+        for( UINT Mask = Masks[i]; Mask; Mask &= Mask - 1 )
+            pDrawLists[ LowestBit( Mask ) ].Meshes.push_back( pItemMeshes[i] );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+void SDKMESH_PACKET_SET::Clear()
+{
+    MeshPackets.clear();
+    DrawPackets.clear();
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::AddMesh( const SDKMESH_MESH_PACKET& MeshPacket )
+{
+    MeshPackets.push_back( MeshPacket );
+    MeshPackets.back().FirstDrawPacket = ( UINT )DrawPackets.size();
+    MeshPackets.back().NumDrawPackets = 0;
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::AddDraw( const SDKMESH_DRAW_PACKET& Draw )
+{
+    assert( !MeshPackets.empty() );
+
+    auto pMeshPacket = &MeshPackets.back();
+    if( pMeshPacket->NumDrawPackets > 0 )
+    {
+        auto &Prev = DrawPackets.back();
+        if( Prev.MaterialID == Draw.MaterialID && IsContiguousDraw( Prev, Draw ) )
+        {
+            Prev.IndexCount += Draw.IndexCount;
+            return;
+        }
+    }
+
+    DrawPackets.push_back( Draw );
+    pMeshPacket->NumDrawPackets++;
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::RenderMesh( UINT iMesh,
+                                     ICommandRecorder* pRecorder,
+                                     D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                     UINT iDiffuseSlot,
+                                     UINT iNormalSlot,
+                                     UINT iSpecularSlot,
+                                     UINT NumInstances ) const
+{
+    const SDKMESH_MESH_PACKET* pMeshPacket = &MeshPackets[iMesh];
+    const SDKMESH_DRAW_PACKET* pDraw = DrawPackets.data() + pMeshPacket->FirstDrawPacket;
+    const SDKMESH_DRAW_PACKET* pDrawEnd = pDraw + pMeshPacket->NumDrawPackets;
+
+    const UINT RootSlots[TS_COUNT] = { iDiffuseSlot, iNormalSlot, iSpecularSlot };
+    UINT SlotMask = 0;
+    for( UINT t = 0; t < TS_COUNT; t++ )
+    {
+        if( RootSlots[t] != INVALID_SAMPLER_SLOT )
+            SlotMask |= 1u << t;
+    }
+
+    D3D12_PRIMITIVE_TOPOLOGY CurrPrimType = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    UINT CurrMaterialID = INVALID_MATERIAL;
+    INT CurrHeapIndex[TS_COUNT] = { INT_MIN, INT_MIN, INT_MIN };
+    const UINT* pTextureMask = MaterialTable.TextureMask.data();
+    const bool bBindless = IsBindlessMaterialsEnabled();
+
+    pRecorder->IASetVertexBuffers( 0, pMeshPacket->NumVertexBuffers, pMeshPacket->VBV );
+    pRecorder->IASetIndexBuffer( &pMeshPacket->IBV );
+
+    for( ; pDraw != pDrawEnd; ++pDraw )
+    {
+        if( pDraw->PrimType != CurrPrimType )
+        {
+            CurrPrimType = pDraw->PrimType;
+            pRecorder->IASetPrimitiveTopology( CurrPrimType );
+        }
+
+        if( pDraw->MaterialID != CurrMaterialID && bBindless )
+        {
+            CurrMaterialID = pDraw->MaterialID;
+            pRecorder->SetGraphicsRoot32BitConstant( MaterialIndexSlot, CurrMaterialID, 0 );
+        }
+        else if( pDraw->MaterialID != CurrMaterialID )
+        {
+            CurrMaterialID = pDraw->MaterialID;
+
+            UINT BindMask = pTextureMask[CurrMaterialID] & SlotMask;
+            for( UINT t = 0; BindMask; t++, BindMask >>= 1 )
+            {
+                if( !( BindMask & 1 ) )
+                    continue;
+
+                INT HeapIndex = MaterialTable.HeapIndex[t][CurrMaterialID];
+                if( HeapIndex != CurrHeapIndex[t] )
+                {
+                    CurrHeapIndex[t] = HeapIndex;
+                    pRecorder->SetGraphicsRootDescriptorTable(
+                        RootSlots[t], OffsetDescriptor( hDescriptorStart, HeapIndex, CbvSrvUavDescriptorSize ) );
+                }
+            }
+        }
+
+        pRecorder->DrawIndexedInstanced( pDraw->IndexCount, NumInstances, pDraw->IndexStart, pDraw->VertexStart, 0 );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Only positions and indices are bound, and since no material state is set the draws are
+// coalesced across material boundaries as well.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::RenderMeshDepth( UINT iMesh,
+                                          ICommandRecorder* pRecorder ) const
+{
+    const SDKMESH_MESH_PACKET* pMeshPacket = &MeshPackets[iMesh];
+    const SDKMESH_DRAW_PACKET* pDraw = DrawPackets.data() + pMeshPacket->FirstDrawPacket;
+    const SDKMESH_DRAW_PACKET* pDrawEnd = pDraw + pMeshPacket->NumDrawPackets;
+
+    if( pMeshPacket->PositionVBV.BufferLocation )
+        pRecorder->IASetVertexBuffers( 0, 1, &pMeshPacket->PositionVBV );
+    else
+        pRecorder->IASetVertexBuffers( 0, pMeshPacket->NumVertexBuffers, pMeshPacket->VBV );
+    pRecorder->IASetIndexBuffer( &pMeshPacket->IBV );
+
+    D3D12_PRIMITIVE_TOPOLOGY CurrPrimType = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+    for( ; pDraw != pDrawEnd; ++pDraw )
+    {
+        SDKMESH_DRAW_PACKET Draw = *pDraw;
+        while( pDraw + 1 != pDrawEnd && IsContiguousDraw( Draw, pDraw[1] ) )
+        {
+            ++pDraw;
+            Draw.IndexCount += pDraw->IndexCount;
+        }
+
+        if( Draw.PrimType != CurrPrimType )
+        {
+            CurrPrimType = Draw.PrimType;
+            pRecorder->IASetPrimitiveTopology( CurrPrimType );
+        }
+
+        pRecorder->DrawIndexedInstanced( Draw.IndexCount, 1, Draw.IndexStart, Draw.VertexStart, 0 );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Key every draw packet of the meshes and sort the keys.  The depth is taken once per
+// mesh, at its bounds center.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::BuildSortedDrawList( const UINT* pMeshes, UINT NumMeshes, const SDKMESH_SORT_PARAMS& Params,
+                                              SDKMESH_SORTED_DRAW_LIST* pSortedList, JobSystem* pJobSystem ) const
+{
+    const UINT64 MaterialMask = ( 1ull << SDKMESH_SORT_MATERIAL_BITS ) - 1;
+    const UINT DepthMax = ( 1u << SDKMESH_SORT_DEPTH_BITS ) - 1;
+
+    pSortedList->Keys.clear();
+    pSortedList->Draws.clear();
+
+    if( MeshPackets.empty() )
+        return;
+
+    static_assert( SDKMESH_SORT_PASS_BITS + SDKMESH_SORT_PIPELINE_BITS + SDKMESH_SORT_MATERIAL_BITS +
+                   SDKMESH_SORT_DEPTH_BITS + SDKMESH_SORT_MESH_BITS == 64, "Sort key fields must fill 64 bits" );
+    assert( MeshPackets.size() <= ( 1ull << SDKMESH_SORT_MESH_BITS ) );
+
+    UINT64 StateBits = ( UINT64 )( Params.Pass & ( ( 1u << SDKMESH_SORT_PASS_BITS ) - 1 ) );
+    StateBits = ( StateBits << SDKMESH_SORT_PIPELINE_BITS ) | ( Params.PipelineState & ( ( 1u << SDKMESH_SORT_PIPELINE_BITS ) - 1 ) );
+    StateBits <<= SDKMESH_SORT_MATERIAL_BITS;
+
+    XMVECTOR vDepthPlane = XMLoadFloat4( &Params.DepthPlane );
+    float DepthScale = Params.MaxDepth > 0.0f ? DepthMax / Params.MaxDepth : 0.0f;
+
+    for( UINT i = 0; i < NumMeshes; i++ )
+    {
+        UINT iMesh = pMeshes[i];
+        if( iMesh >= MeshPackets.size() )
+            continue;
+
+        const SDKMESH_MESH_PACKET* pMeshPacket = &MeshPackets[iMesh];
+
+        float Depth = XMVectorGetX( XMPlaneDotCoord( vDepthPlane, XMLoadFloat3( &pMeshPacket->BoundsCenter ) ) );
+        UINT DepthBucket = ( UINT )( ( std::min )( ( std::max )( Depth * DepthScale, 0.0f ), ( float )DepthMax ) );
+        UINT64 DepthBits = ( ( UINT64 )DepthBucket << SDKMESH_SORT_MESH_BITS ) | iMesh;
+
+        for( UINT d = 0; d < pMeshPacket->NumDrawPackets; d++ )
+        {
+            UINT iDraw = pMeshPacket->FirstDrawPacket + d;
+            UINT64 Key = StateBits;
+
+            if( !Params.DepthOnly )
+                Key |= ( std::min )( ( UINT64 )DrawPackets[iDraw].MaterialID, MaterialMask );
+
+            pSortedList->Keys.push_back( ( Key << ( SDKMESH_SORT_DEPTH_BITS + SDKMESH_SORT_MESH_BITS ) ) | DepthBits );
+            pSortedList->Draws.push_back( iDraw );
+        }
+    }
+
+    pSortedList->Sorter.Sort( pSortedList->Keys.data(), pSortedList->Draws.data(), pSortedList->NumDraws(), pJobSystem );
+}
+
+//--------------------------------------------------------------------------------------
+// Meshes often share their buffers, so the views are compared rather than the mesh
+// indices, and the descriptor tables are tracked per slot.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::RenderSortedDrawList( const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                               UINT FirstDraw,
+                                               UINT EndDraw,
+                                               ICommandRecorder* pRecorder,
+                                               D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                               UINT iDiffuseSlot,
+                                               UINT iNormalSlot,
+                                               UINT iSpecularSlot ) const
+{
+    const UINT MeshMask = ( 1u << SDKMESH_SORT_MESH_BITS ) - 1;
+
+    const UINT RootSlots[TS_COUNT] = { iDiffuseSlot, iNormalSlot, iSpecularSlot };
+    UINT SlotMask = 0;
+    for( UINT t = 0; t < TS_COUNT; t++ )
+    {
+        if( RootSlots[t] != INVALID_SAMPLER_SLOT )
+            SlotMask |= 1u << t;
+    }
+
+    const SDKMESH_MESH_PACKET* pCurrMeshPacket = nullptr;
+    D3D12_PRIMITIVE_TOPOLOGY CurrPrimType = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    UINT CurrMesh = INVALID_MESH;
+    UINT CurrMaterialID = INVALID_MATERIAL;
+    INT CurrHeapIndex[TS_COUNT] = { INT_MIN, INT_MIN, INT_MIN };
+    const UINT* pTextureMask = MaterialTable.TextureMask.data();
+    const bool bBindless = IsBindlessMaterialsEnabled();
+
+    EndDraw = ( std::min )( EndDraw, pSortedList->NumDraws() );
+
+    for( UINT i = FirstDraw; i < EndDraw; i++ )
+    {
+        UINT iMesh = ( UINT )pSortedList->Keys[i] & MeshMask;
+        const SDKMESH_DRAW_PACKET* pDraw = &DrawPackets[ pSortedList->Draws[i] ];
+
+        if( iMesh != CurrMesh )
+        {
+            const SDKMESH_MESH_PACKET* pMeshPacket = &MeshPackets[iMesh];
+            CurrMesh = iMesh;
+
+            if( !pCurrMeshPacket || pCurrMeshPacket->NumVertexBuffers != pMeshPacket->NumVertexBuffers ||
+                memcmp( pCurrMeshPacket->VBV, pMeshPacket->VBV, pMeshPacket->NumVertexBuffers * sizeof( D3D12_VERTEX_BUFFER_VIEW ) ) )
+                pRecorder->IASetVertexBuffers( 0, pMeshPacket->NumVertexBuffers, pMeshPacket->VBV );
+            if( !pCurrMeshPacket || memcmp( &pCurrMeshPacket->IBV, &pMeshPacket->IBV, sizeof( D3D12_INDEX_BUFFER_VIEW ) ) )
+                pRecorder->IASetIndexBuffer( &pMeshPacket->IBV );
+
+            pCurrMeshPacket = pMeshPacket;
+        }
+
+        if( pDraw->PrimType != CurrPrimType )
+        {
+            CurrPrimType = pDraw->PrimType;
+            pRecorder->IASetPrimitiveTopology( CurrPrimType );
+        }
+
+        if( pDraw->MaterialID != CurrMaterialID && bBindless )
+        {
+            CurrMaterialID = pDraw->MaterialID;
+            pRecorder->SetGraphicsRoot32BitConstant( MaterialIndexSlot, CurrMaterialID, 0 );
+        }
+        else if( pDraw->MaterialID != CurrMaterialID )
+        {
+            CurrMaterialID = pDraw->MaterialID;
+
+            UINT BindMask = pTextureMask[CurrMaterialID] & SlotMask;
+            for( UINT t = 0; BindMask; t++, BindMask >>= 1 )
+            {
+                if( !( BindMask & 1 ) )
+                    continue;
+
+                INT HeapIndex = MaterialTable.HeapIndex[t][CurrMaterialID];
+                if( HeapIndex != CurrHeapIndex[t] )
+                {
+                    CurrHeapIndex[t] = HeapIndex;
+                    pRecorder->SetGraphicsRootDescriptorTable(
+                        RootSlots[t], OffsetDescriptor( hDescriptorStart, HeapIndex, CbvSrvUavDescriptorSize ) );
+                }
+            }
+        }
+
+        pRecorder->DrawIndexedInstanced( pDraw->IndexCount, 1, pDraw->IndexStart, pDraw->VertexStart, 0 );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Consecutive draws of a mesh are coalesced the way RenderMeshDepth does, and the position
+// streams are compared like the views above.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::RenderSortedDrawListDepth( const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                                    UINT FirstDraw,
+                                                    UINT EndDraw,
+                                                    ICommandRecorder* pRecorder ) const
+{
+    const UINT MeshMask = ( 1u << SDKMESH_SORT_MESH_BITS ) - 1;
+
+    D3D12_VERTEX_BUFFER_VIEW CurrVBV[MAX_VERTEX_STREAMS];
+    UINT CurrNumVBs = 0;
+    D3D12_INDEX_BUFFER_VIEW CurrIBV = {};
+    D3D12_PRIMITIVE_TOPOLOGY CurrPrimType = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+    EndDraw = ( std::min )( EndDraw, pSortedList->NumDraws() );
+
+    for( UINT i = FirstDraw; i < EndDraw; i++ )
+    {
+        UINT iMesh = ( UINT )pSortedList->Keys[i] & MeshMask;
+        const SDKMESH_MESH_PACKET* pMeshPacket = &MeshPackets[iMesh];
+        SDKMESH_DRAW_PACKET Draw = DrawPackets[ pSortedList->Draws[i] ];
+
+        while( i + 1 < EndDraw && ( ( UINT )pSortedList->Keys[i + 1] & MeshMask ) == iMesh &&
+               IsContiguousDraw( Draw, DrawPackets[ pSortedList->Draws[i + 1] ] ) )
+        {
+            ++i;
+            Draw.IndexCount += DrawPackets[ pSortedList->Draws[i] ].IndexCount;
+        }
+
+        const D3D12_VERTEX_BUFFER_VIEW* pVBV = pMeshPacket->VBV;
+        UINT NumVBs = pMeshPacket->NumVertexBuffers;
+        if( pMeshPacket->PositionVBV.BufferLocation )
+        {
+            pVBV = &pMeshPacket->PositionVBV;
+            NumVBs = 1;
+        }
+
+        if( NumVBs != CurrNumVBs || memcmp( CurrVBV, pVBV, NumVBs * sizeof( D3D12_VERTEX_BUFFER_VIEW ) ) )
+        {
+            CurrNumVBs = NumVBs;
+            memcpy( CurrVBV, pVBV, NumVBs * sizeof( D3D12_VERTEX_BUFFER_VIEW ) );
+            pRecorder->IASetVertexBuffers( 0, NumVBs, pVBV );
+        }
+
+        if( memcmp( &CurrIBV, &pMeshPacket->IBV, sizeof( D3D12_INDEX_BUFFER_VIEW ) ) )
+        {
+            CurrIBV = pMeshPacket->IBV;
+            pRecorder->IASetIndexBuffer( &CurrIBV );
+        }
+
+        if( Draw.PrimType != CurrPrimType )
+        {
+            CurrPrimType = Draw.PrimType;
+            pRecorder->IASetPrimitiveTopology( CurrPrimType );
+        }
+
+        pRecorder->DrawIndexedInstanced( Draw.IndexCount, 1, Draw.IndexStart, Draw.VertexStart, 0 );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// The draw packets of a mesh are contiguous in its index buffer more often than not, the
+// builder merges those that share a material back into one command.
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void SDKMESH_PACKET_SET::BuildIndirectDraws( const UINT* pMeshes, UINT NumMeshes, bool bDepthOnly,
+                                             IndirectDrawBuilder* pBuilder, std::vector<UINT>* pDirectMeshes ) const
+{
+    for( UINT i = 0; i < NumMeshes; i++ )
+    {
+        UINT iMesh = pMeshes[i];
+
+        if( iMesh >= MeshPackets.size() )
+        {
+            pDirectMeshes->push_back( iMesh );
+            continue;
+        }
+
+        const SDKMESH_MESH_PACKET* pMeshPacket = &MeshPackets[iMesh];
+        const SDKMESH_DRAW_PACKET* pDraw = DrawPackets.data() + pMeshPacket->FirstDrawPacket;
+        const SDKMESH_DRAW_PACKET* pDrawEnd = pDraw + pMeshPacket->NumDrawPackets;
+        const bool bPositions = bDepthOnly && pMeshPacket->PositionVBV.BufferLocation;
+
+        bool bIndirect = bPositions || pMeshPacket->NumVertexBuffers == 1;
+        for( const SDKMESH_DRAW_PACKET* p = pDraw; bIndirect && p != pDrawEnd; ++p )
+            bIndirect = p->PrimType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+        if( !bIndirect )
+        {
+            pDirectMeshes->push_back( iMesh );
+            continue;
+        }
+
+        pBuilder->SetBuffers( bPositions ? pMeshPacket->PositionVBV : pMeshPacket->VBV[0], pMeshPacket->IBV );
+        for( ; pDraw != pDrawEnd; ++pDraw )
+            pBuilder->AddDraw( bDepthOnly ? 0 : pDraw->MaterialID, pDraw->IndexCount, pDraw->IndexStart, pDraw->VertexStart );
+    }
+}
@@ -0,0 +1,217 @@
+//--------------------------------------------------------------------------------------
+// File: SDKmeshPackets.h
+//
+// Draw packets, draw lists and sorted draw lists of CDXUTSDKMesh.  Everything in here
+// records through an ICommandRecorder and only needs the D3D12 and DirectXMath types,
+// so it builds and runs without a device.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkId=320437
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "D3D12Types.h"
+#include "FrustumCuller.h"
+#include "CommandRecorder.h"
+#include "RadixSort.h"
+#include <vector>
+
+#ifndef MAX_VERTEX_STREAMS
+#define MAX_VERTEX_STREAMS 16
+#endif
+#ifndef INVALID_MESH
+#define INVALID_MESH ((UINT)-1)
+#endif
+#ifndef INVALID_MATERIAL
+#define INVALID_MATERIAL ((UINT)-1)
+#endif
+#ifndef INVALID_SAMPLER_SLOT
+#define INVALID_SAMPLER_SLOT ((UINT)-1)
+#endif
+
+class JobSystem;
+class IndirectDrawBuilder;
+
+//--------------------------------------------------------------------------------------
+// Draw packets.  Everything RenderMesh needs is resolved once after loading so that the
+// per-frame path is a flat walk over these arrays.
+//--------------------------------------------------------------------------------------
+enum SDKMESH_TEXTURE_SLOT
+{
+    TS_DIFFUSE = 0,
+    TS_NORMAL,
+    TS_SPECULAR,
+    TS_COUNT,
+};
+
+// Dense copy of the per-material state the draw loops read, one array per field so that
+// recording touches a few bytes per material instead of a whole SDKMESH_MATERIAL.
+struct SDKMESH_MATERIAL_TABLE
+{
+    std::vector<INT>  HeapIndex[TS_COUNT];  // Descriptor offsets relative to hDescriptorStart
+    std::vector<UINT> TextureMask;          // Bit (1 << SDKMESH_TEXTURE_SLOT) set when the texture is bindable
+
+    UINT Size() const { return ( UINT )TextureMask.size(); }
+    void Clear()
+    {
+        for( auto &a : HeapIndex )
+            a.clear();
+        TextureMask.clear();
+    }
+};
+
+struct SDKMESH_DRAW_PACKET
+{
+    D3D12_PRIMITIVE_TOPOLOGY PrimType;
+    UINT IndexCount;
+    UINT IndexStart;
+    INT  VertexStart;
+    UINT MaterialID;            // Index into SDKMESH_MATERIAL_TABLE
+};
+
+struct SDKMESH_MESH_PACKET
+{
+    UINT NumVertexBuffers;
+    D3D12_VERTEX_BUFFER_VIEW VBV[MAX_VERTEX_STREAMS];
+    D3D12_INDEX_BUFFER_VIEW IBV;
+    D3D12_VERTEX_BUFFER_VIEW PositionVBV;   // Packed float3 positions, BufferLocation is 0 when not split
+    DirectX::XMFLOAT3 BoundsCenter;         // World space, where the depth of the mesh is taken when sorting
+    UINT FirstDrawPacket;
+    UINT NumDrawPackets;
+};
+
+//--------------------------------------------------------------------------------------
+// Draw lists.  The frame hierarchy is flattened once after loading; a draw list is the
+// subset of it that survived culling against one view, in traversal order.
+//--------------------------------------------------------------------------------------
+
+// Six outward facing world space planes, in the form DirectX::BoundingBox::ContainedBy takes
+struct SDKMESH_FRUSTUM
+{
+    DirectX::XMFLOAT4 Planes[6];
+
+    // Extract the planes of a row-vector, D3D style ( 0 <= z <= w ) view-projection matrix
+    void CreateFromMatrix( _In_ DirectX::FXMMATRIX ViewProj );
+};
+
+struct SDKMESH_DRAW_LIST
+{
+    std::vector<UINT> Meshes;                   // Visible mesh indices in frame traversal order
+    FrustumCuller Bounds;                       // Scratch, world space bounds of every frame mesh
+    std::vector<UINT> Visible;                  // Scratch, frame mesh slots that passed the cull
+    UINT NumTotal;
+
+    SDKMESH_DRAW_LIST() : NumTotal(0) {}
+    UINT NumVisible() const { return ( UINT )Meshes.size(); }
+};
+
+// Visibility of every frame mesh in several views, from one culling sweep
+struct SDKMESH_VIEW_MASKS
+{
+    FrustumCuller Bounds;                       // World space bounds of every frame mesh
+    std::vector<UINT> Masks;                    // Bit v set when the frame mesh is visible in view v
+    UINT NumViews;
+
+    SDKMESH_VIEW_MASKS() : NumViews(0) {}
+
+    // Split the masks into per-view draw lists, pItemMeshes gives the mesh of every frame mesh
+    void BuildDrawLists( _In_reads_(Masks.size()) const UINT* pItemMeshes,
+                         _Out_writes_(NumViews) SDKMESH_DRAW_LIST* pDrawLists ) const;
+};
+
+//--------------------------------------------------------------------------------------
+// Sorted draw lists.  Every draw packet of the listed meshes gets a 64-bit key, made of
+// the fields below from the most significant bits down.  Played back in key order, the
+// draws sharing state follow each other and only the state that changes is set, across
+// mesh boundaries as well.
+//--------------------------------------------------------------------------------------
+#define SDKMESH_SORT_PASS_BITS      4
+#define SDKMESH_SORT_PIPELINE_BITS  8
+#define SDKMESH_SORT_MATERIAL_BITS  16
+#define SDKMESH_SORT_DEPTH_BITS     16
+#define SDKMESH_SORT_MESH_BITS      20
+
+struct SDKMESH_SORT_PARAMS
+{
+    UINT Pass;                                  // Wider values are masked
+    UINT PipelineState;
+    DirectX::XMFLOAT4 DepthPlane;               // Depth of a draw is the distance of its mesh's world bounds center
+    float MaxDepth;                             // to this plane, clamped to [0, MaxDepth] and bucketed
+    bool DepthOnly;                             // Leaves the material out, depth draws do not bind one
+};
+
+struct SDKMESH_SORTED_DRAW_LIST
+{
+    std::vector<UINT64> Keys;                   // Ascending, the mesh of a draw is in its low bits
+    std::vector<UINT> Draws;                    // Draw packet indices in key order
+    RadixSorter Sorter;
+
+    UINT NumDraws() const { return ( UINT )Draws.size(); }
+};
+
+//--------------------------------------------------------------------------------------
+// The compiled draw state of a set of meshes and the draw loops over it.  CDXUTSDKMesh
+// fills one from the loaded file; anything else may fill one from memory, the buffer
+// views are only ever handed to the recorder.
+//--------------------------------------------------------------------------------------
+struct SDKMESH_PACKET_SET
+{
+    SDKMESH_MATERIAL_TABLE MaterialTable;
+    std::vector<SDKMESH_MESH_PACKET> MeshPackets;   // Indexed by mesh
+    std::vector<SDKMESH_DRAW_PACKET> DrawPackets;
+    UINT CbvSrvUavDescriptorSize;
+    UINT MaterialIndexSlot;     // Root constant of the bindless material index, INVALID_SAMPLER_SLOT for tables
+
+    SDKMESH_PACKET_SET() : CbvSrvUavDescriptorSize(0), MaterialIndexSlot(INVALID_SAMPLER_SLOT) {}
+
+    UINT NumMeshes() const { return ( UINT )MeshPackets.size(); }
+    bool IsBindlessMaterialsEnabled() const { return MaterialIndexSlot != INVALID_SAMPLER_SLOT; }
+
+    // Drop the packets, the material table and the bindings are kept
+    void Clear();
+
+    // Append the next mesh, its draws are the ones added until the next AddMesh.  A draw
+    // sharing material, topology and base vertex with the previous draw of the mesh whose
+    // index range continues it is merged into that draw.
+    void AddMesh( _In_ const SDKMESH_MESH_PACKET& MeshPacket );
+    void AddDraw( _In_ const SDKMESH_DRAW_PACKET& Draw );
+
+    // Replay the packets of a mesh, skipping topology and descriptor table changes that
+    // would not alter the bound state.
+    void RenderMesh( _In_ UINT iMesh,
+                     _In_ ICommandRecorder* pRecorder,
+                     _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                     _In_ UINT iDiffuseSlot,
+                     _In_ UINT iNormalSlot,
+                     _In_ UINT iSpecularSlot,
+                     _In_ UINT NumInstances = 1 ) const;
+    void RenderMeshDepth( _In_ UINT iMesh,
+                          _In_ ICommandRecorder* pRecorder ) const;
+
+    // See CDXUTSDKMesh, the meshes must have packets
+    void BuildSortedDrawList( _In_reads_(NumMeshes) const UINT* pMeshes,
+                              _In_ UINT NumMeshes,
+                              _In_ const SDKMESH_SORT_PARAMS& Params,
+                              _Inout_ SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                              _In_opt_ JobSystem* pJobSystem = nullptr ) const;
+    void RenderSortedDrawList( _In_ const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                               _In_ UINT FirstDraw,
+                               _In_ UINT EndDraw,
+                               _In_ ICommandRecorder* pRecorder,
+                               _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                               _In_ UINT iDiffuseSlot,
+                               _In_ UINT iNormalSlot,
+                               _In_ UINT iSpecularSlot ) const;
+    void RenderSortedDrawListDepth( _In_ const SDKMESH_SORTED_DRAW_LIST* pSortedList,
+                                    _In_ UINT FirstDraw,
+                                    _In_ UINT EndDraw,
+                                    _In_ ICommandRecorder* pRecorder ) const;
+    // Meshes without packets go to pDirectMeshes along with the ones ExecuteIndirect can not draw
+    void BuildIndirectDraws( _In_reads_(NumMeshes) const UINT* pMeshes,
+                             _In_ UINT NumMeshes,
+                             _In_ bool bDepthOnly,
+                             _Inout_ IndirectDrawBuilder* pBuilder,
+                             _Inout_ std::vector<UINT>* pDirectMeshes ) const;
+};
@@ -17,6 +17,9 @@ public:
 
   HRESULT WaitForSyncPoint(_In_ UINT64 iSyncPoint, _In_opt_ INT iMaxSpinCount = 4000);
 
+  /// Last sync point the GPU has reached, every point up to it is complete.
+  UINT64 GetCompletedSyncPoint() const;
+
   HRESULT FlushAndReset();
 
 private:
@@ -38,4 +41,8 @@ inline bool SyncFence::operator == (nullptr_t) const {
 
 inline bool SyncFence::operator!=(nullptr_t) const {
   return m_pd3dFence != nullptr;
-}
\ No newline at end of file
+}
+
+inline UINT64 SyncFence::GetCompletedSyncPoint() const {
+  return m_pd3dFence ? m_pd3dFence->GetCompletedValue() : 0;
+}
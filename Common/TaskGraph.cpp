@@ -0,0 +1,55 @@
+#include "TaskGraph.h"
+
+void TaskGraph::Clear() {
+  m_aNodes.clear();
+}
+
+TaskGraph::NodeId TaskGraph::AddNode(const char *pName, JobSystem::JobFunction Function) {
+  Node node;
+  node.Name = pName;
+  node.Function = std::move(Function);
+  node.uNumDependencies = 0;
+  m_aNodes.push_back(std::move(node));
+  return (NodeId)m_aNodes.size() - 1;
+}
+
+void TaskGraph::AddDependency(NodeId iNode, NodeId iDependency) {
+  m_aNodes[iDependency].Successors.push_back(iNode);
+  ++m_aNodes[iNode].uNumDependencies;
+}
+
+void TaskGraph::Execute(JobSystem *pJobSystem) {
+  uint32_t uNumNodes = GetNodeCount();
+  JobCounter counter;
+
+  if (uNumNodes > m_uPendingCapacity) {
+    m_aPending.reset(new std::atomic<uint32_t>[uNumNodes]);
+    m_uPendingCapacity = uNumNodes;
+  }
+
+  for (uint32_t i = 0; i < uNumNodes; ++i)
+    m_aPending[i].store(m_aNodes[i].uNumDependencies, std::memory_order_relaxed);
+
+  for (uint32_t i = 0; i < uNumNodes; ++i) {
+    if (m_aNodes[i].uNumDependencies == 0)
+      RunNode(pJobSystem, (NodeId)i, &counter);
+  }
+
+  pJobSystem->Wait(&counter);
+}
+
+void TaskGraph::RunNode(JobSystem *pJobSystem, NodeId iNode, JobCounter *pCounter) {
+  pJobSystem->Run(
+      [=]() {
+        const Node &node = m_aNodes[iNode];
+
+        node.Function();
+
+        // Successors are queued before this job completes, so the counter cannot drain early
+        for (NodeId iSuccessor : node.Successors) {
+          if (m_aPending[iSuccessor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            RunNode(pJobSystem, iSuccessor, pCounter);
+        }
+      },
+      pCounter);
+}
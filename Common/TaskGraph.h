@@ -0,0 +1,50 @@
+#pragma once
+#include "JobSystem.h"
+
+///
+/// Declarative graph of jobs. Nodes and their dependencies are set up once and the graph is
+/// then executed as many times as needed, typically once per frame. A node is queued as soon
+/// as every node it depends on is done, so independent branches run concurrently and only
+/// the nodes that really wait on something are ordered.
+///
+class TaskGraph {
+public:
+  typedef int NodeId;
+
+  void Clear();
+
+  NodeId AddNode(const char *pName, JobSystem::JobFunction Function);
+  /// iNode starts only after iDependency has finished. The graph must stay acyclic.
+  void AddDependency(NodeId iNode, NodeId iDependency);
+
+  uint32_t GetNodeCount() const;
+  const char *GetNodeName(NodeId iNode) const;
+
+  /// Runs every node once and returns when all of them are done. The calling thread runs
+  /// jobs while it waits.
+  void Execute(JobSystem *pJobSystem);
+
+private:
+  struct Node {
+    const char *Name;
+    JobSystem::JobFunction Function;
+    std::vector<NodeId> Successors;
+    uint32_t uNumDependencies;
+  };
+
+  void RunNode(JobSystem *pJobSystem, NodeId iNode, JobCounter *pCounter);
+
+  std::vector<Node> m_aNodes;
+  // Dependencies not yet finished in the current execution
+  std::unique_ptr<std::atomic<uint32_t>[]> m_aPending;
+  uint32_t m_uPendingCapacity = 0;
+};
+
+/// Inline implementation
+inline uint32_t TaskGraph::GetNodeCount() const {
+  return (uint32_t)m_aNodes.size();
+}
+
+inline const char *TaskGraph::GetNodeName(NodeId iNode) const {
+  return m_aNodes[iNode].Name;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "d3dUtils.h"
+#include "UploadBufferStack.h"
 #include <vector>
 
 class UploadBuffer
@@ -14,6 +15,12 @@ public:
     );
 
     VOID CopyData(const void *pBuffer, UINT cbBuffer, UINT iIndex);
+    /// Copies uCount consecutive elements starting at iIndex, pBuffer is packed with
+    /// cbPerElement bytes per element.
+    VOID CopyElements(const void *pBuffer, UINT uCount, UINT iIndex);
+
+    /// Upload heap resource, for the APIs taking a buffer and an offset rather than an address.
+    ID3D12Resource *GetResource() const;
 
     D3D12_GPU_VIRTUAL_ADDRESS GetConstBufferAddress() const;
     D3D12_GPU_VIRTUAL_ADDRESS GetConstBufferAddress(UINT uIndex) const;
@@ -31,36 +38,3 @@ protected:
     UINT            m_cbElementStride = 0;
 };
 
-
-
-class UploadBufferStack {
-public:
-  UploadBufferStack();
-  ~UploadBufferStack();
-  HRESULT Initialize(ID3D12Device *pDevice, UINT BlockSize, UINT ReservedBlockCount);
-  HRESULT Push(_In_ const void *pData, _In_ UINT uBufferSize, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV = nullptr);
-  HRESULT Push(_In_ UINT uBufferSize, _Out_opt_ void **ppMappedData, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV = nullptr);
-  void Clear();
-  void ClearCapacity();
-private:
-  void Destroy();
-  void LockAllocator();
-  void UnlockAllocator();
-
-  struct BufferStorage {
-    ID3D12Resource *UploadBuffer;
-    UINT BufferSize;
-    void *pMappedData;
-  };
-
-  ID3D12Device *m_pd3dDevice;
-  std::vector<BufferStorage> m_aBufferStorage;
-  UINT m_uBlockSize;
-  UINT m_uReservedBlockCount;
-  UINT m_uCurrBlock;
-  UINT m_uCurrOffsetInBlock;
-  UINT m_uCurrBufferSize;
-
-  // Multithread support
-  CRITICAL_SECTION m_csAlloc;
-};
@@ -0,0 +1,211 @@
+#include "UploadBufferStack.h"
+#include <cstring>
+#include <new>
+
+namespace {
+// Where the calling thread allocates in a stack. A handful of stacks are live at a time, one
+// per frame in flight, and a thread pushes to one of them per frame, so a small direct
+// mapped cache does. A collision only costs a fresh block.
+struct UPLOAD_STACK_THREAD_CURSOR {
+  const void *pOwner;
+  UINT64 uEpoch;
+  UINT uBlock;
+  UINT uOffset;
+};
+
+const UINT s_uNumUploadStackCursors = 8;
+thread_local UPLOAD_STACK_THREAD_CURSOR t_aUploadStackCursors[s_uNumUploadStackCursors];
+std::atomic<UINT64> s_uNextUploadStackEpoch(1);
+} // namespace
+
+UploadBufferStack::UploadBufferStack() : m_uNumBlocks(0), m_uNextBlock(0) {
+  m_pd3dDevice = nullptr;
+  m_uMaxBlockCount = 0;
+  m_uBlockSize = 0;
+  m_uReservedBlockCount = 0;
+  m_uEpoch = s_uNextUploadStackEpoch.fetch_add(1);
+}
+
+UploadBufferStack::~UploadBufferStack() {
+
+  Destroy();
+  if(m_pd3dDevice)
+    m_pd3dDevice->Release();
+}
+
+void UploadBufferStack::Destroy() {
+
+  UINT uNumBlocks = m_uNumBlocks.load(std::memory_order_relaxed);
+
+  for(UINT i = 0; i < uNumBlocks; ++i)
+    ReleaseBlock(i);
+
+  m_uNumBlocks.store(0, std::memory_order_relaxed);
+  m_uNextBlock.store(0, std::memory_order_relaxed);
+  m_uEpoch = s_uNextUploadStackEpoch.fetch_add(1);
+}
+
+void UploadBufferStack::ReleaseBlock(UINT uBlock) {
+
+  BufferStorage &block = m_aBufferStorage[uBlock];
+
+  if(block.UploadBuffer)
+    block.UploadBuffer->Release();
+  block.UploadBuffer = nullptr;
+  block.SystemMemory.reset();
+}
+
+HRESULT UploadBufferStack::Initialize(ID3D12Device *pDevice, UINT BlockSize, UINT ReservedBlockCount, UINT MaxBlockCount) {
+
+  if(BlockSize < 1 || MaxBlockCount < 1)
+    return E_INVALIDARG;
+
+  Destroy();
+
+  if(pDevice)
+    pDevice->AddRef();
+  if(m_pd3dDevice)
+    m_pd3dDevice->Release();
+  m_pd3dDevice = pDevice;
+  m_uBlockSize = CalcConstantBufferByteSize(BlockSize);
+  m_uReservedBlockCount = (std::min)(ReservedBlockCount, MaxBlockCount);
+  m_uMaxBlockCount = MaxBlockCount;
+  m_aBufferStorage.reset(new BufferStorage[MaxBlockCount]());
+  return S_OK;
+}
+
+HRESULT UploadBufferStack::Push(_In_ const void *pData, _In_ UINT uBufferSize, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV) {
+
+  void *pMappedData;
+  HRESULT hr = Push(uBufferSize, &pMappedData, pCBV);
+  if(SUCCEEDED(hr))
+    memcpy(pMappedData, pData, uBufferSize);
+  return hr;
+}
+
+HRESULT UploadBufferStack::Push(_In_ UINT uBufferSize, _Out_opt_ void **ppMappedData, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV) {
+
+  if(m_uBlockSize == 0)
+    return E_FAIL;
+
+  // The block size bounds a push
+  if(uBufferSize > m_uBlockSize)
+    return E_INVALIDARG;
+
+  HRESULT hr = S_OK;
+
+  uBufferSize = CalcConstantBufferByteSize(uBufferSize);
+
+  auto &cursor = t_aUploadStackCursors[(reinterpret_cast<uintptr_t>(this) / alignof(UploadBufferStack)) %
+                                       s_uNumUploadStackCursors];
+
+  // Nothing shared is touched while the thread's own block has room
+  if(cursor.pOwner != this || cursor.uEpoch != m_uEpoch || cursor.uOffset + uBufferSize > m_uBlockSize) {
+    UINT uBlock;
+    hr = AcquireBlock(&uBlock);
+    if(FAILED(hr))
+      return hr;
+    cursor = { this, m_uEpoch, uBlock, 0 };
+  }
+
+  const BufferStorage &block = m_aBufferStorage[cursor.uBlock];
+  UINT uOffset = cursor.uOffset;
+  cursor.uOffset += uBufferSize;
+
+  if(ppMappedData) *ppMappedData = (BYTE *)block.pMappedData + uOffset;
+  if(pCBV) {
+    pCBV->BufferLocation = block.BufferLocation + uOffset;
+    pCBV->SizeInBytes = uBufferSize;
+  }
+
+  return hr;
+}
+
+HRESULT UploadBufferStack::AcquireBlock(_Out_ UINT *puBlock) {
+
+  HRESULT hr = S_OK;
+  UINT uBlock = m_uNextBlock.fetch_add(1, std::memory_order_relaxed);
+
+  // All blocks are in use
+  if(uBlock >= m_uMaxBlockCount)
+    return E_OUTOFMEMORY;
+
+  // Blocks kept from earlier frames are simply taken, only growing the stack locks
+  if(uBlock >= m_uNumBlocks.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(m_GrowLock);
+    while(SUCCEEDED(hr) && m_uNumBlocks.load(std::memory_order_relaxed) <= uBlock)
+      hr = CreateBlock(m_uNumBlocks.load(std::memory_order_relaxed));
+    if(FAILED(hr))
+      return hr;
+  }
+
+  *puBlock = uBlock;
+  return hr;
+}
+
+HRESULT UploadBufferStack::CreateBlock(UINT uBlock) {
+
+  BufferStorage &block = m_aBufferStorage[uBlock];
+
+  if(m_pd3dDevice == nullptr) {
+    block.SystemMemory.reset(new (std::nothrow) BYTE[m_uBlockSize]);
+    if(!block.SystemMemory)
+      return E_OUTOFMEMORY;
+    block.BufferLocation = (D3D12_GPU_VIRTUAL_ADDRESS)uBlock * m_uBlockSize;
+    block.pMappedData = block.SystemMemory.get();
+    m_uNumBlocks.store(uBlock + 1, std::memory_order_release);
+    return S_OK;
+  }
+
+  D3D12_HEAP_PROPERTIES heapProperties = {};
+  heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+  heapProperties.CreationNodeMask = 1;
+  heapProperties.VisibleNodeMask = 1;
+
+  D3D12_RESOURCE_DESC bufferDesc = {};
+  bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+  bufferDesc.Width = m_uBlockSize;
+  bufferDesc.Height = 1;
+  bufferDesc.DepthOrArraySize = 1;
+  bufferDesc.MipLevels = 1;
+  bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+  bufferDesc.SampleDesc.Count = 1;
+  bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+  ID3D12Resource *pBuffer = nullptr;
+  void *pMappedData = nullptr;
+
+  HRESULT hr = m_pd3dDevice->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+                                                     D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&pBuffer));
+  if(FAILED(hr))
+    return hr;
+
+  hr = pBuffer->Map(0, nullptr, &pMappedData);
+  if(FAILED(hr)) {
+    pBuffer->Release();
+    return hr;
+  }
+
+  block.UploadBuffer = pBuffer;
+  block.BufferLocation = pBuffer->GetGPUVirtualAddress();
+  block.pMappedData = pMappedData;
+  m_uNumBlocks.store(uBlock + 1, std::memory_order_release);
+  return hr;
+}
+
+void UploadBufferStack::Clear() {
+
+  m_uNextBlock.store(0, std::memory_order_relaxed);
+  m_uEpoch = s_uNextUploadStackEpoch.fetch_add(1);
+}
+
+void UploadBufferStack::ClearCapacity() {
+
+  UINT uNumBlocks = m_uNumBlocks.load(std::memory_order_relaxed);
+
+  for(UINT i = m_uReservedBlockCount; i < uNumBlocks; ++i)
+    ReleaseBlock(i);
+
+  m_uNumBlocks.store((std::min)(uNumBlocks, m_uReservedBlockCount), std::memory_order_relaxed);
+  Clear();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "D3D12Types.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+///
+/// Linear allocator of constant buffers in upload heap blocks, cleared once the GPU is done
+/// with a frame. Pushing is lock-free: every thread bump allocates in a block of its own and
+/// only grabs the next block, with one atomic increment, when its block is used up. Blocks
+/// are kept across Clear and reused, creating a new one is the only locked path.
+///
+/// UploadRingBuffer replaces it for the per-frame data of the samples. Initialized without a
+/// device the blocks are system memory and the CBV locations are offsets from 0, which is
+/// how the tests measure the push paths.
+///
+class UploadBufferStack {
+public:
+  UploadBufferStack();
+  ~UploadBufferStack();
+  /// MaxBlockCount bounds the number of blocks, their bookkeeping is allocated up front so
+  /// it never moves under the threads pushing. pDevice may be null.
+  HRESULT Initialize(ID3D12Device *pDevice, UINT BlockSize, UINT ReservedBlockCount, UINT MaxBlockCount = 4096);
+  /// Thread safe.
+  HRESULT Push(_In_ const void *pData, _In_ UINT uBufferSize, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV = nullptr);
+  HRESULT Push(_In_ UINT uBufferSize, _Out_opt_ void **ppMappedData, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV = nullptr);
+  /// Not thread safe, nothing may push while the stack is cleared. O(1), the blocks are
+  /// handed out again from the first one.
+  void Clear();
+  /// Releases the blocks beyond the reserved count, O(blocks).
+  void ClearCapacity();
+
+  UINT GetBlockSize() const;
+  UINT GetBlockCount() const;
+  UINT GetUsedBlockCount() const;
+
+private:
+  static UINT CalcConstantBufferByteSize(UINT uByteSize);
+  void Destroy();
+  void ReleaseBlock(UINT uBlock);
+  HRESULT AcquireBlock(_Out_ UINT *puBlock);
+  HRESULT CreateBlock(UINT uBlock);
+
+  struct BufferStorage {
+    ID3D12Resource *UploadBuffer;
+    std::unique_ptr<BYTE[]> SystemMemory;   // Instead of UploadBuffer without a device
+    D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+    void *pMappedData;
+  };
+
+  ID3D12Device *m_pd3dDevice;
+  std::unique_ptr<BufferStorage[]> m_aBufferStorage;
+  UINT m_uMaxBlockCount;
+  UINT m_uBlockSize;
+  UINT m_uReservedBlockCount;
+  std::atomic<UINT> m_uNumBlocks;   // Blocks created, published with release
+  std::atomic<UINT> m_uNextBlock;   // Next block to hand out since the last Clear
+  // Changes on every Clear, a thread's block is only its own within the same epoch.
+  // Epochs are unique across stacks, so a stack at a reused address never matches.
+  UINT64 m_uEpoch;
+
+  // Only creating a block takes it
+  std::mutex m_GrowLock;
+};
+
+/// Inline implementation
+inline UINT UploadBufferStack::GetBlockSize() const {
+  return m_uBlockSize;
+}
+
+inline UINT UploadBufferStack::GetBlockCount() const {
+  return m_uNumBlocks.load(std::memory_order_relaxed);
+}
+
+inline UINT UploadBufferStack::GetUsedBlockCount() const {
+  return (std::min)(m_uNextBlock.load(std::memory_order_relaxed), m_uNumBlocks.load(std::memory_order_relaxed));
+}
+
+/// Constant buffers are multiples of 256 bytes, see d3dUtils::CalcConstantBufferByteSize.
+inline UINT UploadBufferStack::CalcConstantBufferByteSize(UINT uByteSize) {
+  return (uByteSize + 255) & ~255u;
+}
@@ -0,0 +1,374 @@
+#include "UploadRingBuffer.h"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+// Where the calling thread allocates in a ring, valid for that ring within one epoch. The
+// mapped address is kept rather than the page index, so a page stays usable after the ring
+// grows away from its buffer. A sample has one ring, the direct mapped cache only has to
+// keep a few apart; a collision costs a fresh page.
+struct UPLOAD_RING_THREAD_CURSOR {
+  const void *pOwner;
+  UINT64 uEpoch;
+  BYTE *pMappedData;
+  D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+  UINT uOffset;
+};
+
+const UINT s_uNumUploadRingCursors = 4;
+thread_local UPLOAD_RING_THREAD_CURSOR t_aUploadRingCursors[s_uNumUploadRingCursors];
+std::atomic<UINT64> s_uNextUploadRingEpoch(1);
+} // namespace
+
+UploadRingBuffer::UploadRingBuffer() {
+  m_pd3dDevice = nullptr;
+  m_pFence = nullptr;
+  m_Storage = {};
+  m_uPageSize = 0;
+  m_uMaxPages = 0;
+  m_uGrowCount = 0;
+  m_uHeadPage = 0;
+  m_uTailPage = 0;
+  m_uUsedPages = 0;
+  m_uOpenFramePages = 0;
+  m_uEpoch = s_uNextUploadRingEpoch.fetch_add(1);
+}
+
+UploadRingBuffer::~UploadRingBuffer() {
+
+  Destroy();
+  if (m_pd3dDevice)
+    m_pd3dDevice->Release();
+}
+
+void UploadRingBuffer::Destroy() {
+
+  ReleaseStorage(&m_Storage);
+  for (auto &retired : m_aRetiredStorages)
+    ReleaseStorage(&retired.Storage);
+  m_aRetiredStorages.clear();
+  m_aFrames.clear();
+
+  m_uPageSize = 0;
+  m_uMaxPages = 0;
+  m_uHeadPage = 0;
+  m_uTailPage = 0;
+  m_uUsedPages = 0;
+  m_uOpenFramePages = 0;
+  m_uGrowCount = 0;
+  m_uEpoch = s_uNextUploadRingEpoch.fetch_add(1);
+}
+
+HRESULT UploadRingBuffer::Initialize(
+  _In_opt_ ID3D12Device *pDevice,
+  _In_ IUploadRingFence *pFence,
+  _In_ UINT64 uSize,
+  _In_ UINT64 uMaxSize,
+  _In_ UINT uPageSize
+) {
+
+  if (pFence == nullptr || uSize < 1 || uPageSize < 1)
+    return E_INVALIDARG;
+
+  Destroy();
+
+  if (pDevice)
+    pDevice->AddRef();
+  if (m_pd3dDevice)
+    m_pd3dDevice->Release();
+  m_pd3dDevice = pDevice;
+  m_pFence = pFence;
+
+  m_uPageSize = CalcConstantBufferByteSize(uPageSize);
+  UINT uNumPages = (UINT)((uSize + m_uPageSize - 1) / m_uPageSize);
+  m_uMaxPages = (std::max)(uNumPages, (UINT)((uMaxSize + m_uPageSize - 1) / m_uPageSize));
+
+  HRESULT hr = CreateStorage(uNumPages, &m_Storage);
+  if (FAILED(hr))
+    m_uPageSize = 0;
+  return hr;
+}
+
+HRESULT UploadRingBuffer::Allocate(
+  _In_ UINT uSize,
+  _In_ UINT uAlignment,
+  _Out_opt_ void **ppMappedData,
+  _Out_opt_ D3D12_GPU_VIRTUAL_ADDRESS *pGpuAddress
+) {
+
+  HRESULT hr = S_OK;
+  BYTE *pMappedData;
+  D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+
+  // The storage itself moves when the ring grows, the page size does not
+  if (m_uPageSize == 0)
+    return E_FAIL;
+
+  if (uAlignment == 0 || (uAlignment & (uAlignment - 1)) || uAlignment > D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT)
+    return E_INVALIDARG;
+
+  if (uSize > m_uPageSize / 4) {
+    // Large enough that sharing a page would waste most of it
+    std::lock_guard<std::mutex> lock(m_PageLock);
+    hr = AllocatePages((uSize + m_uPageSize - 1) / m_uPageSize, &pMappedData, &BufferLocation);
+    if (FAILED(hr))
+      return hr;
+  } else {
+    auto &cursor = t_aUploadRingCursors[(reinterpret_cast<uintptr_t>(this) / alignof(UploadRingBuffer)) %
+                                        s_uNumUploadRingCursors];
+    UINT uOffset = (cursor.uOffset + uAlignment - 1) & ~(uAlignment - 1);
+
+    // Nothing shared is touched while the thread's own page has room
+    if (cursor.pOwner != this || cursor.uEpoch != m_uEpoch || uOffset + uSize > m_uPageSize) {
+      BYTE *pPage;
+      D3D12_GPU_VIRTUAL_ADDRESS PageLocation;
+      {
+        std::lock_guard<std::mutex> lock(m_PageLock);
+        hr = AllocatePages(1, &pPage, &PageLocation);
+      }
+      if (FAILED(hr)) {
+        cursor.pOwner = nullptr;
+        return hr;
+      }
+      cursor = {this, m_uEpoch, pPage, PageLocation, 0};
+      uOffset = 0;
+    }
+
+    pMappedData = cursor.pMappedData + uOffset;
+    BufferLocation = cursor.BufferLocation + uOffset;
+    cursor.uOffset = uOffset + uSize;
+  }
+
+  if (ppMappedData) *ppMappedData = pMappedData;
+  if (pGpuAddress) *pGpuAddress = BufferLocation;
+  return hr;
+}
+
+HRESULT UploadRingBuffer::Push(_In_ const void *pData, _In_ UINT uBufferSize, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV) {
+
+  void *pMappedData;
+  D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+  UINT uAlignedSize = CalcConstantBufferByteSize(uBufferSize);
+
+  HRESULT hr = Allocate(uAlignedSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &pMappedData, &BufferLocation);
+  if (FAILED(hr))
+    return hr;
+  memcpy(pMappedData, pData, uBufferSize);
+  if (pCBV) {
+    pCBV->BufferLocation = BufferLocation;
+    pCBV->SizeInBytes = uAlignedSize;
+  }
+  return hr;
+}
+
+HRESULT UploadRingBuffer::PushVertices(
+  _In_reads_bytes_(uBufferSize) const void *pData,
+  _In_ UINT uBufferSize,
+  _In_ UINT uStride,
+  _Out_ D3D12_VERTEX_BUFFER_VIEW *pVBV
+) {
+
+  void *pMappedData;
+
+  HRESULT hr = Allocate(uBufferSize, 16, &pMappedData, &pVBV->BufferLocation);
+  if (FAILED(hr))
+    return hr;
+  memcpy(pMappedData, pData, uBufferSize);
+  pVBV->SizeInBytes = uBufferSize;
+  pVBV->StrideInBytes = uStride;
+  return hr;
+}
+
+HRESULT UploadRingBuffer::PushIndices(
+  _In_reads_bytes_(uBufferSize) const void *pData,
+  _In_ UINT uBufferSize,
+  _In_ DXGI_FORMAT Format,
+  _Out_ D3D12_INDEX_BUFFER_VIEW *pIBV
+) {
+
+  void *pMappedData;
+
+  HRESULT hr = Allocate(uBufferSize, 4, &pMappedData, &pIBV->BufferLocation);
+  if (FAILED(hr))
+    return hr;
+  memcpy(pMappedData, pData, uBufferSize);
+  pIBV->SizeInBytes = uBufferSize;
+  pIBV->Format = Format;
+  return hr;
+}
+
+void UploadRingBuffer::FinishFrame(_In_ UINT64 uFencePoint) {
+
+  std::unique_lock<std::mutex> lock(m_PageLock);
+
+  if (m_uOpenFramePages > 0) {
+    m_aFrames.push_back({uFencePoint, m_uOpenFramePages});
+    m_uOpenFramePages = 0;
+  }
+
+  for (auto &retired : m_aRetiredStorages) {
+    if (retired.uFencePoint == 0)
+      retired.uFencePoint = uFencePoint;
+  }
+
+  Reclaim(m_pFence ? m_pFence->GetCompletedFencePoint() : 0);
+
+  lock.unlock();
+
+  m_uEpoch = s_uNextUploadRingEpoch.fetch_add(1);
+}
+
+HRESULT UploadRingBuffer::AllocatePages(UINT uNumPages, _Out_ BYTE **ppMappedData,
+                                        _Out_ D3D12_GPU_VIRTUAL_ADDRESS *pGpuAddress) {
+
+  HRESULT hr = S_OK;
+  UINT uFirstPage;
+
+  // More than the ring holds at its largest
+  if (uNumPages > m_uMaxPages)
+    return E_OUTOFMEMORY;
+
+  while (!TryAllocatePages(uNumPages, &uFirstPage)) {
+    Reclaim(m_pFence->GetCompletedFencePoint());
+    if (TryAllocatePages(uNumPages, &uFirstPage))
+      break;
+
+    // Growing is preferred over stalling on the GPU, waiting is left for the size cap. When
+    // the frame being recorded holds every page there is nothing to wait for.
+    if (m_Storage.uNumPages < m_uMaxPages)
+      hr = Grow(uNumPages);
+    else if (!m_aFrames.empty())
+      hr = m_pFence->WaitForFencePoint(m_aFrames.front().uFencePoint);
+    else
+      hr = E_OUTOFMEMORY;
+    if (FAILED(hr))
+      return hr;
+  }
+
+  *ppMappedData = m_Storage.pMappedData + (UINT64)uFirstPage * m_uPageSize;
+  *pGpuAddress = m_Storage.BufferLocation + (UINT64)uFirstPage * m_uPageSize;
+  return hr;
+}
+
+bool UploadRingBuffer::TryAllocatePages(UINT uNumPages, _Out_ UINT *puFirstPage) {
+
+  UINT uRingPages = m_Storage.uNumPages;
+  UINT uSkipPages;
+
+  if (m_uUsedPages == 0)
+    m_uHeadPage = m_uTailPage = 0;
+
+  // Allocations are contiguous, the pages left before the end are skipped when they do not
+  // fit and go back with the frame
+  uSkipPages = m_uHeadPage + uNumPages > uRingPages ? uRingPages - m_uHeadPage : 0;
+  if (m_uUsedPages + uSkipPages + uNumPages > uRingPages)
+    return false;
+
+  m_uHeadPage = (m_uHeadPage + uSkipPages) % uRingPages;
+  *puFirstPage = m_uHeadPage;
+  m_uHeadPage = (m_uHeadPage + uNumPages) % uRingPages;
+  m_uUsedPages += uSkipPages + uNumPages;
+  m_uOpenFramePages += uSkipPages + uNumPages;
+  return true;
+}
+
+void UploadRingBuffer::Reclaim(UINT64 uCompletedFencePoint) {
+
+  while (!m_aFrames.empty() && m_aFrames.front().uFencePoint <= uCompletedFencePoint) {
+    m_uTailPage = (m_uTailPage + m_aFrames.front().uNumPages) % m_Storage.uNumPages;
+    m_uUsedPages -= m_aFrames.front().uNumPages;
+    m_aFrames.pop_front();
+  }
+
+  auto it = std::remove_if(m_aRetiredStorages.begin(), m_aRetiredStorages.end(), [=](RetiredStorage &retired) {
+    if (retired.uFencePoint == 0 || retired.uFencePoint > uCompletedFencePoint)
+      return false;
+    ReleaseStorage(&retired.Storage);
+    return true;
+  });
+  m_aRetiredStorages.erase(it, m_aRetiredStorages.end());
+}
+
+HRESULT UploadRingBuffer::Grow(UINT uMinPages) {
+
+  RingStorage storage;
+  UINT uNumPages = (std::min)((std::max)(m_Storage.uNumPages * 2, uMinPages), m_uMaxPages);
+
+  HRESULT hr = CreateStorage(uNumPages, &storage);
+  if (FAILED(hr))
+    return hr;
+
+  // Every frame so far allocated from the old buffer, the open one included. It goes once
+  // the open frame completes, finished frames are all older.
+  m_aRetiredStorages.push_back({m_Storage, 0});
+  m_Storage = storage;
+  m_aFrames.clear();
+  m_uHeadPage = 0;
+  m_uTailPage = 0;
+  m_uUsedPages = 0;
+  m_uOpenFramePages = 0;
+  ++m_uGrowCount;
+
+  return hr;
+}
+
+HRESULT UploadRingBuffer::CreateStorage(UINT uNumPages, _Out_ RingStorage *pStorage) {
+
+  UINT64 uSize = (UINT64)uNumPages * m_uPageSize;
+
+  *pStorage = {};
+  pStorage->uNumPages = uNumPages;
+
+  if (m_pd3dDevice == nullptr) {
+    pStorage->pSystemMemory = new (std::nothrow) BYTE[uSize];
+    if (pStorage->pSystemMemory == nullptr)
+      return E_OUTOFMEMORY;
+    pStorage->pMappedData = pStorage->pSystemMemory;
+    return S_OK;
+  }
+
+  D3D12_HEAP_PROPERTIES heapProperties = {};
+  heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+  heapProperties.CreationNodeMask = 1;
+  heapProperties.VisibleNodeMask = 1;
+
+  D3D12_RESOURCE_DESC bufferDesc = {};
+  bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+  bufferDesc.Width = uSize;
+  bufferDesc.Height = 1;
+  bufferDesc.DepthOrArraySize = 1;
+  bufferDesc.MipLevels = 1;
+  bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+  bufferDesc.SampleDesc.Count = 1;
+  bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+  ID3D12Resource *pBuffer = nullptr;
+  void *pMappedData = nullptr;
+
+  HRESULT hr = m_pd3dDevice->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+                                                     D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&pBuffer));
+  if (FAILED(hr))
+    return hr;
+
+  // Upload heaps may stay mapped for the lifetime of the resource, the CPU reads nothing
+  D3D12_RANGE readRange = {0, 0};
+  hr = pBuffer->Map(0, &readRange, &pMappedData);
+  if (FAILED(hr)) {
+    pBuffer->Release();
+    return hr;
+  }
+
+  pStorage->UploadBuffer = pBuffer;
+  pStorage->BufferLocation = pBuffer->GetGPUVirtualAddress();
+  pStorage->pMappedData = (BYTE *)pMappedData;
+  return hr;
+}
+
+void UploadRingBuffer::ReleaseStorage(RingStorage *pStorage) {
+  if (pStorage->UploadBuffer)
+    pStorage->UploadBuffer->Release();
+  delete[] pStorage->pSystemMemory;
+  *pStorage = {};
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include "D3D12Types.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+///
+/// The fence the ring retires frames with. FrameContextManager adapts its SyncFence; without
+/// one, as in the tests, the caller decides when a frame completes.
+///
+class IUploadRingFence {
+public:
+  virtual ~IUploadRingFence() = default;
+
+  /// Last fence point reached, every point up to it is complete.
+  virtual UINT64 GetCompletedFencePoint() const = 0;
+  /// Blocks until the fence reaches uFencePoint.
+  virtual HRESULT WaitForFencePoint(_In_ UINT64 uFencePoint) = 0;
+};
+
+///
+/// One persistently mapped upload buffer shared by all the frames in flight, for transient
+/// constants, vertices and indices. The ring is handed out in pages; every thread bump
+/// allocates in a page of its own and only locks to take the next one. The pages taken
+/// between two FinishFrame calls are tagged with the fence point that frame was signaled
+/// with and come back once the fence reaches it, so nobody has to wait for a frame before
+/// reusing its memory.
+///
+/// When the ring is full it grows by doubling up to the maximum size; the old buffer lives on
+/// until the frames using it complete. Past the maximum, allocating waits for the oldest frame
+/// on the fence, so nothing else may wait on it while frames are recorded.
+///
+/// Like UploadBufferStack, initialized without a device the ring is system memory and the GPU
+/// addresses are offsets from 0, which is how the tests drive the wrap, reuse and growth.
+///
+class UploadRingBuffer {
+public:
+  UploadRingBuffer();
+  ~UploadRingBuffer();
+
+  /// uSize and uMaxSize are rounded up to whole pages, uMaxSize == uSize never grows. Pages
+  /// are multiples of 256 bytes so every allocation can be a constant buffer. pDevice may be
+  /// null, pFence is not owned and must outlive the ring.
+  HRESULT Initialize(
+    _In_opt_ ID3D12Device *pDevice,
+    _In_ IUploadRingFence *pFence,
+    _In_ UINT64 uSize,
+    _In_ UINT64 uMaxSize,
+    _In_ UINT uPageSize = 1 << 14
+  );
+  void Destroy();
+
+  /// Thread safe. uAlignment is a power of two, at most 256. Allocations larger than a
+  /// quarter page take whole pages of their own.
+  HRESULT Allocate(
+    _In_ UINT uSize,
+    _In_ UINT uAlignment,
+    _Out_opt_ void **ppMappedData,
+    _Out_opt_ D3D12_GPU_VIRTUAL_ADDRESS *pGpuAddress
+  );
+  /// Thread safe, same as UploadBufferStack::Push.
+  HRESULT Push(_In_ const void *pData, _In_ UINT uBufferSize, _Out_opt_ D3D12_CONSTANT_BUFFER_VIEW_DESC *pCBV = nullptr);
+  HRESULT PushVertices(
+    _In_reads_bytes_(uBufferSize) const void *pData,
+    _In_ UINT uBufferSize,
+    _In_ UINT uStride,
+    _Out_ D3D12_VERTEX_BUFFER_VIEW *pVBV
+  );
+  HRESULT PushIndices(
+    _In_reads_bytes_(uBufferSize) const void *pData,
+    _In_ UINT uBufferSize,
+    _In_ DXGI_FORMAT Format,
+    _Out_ D3D12_INDEX_BUFFER_VIEW *pIBV
+  );
+
+  /// Not thread safe, nothing may allocate meanwhile. Everything allocated since the last
+  /// call stays in use until the fence reaches uFencePoint, the point the frame's work was
+  /// signaled with. Also gives back the pages of every frame completed so far.
+  void FinishFrame(_In_ UINT64 uFencePoint);
+
+  UINT64 GetSize() const;
+  UINT64 GetUsedSize() const;
+  UINT GetGrowCount() const;
+
+private:
+  struct RingStorage {
+    ID3D12Resource *UploadBuffer;
+    BYTE *pSystemMemory;   // Instead of UploadBuffer without a device
+    D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+    BYTE *pMappedData;
+    UINT uNumPages;
+  };
+
+  // Pages a finished frame took, in ring order from the tail
+  struct FrameRange {
+    UINT64 uFencePoint;
+    UINT uNumPages;
+  };
+
+  // A buffer the ring grew out of, 0 until the frame still allocating from it finishes
+  struct RetiredStorage {
+    RingStorage Storage;
+    UINT64 uFencePoint;
+  };
+
+  static UINT CalcConstantBufferByteSize(UINT uByteSize);
+  HRESULT CreateStorage(UINT uNumPages, _Out_ RingStorage *pStorage);
+  static void ReleaseStorage(RingStorage *pStorage);
+  // Called with m_PageLock held
+  HRESULT AllocatePages(UINT uNumPages, _Out_ BYTE **ppMappedData, _Out_ D3D12_GPU_VIRTUAL_ADDRESS *pGpuAddress);
+  bool TryAllocatePages(UINT uNumPages, _Out_ UINT *puFirstPage);
+  void Reclaim(UINT64 uCompletedFencePoint);
+  HRESULT Grow(UINT uMinPages);
+
+  ID3D12Device *m_pd3dDevice;
+  IUploadRingFence *m_pFence;
+  RingStorage m_Storage;
+  UINT m_uPageSize;
+  UINT m_uMaxPages;
+  UINT m_uGrowCount;
+
+  // Pages in use run from the tail to the head, wrapping around
+  UINT m_uHeadPage;
+  UINT m_uTailPage;
+  UINT m_uUsedPages;
+  UINT m_uOpenFramePages;   // Taken since the last FinishFrame
+  std::deque<FrameRange> m_aFrames;
+  std::vector<RetiredStorage> m_aRetiredStorages;
+
+  // Changes on every FinishFrame, a thread's page is only its own within the same epoch.
+  // Epochs are unique across rings, so a ring at a reused address never matches.
+  UINT64 m_uEpoch;
+
+  std::mutex m_PageLock;
+};
+
+/// Inline implementation
+inline UINT64 UploadRingBuffer::GetSize() const {
+  return (UINT64)m_Storage.uNumPages * m_uPageSize;
+}
+
+inline UINT64 UploadRingBuffer::GetUsedSize() const {
+  return (UINT64)m_uUsedPages * m_uPageSize;
+}
+
+inline UINT UploadRingBuffer::GetGrowCount() const {
+  return m_uGrowCount;
+}
+
+/// Constant buffers are multiples of 256 bytes, see d3dUtils::CalcConstantBufferByteSize.
+inline UINT UploadRingBuffer::CalcConstantBufferByteSize(UINT uByteSize) {
+  return (uByteSize + 255) & ~255u;
+}
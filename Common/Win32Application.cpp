@@ -1,4 +1,5 @@
 #include "Common.h"
+#include "CpuProfiler.h"
 #include "D3D12RendererContext.hpp"
 #include "Win32Application.hpp"
 #include <Windows.h>
@@ -12,6 +13,9 @@ WindowInteractor::WindowInteractor() {
   m_FrameStat.LastFrameCount = 0;
   m_FrameStat.TotalFrameCount = 0;
 
+  m_fLastFrameInterval = .0;
+  m_bWriteFrameTimeStatsOnExit = FALSE;
+
   m_bFullscreenState = FALSE;
 
   Reset();
@@ -27,6 +31,7 @@ WindowInteractor::~WindowInteractor() {
 void WindowInteractor::Reset() {
   m_GlobalTimer.Reset();
   m_FrameStat.LastTimeStamp = .0;
+  m_bSkipFrameInterval = true;
 }
 
 bool WindowInteractor::IsPaused() const {
@@ -35,9 +40,13 @@ bool WindowInteractor::IsPaused() const {
 
 void WindowInteractor::SetPaused(bool paused) {
   paused ? m_GlobalTimer.Stop() : m_GlobalTimer.Resume();
+  // The timer resumes without a tick, the interval would span the pause
+  m_bSkipFrameInterval |= !paused;
 }
 
 void WindowInteractor::Tick() {
+  // One frame is presented per tick
+  m_fLastFrameInterval = m_GlobalTimer.GetElapsedTime();
   m_GlobalTimer.Tick();
 
   if(!m_GlobalTimer.IsPaused()) {
@@ -57,6 +66,31 @@ double WindowInteractor::GetFPS() const {
   return m_FrameStat.FPS;
 }
 
+void WindowInteractor::AddFrameTime(double fCpuTime) {
+  if (m_bSkipFrameInterval) {
+    m_bSkipFrameInterval = false;
+    return;
+  }
+
+  m_FrameTimeStats.AddFrame((float)(fCpuTime * 1000.0), (float)(m_fLastFrameInterval * 1000.0));
+}
+
+const FrameTimeStats &WindowInteractor::GetFrameTimeStats() const {
+  return m_FrameTimeStats;
+}
+
+void WindowInteractor::ResetFrameTimeStats() {
+  m_FrameTimeStats.Reset();
+}
+
+HRESULT WindowInteractor::WriteFrameTimeStats(_In_z_ const char *pFileName) const {
+  return m_FrameTimeStats.WriteCsv(pFileName);
+}
+
+void WindowInteractor::SetWriteFrameTimeStatsOnExit(BOOL bWrite) {
+  m_bWriteFrameTimeStatsOnExit = bWrite;
+}
+
 double WindowInteractor::GetTotalTime() const {
   return m_GlobalTimer.GetTime();
 }
@@ -188,6 +222,7 @@ int RunSample(_In_ D3D12RendererContext *pRenderer, _In_ WindowInteractor *pInte
   MSG msg = {0};
 
   float fTime, fElapsed;
+  DXUT::CDXUTTimer frameTimer;
   pWndContext->pInteractor->Reset();
 
   while (msg.message != WM_QUIT) {
@@ -202,12 +237,17 @@ int RunSample(_In_ D3D12RendererContext *pRenderer, _In_ WindowInteractor *pInte
       pWndContext->pInteractor->Tick();
 
       ReportFrameStats(hMainWnd, fTime, fElapsed);
+      frameTimer.Reset();
       pRenderer->Update(fTime, fElapsed);
       pRenderer->RenderFrame(fTime, fElapsed);
+      pWndContext->pInteractor->AddFrameTime(frameTimer.GetTime() - pRenderer->GetLastFrameWaitMs() * 1e-3);
     } else
       Sleep(10);
   }
 
+  if (pWndContext->pInteractor->m_bWriteFrameTimeStatsOnExit)
+    V(pWndContext->pInteractor->WriteFrameTimeStats("FrameTimes.csv"));
+
   pRenderer->Destroy();
 
   return msg.message == WM_QUIT ? 0 : -1;
@@ -221,10 +261,12 @@ void ReportFrameStats(HWND hwnd, float fTime, float fElapsed) {
   tmInterval += fElapsed;
 
   if (tmInterval > 1.0) {
-    wchar_t buff[128];
-    _snwprintf_s(buff, _countof(buff), L"%s, FPS:%3.1f, MSPF:%.3f", pWndContext->Title.c_str(),
+    wchar_t buff[160];
+    FRAME_TIME_PERCENTILES percentiles = pWndContext->pInteractor->GetFrameTimeStats().GetPercentiles(FRAME_TIME_PRESENT);
+    _snwprintf_s(buff, _countof(buff), L"%s, FPS:%3.1f, MSPF:%.3f, P99:%.3f", pWndContext->Title.c_str(),
       static_cast<float>(pWndContext->pInteractor->GetFPS()),
-      static_cast<float>(1000.0 / pWndContext->pInteractor->GetFPS())
+      static_cast<float>(1000.0 / pWndContext->pInteractor->GetFPS()),
+      percentiles.P99
     );
     SetWindowTextW(hwnd, buff);
     tmInterval = .0;
@@ -307,6 +349,18 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
       RECT rectDesktop = pWndContext->pRenderer->GetSwapchainContainingOutputDesktopCoordinates();
       pWndContext->pInteractor->ToggleFullscreenWindow(&rectDesktop);
       pWndContext->pRenderer->SetFullscreenMode(pWndContext->pInteractor->GetFullscreenState());
+    } else if (wp == VK_F8 && pWndContext) {
+      if (FAILED(pWndContext->pInteractor->WriteFrameTimeStats("FrameTimes.csv")))
+        DX_TRACE(L"Failed to write FrameTimes.csv\n");
+    } else if (wp == VK_F9) {
+      // Toggle the CPU profiler capture, the trace is written once it stops.
+      if (CpuProfiler::IsCapturing()) {
+        CpuProfiler::EndCapture();
+        if (!CpuProfiler::ExportChromeTrace("CpuTrace.json"))
+          DX_TRACE(L"Failed to write CpuTrace.json\n");
+      } else {
+        CpuProfiler::BeginCapture();
+      }
     }
     break;
   }
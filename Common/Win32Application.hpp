@@ -1,6 +1,7 @@
 #pragma once
 #include <sal.h>
 #include "DXUTmisc.h"
+#include "FrameTimeStats.h"
 
 class D3D12RendererContext;
 
@@ -24,6 +25,15 @@ public:
   double GetElapsedTime() const;
   double GetFPS() const;
 
+  /// Adds the frame to the frame time statistics with the present to present interval the
+  /// last Tick measured. The first frame after a pause is left out.
+  void AddFrameTime(double fCpuTime);
+  const FrameTimeStats &GetFrameTimeStats() const;
+  void ResetFrameTimeStats();
+  HRESULT WriteFrameTimeStats(_In_z_ const char *pFileName) const;
+  /// Writes the statistics to FrameTimes.csv when the sample exits, F8 writes them any time.
+  void SetWriteFrameTimeStatsOnExit(BOOL bWrite);
+
   void ToggleFullscreenWindow(_In_opt_ LPCRECT pDesktopCoordinates);
   BOOL GetFullscreenState() const;
 
@@ -50,6 +60,11 @@ protected:
     double FPS;
   } mutable m_FrameStat;
 
+  FrameTimeStats m_FrameTimeStats;
+  double m_fLastFrameInterval;
+  bool m_bSkipFrameInterval;
+  BOOL m_bWriteFrameTimeStatsOnExit;
+
   DXUT::CDXUTTimer m_GlobalTimer;
 };
 
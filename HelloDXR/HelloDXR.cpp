@@ -64,13 +64,10 @@ static XMMATRIX NormalTranspseFromWorld(CXMMATRIX matWorld) {
 
 struct ObjectConstants {};
 
+// Per frame constants, one slot for each frame context. The allocators and fence points
+// live in the frame contexts of the renderer.
 class FrameResources {
 public:
-  FrameResources();
-  ~FrameResources();
-
-  HRESULT CreateCommandAllocator(ID3D12Device *pd3dDevice);
-
   static HRESULT CreatePerframeBuffers(ID3D12Device *pd3dDevice, int iPassCount);
 
   static HRESULT CreateInstanceNormalXformBuffer(ID3D12Device *pd3dDevice,
@@ -86,8 +83,6 @@ public:
     return hr;
   }
 
-  UINT64 FenceCount;
-  ID3D12CommandAllocator *CmdAllocator;
   static UploadBuffer PerframeBuffer;
   static UploadBuffer SpotLightBuffer;
 
@@ -98,20 +93,6 @@ UploadBuffer FrameResources::PerframeBuffer;
 UploadBuffer FrameResources::SpotLightBuffer;
 UploadBuffer FrameResources::InstanceNormalXformBuffer;
 
-FrameResources::FrameResources() {
-  FenceCount = 0;
-  CmdAllocator = nullptr;
-}
-FrameResources::~FrameResources() { SAFE_RELEASE(CmdAllocator); }
-
-HRESULT FrameResources::CreateCommandAllocator(ID3D12Device *pd3dDevice) {
-  HRESULT hr;
-
-  V_RETURN(pd3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&CmdAllocator)));
-
-  return hr;
-}
-
 HRESULT FrameResources::CreatePerframeBuffers(ID3D12Device *pd3dDevice, int iPassCount) {
   HRESULT hr;
   V_RETURN(PerframeBuffer.CreateBuffer(pd3dDevice, iPassCount, sizeof(FrameConstants), TRUE));
@@ -188,7 +169,7 @@ private:
   HRESULT CreateRaytracingOutputBuffer();
 
   /// Create Shader bindiing table to update resource to ray tracing pipeline.
-  HRESULT CreateRaytracingShaderBindingTable(FrameResources *pFrameResources);
+  HRESULT CreateRaytracingShaderBindingTable();
 
   VOID PostInitialize();
 
@@ -218,8 +199,6 @@ private:
 
   ComPtr<ID3D12Resource> m_pSBTBuffer;
 
-  static const UINT s_uNumberOfFrames = 3;
-  FrameResources m_aFrameResources[s_uNumberOfFrames];
   UINT m_iCurrentFrameIndex;
 
   float m_fLightRotationAngle;
@@ -242,6 +221,8 @@ HelloDXRApp::HelloDXRApp() {
 
   m_aDeviceConfig.RaytracingEnabled = TRUE;
 
+  m_aDeviceConfig.FrameCount = 3;
+
   m_iCurrentFrameIndex = 0;
 
   m_fAnimationTimeElapsed = 0;
@@ -280,10 +261,7 @@ HRESULT HelloDXRApp::OnInitPipelines() {
   // V_RETURN(CreateCbvSrvUavDescriptorHeap());
   // V_RETURN(CreateRaytracingShaderBindingTable());
 
-  for (auto &frameRes : m_aFrameResources) {
-    V_RETURN(frameRes.CreateCommandAllocator(m_pd3dDevice));
-  }
-  FrameResources::CreatePerframeBuffers(m_pd3dDevice, s_uNumberOfFrames);
+  FrameResources::CreatePerframeBuffers(m_pd3dDevice, FrameContextManager::s_uMaxFrameCount);
 
   // Execute the initialization commands.
   V_RETURN(m_pd3dCommandList->Close());
@@ -822,7 +800,7 @@ HRESULT HelloDXRApp::CreateRaytracingOutputBuffer() {
 // contains the ray generation shader, the miss shaders, then the hit groups.
 // Using the helper class, those can be specified in arbitrary order.
 //
-HRESULT HelloDXRApp::CreateRaytracingShaderBindingTable(FrameResources *) {
+HRESULT HelloDXRApp::CreateRaytracingShaderBindingTable() {
 
   HRESULT hr = S_OK;
 
@@ -909,13 +887,9 @@ void HelloDXRApp::OnFrameMoved(float fTime, float fElapsed) {
 
   m_Camera.FrameMove(fElapsed, this);
 
-  FrameResources *pFrameResources;
-
-  m_iCurrentFrameIndex = (m_iCurrentFrameIndex + 1) % s_uNumberOfFrames;
-  pFrameResources = &m_aFrameResources[m_iCurrentFrameIndex];
-
-  /// Sychronize it.
-  V(m_pSyncFence->WaitForSyncPoint(pFrameResources->FenceCount));
+  /// Only waits when the frames in flight are all taken.
+  V(m_FrameContexts.BeginFrame());
+  m_iCurrentFrameIndex = m_FrameContexts.GetFrameIndex();
 
   /// Update Camera parameters.
   FrameConstants frameRes;
@@ -949,7 +923,7 @@ void HelloDXRApp::OnFrameMoved(float fTime, float fElapsed) {
 
   FrameResources::SpotLightBuffer.CopyData(&spotLight, sizeof(SpotLight), 0);
 
-  V(CreateRaytracingShaderBindingTable(pFrameResources));
+  V(CreateRaytracingShaderBindingTable());
 }
 
 VOID HelloDXRApp::AnimateInstances(float fTime, float fElapsed) {
@@ -992,15 +966,11 @@ VOID HelloDXRApp::AnimateInstances(float fTime, float fElapsed) {
 void HelloDXRApp::OnRenderFrame(float fTime, float fElapsed) {
 
   HRESULT hr;
-  FrameResources *pFrameResources = &m_aFrameResources[m_iCurrentFrameIndex];
-
-  // Reuse the memory associated with command recording.
-  // We can only reset when the associated command lists have finished execution on the GPU.
-  V(pFrameResources->CmdAllocator->Reset());
 
+  // The frame context's allocator was reset by BeginFrame, once the GPU was done with it.
   // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
   // Reusing the command list reuses memory.
-  V(m_pd3dCommandList->Reset(pFrameResources->CmdAllocator, nullptr));
+  V(m_pd3dCommandList->Reset(m_FrameContexts.GetCommandAllocator(), nullptr));
 
   AnimateInstances(fTime, fElapsed);
 
@@ -1076,7 +1046,7 @@ void HelloDXRApp::OnRenderFrame(float fTime, float fElapsed) {
   ID3D12CommandList *cmdsLists[] = {m_pd3dCommandList};
   m_pd3dCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
-  m_pSyncFence->Signal(m_pd3dCommandQueue, &pFrameResources->FenceCount);
+  V(m_FrameContexts.EndFrame(m_pd3dCommandQueue));
 
   // swap the back and front buffers
   Present();
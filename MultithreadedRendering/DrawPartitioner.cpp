@@ -0,0 +1,119 @@
+#include "DrawPartitioner.h"
+#include <algorithm>
+#include <cstring>
+
+// Initial guess: draw calls dominate, bindings cost about half a draw, indices barely matter
+// on the CPU side.
+static const float s_afDefaultWeights[DrawPartitioner::FEATURE_COUNT] = { 0.0f, 1.0f, 0.5f, 0.01f };
+
+DrawPartitioner::DrawPartitioner() {
+  m_fLearningRate = 0.05f;
+  ResetWeights();
+}
+
+void DrawPartitioner::ResetWeights() {
+  memcpy(m_afWeights, s_afDefaultWeights, sizeof(m_afWeights));
+}
+
+float DrawPartitioner::ItemCost(const DRAW_COST_FEATURES &item) const {
+  return m_afWeights[FEATURE_DRAWS] * item.Draws + m_afWeights[FEATURE_STATE_CHANGES] * item.StateChanges +
+         m_afWeights[FEATURE_KILO_INDICES] * item.KiloIndices;
+}
+
+void DrawPartitioner::AccumulateFeatures(const DRAW_COST_FEATURES &item, float *pFeatures) {
+  pFeatures[FEATURE_DRAWS] += item.Draws;
+  pFeatures[FEATURE_STATE_CHANGES] += item.StateChanges;
+  pFeatures[FEATURE_KILO_INDICES] += item.KiloIndices;
+}
+
+void DrawPartitioner::Partition(
+  _In_reads_(uNumItems) const DRAW_COST_FEATURES *pItems,
+  _In_ UINT uNumItems,
+  _In_ UINT uNumChunks,
+  _Out_writes_(uNumChunks + 1) UINT *pRanges,
+  _Out_writes_(uNumChunks * FEATURE_COUNT) float *pChunkFeatures
+) const {
+
+  float fTotal = 0.0f;
+  for (UINT i = 0; i < uNumItems; ++i)
+    fTotal += ItemCost(pItems[i]);
+
+  std::fill(pChunkFeatures, pChunkFeatures + uNumChunks * FEATURE_COUNT, 0.0f);
+
+  // An item goes to the chunk its cost midpoint falls in, so no boundary is off by more
+  // than half an item.
+  UINT uItem = 0;
+  float fAccum = 0.0f;
+
+  pRanges[0] = 0;
+  for (UINT k = 0; k < uNumChunks; ++k) {
+    float fTarget = fTotal * (float)(k + 1) / (float)uNumChunks;
+    float *pFeatures = &pChunkFeatures[k * FEATURE_COUNT];
+
+    pFeatures[FEATURE_OVERHEAD] = 1.0f;
+    while (uItem < uNumItems && (k + 1 == uNumChunks || fAccum + 0.5f * ItemCost(pItems[uItem]) <= fTarget)) {
+      fAccum += ItemCost(pItems[uItem]);
+      AccumulateFeatures(pItems[uItem], pFeatures);
+      ++uItem;
+    }
+    pRanges[k + 1] = uItem;
+  }
+}
+
+void DrawPartitioner::RoundRobin(
+  _In_reads_(uNumItems) const DRAW_COST_FEATURES *pItems,
+  _In_ UINT uNumItems,
+  _In_ UINT uNumChunks,
+  _Out_writes_(uNumChunks * FEATURE_COUNT) float *pChunkFeatures
+) const {
+
+  std::fill(pChunkFeatures, pChunkFeatures + uNumChunks * FEATURE_COUNT, 0.0f);
+
+  for (UINT k = 0; k < uNumChunks; ++k)
+    pChunkFeatures[k * FEATURE_COUNT + FEATURE_OVERHEAD] = 1.0f;
+
+  for (UINT i = 0; i < uNumItems; ++i)
+    AccumulateFeatures(pItems[i], &pChunkFeatures[(i % uNumChunks) * FEATURE_COUNT]);
+}
+
+float DrawPartitioner::Estimate(_In_reads_(FEATURE_COUNT) const float *pFeatures) const {
+  float fCost = 0.0f;
+  for (int f = 0; f < FEATURE_COUNT; ++f)
+    fCost += m_afWeights[f] * pFeatures[f];
+  return fCost;
+}
+
+void DrawPartitioner::Adapt(
+  _In_reads_(uNumChunks * FEATURE_COUNT) const float *pChunkFeatures,
+  _In_reads_(uNumChunks) const float *pMeasuredUs,
+  _In_ UINT uNumChunks
+) {
+
+  for (UINT k = 0; k < uNumChunks; ++k) {
+    const float *pFeatures = &pChunkFeatures[k * FEATURE_COUNT];
+    float fNorm = 1e-3f;
+
+    for (int f = 0; f < FEATURE_COUNT; ++f)
+      fNorm += pFeatures[f] * pFeatures[f];
+
+    float fStep = m_fLearningRate * (pMeasuredUs[k] - Estimate(pFeatures)) / fNorm;
+
+    // Negative weights would make the partition reward expensive items
+    for (int f = 0; f < FEATURE_COUNT; ++f)
+      m_afWeights[f] = (std::max)(0.0f, m_afWeights[f] + fStep * pFeatures[f]);
+  }
+
+  // Keep the draw weight alive so the ranges never degenerate
+  m_afWeights[FEATURE_DRAWS] = (std::max)(m_afWeights[FEATURE_DRAWS], 1e-3f);
+}
+
+float DrawPartitioner::Imbalance(_In_reads_(uNumChunks) const float *pCosts, _In_ UINT uNumChunks) {
+  float fMax = 0.0f, fSum = 0.0f;
+
+  for (UINT k = 0; k < uNumChunks; ++k) {
+    fMax = (std::max)(fMax, pCosts[k]);
+    fSum += pCosts[k];
+  }
+
+  return fSum > 0.0f ? fMax * uNumChunks / fSum : 1.0f;
+}
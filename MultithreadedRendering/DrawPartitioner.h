@@ -0,0 +1,73 @@
+#pragma once
+#include <d3dUtils.h>
+
+/// What the recording of one draw item (a mesh, as RenderMesh receives it) is estimated from.
+struct DRAW_COST_FEATURES {
+  float Draws;          // Draw calls after subset merging
+  float StateChanges;   // Buffer, topology and material bindings
+  float KiloIndices;    // Indices, in thousands
+};
+
+///
+/// Splits a draw sequence into contiguous, equally expensive ranges, one per chunk. The cost of
+/// a range is a weighted sum of its features plus a constant per chunk overhead; the weights
+/// are fitted online to the measured recording time of every chunk with normalized LMS.
+///
+class DrawPartitioner {
+public:
+  enum FEATURE {
+    FEATURE_OVERHEAD,
+    FEATURE_DRAWS,
+    FEATURE_STATE_CHANGES,
+    FEATURE_KILO_INDICES,
+    FEATURE_COUNT
+  };
+
+  DrawPartitioner();
+
+  /// Writes uNumChunks + 1 boundaries into pRanges, chunk k records items [pRanges[k], pRanges[k + 1]).
+  /// pChunkFeatures receives FEATURE_COUNT sums per chunk.
+  void Partition(
+    _In_reads_(uNumItems) const DRAW_COST_FEATURES *pItems,
+    _In_ UINT uNumItems,
+    _In_ UINT uNumChunks,
+    _Out_writes_(uNumChunks + 1) UINT *pRanges,
+    _Out_writes_(uNumChunks * FEATURE_COUNT) float *pChunkFeatures
+  ) const;
+
+  /// Feature sums when item i goes to chunk i % uNumChunks, for comparison.
+  void RoundRobin(
+    _In_reads_(uNumItems) const DRAW_COST_FEATURES *pItems,
+    _In_ UINT uNumItems,
+    _In_ UINT uNumChunks,
+    _Out_writes_(uNumChunks * FEATURE_COUNT) float *pChunkFeatures
+  ) const;
+
+  /// Estimated cost, in microseconds, of one chunk's feature sums.
+  float Estimate(_In_reads_(FEATURE_COUNT) const float *pFeatures) const;
+
+  /// One NLMS step per chunk towards the measured recording times, in microseconds.
+  void Adapt(
+    _In_reads_(uNumChunks * FEATURE_COUNT) const float *pChunkFeatures,
+    _In_reads_(uNumChunks) const float *pMeasuredUs,
+    _In_ UINT uNumChunks
+  );
+
+  void ResetWeights();
+  const float *GetWeights() const;
+
+  /// Largest over mean, 1 is perfectly balanced.
+  static float Imbalance(_In_reads_(uNumChunks) const float *pCosts, _In_ UINT uNumChunks);
+
+private:
+  float ItemCost(const DRAW_COST_FEATURES &item) const;
+  static void AccumulateFeatures(const DRAW_COST_FEATURES &item, float *pFeatures);
+
+  float m_afWeights[FEATURE_COUNT];
+  float m_fLearningRate;
+};
+
+/// Inline implementation
+inline const float *DrawPartitioner::GetWeights() const {
+  return m_afWeights;
+}
@@ -27,55 +27,39 @@ HRESULT CMultithreadedDXUTMesh::Create( ResourceUploadBatch* pUploadBatch, LPCWS
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_ void CMultithreadedDXUTMesh::RenderMesh(UINT iMesh,
                                                                bool bAdjacent,
-                                                               ID3D12GraphicsCommandList *pd3dCommandList,
+                                                               ICommandRecorder *pRecorder,
                                                                D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                                                                UINT iDiffuseSlot,
                                                                UINT iNormalSlot,
                                                                UINT iSpecularSlot) {
-  CDXUTSDKMesh::RenderMesh(iMesh, bAdjacent, pd3dCommandList, hDescriptorStart, iDiffuseSlot, iNormalSlot,
+  CDXUTSDKMesh::RenderMesh(iMesh, bAdjacent, pRecorder, hDescriptorStart, iDiffuseSlot, iNormalSlot,
                            iSpecularSlot);
 }
 
 //--------------------------------------------------------------------------------------
-_Use_decl_annotations_ void CMultithreadedDXUTMesh::RenderFrame(UINT iFrame,
-                                                                bool bAdjacent,
-                                                                ID3D12GraphicsCommandList *pd3dCommandList,
-                                                                D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
-                                                                UINT iDiffuseSlot,
-                                                                UINT iNormalSlot,
-                                                                UINT iSpecularSlot) {
-  if (!m_pStaticMeshData || !m_pFrameArray)
-    return;
-
-  if (m_pFrameArray[iFrame].Mesh != INVALID_MESH) {
-    if (!m_aRenderMeshCallback.pRenderMesh) {
-      RenderMesh(m_pFrameArray[iFrame].Mesh, bAdjacent, pd3dCommandList, hDescriptorStart, iDiffuseSlot, iNormalSlot,
-                 iSpecularSlot);
-    } else {
-      m_aRenderMeshCallback.pRenderMesh(this, m_pFrameArray[iFrame].Mesh, bAdjacent, pd3dCommandList, hDescriptorStart,
-                                        iDiffuseSlot, iNormalSlot, iSpecularSlot,
-                                        m_aRenderMeshCallback.pRenderUserContext);
-    }
-  }
-
-  // Render our children
-  if (m_pFrameArray[iFrame].ChildFrame != INVALID_FRAME)
-    RenderFrame(m_pFrameArray[iFrame].ChildFrame, bAdjacent, pd3dCommandList, hDescriptorStart, iDiffuseSlot,
-                iNormalSlot, iSpecularSlot);
-
-  // Render our siblings
-  if (m_pFrameArray[iFrame].SiblingFrame != INVALID_FRAME)
-    RenderFrame(m_pFrameArray[iFrame].SiblingFrame, bAdjacent, pd3dCommandList, hDescriptorStart, iDiffuseSlot,
-                iNormalSlot, iSpecularSlot);
+_Use_decl_annotations_ void CMultithreadedDXUTMesh::RenderMeshDepth(UINT iMesh,
+                                                                    ICommandRecorder *pRecorder) {
+  CDXUTSDKMesh::RenderMeshDepth(iMesh, pRecorder);
 }
 
 //--------------------------------------------------------------------------------------
-_Use_decl_annotations_
-void CMultithreadedDXUTMesh::Render( ID3D12GraphicsCommandList* pd3dCommandList,
-                                     D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
-                                     UINT iDiffuseSlot,
-                                     UINT iNormalSlot,
-                                     UINT iSpecularSlot )
-{
-    RenderFrame( 0, false, pd3dCommandList, hDescriptorStart, iDiffuseSlot, iNormalSlot, iSpecularSlot );
+_Use_decl_annotations_ void CMultithreadedDXUTMesh::RenderMeshList(const UINT *pMeshes,
+                                                                   UINT NumMeshes,
+                                                                   bool bAdjacent,
+                                                                   bool bDepthOnly,
+                                                                   ICommandRecorder *pRecorder,
+                                                                   D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                                                   UINT iDiffuseSlot,
+                                                                   UINT iNormalSlot,
+                                                                   UINT iSpecularSlot) {
+  if (!m_aRenderMeshCallback.pRenderMesh) {
+    CDXUTSDKMesh::RenderMeshList(pMeshes, NumMeshes, bAdjacent, bDepthOnly, pRecorder, hDescriptorStart,
+                                 iDiffuseSlot, iNormalSlot, iSpecularSlot);
+    return;
+  }
+
+  for (UINT i = 0; i < NumMeshes; ++i) {
+    m_aRenderMeshCallback.pRenderMesh(this, pMeshes[i], bAdjacent, bDepthOnly, pRecorder, hDescriptorStart,
+                                      iDiffuseSlot, iNormalSlot, iSpecularSlot, m_aRenderMeshCallback.pRenderUserContext);
+  }
 }
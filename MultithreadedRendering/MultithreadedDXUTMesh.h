@@ -6,7 +6,8 @@ class CMultithreadedDXUTMesh;
 typedef void (*LPRENDERMESH12)(CMultithreadedDXUTMesh *pMesh,
                                UINT iMesh,
                                bool bAdjacent,
-                               ID3D12GraphicsCommandList *pd3dCommandList,
+                               bool bDepthOnly,
+                               ICommandRecorder *pRecorder,
                                D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                                UINT iDiffuseSlot,
                                UINT iNormalSlot,
@@ -39,28 +40,27 @@ public:
                             _In_z_ LPCWSTR szFileName,
                             _In_opt_ MT_SDKMESH_CALLBACKS12* pLoaderCallbacks = nullptr) ;
 
-    virtual void Render( _In_ ID3D12GraphicsCommandList* pd3dCommandList,
-                         _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
-                         _In_ UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
-                         _In_ UINT iNormalSlot = INVALID_SAMPLER_SLOT,
-                         _In_ UINT iSpecularSlot = INVALID_SAMPLER_SLOT ) override;
-
     void RenderMesh( _In_ UINT iMesh,
                      _In_ bool bAdjacent,
-                     _In_ ID3D12GraphicsCommandList* pd3dCommandList,
+                     _In_ ICommandRecorder* pRecorder,
                      _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                      _In_ UINT iDiffuseSlot,
                      _In_ UINT iNormalSlot,
                      _In_ UINT iSpecularSlot );
-    void RenderFrame( _In_ UINT iFrame,
-                      _In_ bool bAdjacent,
-                      _In_ ID3D12GraphicsCommandList* pd3dCommandList,
-                      _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
-                      _In_ UINT iDiffuseSlot,
-                      _In_ UINT iNormalSlot,
-                      _In_ UINT iSpecularSlot );
+    void RenderMeshDepth( _In_ UINT iMesh,
+                          _In_ ICommandRecorder* pRecorder );
 
 protected:
+    virtual void RenderMeshList( _In_reads_(NumMeshes) const UINT* pMeshes,
+                                 _In_ UINT NumMeshes,
+                                 _In_ bool bAdjacent,
+                                 _In_ bool bDepthOnly,
+                                 _In_ ICommandRecorder* pRecorder,
+                                 _In_ D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
+                                 _In_ UINT iDiffuseSlot,
+                                 _In_ UINT iNormalSlot,
+                                 _In_ UINT iSpecularSlot ) override;
+
   MT_SDKMESH_RENDER_CALLBACK12 m_aRenderMeshCallback;
 
 private:
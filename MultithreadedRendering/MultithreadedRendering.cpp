@@ -7,14 +7,20 @@
 #include <RootSignatureGenerator.h>
 #include <array>
 #include "MultithreadedDXUTMesh.h"
+#include "DrawPartitioner.h"
 #include <Camera.h>
 #include <UploadBuffer.h>
+#include <UploadRingBuffer.h>
+#include <CommandRecorder.h>
+#include <IndirectDrawBuilder.h>
+#include <TaskGraph.h>
+#include <CpuTopology.h>
+#include <CpuProfiler.h>
 #include <imgui.h>
 #include <imgui_impl_win32.h>
 #include <imgui_impl_dx12.h>
 #include <DirectXCollision.h>
 #include <ShlObj.h>
-#include <process.h>
 
 #undef min
 #undef max
@@ -29,6 +35,23 @@ static const int s_iNumLights  = 4;
 static const int s_iNumShadows = 1;
 static const int s_iNumMirrors = 4;
 
+// Scene passes, each one culled against its own view
+static const int s_iScenePassMain    = 0;
+static const int s_iScenePassShadow0 = s_iScenePassMain + 1;
+static const int s_iScenePassMirror0 = s_iScenePassShadow0 + s_iNumShadows;
+static const int s_iNumScenePasses   = s_iScenePassMirror0 + s_iNumMirrors;
+static_assert(s_iNumScenePasses <= FrustumCuller::MAX_VIEWS, "Scene passes must fit in a view mask");
+
+// Root parameters of the bindless material path, after the per-slot texture tables
+static const UINT s_uMaterialIndexRootSlot = 6;
+static const UINT s_uBindlessTableRootSlot = 7;
+
+// Recording sweeps, frames skipped after every change and frames measured
+static const int  s_iRecordingSweepWarmupFrames = 30;
+static const int  s_iRecordingSweepFrames = 120;
+static const char *s_aPinningPolicyNames[] = { "none", "cores first", "physical cores" };
+static const char *s_aFramePipeliningNames[] = { "throughput", "latency" };
+
 //
 // Default view parameters
 //
@@ -76,6 +99,7 @@ int WINAPI wWinMain(HINSTANCE hInst, HINSTANCE hPrevInst, PWSTR lpszCmdline, int
 struct PipelineStateTuple {
   ComPtr<ID3D12PipelineState> PSO;
   ComPtr<ID3D12RootSignature> RootSignature;
+  ComPtr<ID3D12PipelineState> BindlessPSO; // Same state with the bindless material PS, null without a PS
 };
 
 struct CB_PER_OBJECT {
@@ -106,16 +130,20 @@ enum SCENE_MT_RENDER_CASE {
   SCENE_MT_RENDER_CASE_MIRROR_AREA,
 };
 
+struct FrameResources;
+
 struct SceneParamsStatic {
   SCENE_MT_RENDER_CASE RenderCase;
+  int iScenePass;                       // Selects the culled draw list
   PipelineStateTuple *pPipelineStateTuple;
+  const FrameResources *pFrameResources; // Indirect arguments of the frame
   ID3D12Resource *pShadowTexture; // For rendering shadow map
   D3D12_CPU_DESCRIPTOR_HANDLE hRenderTargetView;
   D3D12_CPU_DESCRIPTOR_HANDLE hDepthStencilView;
   D3D12_VIEWPORT Viewport;
   D3D12_RECT ScissorRect;
 
-  UploadBufferStack *pConstBufferStack; // For allocating constant buffers.
+  UploadRingBuffer *pConstBufferRing; // For allocating constant buffers.
 
   UINT8 uStencilRef;
 
@@ -127,44 +155,55 @@ struct SceneParamsDynamic {
   XMFLOAT4X4 matViewProj;
 };
 
+// Scene recording resources of one frame context, the frame's own allocator and fence
+// point are kept by the renderer's frame contexts.
 struct FrameResources {
-  ComPtr<ID3D12CommandAllocator> CommandAllocator;
-
   ComPtr<ID3D12GraphicsCommandList> ShadowCommandLists[s_iNumShadows]; // Shared across frames in flight
   ComPtr<ID3D12CommandAllocator> ShadowCommandAllocators[s_iNumShadows];
   ComPtr<ID3D12GraphicsCommandList> MirrorCommandLists[s_iNumMirrors]; // Shared across frames in flight
   ComPtr<ID3D12CommandAllocator> MirrorCommandAllocators[s_iNumMirrors];
 
-  ComPtr<ID3D12GraphicsCommandList> ChunkCommandLists[MAXIMUM_WAIT_OBJECTS]; // Shared across frames in flight
-  ComPtr<ID3D12CommandAllocator> ChunkCommandAllocators[MAXIMUM_WAIT_OBJECTS];
-
-  UploadBufferStack ConstBufferStack;
-  UINT64 FencePoint;
+  // One list per scene pass and chunk, chunk 0 records the pass setup. Sized to the
+  // largest chunk count, which is not bounded.
+  std::vector<ComPtr<ID3D12GraphicsCommandList>> ChunkCommandLists[s_iNumScenePasses]; // Shared across frames in flight
+  // One allocator per job system thread, backing every chunk list the thread records in
+  // the frame. The memory they grow into is first touched by their own thread, which stays
+  // on its NUMA node once the workers are pinned.
+  std::vector<ComPtr<ID3D12CommandAllocator>> WorkerCommandAllocators;
+
+  // ExecuteIndirect arguments of every scene pass, IndirectArgsPerPass commands each. Grown
+  // when a pass needs more, by then the GPU is done with the frame's previous arguments.
+  UploadBuffer IndirectArgs;
+  UINT IndirectArgsPerPass = 0;
 };
 
 class MultithreadedRenderingSample;
 
 struct SCENE_RENDERING_THREAD_PARAMS {
   int SlotIndex;
-  HANDLE CompletionEvent;
   FrameResources                      *pFrameResources;
   MultithreadedRenderingSample        *pInstance;
   int BatchIndex;
   SCENE_MT_RENDER_CASE RenderCase;
 };
 
-struct CHUNK_RENDERING_THREAD_PARAMS {
-  MultithreadedRenderingSample *pInstance;
-  int ChunkIndex;
-  FrameResources *pFrameResources;
-  HANDLE PassBeginEvent;
-  HANDLE PassEndEvent;
+// One configuration of a recording sweep and what was measured with it
+struct RECORDING_SWEEP_STEP {
+  UINT NumThreads;
+  CPU_PINNING_POLICY Pinning;
+  float MeanMs;
+  float StdDevMs;
 };
 
-// Chunk thread local variables
+// Chunk local variables, reachable through the TLS slot while a chunk task records
 struct CHUNK_RENDERING_THREAD_LOCAL_VARS {
   int ChunkIndex;
   volatile ULONG NextDrawcallIndex;
+  ICommandRecorder *pRecorder;
+  UINT FirstDrawcall;   // Contiguous drawcall range of the chunk when partitioned by cost
+  UINT EndDrawcall;
+  float DrawRecordingUs; // Spent in RenderScene's draws, the part the partition divides
+  BOOL DrawsRecorded;    // False when the pass returned early, a back-facing mirror
 };
 
 class ImGuiInteractor: public WindowInteractor {
@@ -244,11 +283,107 @@ protected:
     ImGui::NewFrame();
 
     if (ImGui::Begin("Rendering opts", nullptr, ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_AlwaysAutoResize)) {
-      ImGui::RadioButton("ST Def", (int *)&m_RenderSchedulingOption, RENDER_SCHEDULING_OPTION_ST);
-      ImGui::RadioButton("MT Def/Scene", (int *)&m_RenderSchedulingOption, RENDER_SCHEDULING_OPTION_MT_SCENE);
-      ImGui::RadioButton("MT Def/Chunk", (int *)&m_RenderSchedulingOption, RENDER_SCHEDULING_OPTION_MT_CHUNK);
+      bool bSchedulingChanged = false;
+      bSchedulingChanged |= ImGui::RadioButton("ST Def", (int *)&m_RenderSchedulingOption, RENDER_SCHEDULING_OPTION_ST);
+      bSchedulingChanged |= ImGui::RadioButton("MT Def/Scene", (int *)&m_RenderSchedulingOption,
+                                               RENDER_SCHEDULING_OPTION_MT_SCENE);
+      bSchedulingChanged |= ImGui::RadioButton("MT Def/Chunk", (int *)&m_RenderSchedulingOption,
+                                               RENDER_SCHEDULING_OPTION_MT_CHUNK);
+      // The frame time window only holds frames of the current scheduling option
+      if (bSchedulingChanged)
+        ResetFrameTimeStats();
+      ImGui::Separator();
+      FRAME_TIME_PERCENTILES cpuTimes = GetFrameTimeStats().GetPercentiles(FRAME_TIME_CPU);
+      FRAME_TIME_PERCENTILES presentTimes = GetFrameTimeStats().GetPercentiles(FRAME_TIME_PRESENT);
+      ImGui::Text("Frame times of %u frames, p50 / p95 / p99 / max:", GetFrameTimeStats().GetFrameCount());
+      ImGui::Text("  CPU: %.2f / %.2f / %.2f / %.2f ms", cpuTimes.P50, cpuTimes.P95, cpuTimes.P99, cpuTimes.Max);
+      ImGui::Text("  Present to present: %.2f / %.2f / %.2f / %.2f ms", presentTimes.P50, presentTimes.P95,
+                  presentTimes.P99, presentTimes.Max);
+      if (ImGui::Button("Reset frame times"))
+        ResetFrameTimeStats();
+      ImGui::SameLine();
+      if (ImGui::Button("Write FrameTimes.csv (F8)") && FAILED(WriteFrameTimeStats("FrameTimes.csv")))
+        DX_TRACE(L"Failed to write FrameTimes.csv\n");
+      ImGui::CheckboxFlags("Write frame times at exit", &m_bWriteFrameTimeStatsOnExit, TRUE);
       ImGui::Separator();
       ImGui::CheckboxFlags("Enable tight mirror stencil clipping space", &m_bOptmizeMirrorClipSpace, TRUE);
+      ImGui::CheckboxFlags("Use compiled draw packets", &m_bUseDrawPackets, TRUE);
+      if (m_bUseDrawPackets) {
+        ImGui::CheckboxFlags("Sort draws by state", &m_bSortDraws, TRUE);
+        if (m_bSortDraws)
+          ImGui::Text("  %u draws sorted in %.1f us", m_uSortedDrawCount, m_fDrawSortUs);
+        if (ImGui::Button("Measure draw state changes"))
+          m_bRunDrawStateMeasure = TRUE;
+        if (m_bHasDrawStateMeasure)
+          ImGui::Text("  State changes of all passes, unsorted: %u, sorted: %u", m_aDrawStateChanges[0],
+                      m_aDrawStateChanges[1]);
+      }
+      if (m_bBindlessSupported) {
+        ImGui::CheckboxFlags("Bindless materials", &m_bBindlessMaterials, TRUE);
+        if (ImGui::Button("Measure material binding"))
+          m_bRunMaterialBindingMeasure = TRUE;
+        if (m_bHasMaterialBindingMeasure) {
+          ImGui::Text("  Tables: %.1f us, %u root arguments", m_aMaterialBindingUs[0], m_aMaterialBindingArgs[0]);
+          ImGui::Text("  Bindless: %.1f us, %u root arguments", m_aMaterialBindingUs[1], m_aMaterialBindingArgs[1]);
+        }
+        if (m_bBindlessMaterials && m_bUseDrawPackets) {
+          ImGui::CheckboxFlags("ExecuteIndirect submission", &m_bIndirectDraws, TRUE);
+          if (m_bIndirectDraws)
+            ImGui::Text("  %u commands for %u draws, %u meshes drawn directly", m_uIndirectCommandCount,
+                        m_uIndirectDrawCount, m_uIndirectDirectMeshCount);
+        }
+      }
+      ImGui::Separator();
+      ImGui::Text("CPU recording: %.3f ms", m_fRecordingTimeMs);
+      ImGui::SliderInt("Frames in flight", &m_iFramesInFlight, 1, FrameContextManager::s_uMaxFrameCount);
+      ImGui::Combo("Frame pipelining", &m_iFramePipeliningMode, s_aFramePipeliningNames,
+                   _countof(s_aFramePipeliningNames));
+      ImGui::Text("CPU wait for GPU: %.3f ms", m_fFrameWaitTimeMs);
+      ImGui::Text("Model draws per pass: %u (%u subsets)", m_uModelDrawCount, m_uModelSubsetCount);
+      if (IsMultithreadedPerChunk()) {
+        if (m_iRecordingSweepStep < 0) {
+          ImGui::SliderInt("Chunk threads", &m_iChunkThreadCount, 1, m_iMaxChunkThreadCount);
+          ImGui::Combo("Worker pinning", &m_iWorkerPinning, s_aPinningPolicyNames, _countof(s_aPinningPolicyNames));
+        } else {
+          ImGui::Text("Chunk threads: %d, %s pinning (sweeping)", m_iChunkThreadCount,
+                      s_aPinningPolicyNames[m_iWorkerPinning]);
+        }
+        ImGui::CheckboxFlags("Cost weighted chunk partition", &m_bCostWeightedPartition, TRUE);
+        ImGui::CheckboxFlags("Adapt draw cost weights", &m_bAdaptDrawCostWeights, TRUE);
+        ImGui::CheckboxFlags("Null command recording", &m_bNullCommandRecording, TRUE);
+        if (m_bNullCommandRecording)
+          ImGui::Text("  %u draws, %.2f Mdraws/s per thread", m_uNullDrawCount, m_fNullDrawsPerThreadSec * 1e-6f);
+        ImGui::Text("Chunk imbalance (max/mean), measured: %.2f", m_fMeasuredChunkImbalance);
+        ImGui::Text("  predicted round robin: %.2f, cost weighted: %.2f", m_fRoundRobinChunkImbalance,
+                    m_fWeightedChunkImbalance);
+        ImGui::Text("  weights (us): %.2f + %.3f/draw + %.3f/state + %.4f/kidx", m_afDrawCostWeights[0],
+                    m_afDrawCostWeights[1], m_afDrawCostWeights[2], m_afDrawCostWeights[3]);
+      }
+      ImGui::Separator();
+      ImGui::CheckboxFlags("Enable frustum culling", &m_bEnableFrustumCulling, TRUE);
+      if (m_bEnableFrustumCulling) {
+        ImGui::Text("Visible meshes, main: %u / %u", m_aVisibleMeshes[s_iScenePassMain], m_uTotalMeshes);
+        for (int i = 0; i < s_iNumShadows; ++i)
+          ImGui::Text("Visible meshes, shadow %d: %u / %u", i, m_aVisibleMeshes[s_iScenePassShadow0 + i], m_uTotalMeshes);
+        for (int i = 0; i < s_iNumMirrors; ++i)
+          ImGui::Text("Visible meshes, mirror %d: %u / %u", i, m_aVisibleMeshes[s_iScenePassMirror0 + i], m_uTotalMeshes);
+      }
+      if (CpuProfiler::IsCapturing())
+        ImGui::Text("CPU capture: %u markers, %u dropped, F9 stops", CpuProfiler::GetEventCount(),
+                    CpuProfiler::GetDroppedEventCount());
+      else
+        ImGui::Text("CPU capture: F9 starts, written to CpuTrace.json");
+      if (ImGui::Button("Run chunk thread sweep") && m_iRecordingSweepStep < 0)
+        m_bRunThreadSweep = TRUE;
+      ImGui::SameLine();
+      if (ImGui::Button("Run pinning comparison") && m_iRecordingSweepStep < 0)
+        m_bRunPinningSweep = TRUE;
+      if (m_bHasRecordingSweep) {
+        for (const auto &step : m_aRecordingSweep)
+          ImGui::Text("%u threads, %s pinning: %.3f ms, sd %.3f ms, x%.2f", step.NumThreads,
+                      s_aPinningPolicyNames[step.Pinning], step.MeanMs, step.StdDevMs,
+                      m_aRecordingSweep[0].MeanMs / step.MeanMs);
+      }
     }
     ImGui::End();
 
@@ -282,6 +417,10 @@ protected:
     return m_RenderSchedulingOption == RENDER_SCHEDULING_OPTION_MT_SCENE;
   }
 
+  BOOL IsCostWeightedPartition() const {
+    return m_bCostWeightedPartition;
+  }
+
   BOOL IsSinglethreadedDeferred() const {
     return m_RenderSchedulingOption == RENDER_SCHEDULING_OPTION_ST;
   }
@@ -294,6 +433,45 @@ protected:
     return m_bOptmizeMirrorClipSpace;
   }
 
+  BOOL IsUseDrawPackets() const {
+    return m_bUseDrawPackets;
+  }
+
+  // Sorted playback needs the draw packets
+  BOOL IsSortDraws() const {
+    return m_bUseDrawPackets && m_bSortDraws;
+  }
+
+  BOOL IsBindlessMaterials() const {
+    return m_bBindlessSupported && m_bBindlessMaterials;
+  }
+
+  // The commands pass the material index, they can not switch descriptor tables
+  BOOL IsIndirectDraws() const {
+    return m_bUseDrawPackets && m_bIndirectDraws && IsBindlessMaterials();
+  }
+
+  BOOL IsEnableFrustumCulling() const {
+    return m_bEnableFrustumCulling;
+  }
+
+  BOOL IsNullCommandRecording() const {
+    return IsMultithreadedPerChunk() && m_bNullCommandRecording;
+  }
+
+  // Smooth the per-frame command recording time for display.
+  void UpdateRecordingTime(double fSeconds) {
+    m_fRecordingTimeMs += (static_cast<float>(fSeconds * 1000.0) - m_fRecordingTimeMs) * 0.05f;
+  }
+
+  void UpdateFrameWaitTime(float fMs) {
+    m_fFrameWaitTimeMs += (fMs - m_fFrameWaitTimeMs) * 0.05f;
+  }
+
+  void UpdateDrawSortTime(double fSeconds) {
+    m_fDrawSortUs += (static_cast<float>(fSeconds * 1e6) - m_fDrawSortUs) * 0.05f;
+  }
+
 private:
   void BeginInteraction() {
     ImGui::SetCurrentContext(m_pImGuiCtx);
@@ -308,6 +486,49 @@ protected:
   // UI data
   RENDER_SCHEDULING_OPTIONS m_RenderSchedulingOption = RENDER_SCHEDULING_OPTION_ST;
   BOOL m_bOptmizeMirrorClipSpace = FALSE;
+  BOOL m_bUseDrawPackets = TRUE;
+  BOOL m_bSortDraws = FALSE;
+  UINT m_uSortedDrawCount = 0;
+  float m_fDrawSortUs = 0.0f;
+  BOOL m_bRunDrawStateMeasure = FALSE;
+  BOOL m_bHasDrawStateMeasure = FALSE;
+  UINT m_aDrawStateChanges[2] = {}; // Unsorted, sorted
+  BOOL m_bBindlessSupported = FALSE; // Unbounded descriptor ranges need resource binding tier 2
+  BOOL m_bBindlessMaterials = FALSE;
+  BOOL m_bRunMaterialBindingMeasure = FALSE;
+  BOOL m_bHasMaterialBindingMeasure = FALSE;
+  float m_aMaterialBindingUs[2] = {}; // Tables, bindless
+  UINT m_aMaterialBindingArgs[2] = {};
+  BOOL m_bIndirectDraws = FALSE;
+  UINT m_uIndirectCommandCount = 0;
+  UINT m_uIndirectDrawCount = 0;
+  UINT m_uIndirectDirectMeshCount = 0;
+  float m_fRecordingTimeMs = 0.0f;
+  int m_iFramesInFlight = 3;
+  int m_iFramePipeliningMode = FRAME_PIPELINING_MODE_THROUGHPUT;
+  float m_fFrameWaitTimeMs = 0.0f;
+  UINT m_uModelDrawCount = 0;
+  UINT m_uModelSubsetCount = 0;
+  BOOL m_bCostWeightedPartition = TRUE;
+  BOOL m_bAdaptDrawCostWeights = TRUE;
+  BOOL m_bNullCommandRecording = FALSE;
+  UINT m_uNullDrawCount = 0;
+  float m_fNullDrawsPerThreadSec = 0.0f;
+  float m_fMeasuredChunkImbalance = 1.0f;
+  float m_fRoundRobinChunkImbalance = 1.0f;
+  float m_fWeightedChunkImbalance = 1.0f;
+  float m_afDrawCostWeights[DrawPartitioner::FEATURE_COUNT] = {};
+  BOOL m_bEnableFrustumCulling = TRUE;
+  UINT m_aVisibleMeshes[s_iNumScenePasses] = {};
+  UINT m_uTotalMeshes = 0;
+  int m_iChunkThreadCount = 1;
+  int m_iMaxChunkThreadCount = 1;
+  int m_iWorkerPinning = CPU_PINNING_NONE;
+  BOOL m_bRunThreadSweep = FALSE;
+  BOOL m_bRunPinningSweep = FALSE;
+  BOOL m_bHasRecordingSweep = FALSE;
+  int m_iRecordingSweepStep = -1; // Index into the sweep steps while a sweep runs
+  std::vector<RECORDING_SWEEP_STEP> m_aRecordingSweep;
 };
 
 class MultithreadedRenderingSample : public D3D12RendererContext, public ImGuiInteractor {
@@ -322,13 +543,31 @@ private:
   void OnFrameMoved(float fTime, float fElapsed) override;
   void OnRenderFrame(float fTime, float fElapsed) override;
   void OnResizeFrame(int cx, int cy) override;
-  void RenderScene(ID3D12GraphicsCommandList *pCommandList, const SceneParamsStatic *pStaticParams,
+  void RenderScene(ICommandRecorder *pRecorder, const SceneParamsStatic *pStaticParams,
                    const SceneParamsDynamic *pDynamicParams);
+  void RenderSceneDraws(ICommandRecorder *pRecorder, const SceneParamsStatic *pStaticParams, BOOL bBindless);
 
   void RenderShadow(int iShadow, FrameResources *pFrameResources);
   void RenderMirror(int iMirror, FrameResources *pFrameResources);
   void RenderSceneDirect(FrameResources *pFrameResources);
-  void OnPerChunkRenderDeferred(int chunkIndex, FrameResources* const* ppFrameResources);
+  void CalcSceneFrustums(SDKMESH_FRUSTUM *pFrustums);
+  void BuildSceneDrawLists();
+  void BuildSortedDrawLists();
+  HRESULT BuildIndirectDrawLists(FrameResources *pFrameResources);
+  void MeasureDrawStateChanges();
+  void MeasureMaterialBinding();
+  void BuildFrameTaskGraph();
+  void RecordChunkPass(int iScenePass, int iChunk);
+  void SubmitChunkPass(int iScenePass);
+  void PartitionChunkDraws();
+  void UpdateChunkBalance();
+  void SetChunkThreadCount(UINT uNumChunks);
+  void SetWorkerPinning(CPU_PINNING_POLICY ePolicy);
+  void StartThreadSweep();
+  void StartPinningSweep();
+  void StartRecordingSweep();
+  void StopRecordingSweep();
+  void StepRecordingSweep(double fRecordingTime);
 
   // UI
   LRESULT OnMsgProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) override;
@@ -354,12 +593,11 @@ private:
     _Inout_     PTP_WORK              Work
   );
 
-  static unsigned int WINAPI _PerChunkRenderDeferredProc(LPVOID pv);
-
   static void RenderMesh(CMultithreadedDXUTMesh *pMesh,
                          UINT iMesh,
                          bool bAdjacent,
-                         ID3D12GraphicsCommandList *pd3dCommandList,
+                         bool bDepthOnly,
+                         ICommandRecorder *pRecorder,
                          D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
                          UINT iDiffuseSlot,
                          UINT iNormalSlot,
@@ -367,6 +605,8 @@ private:
                          void *pUserContext);
 
   int GetCurrentChunkThreadIndex() const;
+  BOOL IsCurrentChunkDrawcall(ULONG drawcallIndex) const;
+  ICommandRecorder *GetCurrentChunkRecorder() const;
   void ResetCurrentChunkThreadDrawcallIndex();
   // Increment current chunk thread drawcall index
   // and return the previous draw call index
@@ -374,6 +614,8 @@ private:
 
   CMultithreadedDXUTMesh m_Model;
   ComPtr<ID3D12DescriptorHeap> m_pModelDescriptorHeap;
+  UINT m_uBindlessDescriptorStart = 0; // Bindless material range in m_pModelDescriptorHeap
+  ComPtr<ID3D12CommandSignature> m_pIndirectDrawSignature; // INDIRECT_DRAW_ARGS, null without bindless support
   std::future<HRESULT> m_InitPipelineWaitable;
 
   // Mirror models
@@ -428,9 +670,7 @@ private:
   };
   // Store all the pipeline state we will use.
   std::array<PipelineStateTuple, NAMED_PIPELINE_INDEX_MAX> m_aPipelineLib;
-  INT m_iFrameIndex = 0;
-  static const UINT s_uTotalFrameCount = 3;
-  FrameResources m_aFrameResources[s_uTotalFrameCount];
+  FrameResources m_aFrameResources[FrameContextManager::s_uMaxFrameCount];
 
   // Camera parameters
   CModelViewerCamera m_Camera;
@@ -458,12 +698,68 @@ private:
   SCENE_RENDERING_THREAD_PARAMS m_aShadowWorkQueueParams[s_iNumShadows];
   PTP_WORK m_aMirrorWorkQueuePool[s_iNumMirrors];
   SCENE_RENDERING_THREAD_PARAMS m_aMirrorWorkQueuePoolParams[s_iNumMirrors];
+  // Scene works still running, whichever finishes last signals the main thread. Unlike one
+  // event per work, this does not care how many works there are.
+  volatile LONG m_lPendingSceneWorks = 0;
+  HANDLE m_hSceneWorksDoneEvent = nullptr;
+  double m_fSceneWorksDoneTime = 0.0; // m_RecordingTimer time when the last scene work finished
   DWORD m_dwChunkThreadsLocalSlot; // Chunk threads local index variable slot.
-  UINT   m_uNumberOfChunkThreads; // Work queue item count in parallel for a single render frame.
-  HANDLE m_aChunkThreads[MAXIMUM_WAIT_OBJECTS];
-  CHUNK_RENDERING_THREAD_PARAMS m_aChunkThreadArgs[MAXIMUM_WAIT_OBJECTS];
-  CHUNK_RENDERING_THREAD_LOCAL_VARS m_aChunkThreadLocalVars[MAXIMUM_WAIT_OBJECTS+1];
-  volatile LONG m_lShowdownChunkThreads = 0;
+  CpuTopology m_CpuTopology;
+  CPU_PINNING_POLICY m_eWorkerPinning = CPU_PINNING_NONE;
+  std::vector<GROUP_AFFINITY> m_aWorkerDefaultAffinities; // As the threads started, restored when unpinned
+  UINT   m_uMaxChunkThreads;      // Chunk resources are allocated for this many chunks, one per logical processor.
+  UINT   m_uNumberOfChunkThreads; // Chunks every pass is split into, one per thread including the main thread.
+  CHUNK_RENDERING_THREAD_LOCAL_VARS m_MainThreadLocalVars;
+  std::vector<CHUNK_RENDERING_THREAD_LOCAL_VARS> m_aChunkTaskLocalVars[s_iNumScenePasses];
+  std::vector<ID3D12CommandList *> m_aChunkSubmitLists[s_iNumScenePasses];
+  // Chunks record into these instead of the command lists when null command recording is on,
+  // the scheduling is measured without the driver's cost and nothing is submitted.
+  std::vector<NullCommandRecorder> m_aChunkNullRecorders[s_iNumScenePasses];
+
+  // Per chunk scheduling: every pass records its chunks as soon as a worker is free, and
+  // the per pass submission nodes are chained so the queue still sees the passes in order.
+  JobSystem m_JobSystem;
+  TaskGraph m_FrameTaskGraph;
+  FrameResources *m_pTaskGraphFrameResources = nullptr;
+
+  // Draw distribution over the chunks, rebuilt every frame from the culled draw lists.
+  // Per mesh cost features are taken once the model is loaded.
+  DrawPartitioner m_DrawPartitioner;
+  std::vector<DRAW_COST_FEATURES> m_aMeshColorCosts;
+  std::vector<DRAW_COST_FEATURES> m_aMeshDepthCosts;
+  std::vector<DRAW_COST_FEATURES> m_aDrawCostItems; // Scratch, costs of one pass in draw order
+  std::vector<float> m_aWeightedFeatures;   // Scratch, feature sums of both distributions and their costs
+  std::vector<float> m_aRoundRobinFeatures;
+  std::vector<float> m_aWeightedCosts;
+  std::vector<float> m_aRoundRobinCosts;
+  std::vector<UINT> m_aChunkDrawRanges[s_iNumScenePasses];
+  std::vector<float> m_aChunkCostFeatures[s_iNumScenePasses];
+  std::vector<float> m_aChunkRecordingUs[s_iNumScenePasses];
+
+  // Recording sweep, the running sums of the current step and the settings to go back to
+  int m_iRecordingSweepFrame = 0;
+  double m_fRecordingSweepSum = 0.0;
+  double m_fRecordingSweepSumSq = 0.0;
+  int m_iSweepRestoreCount = 0;
+  CPU_PINNING_POLICY m_eSweepRestorePinning = CPU_PINNING_NONE;
+
+  // Measures the command list recording time of a frame, from the first draw recorded to the
+  // last. Culling, sorting and the argument buffer build are left out, and so are the UI and
+  // submission where they are not interleaved with the chunks.
+  DXUT::CDXUTTimer m_RecordingTimer;
+
+  // Culled model draw lists, rebuilt on the render thread before any pass is recorded
+  SDKMESH_VIEW_MASKS m_SceneViewMasks;
+  SDKMESH_DRAW_LIST m_aSceneDrawLists[s_iNumScenePasses];
+
+  // The draws of every pass in state order, built after the culling when sorting is on
+  SDKMESH_SORTED_DRAW_LIST m_aSortedDrawLists[s_iNumScenePasses];
+  DXUT::CDXUTTimer m_DrawSortTimer;
+
+  // The draws of every pass as ExecuteIndirect arguments and the meshes they can not cover,
+  // built after the culling when indirect submission is on
+  IndirectDrawBuilder m_aIndirectDraws[s_iNumScenePasses];
+  std::vector<UINT> m_aIndirectDirectMeshes[s_iNumScenePasses];
 };
 
 HRESULT CreateMultithreadRenderingRendererAndInteractor(D3D12RendererContext **ppRenderer,
@@ -477,6 +773,10 @@ HRESULT CreateMultithreadRenderingRendererAndInteractor(D3D12RendererContext **p
 
 MultithreadedRenderingSample::MultithreadedRenderingSample() {
   m_aDeviceConfig.SwapChainBackBufferFormatSRGB = TRUE;
+  // Transient constants of every frame in flight, given back as the sync fence passes them
+  m_aDeviceConfig.FrameCount = 3;
+  m_aDeviceConfig.FrameUploadRingSize = 1 << 22;
+  m_aDeviceConfig.FrameUploadRingMaxSize = 1 << 26;
 }
 
 UINT MultithreadedRenderingSample::GetExtraDSVDescriptorCount() const {
@@ -497,7 +797,7 @@ HRESULT MultithreadedRenderingSample::OnInitPipelines() {
   InitCamera();
   InitLights();
 
-  V_RETURN(ImGuiInteractor::OnInitialize(m_pd3dDevice, s_uTotalFrameCount, m_BackBufferFormat));
+  V_RETURN(ImGuiInteractor::OnInitialize(m_pd3dDevice, FrameContextManager::s_uMaxFrameCount, m_BackBufferFormat));
 
   V_RETURN(m_InitPipelineWaitable.get());
   return hr;
@@ -506,17 +806,9 @@ HRESULT MultithreadedRenderingSample::OnInitPipelines() {
 void MultithreadedRenderingSample::OnDestroy() {
   ImGuiInteractor::OnDestroy();
 
-  for(auto &param : m_aShadowWorkQueueParams) {
-    if(param.CompletionEvent != NULL) {
-      CloseHandle(param.CompletionEvent);
-      param.CompletionEvent = nullptr;
-    }
-  }
-  for(auto &param : m_aMirrorWorkQueuePoolParams) {
-    if(param.CompletionEvent != NULL) {
-      CloseHandle(param.CompletionEvent);
-      param.CompletionEvent = nullptr;
-    }
+  if(m_hSceneWorksDoneEvent != NULL) {
+    CloseHandle(m_hSceneWorksDoneEvent);
+    m_hSceneWorksDoneEvent = nullptr;
   }
 
   if(m_pCleanupGroup) {
@@ -526,26 +818,13 @@ void MultithreadedRenderingSample::OnDestroy() {
   if(m_pThreadpool)
     CloseThreadpool(m_pThreadpool);
 
-  // Notify the chunk threads that we want exit now
-  m_lShowdownChunkThreads = 1;
-  FrameResources *pFrameResources = &m_aFrameResources[0];
-  OnPerChunkRenderDeferred(-1, &pFrameResources);
-
-  int numChunkThreads = m_uNumberOfChunkThreads - 1;
-  for(int i = 0; i < numChunkThreads; ++i) {
-    if(m_aChunkThreads[i] != nullptr)
-      CloseHandle(m_aChunkThreads[i]);
-    if(m_aChunkThreadArgs[i].PassBeginEvent != nullptr)
-      CloseHandle(m_aChunkThreadArgs[i].PassBeginEvent);
-    if(m_aChunkThreadArgs[i].PassEndEvent != nullptr)
-      CloseHandle(m_aChunkThreadArgs[i].PassEndEvent);
-  }
+  m_JobSystem.Shutdown();
 }
 
 HRESULT MultithreadedRenderingSample::CreateFrameResources() {
   HRESULT hr = S_OK;
   char nameBuf[256];
-  int numChunkThreads = m_uNumberOfChunkThreads - 1;
+  int numChunks = m_uMaxChunkThreads;
   int findex;
   const FrameResources *pFrameResources0 = &m_aFrameResources[0];
 
@@ -553,9 +832,6 @@ HRESULT MultithreadedRenderingSample::CreateFrameResources() {
 
     auto &frameResources = m_aFrameResources[findex];
 
-    V_RETURN(frameResources.ConstBufferStack.Initialize(m_pd3dDevice, (1 << 14), 1));
-    V_RETURN(m_pd3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                                  IID_PPV_ARGS(&frameResources.CommandAllocator)));
     for(int i = 0; i < s_iNumShadows; ++i) {
       V_RETURN(m_pd3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
                                                     IID_PPV_ARGS(&frameResources.ShadowCommandAllocators[i])));
@@ -590,23 +866,30 @@ HRESULT MultithreadedRenderingSample::CreateFrameResources() {
       }
     }
 
-    for(int i = 0; i < numChunkThreads; ++i) {
+    // One job system thread per chunk at most
+    frameResources.WorkerCommandAllocators.resize(numChunks);
+    for(int i = 0; i < numChunks; ++i) {
       V_RETURN(m_pd3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                                    IID_PPV_ARGS(&frameResources.ChunkCommandAllocators[i])));
-      sprintf_s(nameBuf, "ChunkCommandAllocators[%d]", i);
-      DX_SetDebugName(frameResources.ChunkCommandAllocators[i].Get(), nameBuf);
-      if(findex == 0) {
-        V_RETURN(m_pd3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                                frameResources.ChunkCommandAllocators[i].Get(), nullptr,
-                                                IID_PPV_ARGS(&frameResources.ChunkCommandLists[i])));
-        sprintf_s(nameBuf, "ChunkCommandLists[%d]", i);
-        DX_SetDebugName(frameResources.ChunkCommandLists[i].Get(), nameBuf);
-        frameResources.ChunkCommandLists[i]->Close();
-      } else {
-        frameResources.ChunkCommandLists[i] = pFrameResources0->ChunkCommandLists[i];
+                                                    IID_PPV_ARGS(&frameResources.WorkerCommandAllocators[i])));
+      sprintf_s(nameBuf, "WorkerCommandAllocators[%d]", i);
+      DX_SetDebugName(frameResources.WorkerCommandAllocators[i].Get(), nameBuf);
+    }
+
+    for(int p = 0; p < s_iNumScenePasses; ++p) {
+      frameResources.ChunkCommandLists[p].resize(numChunks);
+      for(int i = 0; i < numChunks; ++i) {
+        if(findex == 0) {
+          V_RETURN(m_pd3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                  frameResources.WorkerCommandAllocators[0].Get(), nullptr,
+                                                  IID_PPV_ARGS(&frameResources.ChunkCommandLists[p][i])));
+          sprintf_s(nameBuf, "ChunkCommandLists[%d][%d]", p, i);
+          DX_SetDebugName(frameResources.ChunkCommandLists[p][i].Get(), nameBuf);
+          frameResources.ChunkCommandLists[p][i]->Close();
+        } else {
+          frameResources.ChunkCommandLists[p][i] = pFrameResources0->ChunkCommandLists[p][i];
+        }
       }
     }
-    frameResources.FencePoint = 0;
   }
 
   return hr;
@@ -667,13 +950,19 @@ HRESULT MultithreadedRenderingSample::CreateStaticDescriptorHeap() {
   HRESULT hr;
   ComPtr<ID3D12DescriptorHeap> pTempHeap;
   D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+  ComPtr<ID3D12DescriptorHeap> pBindlessHeap;
   UINT numModelDescriptors;
+  UINT numBindlessDescriptors = 0;
 
   V_RETURN(m_Model.GetResourceDescriptorHeap(m_pd3dDevice, FALSE, &m_pModelDescriptorHeap));
+  if (m_bBindlessSupported) {
+    V_RETURN(m_Model.GetBindlessDescriptorHeap(m_pd3dDevice, FALSE, &pBindlessHeap));
+    numBindlessDescriptors = m_Model.GetBindlessDescriptorCount();
+  }
 
   heapDesc = m_pModelDescriptorHeap->GetDesc();
   numModelDescriptors = heapDesc.NumDescriptors;
-  heapDesc.NumDescriptors += s_iNumShadows;
+  heapDesc.NumDescriptors += s_iNumShadows + numBindlessDescriptors;
   heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
   V_RETURN(m_pd3dDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&pTempHeap)));
 
@@ -683,6 +972,16 @@ HRESULT MultithreadedRenderingSample::CreateStaticDescriptorHeap() {
                                       m_pModelDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
                                       D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
+  // The bindless material range follows the model textures
+  m_uBindlessDescriptorStart = s_iNumShadows + numModelDescriptors;
+  if (pBindlessHeap)
+    m_pd3dDevice->CopyDescriptorsSimple(numBindlessDescriptors,
+                                        CD3DX12_CPU_DESCRIPTOR_HANDLE(pTempHeap->GetCPUDescriptorHandleForHeapStart(),
+                                                                      m_uBindlessDescriptorStart,
+                                                                      m_uCbvSrvUavDescriptorSize),
+                                        pBindlessHeap->GetCPUDescriptorHandleForHeapStart(),
+                                        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
   D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
   srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
   srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
@@ -715,6 +1014,30 @@ HRESULT MultithreadedRenderingSample::LoadModel() {
 
   V_RETURN(m_Model.Create(&uploadBatch, LR"(directx-sdk-samples\Media\SquidRoom\SquidRoom.sdkmesh)",
     &createAndRenderCallbacks));
+  V_RETURN(m_Model.CreatePositionStreams(&uploadBatch));
+
+  m_aMeshColorCosts.resize(m_Model.GetNumMeshes());
+  m_aMeshDepthCosts.resize(m_Model.GetNumMeshes());
+
+  for(UINT i = 0; i < m_Model.GetNumMeshes(); ++i) {
+    m_uModelDrawCount += m_Model.GetNumDraws(i);
+    m_uModelSubsetCount += m_Model.GetNumSubsets(i);
+
+    // Vertex and index buffers are bound once per mesh, then a table per material change
+    UINT uMaterialChanges = 0, uIndices = 0, uPrevMaterial = UINT_MAX;
+    for(UINT j = 0; j < m_Model.GetNumSubsets(i); ++j) {
+      auto pSubset = m_Model.GetSubset(i, j);
+      uMaterialChanges += pSubset->MaterialID != uPrevMaterial;
+      uPrevMaterial = pSubset->MaterialID;
+      uIndices += (UINT)pSubset->IndexCount;
+    }
+
+    m_aMeshColorCosts[i].Draws = (float)m_Model.GetNumDraws(i);
+    m_aMeshColorCosts[i].StateChanges = (float)(1 + uMaterialChanges);
+    m_aMeshColorCosts[i].KiloIndices = uIndices * 1e-3f;
+    m_aMeshDepthCosts[i] = m_aMeshColorCosts[i];
+    m_aMeshDepthCosts[i].StateChanges = 1.0f;
+  }
 
   V_RETURN(CreateMirrorModels(&uploadBatch));
 
@@ -814,7 +1137,8 @@ HRESULT MultithreadedRenderingSample::CreateMirrorModels(ResourceUploadBatch *pU
 HRESULT MultithreadedRenderingSample::CreatePSOs() {
 
   HRESULT hr;
-  ComPtr<ID3DBlob> pVSBuffer, pPSBuffer, pErrorBuffer;
+  ComPtr<ID3DBlob> pVSBuffer, pDepthVSBuffer, pPSBuffer, pBindlessPSBuffer, pErrorBuffer;
+  D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
 
   D3D_SHADER_MACRO defines[] = {
 #ifdef UNCOMPRESSED_VERTEX_DATA
@@ -822,8 +1146,19 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
 #endif
     { nullptr, nullptr }
   };
+  D3D_SHADER_MACRO bindlessDefines[] = {
+#ifdef UNCOMPRESSED_VERTEX_DATA
+    { "UNCOMPRESSED_VERTEX_DATA", "" },
+#endif
+    { "BINDLESS_MATERIALS", "" },
+    { nullptr, nullptr }
+  };
   ComPtr<ID3D12RootSignature> pRootSignature;
 
+  m_bBindlessSupported =
+      SUCCEEDED(m_pd3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) &&
+      options.ResourceBindingTier >= D3D12_RESOURCE_BINDING_TIER_2;
+
   V(d3dUtils::CompileShaderFromFile(L"Shaders/MultithreadedRendering_VSPS.hlsl", defines, nullptr, "VSMain", "vs_5_0", 0, 0, &pVSBuffer, &pErrorBuffer));
   if(FAILED(hr)) {
     DX_TRACE(L"Compile VS error: %S\n", pErrorBuffer ? pErrorBuffer->GetBufferPointer(): "Unknown");
@@ -833,6 +1168,15 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
     pErrorBuffer = nullptr;
   }
 
+  V(d3dUtils::CompileShaderFromFile(L"Shaders/MultithreadedRendering_VSPS.hlsl", defines, nullptr, "VSDepthMain", "vs_5_0", 0, 0, &pDepthVSBuffer, &pErrorBuffer));
+  if(FAILED(hr)) {
+    DX_TRACE(L"Compile depth VS error: %S\n", pErrorBuffer ? pErrorBuffer->GetBufferPointer(): "Unknown");
+    return hr;
+  } else if(pErrorBuffer) {
+    DX_TRACE(L"Compile depth VS warning: %S\n", pErrorBuffer->GetBufferPointer());
+    pErrorBuffer = nullptr;
+  }
+
   V(d3dUtils::CompileShaderFromFile(L"Shaders/MultithreadedRendering_VSPS.hlsl", defines, nullptr, "PSMain", "ps_5_0", 0, 0, &pPSBuffer, &pErrorBuffer));
   if(FAILED(hr)) {
     DX_TRACE(L"Compile PS error: %S\n", pErrorBuffer ? pErrorBuffer->GetBufferPointer(): "Unknown");
@@ -842,6 +1186,17 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
     pErrorBuffer = nullptr;
   }
 
+  if (m_bBindlessSupported) {
+    V(d3dUtils::CompileShaderFromFile(L"Shaders/MultithreadedRendering_VSPS.hlsl", bindlessDefines, nullptr, "PSMain", "ps_5_1", 0, 0, &pBindlessPSBuffer, &pErrorBuffer));
+    if(FAILED(hr)) {
+      DX_TRACE(L"Compile bindless PS error: %S\n", pErrorBuffer ? pErrorBuffer->GetBufferPointer(): "Unknown");
+      return hr;
+    } else if(pErrorBuffer) {
+      DX_TRACE(L"Compile bindless PS warning: %S\n", pErrorBuffer->GetBufferPointer());
+      pErrorBuffer = nullptr;
+    }
+  }
+
   D3D12_INPUT_ELEMENT_DESC UncompressedLayout[] = {
     { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -860,6 +1215,11 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
   };
 #endif
 
+  // Shadow pass reads the packed position streams only
+  D3D12_INPUT_ELEMENT_DESC PositionOnlyLayout[] = {
+    { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+  };
+
   RootSignatureGenerator rsGen;
   rsGen.AddConstBufferView(0);
   rsGen.AddConstBufferView(1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -867,6 +1227,10 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
   rsGen.AddDescriptorTable({ CD3DX12_DESCRIPTOR_RANGE1(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0) }, D3D12_SHADER_VISIBILITY_PIXEL);
   rsGen.AddDescriptorTable({ CD3DX12_DESCRIPTOR_RANGE1(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1) }, D3D12_SHADER_VISIBILITY_PIXEL);
   rsGen.AddDescriptorTable({ CD3DX12_DESCRIPTOR_RANGE1(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2) }, D3D12_SHADER_VISIBILITY_PIXEL);
+  rsGen.AddRootConstants(1, 3, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+  if (m_bBindlessSupported)
+    rsGen.AddDescriptorTable({ CD3DX12_DESCRIPTOR_RANGE1(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 1) },
+                             D3D12_SHADER_VISIBILITY_PIXEL);
   rsGen.AddStaticSamples(
     {
       CD3DX12_STATIC_SAMPLER_DESC {
@@ -884,13 +1248,26 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
 
   rsGen.Generate(m_pd3dDevice, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT, &pRootSignature);
 
+  // Every command sets the buffers and the material index root constant before its draw
+  if (m_bBindlessSupported) {
+    D3D12_INDIRECT_ARGUMENT_DESC aArgumentDescs[IndirectDrawBuilder::NUM_ARGUMENT_DESCS];
+    D3D12_COMMAND_SIGNATURE_DESC signatureDesc = {};
+
+    IndirectDrawBuilder::GetArgumentDescs(s_uMaterialIndexRootSlot, aArgumentDescs);
+    signatureDesc.ByteStride = sizeof(INDIRECT_DRAW_ARGS);
+    signatureDesc.NumArgumentDescs = _countof(aArgumentDescs);
+    signatureDesc.pArgumentDescs = aArgumentDescs;
+    V_RETURN(m_pd3dDevice->CreateCommandSignature(&signatureDesc, pRootSignature.Get(),
+                                                  IID_PPV_ARGS(&m_pIndirectDrawSignature)));
+  }
+
   CD3DX12_BLEND_DESC defaultBS{ D3D12_DEFAULT };
 
   D3D12_GRAPHICS_PIPELINE_STATE_DESC shadowPSODesc = {};
   shadowPSODesc.pRootSignature = pRootSignature.Get();
   shadowPSODesc.VS = {
-    pVSBuffer->GetBufferPointer(),
-    pVSBuffer->GetBufferSize()
+    pDepthVSBuffer->GetBufferPointer(),
+    pDepthVSBuffer->GetBufferSize()
   };
   shadowPSODesc.BlendState = CD3DX12_BLEND_DESC{ D3D12_DEFAULT };
   shadowPSODesc.BlendState.RenderTarget[0].BlendEnable = TRUE; // No color buffer write
@@ -903,8 +1280,8 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
   shadowPSODesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC{ D3D12_DEFAULT };
   shadowPSODesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
   shadowPSODesc.InputLayout = {
-    CompressedLayout,
-    (UINT)std::size(CompressedLayout)
+    PositionOnlyLayout,
+    (UINT)std::size(PositionOnlyLayout)
   };
   shadowPSODesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
   shadowPSODesc.NumRenderTargets = 0;
@@ -944,6 +1321,14 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
   m_aPipelineLib[NAMED_PIPELINE_INDEX_NORMAL].RootSignature = pRootSignature;
   V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(&psoDesc,
                                             IID_PPV_ARGS(&m_aPipelineLib[NAMED_PIPELINE_INDEX_NORMAL].PSO)));
+  if (m_bBindlessSupported) {
+    psoDesc.PS = {
+      pBindlessPSBuffer->GetBufferPointer(),
+      pBindlessPSBuffer->GetBufferSize()
+    };
+    V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(
+        &psoDesc, IID_PPV_ARGS(&m_aPipelineLib[NAMED_PIPELINE_INDEX_NORMAL].BindlessPSO)));
+  }
 
   // Mirrored area stencil write pipeline
   psoDesc = {};
@@ -1111,6 +1496,15 @@ HRESULT MultithreadedRenderingSample::CreatePSOs() {
     m_aPipelineLib[i + NAMED_PIPELINE_INDEX_MIRRORED_RENDERING_S0].RootSignature = pRootSignature;
     V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(
         &objPSODesc, IID_PPV_ARGS(&m_aPipelineLib[i + NAMED_PIPELINE_INDEX_MIRRORED_RENDERING_S0].PSO)));
+    if (m_bBindlessSupported) {
+      D3D12_GRAPHICS_PIPELINE_STATE_DESC bindlessDesc = objPSODesc;
+      bindlessDesc.PS = {
+        pBindlessPSBuffer->GetBufferPointer(),
+        pBindlessPSBuffer->GetBufferSize()
+      };
+      V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(
+          &bindlessDesc, IID_PPV_ARGS(&m_aPipelineLib[i + NAMED_PIPELINE_INDEX_MIRRORED_RENDERING_S0].BindlessPSO)));
+    }
 
     m_aPipelineLib[i + NAMED_PIPELINE_INDEX_RENDERING_MIRROR_S0].RootSignature = pRootSignature;
     V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(
@@ -1208,19 +1602,51 @@ void MultithreadedRenderingSample::OnFrameMoved(float fTime, float fElapsed) {
 
   m_Camera.FrameMove(fElapsed, this);
 
-  m_iFrameIndex = (m_iFrameIndex + 1) % s_uTotalFrameCount;
-  auto pFrameResources = &m_aFrameResources[m_iFrameIndex];
-  m_pSyncFence->WaitForSyncPoint(pFrameResources->FencePoint);
-
-  pFrameResources->ConstBufferStack.Clear();
+  // Recording this frame overlaps the GPU running the previous ones, only waits when the
+  // frames in flight are all taken
+  m_FrameContexts.BeginFrame();
+  UpdateFrameWaitTime(m_FrameContexts.GetLastWaitMs());
 
   RENDER_SCHEDULING_OPTIONS ropts = m_RenderSchedulingOption;
 
   ImGuiInteractor::OnFrameMoved(m_pd3dDevice);
 
+  // Taken up by the next BeginFrame
+  m_FrameContexts.SetFrameCount((UINT)m_iFramesInFlight);
+  m_FrameContexts.SetPipeliningMode((FRAME_PIPELINING_MODE)m_iFramePipeliningMode);
+
+  if (m_bRunThreadSweep) {
+    m_bRunThreadSweep = FALSE;
+    StartThreadSweep();
+  }
+
+  if (m_bRunPinningSweep) {
+    m_bRunPinningSweep = FALSE;
+    StartPinningSweep();
+  }
+
   if(ropts != m_RenderSchedulingOption) {
     TuneRendererThreadsByWorkset();
   }
+
+  if (m_iWorkerPinning != m_eWorkerPinning)
+    SetWorkerPinning((CPU_PINNING_POLICY)m_iWorkerPinning);
+
+  if ((UINT)m_iChunkThreadCount != m_uNumberOfChunkThreads)
+    SetChunkThreadCount(m_iChunkThreadCount);
+
+  m_Model.EnableDrawPackets(!!IsUseDrawPackets());
+  m_Model.EnableBindlessMaterials(IsBindlessMaterials() ? s_uMaterialIndexRootSlot : INVALID_SAMPLER_SLOT);
+
+  if (m_bRunDrawStateMeasure) {
+    m_bRunDrawStateMeasure = FALSE;
+    MeasureDrawStateChanges();
+  }
+
+  if (m_bRunMaterialBindingMeasure) {
+    m_bRunMaterialBindingMeasure = FALSE;
+    MeasureMaterialBinding();
+  }
 }
 
 XMMATRIX MultithreadedRenderingSample::CalcLightViewProj( int iLight, BOOL bAdapterFOV )
@@ -1244,6 +1670,19 @@ int MultithreadedRenderingSample::GetCurrentChunkThreadIndex() const {
   return pVars->ChunkIndex;
 }
 
+BOOL MultithreadedRenderingSample::IsCurrentChunkDrawcall(ULONG drawcallIndex) const {
+  auto pVars = reinterpret_cast<CHUNK_RENDERING_THREAD_LOCAL_VARS *>(TlsGetValue(m_dwChunkThreadsLocalSlot));
+
+  if (IsCostWeightedPartition())
+    return drawcallIndex >= pVars->FirstDrawcall && drawcallIndex < pVars->EndDrawcall;
+  return drawcallIndex % m_uNumberOfChunkThreads == (ULONG)(pVars->ChunkIndex + 1);
+}
+
+ICommandRecorder *MultithreadedRenderingSample::GetCurrentChunkRecorder() const {
+  auto pVars = reinterpret_cast<CHUNK_RENDERING_THREAD_LOCAL_VARS *>(TlsGetValue(m_dwChunkThreadsLocalSlot));
+  return pVars->pRecorder;
+}
+
 void MultithreadedRenderingSample::ResetCurrentChunkThreadDrawcallIndex() {
   auto pVars = reinterpret_cast<CHUNK_RENDERING_THREAD_LOCAL_VARS *>(TlsGetValue(m_dwChunkThreadsLocalSlot));
   pVars->NextDrawcallIndex = 0;
@@ -1258,7 +1697,8 @@ void MultithreadedRenderingSample::RenderMesh(
   CMultithreadedDXUTMesh* pMesh, 
   UINT iMesh,
   bool bAdjacent,
-  ID3D12GraphicsCommandList* pd3dCommandList,
+  bool bDepthOnly,
+  ICommandRecorder* pRecorder,
   D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart,
   UINT iDiffuseSlot,
   UINT iNormalSlot,
@@ -1266,28 +1706,31 @@ void MultithreadedRenderingSample::RenderMesh(
   void *pUserContext
 ) {
 
-  ULONG chunkIndex;
-
   auto pSample = reinterpret_cast<MultithreadedRenderingSample *>(pUserContext);
 
 // Skip the task which is not in current thread slot. 
  if(pSample->IsMultithreadedPerChunk()) {
-   chunkIndex = pSample->GetCurrentChunkThreadIndex() + 1;
-   if ((pSample->IncrementCurrentChunkThreadDrawcallIndex() % (ULONG)pSample->m_uNumberOfChunkThreads) == chunkIndex) {
-     pMesh->RenderMesh(
-       iMesh,  
-       bAdjacent,
-       pd3dCommandList,
-       hDescriptorStart,
-       iDiffuseSlot,
-       iNormalSlot,
-       iSpecularSlot);
+   if (pSample->IsCurrentChunkDrawcall(pSample->IncrementCurrentChunkThreadDrawcallIndex())) {
+     if (bDepthOnly) {
+       pMesh->RenderMeshDepth(iMesh, pRecorder);
+     } else {
+       pMesh->RenderMesh(
+         iMesh,
+         bAdjacent,
+         pRecorder,
+         hDescriptorStart,
+         iDiffuseSlot,
+         iNormalSlot,
+         iSpecularSlot);
+     }
    }
+  } else if (bDepthOnly) {
+    pMesh->RenderMeshDepth(iMesh, pRecorder);
   } else {
     pMesh->RenderMesh(
       iMesh,
       bAdjacent,
-      pd3dCommandList,
+      pRecorder,
       hDescriptorStart,
       iDiffuseSlot,
       iNormalSlot,
@@ -1295,22 +1738,31 @@ void MultithreadedRenderingSample::RenderMesh(
   }
 }
 
-void MultithreadedRenderingSample::RenderScene(ID3D12GraphicsCommandList *pCommandList,
+void MultithreadedRenderingSample::RenderScene(ICommandRecorder *pRecorder,
                                                const SceneParamsStatic *pSceneParamsStatic,
                                                const SceneParamsDynamic *pSceneParamsDynamic) {
 
   D3D12_CONSTANT_BUFFER_VIEW_DESC CBV;
+  const PipelineStateTuple *pPipelineStateTuple = pSceneParamsStatic->pPipelineStateTuple;
+  BOOL bBindless = IsBindlessMaterials() && pPipelineStateTuple->BindlessPSO;
 
-  pCommandList->SetPipelineState(pSceneParamsStatic->pPipelineStateTuple->PSO.Get());
-  pCommandList->SetGraphicsRootSignature(pSceneParamsStatic->pPipelineStateTuple->RootSignature.Get());
-  pCommandList->SetDescriptorHeaps(1, m_pModelDescriptorHeap.GetAddressOf());
+  pRecorder->SetPipelineState(bBindless ? pPipelineStateTuple->BindlessPSO.Get() : pPipelineStateTuple->PSO.Get());
+  pRecorder->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
+  pRecorder->SetDescriptorHeaps(1, m_pModelDescriptorHeap.GetAddressOf());
 
-  pCommandList->RSSetViewports(1, &pSceneParamsStatic->Viewport);
-  pCommandList->RSSetScissorRects(1, &pSceneParamsStatic->ScissorRect);
-  pCommandList->OMSetStencilRef(pSceneParamsStatic->uStencilRef);
+  pRecorder->RSSetViewports(1, &pSceneParamsStatic->Viewport);
+  pRecorder->RSSetScissorRects(1, &pSceneParamsStatic->ScissorRect);
+  pRecorder->OMSetStencilRef(pSceneParamsStatic->uStencilRef);
 
   if (pSceneParamsStatic->RenderCase != SCENE_MT_RENDER_CASE_SHADOW) {
-    pCommandList->SetGraphicsRootDescriptorTable(5, m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+    pRecorder->SetGraphicsRootDescriptorTable(5, m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+  }
+
+  // All material textures at once, the draws only pass their material index
+  if (bBindless) {
+    pRecorder->SetGraphicsRootDescriptorTable(
+        s_uBindlessTableRootSlot, CD3DX12_GPU_DESCRIPTOR_HANDLE(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                                m_uBindlessDescriptorStart, m_uCbvSrvUavDescriptorSize));
   }
 
   CB_PER_SCENE sceneData;
@@ -1319,8 +1771,8 @@ void MultithreadedRenderingSample::RenderScene(ID3D12GraphicsCommandList *pComma
   sceneData.m_vTintColor = pSceneParamsStatic->vTintColor;
   XMStoreFloat4(&sceneData.m_vAmbientColor, s_vAmbientColor);
   sceneData.m_vMirrorPlane = pSceneParamsStatic->vMirrorPlane;
-  pSceneParamsStatic->pConstBufferStack->Push(&sceneData, sizeof(sceneData), &CBV);
-  pCommandList->SetGraphicsRootConstantBufferView(2, CBV.BufferLocation);
+  pSceneParamsStatic->pConstBufferRing->Push(&sceneData, sizeof(sceneData), &CBV);
+  pRecorder->SetGraphicsRootConstantBufferView(2, CBV.BufferLocation);
 
   if(pSceneParamsStatic->RenderCase != SCENE_MT_RENDER_CASE_SHADOW) {
     CB_PER_LIGHT lightData;
@@ -1338,27 +1790,117 @@ void MultithreadedRenderingSample::RenderScene(ID3D12GraphicsCommandList *pComma
           XMFLOAT4(g_fLightFalloffDistEnd[iLight], g_fLightFalloffDistRange[iLight], g_fLightFalloffCosAngleEnd[iLight],
                   g_fLightFalloffCosAngleRange[iLight]);
     }
-    pSceneParamsStatic->pConstBufferStack->Push(&lightData, sizeof(lightData), &CBV);
-    pCommandList->SetGraphicsRootConstantBufferView(1, CBV.BufferLocation);
+    pSceneParamsStatic->pConstBufferRing->Push(&lightData, sizeof(lightData), &CBV);
+    pRecorder->SetGraphicsRootConstantBufferView(1, CBV.BufferLocation);
   }
 
   CB_PER_OBJECT objData;
   XMStoreFloat4x4(&objData.m_mWorld, XMMatrixIdentity());
   XMStoreFloat4(&objData.m_vObjectColor, Colors::White);
-  pSceneParamsStatic->pConstBufferStack->Push(&objData, sizeof(objData), &CBV);
-  pCommandList->SetGraphicsRootConstantBufferView(0, CBV.BufferLocation);
+  pSceneParamsStatic->pConstBufferRing->Push(&objData, sizeof(objData), &CBV);
+  pRecorder->SetGraphicsRootConstantBufferView(0, CBV.BufferLocation);
+
+  if (!IsMultithreadedPerChunk()) {
+    RenderSceneDraws(pRecorder, pSceneParamsStatic, bBindless);
+    return;
+  }
+
+  // Only the draws are timed for the partition, the state set up above and what the first
+  // chunk records around the scene do not follow its share of the draws
+  auto pVars = reinterpret_cast<CHUNK_RENDERING_THREAD_LOCAL_VARS *>(TlsGetValue(m_dwChunkThreadsLocalSlot));
+  DXUT::CDXUTTimer timer;
+  timer.Reset();
+
+  RenderSceneDraws(pRecorder, pSceneParamsStatic, bBindless);
+
+  pVars->DrawRecordingUs += (float)(timer.GetTime() * 1e6);
+  pVars->DrawsRecorded = TRUE;
+}
+
+void MultithreadedRenderingSample::RenderSceneDraws(ICommandRecorder *pRecorder,
+                                                    const SceneParamsStatic *pSceneParamsStatic, BOOL bBindless) {
+
+  // One ExecuteIndirect draws the pass, the first chunk records it. The meshes left to
+  // direct draws are split evenly across the chunks, as the sorted draws are. Shadow passes
+  // have no material to index.
+  if (IsIndirectDraws() && (bBindless || pSceneParamsStatic->RenderCase == SCENE_MT_RENDER_CASE_SHADOW)) {
+    const int iScenePass = pSceneParamsStatic->iScenePass;
+    const IndirectDrawBuilder *pIndirectDraws = &m_aIndirectDraws[iScenePass];
+    const std::vector<UINT> &directMeshes = m_aIndirectDirectMeshes[iScenePass];
+    const FrameResources *pFrameResources = pSceneParamsStatic->pFrameResources;
+    CD3DX12_GPU_DESCRIPTOR_HANDLE hDescriptorStart(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                   s_iNumShadows, m_uCbvSrvUavDescriptorSize);
+
+    UINT uFirst = 0, uEnd = (UINT)directMeshes.size();
+    BOOL bFirstChunk = TRUE;
+    if (IsMultithreadedPerChunk()) {
+      UINT uChunk = (UINT)(GetCurrentChunkThreadIndex() + 1);
+      uFirst = (UINT)((UINT64)directMeshes.size() * uChunk / m_uNumberOfChunkThreads);
+      uEnd = (UINT)((UINT64)directMeshes.size() * (uChunk + 1) / m_uNumberOfChunkThreads);
+      bFirstChunk = uChunk == 0;
+    }
+
+    if (bFirstChunk && pIndirectDraws->GetDrawCount() > 0) {
+      pRecorder->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+      pRecorder->ExecuteIndirect(m_pIndirectDrawSignature.Get(), pIndirectDraws->GetDrawCount(),
+                                 pFrameResources->IndirectArgs.GetResource(),
+                                 (UINT64)iScenePass * pFrameResources->IndirectArgsPerPass * sizeof(INDIRECT_DRAW_ARGS),
+                                 nullptr, 0);
+    }
+
+    for (UINT i = uFirst; i < uEnd; ++i) {
+      if (pSceneParamsStatic->RenderCase == SCENE_MT_RENDER_CASE_SHADOW)
+        m_Model.RenderMeshDepth(directMeshes[i], pRecorder);
+      else
+        m_Model.RenderMesh(directMeshes[i], false, pRecorder, hDescriptorStart, 3, 4, INVALID_SAMPLER_SLOT);
+    }
+    return;
+  }
+
+  if (IsSortDraws()) {
+    // Chunks split the sorted draws evenly, each range starts with its own state
+    auto pSortedList = &m_aSortedDrawLists[pSceneParamsStatic->iScenePass];
+    UINT uFirst = 0, uEnd = pSortedList->NumDraws();
+    if (IsMultithreadedPerChunk()) {
+      UINT uChunk = (UINT)(GetCurrentChunkThreadIndex() + 1);
+      uFirst = (UINT)((UINT64)pSortedList->NumDraws() * uChunk / m_uNumberOfChunkThreads);
+      uEnd = (UINT)((UINT64)pSortedList->NumDraws() * (uChunk + 1) / m_uNumberOfChunkThreads);
+    }
+
+    if (pSceneParamsStatic->RenderCase == SCENE_MT_RENDER_CASE_SHADOW) {
+      m_Model.RenderSortedDrawListDepth(pSortedList, uFirst, uEnd, pRecorder);
+    } else {
+      CD3DX12_GPU_DESCRIPTOR_HANDLE hDescriptorStart(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                     s_iNumShadows, m_uCbvSrvUavDescriptorSize);
+      m_Model.RenderSortedDrawList(pSortedList, uFirst, uEnd, pRecorder, hDescriptorStart, 3, 4);
+    }
+    return;
+  }
 
   if(IsMultithreadedPerChunk())
     ResetCurrentChunkThreadDrawcallIndex();
-  m_Model.Render(pCommandList,
-    CD3DX12_GPU_DESCRIPTOR_HANDLE(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-      s_iNumShadows, m_uCbvSrvUavDescriptorSize),
-      3, 4);
+  auto pDrawList = &m_aSceneDrawLists[pSceneParamsStatic->iScenePass];
+  if (pSceneParamsStatic->RenderCase == SCENE_MT_RENDER_CASE_SHADOW) {
+    if (IsEnableFrustumCulling())
+      m_Model.RenderDrawListDepth(pDrawList, pRecorder);
+    else
+      m_Model.RenderDepth(pRecorder);
+  } else {
+    CD3DX12_GPU_DESCRIPTOR_HANDLE hDescriptorStart(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                   s_iNumShadows, m_uCbvSrvUavDescriptorSize);
+    if (IsEnableFrustumCulling())
+      m_Model.RenderDrawList(pDrawList, pRecorder, hDescriptorStart, 3, 4);
+    else
+      m_Model.Render(pRecorder, hDescriptorStart, 3, 4);
+  }
 }
 
 void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFrameResources) {
+  CPU_PROFILE_SCOPE("RenderMirror");
 
-  ID3D12GraphicsCommandList *pCommandList;
+  ID3D12GraphicsCommandList *pCommandList = nullptr;
+  D3D12CommandRecorder d3d12Recorder;
+  ICommandRecorder *pRecorder = &d3d12Recorder;
   int chunkIndex = -1;
 
   if (IsMultithreadedPerScene()) {
@@ -1366,19 +1908,12 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
 
     pFrameResources->MirrorCommandAllocators[iMirror]->Reset();
     pCommandList->Reset(pFrameResources->MirrorCommandAllocators[iMirror].Get(), nullptr);
+    d3d12Recorder.SetCommandList(pCommandList);
   } else if(IsMultithreadedPerChunk()) {
     chunkIndex = GetCurrentChunkThreadIndex();
-
-    if(chunkIndex < 0) {
-      m_pd3dCommandList->Reset(pFrameResources->CommandAllocator.Get(), nullptr);
-      pCommandList = m_pd3dCommandList;
-    } else {
-      pFrameResources->ChunkCommandLists[chunkIndex]->Reset(pFrameResources->ChunkCommandAllocators[chunkIndex].Get(), nullptr);
-      pFrameResources->ChunkCommandLists[chunkIndex]->Close();
-      pCommandList = nullptr;
-    }
+    pRecorder = GetCurrentChunkRecorder();
   } else {
-    pCommandList = m_pd3dCommandList;
+    d3d12Recorder.SetCommandList(m_pd3dCommandList);
   }
 
   D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = CurrentBackBufferView();
@@ -1387,11 +1922,13 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
   if (iMirror == 0) {
     if(chunkIndex < 0) {
 
-      PrepareNextFrame(pCommandList);
+      // A null recorder has no list, the frame's own list moves the back buffer then
+      if (pRecorder->GetCommandList())
+        PrepareNextFrame(pRecorder->GetCommandList());
 
-      pCommandList->ClearRenderTargetView(rtvHandle, Colors::MidnightBlue, 0, nullptr);
-      pCommandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0,
-                                          nullptr);
+      pRecorder->ClearRenderTargetView(rtvHandle, Colors::MidnightBlue, 0, nullptr);
+      pRecorder->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0,
+                                       nullptr);
 
       // Shadow SRVs
       CD3DX12_RESOURCE_BARRIER shadowBarriers[s_iNumShadows];
@@ -1400,7 +1937,7 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
           D3D12_RESOURCE_STATE_DEPTH_WRITE,
           D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
       }
-      pCommandList->ResourceBarrier(s_iNumShadows, shadowBarriers);
+      pRecorder->ResourceBarrier(s_iNumShadows, shadowBarriers);
     }
   }
 
@@ -1422,7 +1959,7 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
 
   // Test for back-facing mirror
   if(XMVectorGetX(XMPlaneDotCoord(vMirrorPlane, vEyePt)) < 0.0f) {
-    if(IsMultithreadedPerScene() || (IsMultithreadedPerChunk() && pCommandList)) {
+    if(IsMultithreadedPerScene()) {
       pCommandList->Close();
     }
     return;
@@ -1435,7 +1972,7 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
   UINT8 stencilRef = 1 << sindex;
   D3D12_RECT stencilAreaRect;
 
-  auto pUploadBufferStack = &pFrameResources->ConstBufferStack;
+  auto pConstBufferRing = m_FrameContexts.GetUploadRing();
   D3D12_CONSTANT_BUFFER_VIEW_DESC objCBV, sceneCBV;
   CB_PER_OBJECT objData;
   CB_PER_SCENE sceneData;
@@ -1484,44 +2021,44 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
   // Write mirrored area stencil value
   if (chunkIndex < 0) {
 
-    pCommandList->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
-    pCommandList->RSSetViewports(1, &m_ScreenViewport);
-    pCommandList->RSSetScissorRects(1, &stencilAreaRect);
+    pRecorder->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
+    pRecorder->RSSetViewports(1, &m_ScreenViewport);
+    pRecorder->RSSetScissorRects(1, &stencilAreaRect);
 
     pPipelineStateTuple = &m_aPipelineLib[NAMED_PIPELINE_INDEX_MIRRORED_S0 + sindex];
 
-    pCommandList->SetPipelineState(pPipelineStateTuple->PSO.Get());
-    pCommandList->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
-    pCommandList->OMSetStencilRef(stencilRef);
+    pRecorder->SetPipelineState(pPipelineStateTuple->PSO.Get());
+    pRecorder->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
+    pRecorder->OMSetStencilRef(stencilRef);
 
     XMStoreFloat4x4(&objData.m_mWorld, XMMatrixTranspose(matMirrorWorld));
     XMStoreFloat4x4(&sceneData.m_mViewProj, XMMatrixTranspose(matViewProj));
-    pUploadBufferStack->Push(&objData, sizeof(objData), &objCBV);
-    pUploadBufferStack->Push(&sceneData, sizeof(sceneData), &sceneCBV);
-    pCommandList->SetGraphicsRootConstantBufferView(0, objCBV.BufferLocation);
-    pCommandList->SetGraphicsRootConstantBufferView(2, sceneCBV.BufferLocation);
+    pConstBufferRing->Push(&objData, sizeof(objData), &objCBV);
+    pConstBufferRing->Push(&sceneData, sizeof(sceneData), &sceneCBV);
+    pRecorder->SetGraphicsRootConstantBufferView(0, objCBV.BufferLocation);
+    pRecorder->SetGraphicsRootConstantBufferView(2, sceneCBV.BufferLocation);
 
-    pCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-    pCommandList->IASetVertexBuffers(0, 1, &m_aMirrorVBVs[iMirror]);
-    pCommandList->DrawInstanced(4, 1, 0, 0);
+    pRecorder->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pRecorder->IASetVertexBuffers(0, 1, &m_aMirrorVBVs[iMirror]);
+    pRecorder->DrawInstanced(4, 1, 0, 0);
 
     // Clear depth value in stencil area
     pPipelineStateTuple = &m_aPipelineLib[NAMED_PIPELINE_INDEX_MIRRORED_CLEAR_DEPTH_S0 + sindex];
-    pCommandList->SetPipelineState(pPipelineStateTuple->PSO.Get());
-    pCommandList->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
-    pCommandList->OMSetStencilRef(stencilRef);
+    pRecorder->SetPipelineState(pPipelineStateTuple->PSO.Get());
+    pRecorder->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
+    pRecorder->OMSetStencilRef(stencilRef);
 
     sceneData.m_mViewProj._31 = sceneData.m_mViewProj._41;
     sceneData.m_mViewProj._32 = sceneData.m_mViewProj._42;
     sceneData.m_mViewProj._33 = sceneData.m_mViewProj._43;
     sceneData.m_mViewProj._34 = sceneData.m_mViewProj._44;
-    pUploadBufferStack->Push(&sceneData, sizeof(sceneData), &sceneCBV);
-    pCommandList->SetGraphicsRootConstantBufferView(0, objCBV.BufferLocation);
-    pCommandList->SetGraphicsRootConstantBufferView(2, sceneCBV.BufferLocation);
+    pConstBufferRing->Push(&sceneData, sizeof(sceneData), &sceneCBV);
+    pRecorder->SetGraphicsRootConstantBufferView(0, objCBV.BufferLocation);
+    pRecorder->SetGraphicsRootConstantBufferView(2, sceneCBV.BufferLocation);
 
-    pCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-    pCommandList->IASetVertexBuffers(0, 1, &m_aMirrorVBVs[iMirror]);
-    pCommandList->DrawInstanced(4, 1, 0, 0);
+    pRecorder->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pRecorder->IASetVertexBuffers(0, 1, &m_aMirrorVBVs[iMirror]);
+    pRecorder->DrawInstanced(4, 1, 0, 0);
   }
 
   SceneParamsStatic staticParams = {};
@@ -1529,8 +2066,10 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
 
   staticParams.hDepthStencilView = DepthStencilView();
   staticParams.hRenderTargetView = CurrentBackBufferView();
-  staticParams.pConstBufferStack = pUploadBufferStack;
+  staticParams.pConstBufferRing = pConstBufferRing;
   staticParams.pPipelineStateTuple = &m_aPipelineLib[NAMED_PIPELINE_INDEX_MIRRORED_RENDERING_S0 + iMirror];
+  staticParams.pFrameResources = pFrameResources;
+  staticParams.iScenePass = s_iScenePassMirror0 + iMirror;
   staticParams.Viewport = m_ScreenViewport;
   staticParams.ScissorRect = stencilAreaRect;
   staticParams.uStencilRef = stencilRef;
@@ -1539,52 +2078,37 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
 
   XMStoreFloat4x4(&dynamicParams.matViewProj, matReflect * matViewProj);
 
-  if(IsMultithreadedPerChunk()) {
-    ID3D12CommandAllocator *pCommandAllocator;
-
-    if(chunkIndex >= 0) {
-      pCommandList = pFrameResources->ChunkCommandLists[chunkIndex].Get();
-      pCommandAllocator = pFrameResources->ChunkCommandAllocators[chunkIndex].Get();
-
-      pCommandList->Reset(pCommandAllocator, nullptr);
-    }
-
-    pCommandList->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
-
-    RenderScene(pCommandList, &staticParams, &dynamicParams);
+  if(IsMultithreadedPerChunk())
+    pRecorder->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
 
-    if(chunkIndex != m_uNumberOfChunkThreads - 2)
-      pCommandList->Close();
-  } else {
-    RenderScene(pCommandList, &staticParams, &dynamicParams);
-  }
+  RenderScene(pRecorder, &staticParams, &dynamicParams);
 
   // Clear stencil value and overwrite depth value of the mirror
   if(!IsMultithreadedPerChunk() || chunkIndex == m_uNumberOfChunkThreads - 2) {
 
-    pCommandList->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
-    pCommandList->RSSetViewports(1, &m_ScreenViewport);
-    pCommandList->RSSetScissorRects(1, &stencilAreaRect); // Optimize this to a samll scissor rect.
+    pRecorder->OMSetRenderTargets(1, &rtvHandle, TRUE, &dsvHandle);
+    pRecorder->RSSetViewports(1, &m_ScreenViewport);
+    pRecorder->RSSetScissorRects(1, &stencilAreaRect); // Optimize this to a samll scissor rect.
 
     pPipelineStateTuple = &m_aPipelineLib[NAMED_PIPELINE_INDEX_RENDERING_MIRROR_S0 + sindex];
-    pCommandList->SetPipelineState(pPipelineStateTuple->PSO.Get());
-    pCommandList->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
-    pCommandList->OMSetStencilRef(stencilRef);
+    pRecorder->SetPipelineState(pPipelineStateTuple->PSO.Get());
+    pRecorder->SetGraphicsRootSignature(pPipelineStateTuple->RootSignature.Get());
+    pRecorder->OMSetStencilRef(stencilRef);
 
     if(IsMultithreadedPerChunk()) {
       XMStoreFloat4x4(&objData.m_mWorld, XMMatrixTranspose(matMirrorWorld));
-      pUploadBufferStack->Push(&objData, sizeof(objData), &objCBV);
+      pConstBufferRing->Push(&objData, sizeof(objData), &objCBV);
     }
 
     XMStoreFloat4x4(&sceneData.m_mViewProj, XMMatrixTranspose(matViewProj));
-    pUploadBufferStack->Push(&sceneData, sizeof(sceneData), &sceneCBV);
-    pCommandList->SetGraphicsRootConstantBufferView(0, objCBV.BufferLocation);
-    pCommandList->SetGraphicsRootConstantBufferView(2, sceneCBV.BufferLocation);
-    pCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-    pCommandList->IASetVertexBuffers(0, 1, &m_aMirrorVBVs[iMirror]);
-    pCommandList->DrawInstanced(4, 1, 0, 0);
-
-    if (IsMultithreadedPerScene() || IsMultithreadedPerChunk()) {
+    pConstBufferRing->Push(&sceneData, sizeof(sceneData), &sceneCBV);
+    pRecorder->SetGraphicsRootConstantBufferView(0, objCBV.BufferLocation);
+    pRecorder->SetGraphicsRootConstantBufferView(2, sceneCBV.BufferLocation);
+    pRecorder->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pRecorder->IASetVertexBuffers(0, 1, &m_aMirrorVBVs[iMirror]);
+    pRecorder->DrawInstanced(4, 1, 0, 0);
+
+    if (IsMultithreadedPerScene()) {
       // EndRenderFrame(pCommandList);
       pCommandList->Close();
     }
@@ -1592,18 +2116,21 @@ void MultithreadedRenderingSample::RenderMirror(int iMirror, FrameResources *pFr
 }
 
 void MultithreadedRenderingSample::RenderShadow(int iShadow, FrameResources *pFrameResources) {
+  CPU_PROFILE_SCOPE("RenderShadow");
 
   SceneParamsStatic shadowStaticParams = {};
   SceneParamsDynamic shadowDynamicParams = {};
-  auto pUploadBufferStack = &pFrameResources->ConstBufferStack;
+  auto pConstBufferRing = m_FrameContexts.GetUploadRing();
 
   shadowStaticParams.RenderCase = SCENE_MT_RENDER_CASE_SHADOW;
+  shadowStaticParams.iScenePass = s_iScenePassShadow0 + iShadow;
   shadowStaticParams.pPipelineStateTuple = &m_aPipelineLib[NAMED_PIPELINE_INDEX_SHADOW];
+  shadowStaticParams.pFrameResources = pFrameResources;
   shadowStaticParams.hDepthStencilView = CD3DX12_CPU_DESCRIPTOR_HANDLE(
     m_pDSVDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), iShadow+1, m_uDsvDescriptorSize
   );
   shadowStaticParams.pShadowTexture = m_aShadowTextures[iShadow].Get();
-  shadowStaticParams.pConstBufferStack = pUploadBufferStack;
+  shadowStaticParams.pConstBufferRing = pConstBufferRing;
   shadowStaticParams.Viewport = m_aShadowViewport;
   shadowStaticParams.ScissorRect = {
     (LONG)m_aShadowViewport.TopLeftX,
@@ -1614,7 +2141,9 @@ void MultithreadedRenderingSample::RenderShadow(int iShadow, FrameResources *pFr
 
   XMStoreFloat4x4(&shadowDynamicParams.matViewProj, CalcLightViewProj(iShadow, FALSE));
 
-  ID3D12GraphicsCommandList *pCommandList;
+  ID3D12GraphicsCommandList *pCommandList = nullptr;
+  D3D12CommandRecorder d3d12Recorder;
+  ICommandRecorder *pRecorder = &d3d12Recorder;
   int chunkIndex = -1;
 
   if(IsMultithreadedPerScene()) {
@@ -1622,42 +2151,42 @@ void MultithreadedRenderingSample::RenderShadow(int iShadow, FrameResources *pFr
 
     pFrameResources->ShadowCommandAllocators[iShadow]->Reset();
     pCommandList->Reset(pFrameResources->ShadowCommandAllocators[iShadow].Get(), nullptr);
+    d3d12Recorder.SetCommandList(pCommandList);
   } else if(IsMultithreadedPerChunk()) {
 
     chunkIndex = GetCurrentChunkThreadIndex();
-    if(chunkIndex < 0)
-      // Main thread
-      pCommandList = m_pd3dCommandList;
-    else
-      pCommandList = pFrameResources->ChunkCommandLists[chunkIndex].Get();
+    pRecorder = GetCurrentChunkRecorder();
   } else {
-    pCommandList = m_pd3dCommandList;
+    d3d12Recorder.SetCommandList(m_pd3dCommandList);
   }
 
   if(chunkIndex < 0) {
-    pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(shadowStaticParams.pShadowTexture,
-                                                                          D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                                                                          D3D12_RESOURCE_STATE_DEPTH_WRITE));
-    pCommandList->ClearDepthStencilView(shadowStaticParams.hDepthStencilView, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+    pRecorder->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(shadowStaticParams.pShadowTexture,
+                                                                       D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                                                       D3D12_RESOURCE_STATE_DEPTH_WRITE));
+    pRecorder->ClearDepthStencilView(shadowStaticParams.hDepthStencilView, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
   }
 
-  pCommandList->OMSetRenderTargets(0, nullptr, FALSE, &shadowStaticParams.hDepthStencilView);
+  pRecorder->OMSetRenderTargets(0, nullptr, FALSE, &shadowStaticParams.hDepthStencilView);
 
-  RenderScene(pCommandList, &shadowStaticParams, &shadowDynamicParams);
+  RenderScene(pRecorder, &shadowStaticParams, &shadowDynamicParams);
 
   if(IsMultithreadedPerScene())
     pCommandList->Close();
 }
 
 void MultithreadedRenderingSample::RenderSceneDirect(FrameResources *pFrameResources) {
+  CPU_PROFILE_SCOPE("RenderSceneDirect");
 
   SceneParamsStatic staticParamsDirect = {};
   SceneParamsDynamic dynamicParamsDirect = {};
 
   staticParamsDirect.pPipelineStateTuple = &m_aPipelineLib[NAMED_PIPELINE_INDEX_NORMAL];
+  staticParamsDirect.pFrameResources = pFrameResources;
+  staticParamsDirect.iScenePass = s_iScenePassMain;
   staticParamsDirect.hRenderTargetView = CurrentBackBufferView();
   staticParamsDirect.hDepthStencilView = DepthStencilView();
-  staticParamsDirect.pConstBufferStack = &pFrameResources->ConstBufferStack;
+  staticParamsDirect.pConstBufferRing = m_FrameContexts.GetUploadRing();
   staticParamsDirect.Viewport =  m_ScreenViewport;
   staticParamsDirect.ScissorRect = m_ScissorRect;
   XMStoreFloat4(&staticParamsDirect.vMirrorPlane, g_XMZero);
@@ -1670,156 +2199,570 @@ void MultithreadedRenderingSample::RenderSceneDirect(FrameResources *pFrameResou
 #endif
     XMStoreFloat4x4(&dynamicParamsDirect.matViewProj, m_Camera.GetViewMatrix() * m_Camera.GetProjMatrix());
 
-  ID3D12GraphicsCommandList *pCommandList;
+  D3D12CommandRecorder d3d12Recorder(m_pd3dCommandList);
+  ICommandRecorder *pRecorder = &d3d12Recorder;
 
-  if(IsMultithreadedPerChunk()) {
-    int chunkIndex = GetCurrentChunkThreadIndex();
+  if(IsMultithreadedPerChunk())
+    pRecorder = GetCurrentChunkRecorder();
 
-    if(chunkIndex < 0)
-      pCommandList = m_pd3dCommandList;
-    else
-      pCommandList = pFrameResources->ChunkCommandLists[chunkIndex].Get();
-  } else {
-    pCommandList = m_pd3dCommandList;
-  }
+  pRecorder->OMSetRenderTargets(1, &CurrentBackBufferView(), TRUE, &DepthStencilView());
+
+  RenderScene(pRecorder, &staticParamsDirect, &dynamicParamsDirect);
+}
+
+void MultithreadedRenderingSample::BuildFrameTaskGraph() {
+
+  // Queue order of the passes; mirrors sample the shadow maps, the main pass comes last.
+  int aPassOrder[s_iNumScenePasses];
+  int iNumPasses = 0;
+  for (int i = 0; i < s_iNumShadows; ++i)
+    aPassOrder[iNumPasses++] = s_iScenePassShadow0 + i;
+  for (int i = 0; i < s_iNumMirrors; ++i)
+    aPassOrder[iNumPasses++] = s_iScenePassMirror0 + i;
+  aPassOrder[iNumPasses++] = s_iScenePassMain;
+
+  TaskGraph::NodeId iPrevSubmit = -1;
+
+  m_FrameTaskGraph.Clear();
 
-  pCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), TRUE, &DepthStencilView());
+  for (int iScenePass : aPassOrder) {
+    // Recording has no CPU side dependency, all the passes record concurrently. Only the
+    // submission waits for the pass's chunks and for the previous submission, which is
+    // what orders the mirrors after the shadow maps they read on the GPU.
+    TaskGraph::NodeId iSubmit =
+        m_FrameTaskGraph.AddNode("SubmitPass", [this, iScenePass]() { SubmitChunkPass(iScenePass); });
 
-  RenderScene(pCommandList, &staticParamsDirect, &dynamicParamsDirect);
+    for (UINT i = 0; i < m_uNumberOfChunkThreads; ++i) {
+      TaskGraph::NodeId iRecord =
+          m_FrameTaskGraph.AddNode("RecordPass", [this, iScenePass, i]() { RecordChunkPass(iScenePass, (int)i); });
+      m_FrameTaskGraph.AddDependency(iSubmit, iRecord);
+    }
+
+    if (iPrevSubmit >= 0)
+      m_FrameTaskGraph.AddDependency(iSubmit, iPrevSubmit);
+    iPrevSubmit = iSubmit;
+  }
 }
 
-void MultithreadedRenderingSample::OnPerChunkRenderDeferred(int chunkIndex, FrameResources* const* ppFrameResources) {
+void MultithreadedRenderingSample::RecordChunkPass(int iScenePass, int iChunk) {
+  CPU_PROFILE_SCOPE("RecordChunkPass");
 
   HRESULT hr;
-  FrameResources* volatile pFrameResources;
-  ID3D12GraphicsCommandList *pCommandList;
-  ID3D12CommandAllocator *pCommandAllocator;
-  UINT i;
-  ID3D12CommandList *cmdLists[MAXIMUM_WAIT_OBJECTS + 1];
-  HANDLE hPassBeginEvent;
-  HANDLE hPassEndEvent;
-  HANDLE aPassBeginEvents[MAXIMUM_WAIT_OBJECTS];
-  HANDLE aPassEndEvents[MAXIMUM_WAIT_OBJECTS];
+  FrameResources *pFrameResources = m_pTaskGraphFrameResources;
+  ID3D12GraphicsCommandList *pCommandList = pFrameResources->ChunkCommandLists[iScenePass][iChunk].Get();
+  ID3D12CommandAllocator *pCommandAllocator =
+      pFrameResources->WorkerCommandAllocators[m_JobSystem.GetCurrentWorkerIndex()].Get();
+  CHUNK_RENDERING_THREAD_LOCAL_VARS *pVars = &m_aChunkTaskLocalVars[iScenePass][iChunk];
+  D3D12CommandRecorder d3d12Recorder(pCommandList);
+  NullCommandRecorder *pNullRecorder = &m_aChunkNullRecorders[iScenePass][iChunk];
+  BOOL bNullRecording = IsNullCommandRecording();
+
+  // Any worker may run the task, publish the chunk through the TLS slot for RenderMesh.
+  // Chunk 0 is the one the main thread used to record, index -1.
+  LPVOID pPrevVars = TlsGetValue(m_dwChunkThreadsLocalSlot);
+  pVars->ChunkIndex = iChunk - 1;
+  pVars->NextDrawcallIndex = 0;
+  pVars->pRecorder = bNullRecording ? static_cast<ICommandRecorder *>(pNullRecorder) : &d3d12Recorder;
+  pVars->FirstDrawcall = m_aChunkDrawRanges[iScenePass][iChunk];
+  pVars->EndDrawcall = m_aChunkDrawRanges[iScenePass][iChunk + 1];
+  pVars->DrawRecordingUs = 0.0f;
+  pVars->DrawsRecorded = FALSE;
+  TlsSetValue(m_dwChunkThreadsLocalSlot, pVars);
+
+  // The allocator was reset with the frame, lists recorded earlier by this thread are closed
+  if (bNullRecording)
+    pNullRecorder->Reset();
+  else
+    V(pCommandList->Reset(pCommandAllocator, nullptr));
 
-  if (chunkIndex < 0) {
+  if (iScenePass == s_iScenePassMain) {
+    RenderSceneDirect(pFrameResources);
 
-    pFrameResources = *ppFrameResources;
+    if (iChunk == (int)m_uNumberOfChunkThreads - 1 && !bNullRecording) {
+      ImGuiInteractor::OnRender(m_pd3dDevice, pCommandList);
+      EndRenderFrame(pCommandList);
+    }
+  } else if (iScenePass >= s_iScenePassMirror0) {
+    RenderMirror(iScenePass - s_iScenePassMirror0, pFrameResources);
+  } else {
+    RenderShadow(iScenePass - s_iScenePassShadow0, pFrameResources);
+  }
+  m_aChunkRecordingUs[iScenePass][iChunk] = pVars->DrawRecordingUs;
+
+  if (!bNullRecording)
+    V(pCommandList->Close());
+
+  TlsSetValue(m_dwChunkThreadsLocalSlot, pPrevVars);
+}
+
+void MultithreadedRenderingSample::SubmitChunkPass(int iScenePass) {
+  CPU_PROFILE_SCOPE("SubmitChunkPass");
+  auto &cmdLists = m_aChunkSubmitLists[iScenePass];
 
-    cmdLists[0] = m_pd3dCommandList;
-    for (i = 1; i < m_uNumberOfChunkThreads; ++i)
-      cmdLists[i] = pFrameResources->ChunkCommandLists[i - 1].Get();
+  if (IsNullCommandRecording())
+    return;
+
+  for (UINT i = 0; i < m_uNumberOfChunkThreads; ++i)
+    cmdLists[i] = m_pTaskGraphFrameResources->ChunkCommandLists[iScenePass][i].Get();
 
-    pCommandList = m_pd3dCommandList;
-    pCommandAllocator = pFrameResources->CommandAllocator.Get();
+  m_pd3dCommandQueue->ExecuteCommandLists(m_uNumberOfChunkThreads, cmdLists.data());
+}
 
-    for(i = 1; i < m_uNumberOfChunkThreads; ++i) {
-      m_aChunkThreadArgs[i-1].pFrameResources = pFrameResources;
-      aPassBeginEvents[i-1] = m_aChunkThreadArgs[i-1].PassBeginEvent;
-      aPassEndEvents[i-1] = m_aChunkThreadArgs[i-1].PassEndEvent;
-      SetEvent(aPassBeginEvents[i-1]);
+void MultithreadedRenderingSample::PartitionChunkDraws() {
+  CPU_PROFILE_SCOPE("PartitionChunkDraws");
+
+  const UINT uNumFeatures = DrawPartitioner::FEATURE_COUNT;
+  UINT uNumChunks = m_uNumberOfChunkThreads;
+  float *aWeightedFeatures = m_aWeightedFeatures.data();
+  float *aRoundRobinFeatures = m_aRoundRobinFeatures.data();
+  float *aWeightedCosts = m_aWeightedCosts.data();
+  float *aRoundRobinCosts = m_aRoundRobinCosts.data();
+  float fWeightedImbalance = 0.0f, fRoundRobinImbalance = 0.0f;
+
+  for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+
+    // The same sequence RenderMeshList hands to RenderMesh for this pass
+    const std::vector<UINT> &meshes =
+        IsEnableFrustumCulling() ? m_aSceneDrawLists[iScenePass].Meshes : m_Model.GetFrameMeshes();
+    BOOL bDepthOnly = iScenePass >= s_iScenePassShadow0 && iScenePass < s_iScenePassMirror0;
+    const auto &meshCosts = bDepthOnly ? m_aMeshDepthCosts : m_aMeshColorCosts;
+
+    m_aDrawCostItems.resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i)
+      m_aDrawCostItems[i] = meshCosts[meshes[i]];
+
+    m_DrawPartitioner.Partition(m_aDrawCostItems.data(), (UINT)m_aDrawCostItems.size(), uNumChunks,
+                                m_aChunkDrawRanges[iScenePass].data(), aWeightedFeatures);
+    m_DrawPartitioner.RoundRobin(m_aDrawCostItems.data(), (UINT)m_aDrawCostItems.size(), uNumChunks,
+                                 aRoundRobinFeatures);
+
+    // The weights adapt to the distribution that is actually recorded
+    memcpy(m_aChunkCostFeatures[iScenePass].data(), IsCostWeightedPartition() ? aWeightedFeatures : aRoundRobinFeatures,
+           uNumChunks * uNumFeatures * sizeof(float));
+
+    // Both distributions under the current cost model, for the report
+    for (UINT k = 0; k < uNumChunks; ++k) {
+      aWeightedCosts[k] = m_DrawPartitioner.Estimate(&aWeightedFeatures[k * uNumFeatures]);
+      aRoundRobinCosts[k] = m_DrawPartitioner.Estimate(&aRoundRobinFeatures[k * uNumFeatures]);
     }
+    fWeightedImbalance += DrawPartitioner::Imbalance(aWeightedCosts, uNumChunks);
+    fRoundRobinImbalance += DrawPartitioner::Imbalance(aRoundRobinCosts, uNumChunks);
+  }
+
+  m_fWeightedChunkImbalance += (fWeightedImbalance / s_iNumScenePasses - m_fWeightedChunkImbalance) * 0.05f;
+  m_fRoundRobinChunkImbalance += (fRoundRobinImbalance / s_iNumScenePasses - m_fRoundRobinChunkImbalance) * 0.05f;
+}
 
-    if(m_lShowdownChunkThreads)
-      return;
+void MultithreadedRenderingSample::UpdateChunkBalance() {
 
-  } else {
-    hPassBeginEvent = chunkIndex < 0 ? nullptr : m_aChunkThreadArgs[chunkIndex].PassBeginEvent;
-    hPassEndEvent = chunkIndex < 0 ? nullptr : m_aChunkThreadArgs[chunkIndex].PassEndEvent;
+  float fMeasuredImbalance = 0.0f;
+  int iNumRecordedPasses = 0;
 
-    WaitForSingleObject(hPassBeginEvent, INFINITE);
-    if (m_lShowdownChunkThreads)
-      return;
+  for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+    // A back-facing mirror records no draws, its zero times say nothing about the features
+    BOOL bRecorded = FALSE;
+    for (UINT i = 0; i < m_uNumberOfChunkThreads && !bRecorded; ++i)
+      bRecorded = m_aChunkTaskLocalVars[iScenePass][i].DrawsRecorded;
+    if (!bRecorded)
+      continue;
 
-    // This line can not be optimized.
-    pFrameResources = *ppFrameResources;
+    ++iNumRecordedPasses;
+    fMeasuredImbalance +=
+        DrawPartitioner::Imbalance(m_aChunkRecordingUs[iScenePass].data(), m_uNumberOfChunkThreads);
 
-    pCommandList = pFrameResources->ChunkCommandLists[chunkIndex].Get();
-    pCommandAllocator = pFrameResources->ChunkCommandAllocators[chunkIndex].Get();
+    // Sorted and indirect passes are not split by the features the partition summed
+    if (m_bAdaptDrawCostWeights && !IsSortDraws() && !IsIndirectDraws())
+      m_DrawPartitioner.Adapt(m_aChunkCostFeatures[iScenePass].data(), m_aChunkRecordingUs[iScenePass].data(),
+                              m_uNumberOfChunkThreads);
   }
 
-  // Reset command allocators.
-  V(pCommandAllocator->Reset());
+  if (iNumRecordedPasses > 0)
+    m_fMeasuredChunkImbalance += (fMeasuredImbalance / iNumRecordedPasses - m_fMeasuredChunkImbalance) * 0.05f;
+  memcpy(m_afDrawCostWeights, m_DrawPartitioner.GetWeights(), sizeof(m_afDrawCostWeights));
 
-  for (int iShadow = 0; iShadow < s_iNumShadows; ++iShadow) {
+  if (IsNullCommandRecording()) {
+    // Draws over the summed draw recording time of all the chunks is the rate of one thread
+    UINT uNumDraws = 0;
+    float fRecordingUs = 0.0f;
 
-    if(chunkIndex < 0) {
-      for(i = 1; i < m_uNumberOfChunkThreads; ++i) {
-        SetEvent(aPassBeginEvents[i-1]);
+    for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+      for (UINT i = 0; i < m_uNumberOfChunkThreads; ++i) {
+        uNumDraws += m_aChunkNullRecorders[iScenePass][i].GetDrawCount();
+        fRecordingUs += m_aChunkRecordingUs[iScenePass][i];
       }
-    } else {
-      WaitForSingleObject(hPassBeginEvent, INFINITE);
     }
 
-    V(pCommandList->Reset(pCommandAllocator, nullptr));
+    m_uNullDrawCount = uNumDraws;
+    if (fRecordingUs > 0.0f)
+      m_fNullDrawsPerThreadSec += (uNumDraws * 1e6f / fRecordingUs - m_fNullDrawsPerThreadSec) * 0.05f;
+  }
+}
 
-    RenderShadow(iShadow, pFrameResources);
+void MultithreadedRenderingSample::SetChunkThreadCount(UINT uNumChunks) {
 
-    pCommandList->Close();
+  uNumChunks = std::max(1u, std::min(uNumChunks, (UINT)m_iMaxChunkThreadCount));
 
-    // Wait for shadow pass complete
-    if(chunkIndex < 0) {
-      WaitForMultipleObjects(m_uNumberOfChunkThreads - 1, aPassEndEvents, TRUE, INFINITE);
-      m_pd3dCommandQueue->ExecuteCommandLists(m_uNumberOfChunkThreads, cmdLists);
-    } else {
-      SetEvent(hPassEndEvent);
+  // Every chunk gets a thread, the main thread included. Workers beyond that park, so the
+  // count really is the recording parallelism and not only the split of the passes.
+  m_uNumberOfChunkThreads = uNumChunks;
+  m_iChunkThreadCount = (int)uNumChunks;
+  m_JobSystem.SetActiveWorkerCount(uNumChunks - 1);
+
+  BuildFrameTaskGraph();
+}
+
+void MultithreadedRenderingSample::SetWorkerPinning(CPU_PINNING_POLICY ePolicy) {
+
+  std::vector<UINT> aOrder;
+  std::vector<uint32_t> aDomains(m_uMaxChunkThreads, 0);
+  UINT uNumSlots = m_CpuTopology.BuildPinningOrder(ePolicy, &aOrder);
+
+  // Worker 0 is the render thread itself. The active workers are the first ones, so they
+  // take the first slots of the order.
+  for (UINT w = 0; w < m_uMaxChunkThreads; ++w) {
+    HANDLE hThread = w == 0 ? GetCurrentThread() : (HANDLE)m_JobSystem.GetWorkerNativeHandle(w);
+    GROUP_AFFINITY affinity = m_aWorkerDefaultAffinities[w];
+
+    if (uNumSlots > 0) {
+      const CPU_LOGICAL_PROCESSOR &processor = m_CpuTopology.GetLogicalProcessor(aOrder[w % uNumSlots]);
+      CpuTopology::GetGroupAffinity(processor, &affinity);
+      aDomains[w] = processor.CacheDomain;
     }
+    SetThreadGroupAffinity(hThread, &affinity, nullptr);
   }
 
-  for (int iMirror = 0; iMirror < s_iNumMirrors; ++iMirror) {
-    if (chunkIndex < 0) {
-      for (i = 1; i < m_uNumberOfChunkThreads; ++i) {
-        SetEvent(aPassBeginEvents[i - 1]);
-      }
-    } else {
-      WaitForSingleObject(hPassBeginEvent, INFINITE);
-    }
+  m_JobSystem.SetWorkerDomains(aDomains.data());
 
-    RenderMirror(iMirror, pFrameResources);
+  m_eWorkerPinning = ePolicy;
+  m_iWorkerPinning = ePolicy;
+  m_iMaxChunkThreadCount = (int)(ePolicy == CPU_PINNING_PHYSICAL_CORES ? uNumSlots : m_uMaxChunkThreads);
 
-    // Wait for the mirror pass complete
-    if (chunkIndex < 0) {
-      WaitForMultipleObjects(m_uNumberOfChunkThreads - 1, aPassEndEvents, TRUE, INFINITE);
-      m_pd3dCommandQueue->ExecuteCommandLists(m_uNumberOfChunkThreads, cmdLists);
-    } else {
-      SetEvent(hPassEndEvent);
-    }
+  if (m_uNumberOfChunkThreads > (UINT)m_iMaxChunkThreadCount)
+    SetChunkThreadCount(m_iMaxChunkThreadCount);
+}
+
+void MultithreadedRenderingSample::StartThreadSweep() {
+
+  UINT uMaxThreads = (UINT)m_iMaxChunkThreadCount;
+
+  m_aRecordingSweep.clear();
+  for (UINT n = 1; n < uMaxThreads; n *= 2)
+    m_aRecordingSweep.push_back({ n, m_eWorkerPinning, 0.0f, 0.0f });
+  m_aRecordingSweep.push_back({ uMaxThreads, m_eWorkerPinning, 0.0f, 0.0f });
+
+  StartRecordingSweep();
+}
+
+void MultithreadedRenderingSample::StartPinningSweep() {
+
+  // The same thread count for every policy, one any of them can place
+  UINT uNumThreads = std::min(m_uNumberOfChunkThreads, std::max(m_CpuTopology.GetCoreCount(), 1u));
+
+  m_aRecordingSweep.clear();
+  for (int i = 0; i < _countof(s_aPinningPolicyNames); ++i)
+    m_aRecordingSweep.push_back({ uNumThreads, (CPU_PINNING_POLICY)i, 0.0f, 0.0f });
+
+  StartRecordingSweep();
+}
+
+void MultithreadedRenderingSample::StartRecordingSweep() {
+
+  m_iSweepRestoreCount = m_iChunkThreadCount;
+  m_eSweepRestorePinning = m_eWorkerPinning;
+  m_iRecordingSweepStep = 0;
+  m_iRecordingSweepFrame = 0;
+  m_fRecordingSweepSum = m_fRecordingSweepSumSq = 0.0;
+  m_bHasRecordingSweep = FALSE;
+
+  m_RenderSchedulingOption = RENDER_SCHEDULING_OPTION_MT_CHUNK;
+  SetWorkerPinning(m_aRecordingSweep[0].Pinning);
+  SetChunkThreadCount(m_aRecordingSweep[0].NumThreads);
+}
+
+void MultithreadedRenderingSample::StopRecordingSweep() {
+  m_iRecordingSweepStep = -1;
+  SetWorkerPinning(m_eSweepRestorePinning);
+  SetChunkThreadCount(m_iSweepRestoreCount);
+}
+
+void MultithreadedRenderingSample::StepRecordingSweep(double fRecordingTime) {
+
+  // Another scheduling mode was picked, the numbers would not mean anything
+  if (!IsMultithreadedPerChunk()) {
+    StopRecordingSweep();
+    return;
   }
 
-  if (chunkIndex < 0) {
-    for (i = 1; i < m_uNumberOfChunkThreads; ++i) {
-      SetEvent(aPassBeginEvents[i - 1]);
-    }
+  // Skip the frames right after a change, the cost weights and the caches settle first
+  if (++m_iRecordingSweepFrame > s_iRecordingSweepWarmupFrames) {
+    double fMs = fRecordingTime * 1000.0;
+    m_fRecordingSweepSum += fMs;
+    m_fRecordingSweepSumSq += fMs * fMs;
+  }
+
+  if (m_iRecordingSweepFrame < s_iRecordingSweepWarmupFrames + s_iRecordingSweepFrames)
+    return;
+
+  // Frame to frame spread matters as much as the mean when comparing placements
+  RECORDING_SWEEP_STEP &step = m_aRecordingSweep[m_iRecordingSweepStep];
+  double fMean = m_fRecordingSweepSum / s_iRecordingSweepFrames;
+  double fVariance = m_fRecordingSweepSumSq / s_iRecordingSweepFrames - fMean * fMean;
+  step.MeanMs = static_cast<float>(fMean);
+  step.StdDevMs = static_cast<float>(sqrt(std::max(fVariance, 0.0)));
+
+  DX_TRACE(L"Recording sweep, %u threads, %S pinning: %.3f ms, sd %.3f ms\n", step.NumThreads,
+           s_aPinningPolicyNames[step.Pinning], step.MeanMs, step.StdDevMs);
+
+  m_iRecordingSweepFrame = 0;
+  m_fRecordingSweepSum = m_fRecordingSweepSumSq = 0.0;
+
+  if (++m_iRecordingSweepStep < (int)m_aRecordingSweep.size()) {
+    SetWorkerPinning(m_aRecordingSweep[m_iRecordingSweepStep].Pinning);
+    SetChunkThreadCount(m_aRecordingSweep[m_iRecordingSweepStep].NumThreads);
   } else {
-    WaitForSingleObject(hPassBeginEvent, INFINITE);
+    m_bHasRecordingSweep = TRUE;
+    StopRecordingSweep();
+  }
+}
+
+void MultithreadedRenderingSample::CalcSceneFrustums(SDKMESH_FRUSTUM *pFrustums) {
+
+  XMMATRIX matViewProj;
+
+#ifdef RENDER_SCENE_LIGHT_POV
+  if (m_bRenderSceneLightPOV)
+    matViewProj = CalcLightViewProj(0, TRUE);
+  else
+#endif
+    matViewProj = m_Camera.GetViewMatrix() * m_Camera.GetProjMatrix();
+
+  pFrustums[s_iScenePassMain].CreateFromMatrix(matViewProj);
+
+  for (int i = 0; i < s_iNumShadows; ++i)
+    pFrustums[s_iScenePassShadow0 + i].CreateFromMatrix(CalcLightViewProj(i, FALSE));
+
+  // Mirrors see the scene through the reflected camera
+  for (int i = 0; i < s_iNumMirrors; ++i)
+    pFrustums[s_iScenePassMirror0 + i].CreateFromMatrix(XMMatrixReflect(XMLoadFloat4(&m_aMirrorPlanes[i])) * matViewProj);
+}
+
+void MultithreadedRenderingSample::BuildSceneDrawLists() {
+  CPU_PROFILE_SCOPE("BuildSceneDrawLists");
+
+  SDKMESH_FRUSTUM aFrustums[s_iNumScenePasses];
+
+  CalcSceneFrustums(aFrustums);
+
+  // One sweep tests every mesh against all the passes, each pass then gets its set bits
+  m_Model.BuildViewMasks(aFrustums, s_iNumScenePasses, XMMatrixIdentity(), &m_SceneViewMasks);
+  m_Model.BuildDrawLists(&m_SceneViewMasks, m_aSceneDrawLists);
+
+  m_uTotalMeshes = m_aSceneDrawLists[s_iScenePassMain].NumTotal;
+  for (int i = 0; i < s_iNumScenePasses; ++i)
+    m_aVisibleMeshes[i] = m_aSceneDrawLists[i].NumVisible();
+}
+
+void MultithreadedRenderingSample::BuildSortedDrawLists() {
+  CPU_PROFILE_SCOPE("BuildSortedDrawLists");
+
+  SDKMESH_FRUSTUM aFrustums[s_iNumScenePasses];
+  UINT uNumDraws = 0;
+
+  CalcSceneFrustums(aFrustums);
+  m_DrawSortTimer.Reset();
+
+  for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+    const std::vector<UINT> &meshes =
+        IsEnableFrustumCulling() ? m_aSceneDrawLists[iScenePass].Meshes : m_Model.GetFrameMeshes();
+    BOOL bDepthOnly = iScenePass >= s_iScenePassShadow0 && iScenePass < s_iScenePassMirror0;
+    SDKMESH_SORT_PARAMS sortParams;
+
+    // Every pass records into its own lists with one pipeline, the key still carries it
+    sortParams.Pass = (UINT)iScenePass;
+    sortParams.PipelineState = bDepthOnly ? SCENE_MT_RENDER_CASE_SHADOW
+                               : iScenePass >= s_iScenePassMirror0 ? SCENE_MT_RENDER_CASE_MIRROR_AREA
+                                                                   : SCENE_MT_RENDER_CASE_DEFAULT;
+    sortParams.DepthOnly = !!bDepthOnly;
+    sortParams.MaxDepth = s_fFarPlane;
+    // Front to back: the depth grows away from the near plane, whose normal points out of the view
+    XMStoreFloat4(&sortParams.DepthPlane, XMVectorNegate(XMLoadFloat4(&aFrustums[iScenePass].Planes[4])));
+
+    m_Model.BuildSortedDrawList(meshes.data(), (UINT)meshes.size(), sortParams, &m_aSortedDrawLists[iScenePass],
+                                &m_JobSystem);
+    uNumDraws += m_aSortedDrawLists[iScenePass].NumDraws();
   }
 
-  pCommandList->Reset(pCommandAllocator, nullptr);
+  m_uSortedDrawCount = uNumDraws;
+  UpdateDrawSortTime(m_DrawSortTimer.GetTime());
+}
 
-  RenderSceneDirect(pFrameResources);
+// The indirect arguments of every pass, copied to the pass's range of the frame's buffer.
+HRESULT MultithreadedRenderingSample::BuildIndirectDrawLists(FrameResources *pFrameResources) {
+  CPU_PROFILE_SCOPE("BuildIndirectDrawLists");
 
-  if(chunkIndex == m_uNumberOfChunkThreads - 2) {
-    ImGuiInteractor::OnRender(m_pd3dDevice, pCommandList);
-    EndRenderFrame(pCommandList);
+  HRESULT hr;
+  UINT uMaxCommands = 0;
+  UINT uNumCommands = 0, uNumDraws = 0, uNumDirectMeshes = 0;
+
+  for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+    const std::vector<UINT> &meshes =
+        IsEnableFrustumCulling() ? m_aSceneDrawLists[iScenePass].Meshes : m_Model.GetFrameMeshes();
+    BOOL bDepthOnly = iScenePass >= s_iScenePassShadow0 && iScenePass < s_iScenePassMirror0;
+    IndirectDrawBuilder *pIndirectDraws = &m_aIndirectDraws[iScenePass];
+
+    pIndirectDraws->Reset();
+    m_aIndirectDirectMeshes[iScenePass].clear();
+    m_Model.BuildIndirectDraws(meshes.data(), (UINT)meshes.size(), !!bDepthOnly, pIndirectDraws,
+                               &m_aIndirectDirectMeshes[iScenePass]);
+
+    uMaxCommands = (std::max)(uMaxCommands, pIndirectDraws->GetDrawCount());
+    uNumCommands += pIndirectDraws->GetDrawCount();
+    uNumDraws += pIndirectDraws->GetAddedDrawCount();
+    uNumDirectMeshes += (UINT)m_aIndirectDirectMeshes[iScenePass].size();
   }
 
-  pCommandList->Close();
+  if (uMaxCommands > pFrameResources->IndirectArgsPerPass) {
+    UINT uArgsPerPass = (std::max)(uMaxCommands, pFrameResources->IndirectArgsPerPass * 2);
 
-  // Wait for mirror pass complete
-  if(chunkIndex < 0) {
-    WaitForMultipleObjects(m_uNumberOfChunkThreads - 1, aPassEndEvents, TRUE, INFINITE);
-    m_pd3dCommandQueue->ExecuteCommandLists(m_uNumberOfChunkThreads, cmdLists);
-  } else {
-    SetEvent(hPassEndEvent);
+    pFrameResources->IndirectArgsPerPass = 0;
+    V_RETURN(pFrameResources->IndirectArgs.CreateBuffer(m_pd3dDevice, uArgsPerPass * s_iNumScenePasses,
+                                                        sizeof(INDIRECT_DRAW_ARGS), FALSE));
+    DX_SetDebugName(pFrameResources->IndirectArgs.GetResource(), "IndirectArgs");
+    pFrameResources->IndirectArgsPerPass = uArgsPerPass;
+  }
+
+  for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+    const IndirectDrawBuilder *pIndirectDraws = &m_aIndirectDraws[iScenePass];
+    pFrameResources->IndirectArgs.CopyElements(pIndirectDraws->GetDraws(), pIndirectDraws->GetDrawCount(),
+                                               iScenePass * pFrameResources->IndirectArgsPerPass);
   }
+
+  m_uIndirectCommandCount = uNumCommands;
+  m_uIndirectDrawCount = uNumDraws;
+  m_uIndirectDirectMeshCount = uNumDirectMeshes;
+  return S_OK;
+}
+
+// Records every pass into a null recorder the way it is drawn unsorted, then sorted, and
+// counts the state changes of the model draws.
+void MultithreadedRenderingSample::MeasureDrawStateChanges() {
+
+  NullCommandRecorder recorder;
+  CD3DX12_GPU_DESCRIPTOR_HANDLE hDescriptorStart(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                 s_iNumShadows, m_uCbvSrvUavDescriptorSize);
+  UINT aStateChanges[2] = {};
+
+  if (!m_bUseDrawPackets)
+    return;
+
+  if (IsEnableFrustumCulling())
+    BuildSceneDrawLists();
+  BuildSortedDrawLists();
+
+  for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+    const std::vector<UINT> &meshes =
+        IsEnableFrustumCulling() ? m_aSceneDrawLists[iScenePass].Meshes : m_Model.GetFrameMeshes();
+    BOOL bDepthOnly = iScenePass >= s_iScenePassShadow0 && iScenePass < s_iScenePassMirror0;
+    auto pSortedList = &m_aSortedDrawLists[iScenePass];
+
+    // Straight to the meshes, the chunk callback would look for a chunk in the TLS slot
+    recorder.Reset();
+    for (UINT iMesh : meshes) {
+      if (bDepthOnly)
+        m_Model.RenderMeshDepth(iMesh, &recorder);
+      else
+        m_Model.RenderMesh(iMesh, false, &recorder, hDescriptorStart, 3, 4, INVALID_SAMPLER_SLOT);
+    }
+    aStateChanges[0] += recorder.GetStateChangeCount();
+
+    recorder.Reset();
+    if (bDepthOnly)
+      m_Model.RenderSortedDrawListDepth(pSortedList, 0, pSortedList->NumDraws(), &recorder);
+    else
+      m_Model.RenderSortedDrawList(pSortedList, 0, pSortedList->NumDraws(), &recorder, hDescriptorStart, 3, 4);
+    aStateChanges[1] += recorder.GetStateChangeCount();
+  }
+
+  memcpy(m_aDrawStateChanges, aStateChanges, sizeof(aStateChanges));
+  DX_TRACE(L"Draw state changes of all passes: %u unsorted, %u sorted\n", aStateChanges[0], aStateChanges[1]);
+
+  m_bHasDrawStateMeasure = TRUE;
+}
+
+// Records the model draws of every color pass into a null recorder with descriptor tables,
+// then with bindless materials, and compares the recording time and the root arguments the
+// draws set.
+void MultithreadedRenderingSample::MeasureMaterialBinding() {
+
+  const int iNumRepeats = 16;
+  NullCommandRecorder recorder;
+  DXUT::CDXUTTimer timer;
+  CD3DX12_GPU_DESCRIPTOR_HANDLE hDescriptorStart(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                 s_iNumShadows, m_uCbvSrvUavDescriptorSize);
+  const UINT aMaterialIndexSlots[2] = {INVALID_SAMPLER_SLOT, s_uMaterialIndexRootSlot};
+
+  if (IsEnableFrustumCulling())
+    BuildSceneDrawLists();
+
+  for (int iMode = 0; iMode < 2; ++iMode) {
+    double fTime = 0.0;
+    UINT uRootArgs = 0;
+
+    m_Model.EnableBindlessMaterials(aMaterialIndexSlots[iMode]);
+
+    // Best of a few runs, the first one warms up the recorder memory
+    for (int iRepeat = 0; iRepeat < iNumRepeats; ++iRepeat) {
+      recorder.Reset();
+      timer.Reset();
+      for (int iScenePass = 0; iScenePass < s_iNumScenePasses; ++iScenePass) {
+        if (iScenePass >= s_iScenePassShadow0 && iScenePass < s_iScenePassMirror0)
+          continue;
+
+        const std::vector<UINT> &meshes =
+            IsEnableFrustumCulling() ? m_aSceneDrawLists[iScenePass].Meshes : m_Model.GetFrameMeshes();
+        for (UINT iMesh : meshes)
+          m_Model.RenderMesh(iMesh, false, &recorder, hDescriptorStart, 3, 4, INVALID_SAMPLER_SLOT);
+      }
+      double fRunTime = timer.GetTime();
+
+      fTime = iRepeat == 0 ? fRunTime : (std::min)(fTime, fRunTime);
+      uRootArgs = recorder.GetCommandCount(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE) +
+                  recorder.GetCommandCount(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT);
+    }
+
+    m_aMaterialBindingUs[iMode] = (float)(fTime * 1e6);
+    m_aMaterialBindingArgs[iMode] = uRootArgs;
+  }
+
+  m_Model.EnableBindlessMaterials(IsBindlessMaterials() ? s_uMaterialIndexRootSlot : INVALID_SAMPLER_SLOT);
+  DX_TRACE(L"Material binding of all color passes: tables %.1f us, %u root arguments; bindless %.1f us, %u root "
+           L"arguments\n",
+           m_aMaterialBindingUs[0], m_aMaterialBindingArgs[0], m_aMaterialBindingUs[1], m_aMaterialBindingArgs[1]);
+
+  m_bHasMaterialBindingMeasure = TRUE;
 }
 
 void MultithreadedRenderingSample::OnRenderFrame(float fTime, float fElapsed) {
 
   HRESULT hr;
-  auto pFrameResources = &m_aFrameResources[m_iFrameIndex];
+  auto pFrameResources = &m_aFrameResources[m_FrameContexts.GetFrameIndex()];
+  double fRecordingTime = 0.0;
+
+  if (IsEnableFrustumCulling())
+    BuildSceneDrawLists();
+  if (IsSortDraws())
+    BuildSortedDrawLists();
+  // Without an argument buffer the passes are recorded draw by draw
+  if (IsIndirectDraws() && FAILED(BuildIndirectDrawLists(pFrameResources))) {
+    DX_TRACE(L"Failed to build the indirect arguments, recording draws directly\n");
+    m_bIndirectDraws = FALSE;
+  }
 
   if (IsMultithreadedPerScene()) {
 
+    m_lPendingSceneWorks = s_iNumShadows + s_iNumMirrors;
+    m_RecordingTimer.Reset();
+
     for (int i = 0; i < s_iNumShadows; ++i) {
       m_aShadowWorkQueueParams[i].pFrameResources = pFrameResources;
       SubmitThreadpoolWork(m_aShadowWorkQueuePool[i]);
@@ -1830,10 +2773,10 @@ void MultithreadedRenderingSample::OnRenderFrame(float fTime, float fElapsed) {
       SubmitThreadpoolWork(m_aMirrorWorkQueuePool[i]);
     }
 
-    V(pFrameResources->CommandAllocator->Reset());
-    V(m_pd3dCommandList->Reset(pFrameResources->CommandAllocator.Get(), nullptr));
+    V(m_pd3dCommandList->Reset(m_FrameContexts.GetCommandAllocator(), nullptr));
 
     RenderSceneDirect(pFrameResources);
+    fRecordingTime = m_RecordingTimer.GetTime();
 
     ImGuiInteractor::OnRender(m_pd3dDevice, m_pd3dCommandList);
 
@@ -1841,33 +2784,58 @@ void MultithreadedRenderingSample::OnRenderFrame(float fTime, float fElapsed) {
 
     m_pd3dCommandList->Close();
 
-    static_assert(s_iNumShadows + s_iNumMirrors <= MAXIMUM_WAIT_OBJECTS, "Scene number per frame must be less than 64");
-
-    HANDLE finEvents[s_iNumShadows + s_iNumMirrors];
-    ID3D12CommandList *cmdLists[s_iNumMirrors + s_iNumMirrors + 1];
+    ID3D12CommandList *cmdLists[s_iNumShadows + s_iNumMirrors + 1];
     int i, j = 0;
 
-    for(i = 0; i < s_iNumShadows; ++i, ++j) {
-      finEvents[j] = m_aShadowWorkQueueParams[i].CompletionEvent;
+    for(i = 0; i < s_iNumShadows; ++i, ++j)
       cmdLists[j] = pFrameResources->ShadowCommandLists[i].Get();
-    }
-    for(i = 0; i < s_iNumMirrors; ++i, ++j) {
-      finEvents[j] = m_aMirrorWorkQueuePoolParams[i].CompletionEvent;
+    for(i = 0; i < s_iNumMirrors; ++i, ++j)
       cmdLists[j] = pFrameResources->MirrorCommandLists[i].Get();
-    }
     cmdLists[j] = m_pd3dCommandList;
 
-    WaitForMultipleObjects(j, finEvents, TRUE, INFINITE);
+    WaitForSingleObject(m_hSceneWorksDoneEvent, INFINITE);
+    // Recording ends with whichever finished last, the scene works or the main thread
+    fRecordingTime = std::max(fRecordingTime, m_fSceneWorksDoneTime);
     m_pd3dCommandQueue->ExecuteCommandLists(j+1, cmdLists);
 
   } else if(IsMultithreadedPerChunk()) {
 
-    OnPerChunkRenderDeferred(-1, &pFrameResources);
+    PartitionChunkDraws();
+
+    for (auto &pAllocator : pFrameResources->WorkerCommandAllocators)
+      V(pAllocator->Reset());
+
+    // The graph records the UI with the last chunk and submits each pass once its chunks are
+    // recorded, so both are timed along
+    m_pTaskGraphFrameResources = pFrameResources;
+    m_RecordingTimer.Reset();
+    m_FrameTaskGraph.Execute(&m_JobSystem);
+    fRecordingTime = m_RecordingTimer.GetTime();
+
+    if (IsNullCommandRecording()) {
+      // The chunks recorded nothing to submit, still present a cleared frame with the UI
+      V(m_pd3dCommandList->Reset(m_FrameContexts.GetCommandAllocator(), nullptr));
+
+      PrepareNextFrame(m_pd3dCommandList);
+      m_pd3dCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::MidnightBlue, 0, nullptr);
+      m_pd3dCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL,
+                                               1.0f, 0, 0, nullptr);
+      m_pd3dCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), TRUE, &DepthStencilView());
+
+      ImGuiInteractor::OnRender(m_pd3dDevice, m_pd3dCommandList);
+
+      EndRenderFrame();
+
+      m_pd3dCommandList->Close();
+      m_pd3dCommandQueue->ExecuteCommandLists(1, CommandListCast(&m_pd3dCommandList));
+    }
+
+    UpdateChunkBalance();
 
   } else if (IsSinglethreadedDeferred()) {
 
-    V(pFrameResources->CommandAllocator->Reset());
-    V(m_pd3dCommandList->Reset(pFrameResources->CommandAllocator.Get(), nullptr));
+    V(m_pd3dCommandList->Reset(m_FrameContexts.GetCommandAllocator(), nullptr));
+    m_RecordingTimer.Reset();
 
     for (int i = 0; i < s_iNumShadows; ++i)
       RenderShadow(i, pFrameResources);
@@ -1876,6 +2844,7 @@ void MultithreadedRenderingSample::OnRenderFrame(float fTime, float fElapsed) {
       RenderMirror(i, pFrameResources);
 
     RenderSceneDirect(pFrameResources);
+    fRecordingTime = m_RecordingTimer.GetTime();
 
     ImGuiInteractor::OnRender(m_pd3dDevice, m_pd3dCommandList);
 
@@ -1885,7 +2854,12 @@ void MultithreadedRenderingSample::OnRenderFrame(float fTime, float fElapsed) {
     m_pd3dCommandQueue->ExecuteCommandLists(1, CommandListCast(&m_pd3dCommandList));
   }
 
-  m_pSyncFence->Signal(m_pd3dCommandQueue, &pFrameResources->FencePoint);
+  UpdateRecordingTime(fRecordingTime);
+
+  if (m_iRecordingSweepStep >= 0)
+    StepRecordingSweep(fRecordingTime);
+
+  V(m_FrameContexts.EndFrame(m_pd3dCommandQueue));
 
   Present();
 }
@@ -1906,25 +2880,10 @@ VOID CALLBACK MultithreadedRenderingSample::_PerSceneRenderDeferredProc(
     default:;
   }
 
-  SetEvent(pParams->CompletionEvent);
-}
-
-unsigned int WINAPI MultithreadedRenderingSample::_PerChunkRenderDeferredProc(LPVOID pv) {
-
-  auto pParams = reinterpret_cast<CHUNK_RENDERING_THREAD_PARAMS *>(pv);
-  auto pInstance = pParams->pInstance;
-  int chunkIndex = pParams->ChunkIndex;
-
-  TlsSetValue(pInstance->m_dwChunkThreadsLocalSlot, (LPVOID)&pInstance->m_aChunkThreadLocalVars[chunkIndex+1]);
-
-  for(;;) {
-    pInstance->OnPerChunkRenderDeferred(pParams->ChunkIndex, &pParams->pFrameResources);
-
-    if(pInstance->m_lShowdownChunkThreads)
-      break;
+  if (InterlockedDecrement(&pParams->pInstance->m_lPendingSceneWorks) == 0) {
+    pParams->pInstance->m_fSceneWorksDoneTime = pParams->pInstance->m_RecordingTimer.GetTime();
+    SetEvent(pParams->pInstance->m_hSceneWorksDoneEvent);
   }
-
-  return 0;
 }
 
 LRESULT MultithreadedRenderingSample::OnMsgProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
@@ -1937,109 +2896,45 @@ LRESULT MultithreadedRenderingSample::OnMsgProc(HWND hwnd, UINT msg, WPARAM wp,
   return ImGuiInteractor::OnMsgProc(hwnd, msg, wp, lp);
 }
 
-//  Helper function to count bits in the processor mask
-static DWORD CountSetBits(ULONG_PTR bitMask)
-{
-    DWORD LSHIFT = sizeof(ULONG_PTR)*8 - 1;
-    DWORD bitSetCount = 0;
-    ULONG_PTR bitTest = ULONG_PTR(1) << LSHIFT;
-    DWORD i;
-
-    for( i = 0; i <= LSHIFT; ++i)
-    {
-        bitSetCount += ((bitMask & bitTest)?1:0);
-        bitTest/=2;
-    }
-
-    return bitSetCount;
-}
-
-static int GetLogicalProcessorCount()
-{
-    DWORD procCoreCount = 0;    // Return 0 on any failure.  That'll show them.
-    auto Glpi = &GetLogicalProcessorInformation;
-
-    bool done = false;
-    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION buffer = nullptr;
-    DWORD returnLength = 0;
-
-    while (!done) 
-    {
-        BOOL rc = Glpi(buffer, &returnLength);
-
-        if (FALSE == rc) 
-        {
-            if (GetLastError() == ERROR_INSUFFICIENT_BUFFER) 
-            {
-                if (buffer) 
-                    free(buffer);
-
-                buffer = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION>( malloc( returnLength ) );
-
-                if ( !buffer ) 
-                {
-                    // Allocation failure
-                    return procCoreCount;
-                }
-            } 
-            else 
-            {
-                // Unanticipated error
-                return procCoreCount;
-            }
-        } 
-        else done = true;
-    }
-
-    assert( buffer );
-    _Analysis_assume_( buffer );
-
-    DWORD byteOffset = 0;
-    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION ptr = buffer;
-    while (byteOffset < returnLength) 
-    {
-        if (ptr->Relationship == RelationProcessorCore) 
-        {
-            if(ptr->ProcessorCore.Flags)
-            {
-                //  Hyperthreading or SMT is enabled.
-                //  Logical processors are on the same core.
-                procCoreCount += 1;
-            }
-            else
-            {
-                //  Logical processors are on different cores.
-                procCoreCount += CountSetBits(ptr->ProcessorMask);
-            }
-        }
-        byteOffset += sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
-        ptr++;
-    }
-
-    free (buffer);
-
-    return procCoreCount;
-}
-
 HRESULT MultithreadedRenderingSample::InitializeRendererThreadpool() {
 
   HRESULT hr = S_OK;
-  int minProcCount = 1, maxProcCount = MAXIMUM_WAIT_OBJECTS;
-
-  maxProcCount = GetLogicalProcessorCount() - 1;
-  maxProcCount = std::min(maxProcCount, MAXIMUM_WAIT_OBJECTS);
+  int minProcCount = 1, maxProcCount;
+  UINT uNumCores;
+
+  // Resources are there for a thread on every logical processor, the SMT siblings are left
+  // out until asked for.
+  if (SUCCEEDED(m_CpuTopology.Initialize())) {
+    maxProcCount = (int)m_CpuTopology.GetLogicalProcessorCount() - 1;
+    uNumCores = m_CpuTopology.GetCoreCount();
+  } else {
+    maxProcCount = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS) - 1;
+    uNumCores = maxProcCount + 1;
+  }
   maxProcCount = std::max(maxProcCount, minProcCount);
 
-  m_uNumberOfChunkThreads = maxProcCount + 1; // Include main thread
+  m_uMaxChunkThreads = maxProcCount + 1; // Include main thread
+  m_uNumberOfChunkThreads = std::max(std::min(uNumCores, m_uMaxChunkThreads), 2u);
+  m_iChunkThreadCount = (int)m_uNumberOfChunkThreads;
+  m_iMaxChunkThreadCount = (int)m_uMaxChunkThreads;
 
   ZeroMemory(m_aShadowWorkQueuePool, sizeof(m_aShadowWorkQueuePool));
   ZeroMemory(m_aShadowWorkQueueParams, sizeof(m_aShadowWorkQueueParams));
   ZeroMemory(m_aMirrorWorkQueuePool, sizeof(m_aMirrorWorkQueuePool));
   ZeroMemory(m_aMirrorWorkQueuePoolParams, sizeof(m_aMirrorWorkQueuePoolParams));
 
-  ZeroMemory(m_aChunkThreads, sizeof(m_aChunkThreads));
-  ZeroMemory(m_aChunkThreadArgs, sizeof(m_aChunkThreadArgs));
-  ZeroMemory(m_aChunkThreadLocalVars, sizeof(m_aChunkThreadLocalVars));
+  for (int p = 0; p < s_iNumScenePasses; ++p) {
+    m_aChunkTaskLocalVars[p].assign(m_uMaxChunkThreads, CHUNK_RENDERING_THREAD_LOCAL_VARS());
+    m_aChunkSubmitLists[p].resize(m_uMaxChunkThreads);
+    m_aChunkNullRecorders[p].resize(m_uMaxChunkThreads);
+    m_aChunkDrawRanges[p].resize(m_uMaxChunkThreads + 1);
+    m_aChunkCostFeatures[p].resize(m_uMaxChunkThreads * DrawPartitioner::FEATURE_COUNT);
+    m_aChunkRecordingUs[p].resize(m_uMaxChunkThreads);
+  }
+  m_aWeightedFeatures.resize(m_uMaxChunkThreads * DrawPartitioner::FEATURE_COUNT);
+  m_aRoundRobinFeatures.resize(m_uMaxChunkThreads * DrawPartitioner::FEATURE_COUNT);
+  m_aWeightedCosts.resize(m_uMaxChunkThreads);
+  m_aRoundRobinCosts.resize(m_uMaxChunkThreads);
 
   m_pThreadpool = CreateThreadpool(nullptr);
   m_pCleanupGroup = CreateThreadpoolCleanupGroup();
@@ -2075,10 +2970,6 @@ HRESULT MultithreadedRenderingSample::InitializeRendererThreadpool() {
     m_aShadowWorkQueueParams[i].pInstance = this;
     m_aShadowWorkQueueParams[i].BatchIndex = i;
     m_aShadowWorkQueueParams[i].RenderCase = SCENE_MT_RENDER_CASE_SHADOW;
-    if ((m_aShadowWorkQueueParams[i].CompletionEvent = CreateEventExW(nullptr, nullptr, 0, EVENT_ALL_ACCESS)) ==
-        nullptr) {
-      return HRESULT_FROM_WIN32(GetLastError());
-    }
   }
 
   for(int i = 0; i < s_iNumMirrors; ++i) {
@@ -2093,10 +2984,10 @@ HRESULT MultithreadedRenderingSample::InitializeRendererThreadpool() {
     m_aMirrorWorkQueuePoolParams[i].pInstance = this;
     m_aMirrorWorkQueuePoolParams[i].BatchIndex = i;
     m_aMirrorWorkQueuePoolParams[i].RenderCase = SCENE_MT_RENDER_CASE_MIRROR_AREA;
-    if ((m_aMirrorWorkQueuePoolParams[i].CompletionEvent = CreateEventExW(nullptr, nullptr, 0, EVENT_ALL_ACCESS)) ==
-        nullptr) {
-      return HRESULT_FROM_WIN32(GetLastError());
-    }
+  }
+
+  if ((m_hSceneWorksDoneEvent = CreateEventExW(nullptr, nullptr, 0, EVENT_ALL_ACCESS)) == nullptr) {
+    return HRESULT_FROM_WIN32(GetLastError());
   }
 
   m_dwChunkThreadsLocalSlot = TlsAlloc();
@@ -2105,32 +2996,24 @@ HRESULT MultithreadedRenderingSample::InitializeRendererThreadpool() {
   }
 
   // Mark main thread
-  m_aChunkThreadLocalVars[0].ChunkIndex = -1;
-  m_aChunkThreadLocalVars[0].NextDrawcallIndex = 0;
-  TlsSetValue(m_dwChunkThreadsLocalSlot, (LPVOID)&m_aChunkThreadLocalVars[0]);
-
-  for(int i = 0; i < maxProcCount; ++i) {
-
-    if((m_aChunkThreadArgs[i].PassBeginEvent = CreateEventExW(nullptr, nullptr, 0, EVENT_ALL_ACCESS)) == nullptr) {
-      return HRESULT_FROM_WIN32(GetLastError());
-    }
-
-    if((m_aChunkThreadArgs[i].PassEndEvent = CreateEventExW(nullptr, nullptr, 0, EVENT_ALL_ACCESS)) == nullptr) {
-      return HRESULT_FROM_WIN32(GetLastError());
-    }
-
-    m_aChunkThreadArgs[i].pInstance = this;
-    m_aChunkThreadArgs[i].ChunkIndex = i;
-    m_aChunkThreadLocalVars[i+1].ChunkIndex = i;
-    m_aChunkThreadLocalVars[i+1].NextDrawcallIndex = 0;
-
-    m_aChunkThreads[i] = (HANDLE)_beginthreadex(nullptr, 0, MultithreadedRenderingSample::_PerChunkRenderDeferredProc,
-      (void *)&m_aChunkThreadArgs[i], 0, nullptr);
-    if(m_aChunkThreads[i] == nullptr) {
-      return HRESULT_FROM_WIN32(GetLastError());
-    }
+  m_MainThreadLocalVars.ChunkIndex = -1;
+  m_MainThreadLocalVars.NextDrawcallIndex = 0;
+  m_MainThreadLocalVars.pRecorder = nullptr;
+  m_MainThreadLocalVars.DrawRecordingUs = 0.0f;
+  m_MainThreadLocalVars.DrawsRecorded = FALSE;
+  TlsSetValue(m_dwChunkThreadsLocalSlot, (LPVOID)&m_MainThreadLocalVars);
+
+  // The main thread joins in while it waits on the frame task graph
+  m_JobSystem.Initialize(maxProcCount);
+
+  m_aWorkerDefaultAffinities.resize(m_uMaxChunkThreads);
+  for (UINT w = 0; w < m_uMaxChunkThreads; ++w) {
+    HANDLE hThread = w == 0 ? GetCurrentThread() : (HANDLE)m_JobSystem.GetWorkerNativeHandle(w);
+    GetThreadGroupAffinity(hThread, &m_aWorkerDefaultAffinities[w]);
   }
 
+  SetChunkThreadCount(m_uNumberOfChunkThreads);
+
   TuneRendererThreadsByWorkset();
 
   return hr;
@@ -2143,14 +3026,4 @@ void MultithreadedRenderingSample::TuneRendererThreadsByWorkset() {
   } else {
     SetThreadpoolCallbackPriority(&m_CallbackEnv, TP_CALLBACK_PRIORITY_LOW);
   }
-
-  if (IsMultithreadedPerChunk()) {
-    for (UINT i = 0; i < m_uNumberOfChunkThreads; ++i) {
-      SetThreadPriority(&m_aChunkThreads[i - 1], THREAD_PRIORITY_NORMAL);
-    }
-  } else {
-    for (UINT i = 0; i < m_uNumberOfChunkThreads; ++i) {
-      SetThreadPriority(&m_aChunkThreads[i - 1], THREAD_PRIORITY_LOWEST);
-    }
-  }
 }
\ No newline at end of file
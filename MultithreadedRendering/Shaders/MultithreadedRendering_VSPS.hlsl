@@ -52,8 +52,24 @@ cbuffer cbPerScene : register( b2 )
 //--------------------------------------------------------------------------------------
 // Textures and Samplers
 //--------------------------------------------------------------------------------------
+#ifdef BINDLESS_MATERIALS
+// Every material's textures in one descriptor range, diffuse, normal and specular in turn,
+// picked by the material index the draw passes as a root constant
+static const uint g_uTexturesPerMaterial = 3;
+
+cbuffer cbPerMaterial : register( b3 )
+{
+    uint g_uMaterialIndex;
+};
+
+Texture2D           g_txMaterials[]            : register( t0, space1 );
+
+#define g_txDiffuse g_txMaterials[g_uMaterialIndex * g_uTexturesPerMaterial]
+#define g_txNormal  g_txMaterials[g_uMaterialIndex * g_uTexturesPerMaterial + 1]
+#else   // #ifdef BINDLESS_MATERIALS
 Texture2D	        g_txDiffuse                : register( t0 );
 Texture2D	        g_txNormal                 : register( t1 );
+#endif  // #ifdef BINDLESS_MATERIALS #else
 Texture2D           g_txShadow[g_iNumShadows]  : register( t2 );
 
 SamplerState        g_samPointClamp : register( s0 );
@@ -111,6 +127,14 @@ VS_OUTPUT VSMain( VS_INPUT Input )
 	return Output;
 }
 
+//--------------------------------------------------------------------------------------
+// Depth-only Vertex Shader, fed by the position-only vertex stream
+//--------------------------------------------------------------------------------------
+float4 VSDepthMain( float4 vPosition : POSITION ) : SV_POSITION
+{
+	return mul( mul( vPosition, g_mWorld ), g_mViewProj );
+}
+
 //--------------------------------------------------------------------------------------
 // Input / Output structures
 //--------------------------------------------------------------------------------------
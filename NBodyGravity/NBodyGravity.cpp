@@ -48,18 +48,10 @@ struct DrawPassConstants {
   XMFLOAT4X4 InvView;
 };
 
+// Per frame constants, one slot for each frame context. The allocators and fence points
+// live in the frame contexts of the renderer.
 class FrameResources {
 public:
-  ~FrameResources() { SAFE_RELEASE(CmdListAlloc); }
-
-  HRESULT CreateCommandAllocator(ID3D12Device *pd3dDevice) {
-    HRESULT hr;
-
-    V_RETURN(pd3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&CmdListAlloc)));
-
-    return hr;
-  }
-
   static HRESULT CreateBuffers(ID3D12Device *pd3dDevice, int NumFrames) {
     HRESULT hr;
 
@@ -68,11 +60,8 @@ public:
     return hr;
   }
 
-  ID3D12CommandAllocator *CmdListAlloc;
   static UploadBuffer ParticleParamCB;
   static UploadBuffer DrawParticleCB;
-
-  UINT64 FencePoint = 0;
 };
 
 UploadBuffer FrameResources::ParticleParamCB;
@@ -102,7 +91,7 @@ private:
 
   void LoadParticles(ParticlePos *pParticles, XMVECTOR Center, XMVECTOR Velocity, float fSpread, UINT NumParticles);
 
-  void UpdatePaticles(FrameResources *pFrameResources);
+  void UpdatePaticles();
 
   enum { MAX_PARTICLES = 10000 };
 
@@ -129,7 +118,6 @@ private:
   D3D12_GPU_DESCRIPTOR_HANDLE m_hParticleUavBuffer2;
   D3D12_GPU_DESCRIPTOR_HANDLE m_hDiffuseMapSrv;
 
-  FrameResources m_FrameResources[3];
   int m_iCurrentFrameIndex = 0;
 
   UploadBuffer m_CSCB;
@@ -150,6 +138,7 @@ HRESULT CreateNBodyGravityRendererContextAndInteractor(D3D12RendererContext **pp
 
 NBodyGravityApp::NBodyGravityApp() {
   m_aDeviceConfig.SwapChainBackBufferFormatSRGB = TRUE;
+  m_aDeviceConfig.FrameCount = 3;
 }
 
 NBodyGravityApp::~NBodyGravityApp() {
@@ -431,13 +420,8 @@ HRESULT NBodyGravityApp::CreatePSOs() {
 
 HRESULT NBodyGravityApp::CreateConstantBuffers() {
   HRESULT hr;
-  int i;
-
-  for (i = 0; i < 3; ++i) {
-    V_RETURN(m_FrameResources[i].CreateCommandAllocator(m_pd3dDevice));
-  }
 
-  V_RETURN(FrameResources::CreateBuffers(m_pd3dDevice, 3));
+  V_RETURN(FrameResources::CreateBuffers(m_pd3dDevice, FrameContextManager::s_uMaxFrameCount));
 
   return hr;
 }
@@ -507,15 +491,13 @@ HRESULT NBodyGravityApp::CreateCbvSrvUavHeap() {
 
 void NBodyGravityApp::OnFrameMoved(float fTime, float fElapsedTime) {
 
-  FrameResources *pFrameResources;
+  HRESULT hr;
 
   m_Camera.FrameMove(fElapsedTime, this);
 
-  m_iCurrentFrameIndex = (m_iCurrentFrameIndex + 1) % 3;
-  pFrameResources = &m_FrameResources[m_iCurrentFrameIndex];
-
-  /// Sychronize it.
-  m_pSyncFence->WaitForSyncPoint(pFrameResources->FencePoint);
+  /// Only waits when the frames in flight are all taken.
+  V(m_FrameContexts.BeginFrame());
+  m_iCurrentFrameIndex = m_FrameContexts.GetFrameIndex();
 
   /// Update the buffers up to this time point.
   ParticelParams pp;
@@ -540,7 +522,7 @@ void NBodyGravityApp::OnFrameMoved(float fTime, float fElapsedTime) {
   FrameResources::DrawParticleCB.CopyData(&dpc, sizeof(dpc), m_iCurrentFrameIndex);
 }
 
-void NBodyGravityApp::UpdatePaticles(FrameResources *pFrameResources) {
+void NBodyGravityApp::UpdatePaticles() {
 
   UINT cbCBByteSize = d3dUtils::CalcConstantBufferByteSize(sizeof(ParticelParams));
   D3D12_GPU_VIRTUAL_ADDRESS cbAddress;
@@ -565,15 +547,13 @@ void NBodyGravityApp::UpdatePaticles(FrameResources *pFrameResources) {
 
 void NBodyGravityApp::OnRenderFrame(float fTime, float fElapsedTime) {
   HRESULT hr;
-  FrameResources *pFrameResources = &m_FrameResources[m_iCurrentFrameIndex];
   D3D12_GPU_VIRTUAL_ADDRESS cbAddress;
 
-  V(pFrameResources->CmdListAlloc->Reset());
-  V(m_pd3dCommandList->Reset(pFrameResources->CmdListAlloc, m_pCSPSO));
+  V(m_pd3dCommandList->Reset(m_FrameContexts.GetCommandAllocator(), m_pCSPSO));
 
   m_pd3dCommandList->SetDescriptorHeaps(1, &m_pCbvUavSrvHeap);
 
-  UpdatePaticles(pFrameResources);
+  UpdatePaticles();
 
   /// Render the particles.
   D3D12_RESOURCE_BARRIER Barriers[] = {
@@ -617,7 +597,7 @@ void NBodyGravityApp::OnRenderFrame(float fTime, float fElapsedTime) {
   ID3D12CommandList *cmdList[] = {m_pd3dCommandList};
   m_pd3dCommandQueue->ExecuteCommandLists(1, cmdList);
 
-  m_pSyncFence->Signal(m_pd3dCommandQueue, &pFrameResources->FencePoint);
+  V(m_FrameContexts.EndFrame(m_pd3dCommandQueue));
 
   Present();
 }
@@ -8,6 +8,8 @@
 #include <ResourceUploadBatch.hpp>
 #include <UploadBuffer.h>
 #include <Camera.h>
+#include <DepthRasterizer.h>
+#include <InstanceBatcher.h>
 #include <imgui/imgui.h>
 #include <imgui/backends/imgui_impl_win32.h>
 #include <imgui/backends/imgui_impl_dx12.h>
@@ -34,13 +36,15 @@ int main() {
 
 class FrameResources {
 public:
-  HRESULT Create(ID3D12Device *pDevice, UINT perFrameResourcesSizeInBytes, UINT count, UINT frameCount) {
+  HRESULT Create(ID3D12Device *pDevice, UINT perFrameResourcesSizeInBytes, UINT count, UINT instanceSizeInBytes,
+                 UINT instanceCount, UINT frameCount) {
 
     HRESULT hr;
     if (frameCount > 4)
       V_RETURN2(L"Can not create frame resources of count bigger than 4", E_INVALIDARG);
 
     V_RETURN(m_PerframeConstBuffer.CreateBuffer(pDevice, count, perFrameResourcesSizeInBytes, true));
+    V_RETURN(m_InstanceBuffer.CreateBuffer(pDevice, instanceCount, instanceSizeInBytes, false));
 
     for (UINT i = 0; i < frameCount; ++i) {
       V_RETURN(pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_aCommandAllocator[i])));
@@ -51,6 +55,7 @@ public:
   }
 
   UploadBuffer *GetBuffer() { return &m_PerframeConstBuffer; }
+  UploadBuffer *GetInstanceBuffer() { return &m_InstanceBuffer; }
 
   UINT64 &GetFencePoint(int frameIndex) {
     _ASSERT(frameIndex >= 0 && frameIndex < 4);
@@ -71,6 +76,7 @@ public:
 
 private:
   UploadBuffer m_PerframeConstBuffer;
+  UploadBuffer m_InstanceBuffer;  // Per-instance data, read by the instanced pipelines as a structured buffer
   ComPtr<ID3D12CommandAllocator> m_aCommandAllocator[4];
   UINT64 m_uFencePoint[4];
 };
@@ -91,6 +97,12 @@ private:
   HRESULT CreatePSOs();
   HRESULT LoadModels();
   HRESULT CreateOccludeQueryResources();
+  void RasterizeOccluders(FXMMATRIX ViewProj, BOOL *pVisible);
+  BOOL IsGpuOcclusionEnabled() const;
+  BOOL IsOcclusionHistoryEnabled() const;
+  void UpdateOcclusionHistory(int iFrameIndex);
+  void SelectOcclusionQueries(UINT *pQueryMask, UINT *pSkipMask);
+  void RenderInstanceBatches(ID3D12GraphicsCommandList *pCommandList, UINT *pInstanceIndex);
 
   // GUI staff
   HRESULT ImGui_Initialize();
@@ -101,6 +113,7 @@ private:
   LRESULT ImGui_HandleMessage(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
 
   ComPtr<ID3D12PipelineState> m_pRenderTexturedPSO;
+  ComPtr<ID3D12PipelineState> m_pRenderTexturedInstancedPSO;
   ComPtr<ID3D12PipelineState> m_pRenderOnTopPSO;
   ComPtr<ID3D12PipelineState> m_pRenderOccluderPSO;
 
@@ -120,6 +133,37 @@ private:
 
   enum { NUM_MICROSCOPE_INSTANCES = 6 };
 
+  // The heavy and occluder mesh instances are drawn through the batcher, keyed by mesh.
+  // Every pass over them draws each instance at most once.
+  enum INSTANCE_MESH { INSTANCE_MESH_HEAVY, INSTANCE_MESH_OCCLUDER };
+  enum { NUM_INSTANCE_PASSES = 3 };
+  InstanceBatcher m_InstanceBatcher;
+  UINT m_uInstanceBatches;
+  UINT m_uInstancesDrawn;
+
+  // Temporal occlusion history. The resolved results are also copied to a persistently
+  // mapped readback ring, read back once the frame slot's fence has passed.
+  ComPtr<ID3D12Resource> m_pQueryReadback;
+  const UINT64 *m_pQueryReadbackData;
+  UINT m_auQueriedMask[s_iSwapChainBufferCount];    // Instances queried by each frame slot
+  UINT m_auHiddenCount[NUM_MICROSCOPE_INSTANCES];   // Consecutive hidden results
+  UINT m_uQueryCursor;                              // Round robin start for the query budget
+  UINT m_uFrameCounter;
+  UINT m_uQueriesIssued;
+  UINT m_uInstancesSkipped;
+
+  // Software occlusion: the city and column triangles kept on the CPU as the occluders,
+  // and the bounds of the proxy box the GPU queries draw around every scanner
+  DepthRasterizer m_DepthRasterizer;
+  std::vector<XMFLOAT3> m_aOccluderPositions;
+  std::vector<UINT> m_aOccluderIndices;
+  BoundingBox m_ProxyBoxBounds;
+
+  DXUT::CDXUTTimer m_RecordingTimer;
+  float m_fRecordingTimeMs;
+  float m_fOcclusionTimeMs;
+  UINT m_uHeavyDrawsRecorded;
+
   ComPtr<ID3D12DescriptorHeap> m_pModelDescriptorHeap;
 
   std::future<HRESULT> m_ModelLoadWaitable;
@@ -138,9 +182,15 @@ private:
     enum OccludePredicationOpt {
       OCCLUDE_PREDICATION_NONE,
       OCCLUDE_PREDICATION_OPT_BINARY,
-      OCCLUDE_PREDICATION_OPT_OCCLUDE
+      OCCLUDE_PREDICATION_OPT_OCCLUDE,
+      OCCLUDE_PREDICATION_OPT_SOFTWARE
     } m_PredicationOpt;
     bool m_bRenderOccluders;
+    bool m_bOcclusionHistory;
+    int m_iHiddenFramesToSkip;    // Hysteresis, consecutive hidden results before an instance is skipped
+    int m_iRetestInterval;        // Frames between re-tests of a skipped instance, staggered per instance
+    int m_iQueryBudget;           // Queries issued per frame at most
+    bool m_bBatchInstances;       // Off, every instance is submitted with a draw of its own
   } m_UserControlVars;
 
   ComPtr<ID3D12DescriptorHeap> m_pImGuiSrvHeap;
@@ -157,12 +207,61 @@ PredicationQueriesRenderer::PredicationQueriesRenderer() {
   this->m_aDeviceConfig.SwapChainBackBufferFormatSRGB = TRUE;
   m_UserControlVars.m_PredicationOpt = UserControlVars::OCCLUDE_PREDICATION_OPT_BINARY;
   m_UserControlVars.m_bRenderOccluders = false;
+  m_UserControlVars.m_bOcclusionHistory = false;
+  m_UserControlVars.m_iHiddenFramesToSkip = 4;
+  m_UserControlVars.m_iRetestInterval = 8;
+  m_UserControlVars.m_iQueryBudget = NUM_MICROSCOPE_INSTANCES;
+  m_UserControlVars.m_bBatchInstances = true;
+  m_pQueryReadbackData = nullptr;
+  ZeroMemory(m_auQueriedMask, sizeof(m_auQueriedMask));
+  ZeroMemory(m_auHiddenCount, sizeof(m_auHiddenCount));
+  m_uQueryCursor = 0;
+  m_uFrameCounter = 0;
+  m_uQueriesIssued = 0;
+  m_uInstancesSkipped = 0;
+  m_fRecordingTimeMs = 0.0f;
+  m_fOcclusionTimeMs = 0.0f;
+  m_uHeavyDrawsRecorded = 0;
+  m_uInstanceBatches = 0;
+  m_uInstancesDrawn = 0;
+}
+
+// Collect the position and index data of every triangle list subset of a mesh. The
+// position is expected as a float3 at offset 0 of the first vertex stream.
+static void GetMeshTriangles(const CDXUTSDKMesh &mesh, std::vector<XMFLOAT3> *pPositions,
+                             std::vector<UINT> *pIndices) {
+
+  for (UINT iMesh = 0; iMesh < mesh.GetNumMeshes(); ++iMesh) {
+    auto pMesh = mesh.GetMesh(iMesh);
+    const BYTE *pVertices = mesh.GetRawVerticesAt(pMesh->VertexBuffers[0]);
+    const BYTE *pRawIndices = mesh.GetRawIndicesAt(pMesh->IndexBuffer);
+    UINT uStride = mesh.GetVertexStride(iMesh, 0);
+    UINT uNumVertices = (UINT)mesh.GetNumVertices(iMesh, 0);
+    UINT uBaseVertex = (UINT)pPositions->size();
+    BOOL b32BitIndices = mesh.GetIndexType(iMesh) == IT_32BIT;
+
+    for (UINT i = 0; i < uNumVertices; ++i)
+      pPositions->push_back(*reinterpret_cast<const XMFLOAT3 *>(pVertices + i * uStride));
+
+    for (UINT iSubset = 0; iSubset < mesh.GetNumSubsets(iMesh); ++iSubset) {
+      auto pSubset = mesh.GetSubset(iMesh, iSubset);
+      if (CDXUTSDKMesh::GetPrimitiveType12((SDKMESH_PRIMITIVE_TYPE)pSubset->PrimitiveType) !=
+          D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+        continue;
+
+      for (UINT64 i = pSubset->IndexStart; i < pSubset->IndexStart + pSubset->IndexCount; ++i) {
+        UINT uIndex = b32BitIndices ? reinterpret_cast<const UINT *>(pRawIndices)[i]
+                                    : reinterpret_cast<const USHORT *>(pRawIndices)[i];
+        pIndices->push_back(uBaseVertex + (UINT)pSubset->VertexStart + uIndex);
+      }
+    }
+  }
 }
 
 HRESULT PredicationQueriesRenderer::CreatePSOs() {
 
   HRESULT hr;
-  ComPtr<ID3DBlob> VSMainBuffer, PSMainBuffer, PSOccluderBuffer;
+  ComPtr<ID3DBlob> VSMainBuffer, VSInstancedBuffer, PSMainBuffer, PSOccluderBuffer;
   ComPtr<ID3DBlob> ErrorBuffer;
 #if defined(_DEBUG)
   UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
@@ -178,6 +277,14 @@ HRESULT PredicationQueriesRenderer::CreatePSOs() {
     return E_FAIL;
   }
 
+  ErrorBuffer = nullptr;
+  V_RETURN(d3dUtils::CompileShaderFromFile(L"Shaders/DrawPredicated.hlsl", nullptr, nullptr, "VSSceneInstanced", "vs_5_0",
+                                           0, 0, &VSInstancedBuffer, &ErrorBuffer));
+  if (ErrorBuffer) {
+    DX_TRACEA("Failed to create instanced vertex shader: %s", ErrorBuffer->GetBufferPointer());
+    return E_FAIL;
+  }
+
   ErrorBuffer = nullptr;
   V_RETURN(d3dUtils::CompileShaderFromFile(L"Shaders/DrawPredicated.hlsl", nullptr, nullptr, "PSSceneMain", "ps_5_0", 0,
                                            0, &PSMainBuffer, &ErrorBuffer));
@@ -206,6 +313,7 @@ HRESULT PredicationQueriesRenderer::CreatePSOs() {
           CD3DX12_DESCRIPTOR_RANGE1{D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0},
       },
       D3D12_SHADER_VISIBILITY_PIXEL);
+  rootSignatureGen.AddShaderResourceView(1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
   rootSignatureGen.AddStaticSamples({CD3DX12_STATIC_SAMPLER_DESC{
       0, D3D12_FILTER_MIN_MAG_MIP_LINEAR, D3D12_TEXTURE_ADDRESS_MODE_WRAP, D3D12_TEXTURE_ADDRESS_MODE_WRAP,
       D3D12_TEXTURE_ADDRESS_MODE_WRAP, 0.0f, 16, D3D12_COMPARISON_FUNC_LESS_EQUAL,
@@ -229,6 +337,10 @@ HRESULT PredicationQueriesRenderer::CreatePSOs() {
   psoDesc.SampleMask = UINT_MAX;
   V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pRenderTexturedPSO)));
 
+  // The heavy and occluder meshes are only drawn instanced
+  psoDesc.VS = CD3DX12_SHADER_BYTECODE(VSInstancedBuffer.Get());
+  V_RETURN(m_pd3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pRenderTexturedInstancedPSO)));
+
   psoDesc.PS = CD3DX12_SHADER_BYTECODE(PSOccluderBuffer.Get());
   psoDesc.DepthStencilState.DepthEnable = TRUE;
   psoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
@@ -280,6 +392,22 @@ HRESULT PredicationQueriesRenderer::LoadModels() {
 
   V_RETURN(uploadBatch.End(m_pd3dCommandQueue, &m_ModelLoadWaitable));
 
+  // What hides the scanners is the scene drawn before the queries, the occluder mesh is
+  // only the proxy box tested against it
+  GetMeshTriangles(m_CityMesh, &m_aOccluderPositions, &m_aOccluderIndices);
+  GetMeshTriangles(m_ColumnMesh, &m_aOccluderPositions, &m_aOccluderIndices);
+
+  m_ProxyBoxBounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+  for (UINT iMesh = 0; iMesh < m_OccluderMesh.GetNumMeshes(); ++iMesh) {
+    BoundingBox meshBounds;
+    XMStoreFloat3(&meshBounds.Center, m_OccluderMesh.GetMeshBBoxCenter(iMesh));
+    XMStoreFloat3(&meshBounds.Extents, m_OccluderMesh.GetMeshBBoxExtents(iMesh));
+    if (iMesh == 0)
+      m_ProxyBoxBounds = meshBounds;
+    else
+      BoundingBox::CreateMerged(m_ProxyBoxBounds, m_ProxyBoxBounds, meshBounds);
+  }
+
   D3D12_DESCRIPTOR_HEAP_DESC heapDesc;
   D3D12_DESCRIPTOR_HEAP_DESC heapDesc2 = {D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 0,
                                           D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, 0};
@@ -334,9 +462,127 @@ HRESULT PredicationQueriesRenderer::CreateOccludeQueryResources() {
                                                  D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_PREDICATION,
                                                  nullptr, IID_PPV_ARGS(&m_pQueryResults)));
 
+  V_RETURN(m_pd3dDevice->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+                                                 D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                 nullptr, IID_PPV_ARGS(&m_pQueryReadback)));
+  V_RETURN(m_pQueryReadback->Map(0, nullptr, (void **)&m_pQueryReadbackData));
+
   return hr;
 }
 
+BOOL PredicationQueriesRenderer::IsGpuOcclusionEnabled() const {
+  return m_UserControlVars.m_PredicationOpt == UserControlVars::OCCLUDE_PREDICATION_OPT_BINARY ||
+         m_UserControlVars.m_PredicationOpt == UserControlVars::OCCLUDE_PREDICATION_OPT_OCCLUDE;
+}
+
+BOOL PredicationQueriesRenderer::IsOcclusionHistoryEnabled() const {
+  return IsGpuOcclusionEnabled() && m_UserControlVars.m_bOcclusionHistory;
+}
+
+// Called once the fence of the frame slot has passed, its read back results are final.
+void PredicationQueriesRenderer::UpdateOcclusionHistory(int iFrameIndex) {
+  UINT uMask = m_auQueriedMask[iFrameIndex];
+
+  if (!IsOcclusionHistoryEnabled())
+    return;
+
+  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
+    if (!(uMask & (1u << i)))
+      continue;
+
+    if (m_pQueryReadbackData[iFrameIndex * NUM_MICROSCOPE_INSTANCES + i])
+      m_auHiddenCount[i] = 0;
+    else
+      ++m_auHiddenCount[i];
+  }
+}
+
+// Instances hidden for long enough are skipped, and only queried again when their
+// staggered re-test comes up. The query budget is shared round robin.
+void PredicationQueriesRenderer::SelectOcclusionQueries(UINT *pQueryMask, UINT *pSkipMask) {
+  int iBudget = m_UserControlVars.m_iQueryBudget;
+  UINT uRetestInterval = (UINT)(std::max)(1, m_UserControlVars.m_iRetestInterval);
+
+  *pQueryMask = 0;
+  *pSkipMask = 0;
+
+  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
+    if (m_auHiddenCount[i] >= (UINT)m_UserControlVars.m_iHiddenFramesToSkip)
+      *pSkipMask |= 1u << i;
+  }
+
+  for (int k = 0; k < NUM_MICROSCOPE_INSTANCES && iBudget > 0; ++k) {
+    UINT i = (m_uQueryCursor + k) % NUM_MICROSCOPE_INSTANCES;
+    BOOL bSkipped = (*pSkipMask >> i) & 1;
+
+    if (!bSkipped || (m_uFrameCounter + i) % uRetestInterval == 0) {
+      *pQueryMask |= 1u << i;
+      --iBudget;
+    }
+  }
+
+  m_uQueryCursor = (m_uQueryCursor + 1) % NUM_MICROSCOPE_INSTANCES;
+}
+
+// Draw the city and the columns into the CPU depth buffer, then test the proxy box of
+// every scanner instance against it, as the GPU queries do. pVisible receives one flag per
+// instance.
+void PredicationQueriesRenderer::RasterizeOccluders(FXMMATRIX ViewProj, BOOL *pVisible) {
+
+  m_DepthRasterizer.Clear();
+  m_DepthRasterizer.RasterizeTriangles(m_aOccluderPositions.data(), (UINT)m_aOccluderPositions.size(),
+                                       m_aOccluderIndices.data(), (UINT)m_aOccluderIndices.size(), ViewProj);
+  m_DepthRasterizer.UpdateTileDepths();
+
+  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
+    auto W1 = XMMatrixRotationY(i * XM_2PI / NUM_MICROSCOPE_INSTANCES);
+    pVisible[i] = m_DepthRasterizer.IsVisible(m_ProxyBoxBounds, W1 * ViewProj);
+  }
+}
+
+// Upload the instance data of the batches and record one instanced render of the mesh per
+// batch, inside the predication and the query of the batch.
+void PredicationQueriesRenderer::RenderInstanceBatches(ID3D12GraphicsCommandList *pCommandList, UINT *pInstanceIndex) {
+  UploadBuffer *pInstanceBuffer = m_FrameResources.GetInstanceBuffer();
+  const BYTE *pInstanceData = m_InstanceBatcher.GetInstanceData();
+  UINT uInstanceSize = m_InstanceBatcher.GetInstanceDataSize();
+  UINT uBaseInstance = *pInstanceIndex;
+
+  for (UINT i = 0; i < m_InstanceBatcher.GetInstanceCount(); ++i)
+    pInstanceBuffer->CopyData(pInstanceData + i * uInstanceSize, uInstanceSize, uBaseInstance + i);
+  *pInstanceIndex += m_InstanceBatcher.GetInstanceCount();
+
+  for (UINT b = 0; b < m_InstanceBatcher.GetBatchCount(); ++b) {
+    const INSTANCE_BATCH &batch = m_InstanceBatcher.GetBatch(b);
+    const INSTANCE_DRAW_STATE &drawState = batch.State;
+
+    // SV_InstanceID counts from 0 in every draw, the view starts at the batch's instances
+    pCommandList->SetGraphicsRootShaderResourceView(
+        2, pInstanceBuffer->GetConstBufferAddress(uBaseInstance + batch.FirstInstance));
+
+    if (drawState.pPredicationBuffer)
+      pCommandList->SetPredication(drawState.pPredicationBuffer, drawState.uPredicationOffset, drawState.PredicationOp);
+    if (drawState.pQueryHeap)
+      pCommandList->BeginQuery(drawState.pQueryHeap, drawState.QueryType, drawState.uQueryIndex);
+
+    if (batch.MeshKey == INSTANCE_MESH_HEAVY)
+      m_HeavyMesh.RenderInstanced(pCommandList, batch.NumInstances,
+                                  CD3DX12_GPU_DESCRIPTOR_HANDLE(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+                                                                m_HeavyMeshDescriptorStartPos, m_uCbvSrvUavDescriptorSize),
+                                  1);
+    else
+      m_OccluderMesh.RenderInstanced(pCommandList, batch.NumInstances, CD3DX12_GPU_DESCRIPTOR_HANDLE());
+
+    if (drawState.pQueryHeap)
+      pCommandList->EndQuery(drawState.pQueryHeap, drawState.QueryType, drawState.uQueryIndex);
+    if (drawState.pPredicationBuffer)
+      pCommandList->SetPredication(nullptr, 0, D3D12_PREDICATION_OP_EQUAL_ZERO);
+  }
+
+  m_uInstanceBatches += m_InstanceBatcher.GetBatchCount();
+  m_uInstancesDrawn += m_InstanceBatcher.GetInstanceCount();
+}
+
 HRESULT PredicationQueriesRenderer::OnInitPipelines() {
   HRESULT hr;
 
@@ -348,8 +594,9 @@ HRESULT PredicationQueriesRenderer::OnInitPipelines() {
 
   V_RETURN(ImGui_Initialize());
 
-  V_RETURN(m_FrameResources.Create(m_pd3dDevice, sizeof(PerFrameConstBuffer),
-                                   s_iSwapChainBufferCount * (1 + 3 * NUM_MICROSCOPE_INSTANCES),
+  V_RETURN(m_FrameResources.Create(m_pd3dDevice, sizeof(PerFrameConstBuffer), s_iSwapChainBufferCount,
+                                   sizeof(XMFLOAT4X4),
+                                   s_iSwapChainBufferCount * NUM_INSTANCE_PASSES * NUM_MICROSCOPE_INSTANCES,
                                    s_iSwapChainBufferCount));
 
   V_RETURN(m_pd3dCommandList->Close());
@@ -376,16 +623,26 @@ void PredicationQueriesRenderer::OnFrameMoved(float fTime, float fElapsedTime) {
 
   V(m_pSyncFence->WaitForSyncPoint(m_FrameResources.GetFencePoint(m_iCurrentFrameIndex)));
 
+  UpdateOcclusionHistory(m_iCurrentFrameIndex);
+
   ImGui_FrameMoved();
 }
 void PredicationQueriesRenderer::OnRenderFrame(float fTime, float fElapsedTime) {
 
   HRESULT hr;
-  auto cbStartIndex = m_iCurrentFrameIndex * (1 + 3 * NUM_MICROSCOPE_INSTANCES);
+  auto cbStartIndex = m_iCurrentFrameIndex;
+  UINT uInstanceIndex = m_iCurrentFrameIndex * NUM_INSTANCE_PASSES * NUM_MICROSCOPE_INSTANCES;
   auto pCommandAllocator = m_FrameResources.GetCommandAllocator(m_iCurrentFrameIndex);
   auto perframeCbv = m_FrameResources.GetBuffer()->GetConstBufferAddress(m_iCurrentFrameIndex);
   auto pCommandList = m_pd3dCommandList;
   D3D12_GPU_VIRTUAL_ADDRESS cbAddress;
+  BOOL abHeavyVisible[NUM_MICROSCOPE_INSTANCES];
+  BOOL bSoftwareOcclusion = m_UserControlVars.m_PredicationOpt == UserControlVars::OCCLUDE_PREDICATION_OPT_SOFTWARE;
+  BOOL bOcclusionHistory = IsOcclusionHistoryEnabled();
+  UINT uQueryMask = (1u << NUM_MICROSCOPE_INSTANCES) - 1;
+  UINT uSkipMask = 0;
+
+  m_RecordingTimer.Reset();
 
   V(pCommandAllocator->Reset());
   V(pCommandList->Reset(pCommandAllocator, m_pRenderTexturedPSO.Get()));
@@ -411,7 +668,7 @@ void PredicationQueriesRenderer::OnRenderFrame(float fTime, float fElapsedTime)
 
   XMStoreFloat4x4(&constBuffer.WorldViewProj, XMMatrixTranspose(W * V * P));
   m_FrameResources.GetBuffer()->CopyData(&constBuffer, sizeof(constBuffer), cbStartIndex);
-  cbAddress = m_FrameResources.GetBuffer()->GetConstBufferAddress(cbStartIndex++);
+  cbAddress = m_FrameResources.GetBuffer()->GetConstBufferAddress(cbStartIndex);
   pCommandList->SetGraphicsRootConstantBufferView(0, cbAddress);
 
   m_CityMesh.Render(pCommandList,
@@ -428,55 +685,97 @@ void PredicationQueriesRenderer::OnRenderFrame(float fTime, float fElapsedTime)
   D3D12_QUERY_TYPE queryType = m_UserControlVars.m_PredicationOpt == UserControlVars::OCCLUDE_PREDICATION_OPT_BINARY ?
     D3D12_QUERY_TYPE_BINARY_OCCLUSION : D3D12_QUERY_TYPE_OCCLUSION;
 
-  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
+  if (bSoftwareOcclusion) {
+    double fStart = m_RecordingTimer.GetTime();
+    RasterizeOccluders(W * V * P, abHeavyVisible);
+    m_fOcclusionTimeMs += (static_cast<float>((m_RecordingTimer.GetTime() - fStart) * 1000.0) - m_fOcclusionTimeMs) * 0.05f;
+  }
 
-    auto W1 = XMMatrixRotationY(i * XM_2PI / NUM_MICROSCOPE_INSTANCES);
-    XMStoreFloat4x4(&constBuffer.WorldViewProj, XMMatrixTranspose(W1 * W * V * P));
+  // The invisible occluder pass only feeds the GPU queries
+  if (bSoftwareOcclusion)
+    uQueryMask = 0;
+  else if (bOcclusionHistory)
+    SelectOcclusionQueries(&uQueryMask, &uSkipMask);
 
-    m_FrameResources.GetBuffer()->CopyData(&constBuffer, sizeof(constBuffer), cbStartIndex);
-    cbAddress = m_FrameResources.GetBuffer()->GetConstBufferAddress(cbStartIndex++);
-    pCommandList->SetGraphicsRootConstantBufferView(0, cbAddress);
+  m_uHeavyDrawsRecorded = 0;
+  m_uInstanceBatches = 0;
+  m_uInstancesDrawn = 0;
 
-    if(m_UserControlVars.m_PredicationOpt != UserControlVars::OCCLUDE_PREDICATION_NONE)
-      pCommandList->SetPredication(m_pQueryResults.Get(),
-                                   (m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES + i) * occluderByteSize,
-                                   D3D12_PREDICATION_OP_EQUAL_ZERO);
+  pCommandList->SetPipelineState(m_pRenderTexturedInstancedPSO.Get());
+  m_InstanceBatcher.Begin(sizeof(XMFLOAT4X4));
 
-    m_HeavyMesh.Render(pCommandList,
-                       CD3DX12_GPU_DESCRIPTOR_HANDLE(m_pModelDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-                                                     m_HeavyMeshDescriptorStartPos, m_uCbvSrvUavDescriptorSize),
-                       1);
-    if (m_UserControlVars.m_PredicationOpt != UserControlVars::OCCLUDE_PREDICATION_NONE)
-      pCommandList->SetPredication(nullptr, 0, D3D12_PREDICATION_OP_EQUAL_ZERO);
-  }
+  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
 
-  pCommandList->SetPipelineState(m_pRenderOccluderPSO.Get());
+    // Hidden instances are never recorded
+    if (bSoftwareOcclusion && !abHeavyVisible[i])
+      continue;
+    if (uSkipMask & (1u << i))
+      continue;
+
+    // The slot holds results only for the instances it queried last time around
+    BOOL bPredicate = IsGpuOcclusionEnabled() &&
+                      (!bOcclusionHistory || (m_auQueriedMask[m_iCurrentFrameIndex] & (1u << i)));
+    INSTANCE_DRAW_STATE drawState = {};
+
+    if (bPredicate) {
+      drawState.pPredicationBuffer = m_pQueryResults.Get();
+      drawState.uPredicationOffset = (m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES + i) * occluderByteSize;
+      drawState.PredicationOp = D3D12_PREDICATION_OP_EQUAL_ZERO;
+    }
 
-  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
     auto W1 = XMMatrixRotationY(i * XM_2PI / NUM_MICROSCOPE_INSTANCES);
     XMStoreFloat4x4(&constBuffer.WorldViewProj, XMMatrixTranspose(W1 * W * V * P));
+    m_InstanceBatcher.Add(INSTANCE_MESH_HEAVY, drawState, &constBuffer.WorldViewProj);
+    ++m_uHeavyDrawsRecorded;
+  }
+
+  m_InstanceBatcher.End(m_UserControlVars.m_bBatchInstances);
+  RenderInstanceBatches(pCommandList, &uInstanceIndex);
+
+  pCommandList->SetPipelineState(m_pRenderOccluderPSO.Get());
+  m_InstanceBatcher.Begin(sizeof(XMFLOAT4X4));
 
-    m_FrameResources.GetBuffer()->CopyData(&constBuffer, sizeof(constBuffer), cbStartIndex);
-    cbAddress = m_FrameResources.GetBuffer()->GetConstBufferAddress(cbStartIndex++);
-    pCommandList->SetGraphicsRootConstantBufferView(0, cbAddress);
+  for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
+    if (!(uQueryMask & (1u << i)))
+      continue;
 
-    if(m_UserControlVars.m_PredicationOpt != UserControlVars::OCCLUDE_PREDICATION_NONE)
-      pCommandList->BeginQuery(m_pQueryHeap.Get(), queryType,
-                               m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES + i);
+    INSTANCE_DRAW_STATE drawState = {};
 
-    m_OccluderMesh.Render(pCommandList, CD3DX12_GPU_DESCRIPTOR_HANDLE());
+    if (IsGpuOcclusionEnabled()) {
+      drawState.pQueryHeap = m_pQueryHeap.Get();
+      drawState.QueryType = queryType;
+      drawState.uQueryIndex = m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES + i;
+    }
 
-    if (m_UserControlVars.m_PredicationOpt != UserControlVars::OCCLUDE_PREDICATION_NONE)
-      pCommandList->EndQuery(m_pQueryHeap.Get(), queryType, m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES + i);
+    auto W1 = XMMatrixRotationY(i * XM_2PI / NUM_MICROSCOPE_INSTANCES);
+    XMStoreFloat4x4(&constBuffer.WorldViewProj, XMMatrixTranspose(W1 * W * V * P));
+    m_InstanceBatcher.Add(INSTANCE_MESH_OCCLUDER, drawState, &constBuffer.WorldViewProj);
   }
 
-  if (m_UserControlVars.m_PredicationOpt != UserControlVars::OCCLUDE_PREDICATION_NONE) {
+  m_InstanceBatcher.End(m_UserControlVars.m_bBatchInstances);
+  RenderInstanceBatches(pCommandList, &uInstanceIndex);
+
+  if (IsGpuOcclusionEnabled()) {
     pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_pQueryResults.Get(),
                                                                            D3D12_RESOURCE_STATE_PREDICATION,
                                                                            D3D12_RESOURCE_STATE_COPY_DEST));
-    pCommandList->ResolveQueryData(m_pQueryHeap.Get(), queryType, m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES,
-                                   NUM_MICROSCOPE_INSTANCES, m_pQueryResults.Get(),
-                                   (m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES) * occluderByteSize);
+
+    // Only queries issued this frame may be resolved, one call per run of them
+    for (int iStart = 0, iEnd; iStart < NUM_MICROSCOPE_INSTANCES; iStart = iEnd) {
+      if (!(uQueryMask & (1u << iStart))) {
+        iEnd = iStart + 1;
+        continue;
+      }
+      for (iEnd = iStart + 1; iEnd < NUM_MICROSCOPE_INSTANCES && (uQueryMask & (1u << iEnd)); ++iEnd)
+        ;
+
+      UINT uFirstQuery = m_iCurrentFrameIndex * NUM_MICROSCOPE_INSTANCES + iStart;
+      pCommandList->ResolveQueryData(m_pQueryHeap.Get(), queryType, uFirstQuery, iEnd - iStart,
+                                     m_pQueryResults.Get(), uFirstQuery * occluderByteSize);
+      pCommandList->ResolveQueryData(m_pQueryHeap.Get(), queryType, uFirstQuery, iEnd - iStart,
+                                     m_pQueryReadback.Get(), uFirstQuery * occluderByteSize);
+    }
+
     pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_pQueryResults.Get(),
                                                                            D3D12_RESOURCE_STATE_COPY_DEST,
                                                                            D3D12_RESOURCE_STATE_PREDICATION));
@@ -484,17 +783,16 @@ void PredicationQueriesRenderer::OnRenderFrame(float fTime, float fElapsedTime)
 
   if(m_UserControlVars.m_bRenderOccluders) {
     pCommandList->SetPipelineState(m_pRenderOnTopPSO.Get());
+    m_InstanceBatcher.Begin(sizeof(XMFLOAT4X4));
 
     for (int i = 0; i < NUM_MICROSCOPE_INSTANCES; ++i) {
       auto W1 = XMMatrixRotationY(i * XM_2PI / NUM_MICROSCOPE_INSTANCES);
       XMStoreFloat4x4(&constBuffer.WorldViewProj, XMMatrixTranspose(W1 * W * V * P));
-
-      m_FrameResources.GetBuffer()->CopyData(&constBuffer, sizeof(constBuffer), cbStartIndex);
-      cbAddress = m_FrameResources.GetBuffer()->GetConstBufferAddress(cbStartIndex++);
-      pCommandList->SetGraphicsRootConstantBufferView(0, cbAddress);
-
-      m_OccluderMesh.Render(pCommandList, CD3DX12_GPU_DESCRIPTOR_HANDLE());
+      m_InstanceBatcher.Add(INSTANCE_MESH_OCCLUDER, INSTANCE_DRAW_STATE{}, &constBuffer.WorldViewProj);
     }
+
+    m_InstanceBatcher.End(m_UserControlVars.m_bBatchInstances);
+    RenderInstanceBatches(pCommandList, &uInstanceIndex);
   }
 
   ImGui_RenderFrame();
@@ -502,6 +800,13 @@ void PredicationQueriesRenderer::OnRenderFrame(float fTime, float fElapsedTime)
   EndRenderFrame(pCommandList);
 
   V(pCommandList->Close());
+
+  m_auQueriedMask[m_iCurrentFrameIndex] = IsGpuOcclusionEnabled() ? uQueryMask : 0;
+  m_uQueriesIssued = IsGpuOcclusionEnabled() ? __popcnt(uQueryMask) : 0;
+  m_uInstancesSkipped = __popcnt(uSkipMask);
+  ++m_uFrameCounter;
+
+  m_fRecordingTimeMs += (static_cast<float>(m_RecordingTimer.GetTime() * 1000.0) - m_fRecordingTimeMs) * 0.05f;
   m_pd3dCommandQueue->ExecuteCommandLists(1, CommandListCast(&pCommandList));
 
   m_pSyncFence->Signal(m_pd3dCommandQueue, &m_FrameResources.GetFencePoint(m_iCurrentFrameIndex));
@@ -513,6 +818,9 @@ void PredicationQueriesRenderer::OnResizeFrame(int cx, int cy) {
   m_Camera.SetProjParams(XM_PIDIV4, GetAspectRatio(), 0.05f, 5000.0f);
   m_Camera.SetWindow(cx, cy);
 
+  // A coarse buffer is plenty for the city blocks and the columns
+  m_DepthRasterizer.Resize(256, (std::max)(1, 256 * cy / (std::max)(cx, 1)));
+
   ImGui_ResizeFrame(cx, cy);
 }
 
@@ -585,9 +893,27 @@ void PredicationQueriesRenderer::ImGui_FrameMoved() {
                      UserControlVars::OCCLUDE_PREDICATION_OPT_OCCLUDE);
   ImGui::RadioButton("Use Binary Occlude Predication", (int *)&m_UserControlVars.m_PredicationOpt,
                      UserControlVars::OCCLUDE_PREDICATION_OPT_BINARY);
+  ImGui::RadioButton("Use Software Occlusion Culling", (int *)&m_UserControlVars.m_PredicationOpt,
+                     UserControlVars::OCCLUDE_PREDICATION_OPT_SOFTWARE);
   ImGui::EndGroup();
   ImGui::Separator();
   ImGui::Checkbox("Render Occluders", &m_UserControlVars.m_bRenderOccluders);
+  ImGui::Checkbox("Batch instances", &m_UserControlVars.m_bBatchInstances);
+  ImGui::Text("Instanced submissions: %u for %u instances", m_uInstanceBatches, m_uInstancesDrawn);
+  ImGui::Separator();
+  ImGui::Text("CPU recording: %.3f ms", m_fRecordingTimeMs);
+  ImGui::Text("Heavy draws recorded: %u / %d", m_uHeavyDrawsRecorded, (int)NUM_MICROSCOPE_INSTANCES);
+  if (m_UserControlVars.m_PredicationOpt == UserControlVars::OCCLUDE_PREDICATION_OPT_SOFTWARE)
+    ImGui::Text("Software occlusion: %.3f ms", m_fOcclusionTimeMs);
+  ImGui::Separator();
+  if (ImGui::Checkbox("Temporal occlusion history", &m_UserControlVars.m_bOcclusionHistory))
+    ZeroMemory(m_auHiddenCount, sizeof(m_auHiddenCount));
+  if (m_UserControlVars.m_bOcclusionHistory) {
+    ImGui::SliderInt("Hidden frames to skip", &m_UserControlVars.m_iHiddenFramesToSkip, 1, 16);
+    ImGui::SliderInt("Re-test interval", &m_UserControlVars.m_iRetestInterval, 1, 16);
+    ImGui::SliderInt("Query budget", &m_UserControlVars.m_iQueryBudget, 1, NUM_MICROSCOPE_INSTANCES);
+    ImGui::Text("Queries issued: %u, instances skipped: %u", m_uQueriesIssued, m_uInstancesSkipped);
+  }
   ImGui::End();
 }
 
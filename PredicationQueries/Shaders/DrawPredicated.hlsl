@@ -5,6 +5,7 @@ cbuffer cbPerFrame: register(b0) {
 
 Texture2D g_txDiffuse : register(t0);
 SamplerState g_samLinear:register(s0);
+StructuredBuffer<float4x4> g_aInstanceViewProj : register(t1);
 
 struct VSInput {
   float3  PosW:    POSITION;
@@ -27,6 +28,14 @@ VSOutput VSSceneMain(VSInput vin) {
   return vout;
 }
 
+VSOutput VSSceneInstanced(VSInput vin, uint iInstance: SV_InstanceID) {
+  VSOutput vout = (VSOutput)0;
+
+  vout.PosH = mul(float4(vin.PosW, 1.0), g_aInstanceViewProj[iInstance]);
+  vout.TexC = vin.TexC;
+  return vout;
+}
+
 float4 PSSceneMain(PSInput pin): SV_TARGET {
   return g_txDiffuse.Sample(g_samLinear, pin.TexC);
   // return float4(1.0, 0.0, 0.0, 1.0);
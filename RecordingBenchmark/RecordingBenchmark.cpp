@@ -0,0 +1,234 @@
+#include <SDKmeshPackets.h>
+#include <TaskGraph.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+using namespace DirectX;
+
+///
+/// Draw recording without a device. A synthetic scene is built in memory as draw packets,
+/// culled against the views every frame with SDKMESH_VIEW_MASKS, and the draw lists are
+/// recorded in chunks by a TaskGraph into NullCommandRecorders, the way the multithreaded
+/// sample records its scene passes. The frames are timed for a growing number of threads
+/// and the draws recorded per second are reported per thread.
+///
+/// RecordingBenchmark [meshes] [frames]
+///
+namespace {
+const UINT s_uNumMaterials = 256;
+const UINT s_uMeshesPerBuffer = 64;   // Meshes sharing a vertex and an index buffer
+const UINT s_uMaxSubsets = 4;
+const UINT s_uNumViews = 4;           // The scene view and three shadow views
+const UINT s_uChunksPerView = 8;
+const UINT s_uCullGrain = 1024;
+const UINT s_uDiffuseSlot = 2, s_uNormalSlot = 3, s_uSpecularSlot = 4;
+
+struct SCENE {
+  SDKMESH_PACKET_SET Packets;
+  SDKMESH_VIEW_MASKS ViewMasks;
+  std::vector<UINT> ItemMeshes;   // One frame mesh per mesh, in mesh order
+  SDKMESH_FRUSTUM aFrustums[s_uNumViews];
+};
+
+struct CHUNK {
+  NullCommandRecorder Recorder;
+  UINT uView;
+  UINT uFirst, uEnd;               // Range of the view's draw list
+};
+
+void BuildScene(UINT uNumMeshes, SCENE *pScene) {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<UINT> materialDist(0, s_uNumMaterials - 1);
+  std::uniform_int_distribution<UINT> subsetDist(1, s_uMaxSubsets);
+  std::uniform_int_distribution<UINT> indexDist(3, 3000);
+
+  SDKMESH_MATERIAL_TABLE &materials = pScene->Packets.MaterialTable;
+  for (auto &a : materials.HeapIndex)
+    a.resize(s_uNumMaterials);
+  materials.TextureMask.resize(s_uNumMaterials);
+  for (UINT m = 0; m < s_uNumMaterials; ++m) {
+    for (UINT t = 0; t < TS_COUNT; ++t)
+      materials.HeapIndex[t][m] = (INT)(m * TS_COUNT + t);
+    materials.TextureMask[m] = (1u << TS_COUNT) - 1;
+  }
+  pScene->Packets.CbvSrvUavDescriptorSize = 32;
+
+  // Meshes on a square grid around the origin
+  const UINT uGridSize = (UINT)std::ceil(std::sqrt((float)uNumMeshes));
+  const float fSpacing = 4.0f;
+
+  pScene->Packets.Clear();
+  pScene->ViewMasks.Bounds.Resize(uNumMeshes);
+  pScene->ItemMeshes.resize(uNumMeshes);
+
+  for (UINT i = 0; i < uNumMeshes; ++i) {
+    UINT uBuffer = i / s_uMeshesPerBuffer;
+    SDKMESH_MESH_PACKET meshPacket = {};
+
+    meshPacket.NumVertexBuffers = 1;
+    meshPacket.VBV[0].BufferLocation = 0x100000000ull + (UINT64)uBuffer * 0x1000000;
+    meshPacket.VBV[0].SizeInBytes = 0x1000000;
+    meshPacket.VBV[0].StrideInBytes = 32;
+    meshPacket.IBV.BufferLocation = 0x800000000ull + (UINT64)uBuffer * 0x1000000;
+    meshPacket.IBV.SizeInBytes = 0x1000000;
+    meshPacket.IBV.Format = DXGI_FORMAT_R32_UINT;
+    meshPacket.PositionVBV.BufferLocation = 0x1000000000ull + (UINT64)uBuffer * 0x1000000;
+    meshPacket.PositionVBV.SizeInBytes = 0x1000000;
+    meshPacket.PositionVBV.StrideInBytes = sizeof(XMFLOAT3);
+    meshPacket.BoundsCenter = XMFLOAT3(((float)(i % uGridSize) - uGridSize * 0.5f) * fSpacing, 0.0f,
+                                       ((float)(i / uGridSize) - uGridSize * 0.5f) * fSpacing);
+    pScene->Packets.AddMesh(meshPacket);
+
+    // Subsets follow each other in the index buffer, so some of them merge
+    UINT uIndexStart = 0;
+    UINT uNumSubsets = subsetDist(rng);
+    for (UINT s = 0; s < uNumSubsets; ++s) {
+      SDKMESH_DRAW_PACKET draw;
+      draw.PrimType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+      draw.IndexCount = indexDist(rng) * 3;
+      draw.IndexStart = uIndexStart;
+      draw.VertexStart = (INT)((i % s_uMeshesPerBuffer) * 4096);
+      draw.MaterialID = materialDist(rng);
+      pScene->Packets.AddDraw(draw);
+      uIndexStart += draw.IndexCount;
+    }
+
+    pScene->ViewMasks.Bounds.SetBox(i, BoundingBox(meshPacket.BoundsCenter, XMFLOAT3(1.0f, 1.0f, 1.0f)));
+    pScene->ItemMeshes[i] = i;
+  }
+
+  // Four views looking out from the center, a quarter turn apart
+  XMMATRIX mProj = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.1f, uGridSize * fSpacing);
+  for (UINT v = 0; v < s_uNumViews; ++v) {
+    XMMATRIX mView = XMMatrixMultiply(XMMatrixTranslation(0.0f, -2.0f, 0.0f), XMMatrixRotationY(v * XM_PIDIV2));
+    pScene->aFrustums[v].CreateFromMatrix(XMMatrixMultiply(mView, mProj));
+  }
+}
+
+/// Culls the scene and records it once. Returns the draws recorded.
+UINT RecordFrame(SCENE *pScene, JobSystem *pJobSystem, TaskGraph *pGraph, SDKMESH_DRAW_LIST *pDrawLists,
+                 std::vector<std::unique_ptr<CHUNK>> *pChunks) {
+  SDKMESH_VIEW_MASKS &viewMasks = pScene->ViewMasks;
+  const UINT uNumItems = viewMasks.Bounds.GetCount();
+
+  viewMasks.NumViews = s_uNumViews;
+  viewMasks.Masks.resize(uNumItems);
+  pJobSystem->ParallelFor(0, uNumItems, s_uCullGrain, [&](uint32_t uBegin, uint32_t uEnd) {
+    viewMasks.Bounds.CullViews(pScene->aFrustums[0].Planes, s_uNumViews, uBegin, uEnd - uBegin,
+                               viewMasks.Masks.data() + uBegin);
+  });
+  viewMasks.BuildDrawLists(pScene->ItemMeshes.data(), pDrawLists);
+
+  // The chunks of a view are consecutive, each takes an equal share of its draw list
+  for (UINT i = 0; i < (UINT)pChunks->size(); ++i) {
+    CHUNK *pChunk = (*pChunks)[i].get();
+    UINT uNumVisible = pDrawLists[pChunk->uView].NumVisible();
+    UINT uChunk = i % s_uChunksPerView;
+    pChunk->uFirst = uNumVisible * uChunk / s_uChunksPerView;
+    pChunk->uEnd = uNumVisible * (uChunk + 1) / s_uChunksPerView;
+    pChunk->Recorder.Reset();
+  }
+
+  pGraph->Execute(pJobSystem);
+
+  UINT uNumDraws = 0;
+  for (auto &pChunk : *pChunks)
+    uNumDraws += pChunk->Recorder.GetDrawCount();
+  return uNumDraws;
+}
+
+void RecordChunk(const SCENE *pScene, const SDKMESH_DRAW_LIST *pDrawLists, CHUNK *pChunk) {
+  const D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart = {0x10000};
+  const std::vector<UINT> &meshes = pDrawLists[pChunk->uView].Meshes;
+
+  for (UINT i = pChunk->uFirst; i < pChunk->uEnd; ++i) {
+    if (pChunk->uView == 0)
+      pScene->Packets.RenderMesh(meshes[i], &pChunk->Recorder, hDescriptorStart, s_uDiffuseSlot, s_uNormalSlot,
+                                 s_uSpecularSlot);
+    else
+      pScene->Packets.RenderMeshDepth(meshes[i], &pChunk->Recorder);
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const UINT uNumMeshes = argc > 1 ? (UINT)strtoul(argv[1], nullptr, 10) : 50000;
+  const UINT uNumFrames = argc > 2 ? (UINT)strtoul(argv[2], nullptr, 10) : 20;
+
+  if (uNumMeshes == 0 || uNumFrames == 0) {
+    fprintf(stderr, "usage: RecordingBenchmark [meshes] [frames]\n");
+    return 1;
+  }
+
+  SCENE scene;
+  BuildScene(uNumMeshes, &scene);
+
+  JobSystem jobSystem;
+  jobSystem.Initialize();
+
+  SDKMESH_DRAW_LIST aDrawLists[s_uNumViews];
+  std::vector<std::unique_ptr<CHUNK>> aChunks;
+  TaskGraph graph;
+
+  for (UINT v = 0; v < s_uNumViews; ++v) {
+    for (UINT c = 0; c < s_uChunksPerView; ++c) {
+      aChunks.emplace_back(new CHUNK());
+      CHUNK *pChunk = aChunks.back().get();
+      pChunk->uView = v;
+      graph.AddNode("RecordChunk", [&scene, &aDrawLists, pChunk]() { RecordChunk(&scene, aDrawLists, pChunk); });
+    }
+  }
+
+  // One thread recording everything is the reference the parallel frames must match
+  UINT uExpectedDraws = 0;
+  {
+    CHUNK reference;
+    RecordFrame(&scene, &jobSystem, &graph, aDrawLists, &aChunks);
+    for (UINT v = 0; v < s_uNumViews; ++v) {
+      reference.uView = v;
+      reference.uFirst = 0;
+      reference.uEnd = aDrawLists[v].NumVisible();
+      RecordChunk(&scene, aDrawLists, &reference);
+    }
+    uExpectedDraws = reference.Recorder.GetDrawCount();
+  }
+
+  printf("%u meshes, %u draw packets, %u views, %u chunks per view, %u draws per frame\n", uNumMeshes,
+         (UINT)scene.Packets.DrawPackets.size(), s_uNumViews, s_uChunksPerView, uExpectedDraws);
+  printf("threads  frame ms  draws/s  draws/s per thread\n");
+
+  // Powers of two up to every hardware thread
+  const UINT uMaxThreads = jobSystem.GetWorkerCount() + 1;
+  std::vector<UINT> aThreadCounts;
+  for (UINT uNumThreads = 1; uNumThreads < uMaxThreads; uNumThreads *= 2)
+    aThreadCounts.push_back(uNumThreads);
+  aThreadCounts.push_back(uMaxThreads);
+
+  int iResult = 0;
+  for (UINT uNumThreads : aThreadCounts) {
+    jobSystem.SetActiveWorkerCount(uNumThreads - 1);
+
+    UINT64 uNumDraws = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (UINT f = 0; f < uNumFrames; ++f) {
+      UINT uFrameDraws = RecordFrame(&scene, &jobSystem, &graph, aDrawLists, &aChunks);
+      if (uFrameDraws != uExpectedDraws) {
+        fprintf(stderr, "%u threads recorded %u draws instead of %u\n", uNumThreads, uFrameDraws, uExpectedDraws);
+        iResult = 1;
+      }
+      uNumDraws += uFrameDraws;
+    }
+    double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double fDrawsPerSecond = fSeconds > 0.0 ? uNumDraws / fSeconds : 0.0;
+    printf("%7u  %8.3f  %7.0f  %18.0f\n", uNumThreads, fSeconds * 1000.0 / uNumFrames, fDrawsPerSecond,
+           fDrawsPerSecond / uNumThreads);
+  }
+
+  jobSystem.Shutdown();
+  return iResult;
+}
@@ -0,0 +1,350 @@
+#include "TestHarness.h"
+#include "AabbTree.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "SDKmeshPackets.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <random>
+
+using namespace DirectX;
+
+namespace {
+// The query benchmark: instance counts, and linear scans timed against the tree queries.
+// The linear sphere and ray scans dominate the run, hence the few queries.
+const UINT s_aBenchmarkSizes[] = {1000, 10000, 100000};
+const UINT s_uBenchmarkQueries = 100;
+const char *s_aBenchmarkItems[] = {"build, insert", "rebuild, SAH", "frustum, linear SoA", "frustum, tree",
+                                   "frustum, tree MT", "spheres, linear", "spheres, tree", "rays, linear",
+                                   "rays, tree"};
+const int s_iNumBenchmarkItems = sizeof(s_aBenchmarkItems) / sizeof(s_aBenchmarkItems[0]);
+
+// Boxes scattered around the origin, seen from z = -fDistance looking down +z
+const float s_fSceneRadius = 600.0f;
+const float s_fCameraDistance = 900.0f;
+const XMFLOAT3 s_vEye(0.0f, 0.0f, -s_fCameraDistance);
+
+void GetFrustum(float fYaw, SDKMESH_FRUSTUM *pFrustum) {
+  pFrustum->CreateFromMatrix(XMMatrixRotationY(fYaw) * XMMatrixTranslation(0.0f, 0.0f, s_fCameraDistance) *
+                             XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 2000.0f));
+}
+
+BoundingBox GenerateBox(std::mt19937 *pRng) {
+  std::uniform_real_distribution<float> posDist(-s_fSceneRadius, s_fSceneRadius);
+  std::uniform_real_distribution<float> extentDist(0.5f, 10.0f);
+
+  return BoundingBox(XMFLOAT3(posDist(*pRng), posDist(*pRng), posDist(*pRng)),
+                     XMFLOAT3(extentDist(*pRng), extentDist(*pRng), extentDist(*pRng)));
+}
+
+// Light sized spheres, and rays from the eye aimed into the scene
+void GenerateQueries(UINT uCount, std::mt19937 *pRng, std::vector<BoundingSphere> *pSpheres,
+                     std::vector<XMFLOAT3> *pRayDirs) {
+  std::uniform_real_distribution<float> posDist(-s_fSceneRadius, s_fSceneRadius);
+
+  pSpheres->resize(uCount);
+  pRayDirs->resize(uCount);
+  for (UINT i = 0; i < uCount; ++i) {
+    XMFLOAT3 vTarget(posDist(*pRng), posDist(*pRng), posDist(*pRng));
+    (*pSpheres)[i] = BoundingSphere(vTarget, 25.0f);
+    XMStoreFloat3(&(*pRayDirs)[i], XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&vTarget), XMLoadFloat3(&s_vEye))));
+  }
+}
+
+// The leaves of a tree, by user data, and the brute force queries over their fat boxes
+class FatBoxes {
+public:
+  void Gather(const AabbTree &tree, const std::vector<int> &aProxies) {
+    m_aBoxes.clear();
+    m_aUserData.clear();
+    for (int iProxy : aProxies) {
+      if (iProxy == AabbTree::NULL_NODE)
+        continue;
+      BoundingBox box;
+      tree.GetFatBox(iProxy, &box);
+      m_aBoxes.push_back(box);
+      m_aUserData.push_back(tree.GetUserData(iProxy));
+    }
+  }
+
+  std::vector<UINT> QueryFrustum(const XMFLOAT4 *pPlanes) const {
+    std::vector<UINT> aResults;
+    for (size_t i = 0; i < m_aBoxes.size(); ++i) {
+      const BoundingBox &box = m_aBoxes[i];
+      bool bOutside = false;
+      for (int p = 0; p < 6 && !bOutside; ++p) {
+        const XMFLOAT4 &P = pPlanes[p];
+        float fDist = box.Center.x * P.x + box.Center.y * P.y + box.Center.z * P.z + P.w;
+        float fRadius = box.Extents.x * fabsf(P.x) + box.Extents.y * fabsf(P.y) + box.Extents.z * fabsf(P.z);
+        bOutside = fDist > fRadius;
+      }
+      if (!bOutside)
+        aResults.push_back(m_aUserData[i]);
+    }
+    return aResults;
+  }
+
+  std::vector<UINT> QuerySphere(const BoundingSphere &sphere) const {
+    std::vector<UINT> aResults;
+    for (size_t i = 0; i < m_aBoxes.size(); ++i) {
+      if (m_aBoxes[i].Intersects(sphere))
+        aResults.push_back(m_aUserData[i]);
+    }
+    return aResults;
+  }
+
+  // Distance to the nearest box hit, FLT_MAX on a miss
+  float RayCast(const XMFLOAT3 &vOrigin, const XMFLOAT3 &vDirection) const {
+    float fNearest = FLT_MAX, fDist;
+    for (const auto &box : m_aBoxes) {
+      if (box.Intersects(XMLoadFloat3(&vOrigin), XMLoadFloat3(&vDirection), fDist))
+        fNearest = (std::min)(fNearest, fDist);
+    }
+    return fNearest;
+  }
+
+  const BoundingBox *Find(UINT uUserData) const {
+    auto it = std::find(m_aUserData.begin(), m_aUserData.end(), uUserData);
+    return it == m_aUserData.end() ? nullptr : &m_aBoxes[it - m_aUserData.begin()];
+  }
+
+private:
+  std::vector<BoundingBox> m_aBoxes;
+  std::vector<UINT> m_aUserData;
+};
+
+std::vector<UINT> Sorted(std::vector<UINT> a) {
+  std::sort(a.begin(), a.end());
+  return a;
+}
+
+// Every query of the tree against the brute force one over the same fat boxes
+void CheckQueries(const AabbTree &tree, const std::vector<int> &aProxies, std::mt19937 *pRng) {
+  FatBoxes fatBoxes;
+  std::vector<BoundingSphere> aSpheres;
+  std::vector<XMFLOAT3> aRayDirs;
+  std::vector<UINT> aResults;
+
+  fatBoxes.Gather(tree, aProxies);
+  GenerateQueries(50, pRng, &aSpheres, &aRayDirs);
+
+  for (int i = 0; i < 8; ++i) {
+    SDKMESH_FRUSTUM frustum;
+    GetFrustum(i * XM_PIDIV4, &frustum);
+    aResults.clear();
+    tree.QueryFrustum(frustum.Planes, &aResults);
+    CHECK(Sorted(aResults) == Sorted(fatBoxes.QueryFrustum(frustum.Planes)));
+  }
+
+  for (const auto &sphere : aSpheres) {
+    aResults.clear();
+    tree.QuerySphere(sphere, &aResults);
+    CHECK(Sorted(aResults) == Sorted(fatBoxes.QuerySphere(sphere)));
+  }
+
+  for (const auto &vDir : aRayDirs) {
+    UINT uUserData;
+    float fDist, fNearest = fatBoxes.RayCast(s_vEye, vDir);
+
+    if (!tree.RayCast(s_vEye, vDir, FLT_MAX, &uUserData, &fDist)) {
+      CHECK(fNearest == FLT_MAX);
+      continue;
+    }
+
+    // Ties aside the leaf is the nearest one, and it is hit where the tree says
+    const BoundingBox *pBox = fatBoxes.Find(uUserData);
+    float fBoxDist = 0.0f;
+    REQUIRE(pBox);
+    CHECK(pBox->Intersects(XMLoadFloat3(&s_vEye), XMLoadFloat3(&vDir), fBoxDist));
+    CHECK(fabsf(fDist - fNearest) <= 1e-3f * (std::max)(1.0f, fNearest));
+    CHECK(fabsf(fBoxDist - fDist) <= 1e-3f * (std::max)(1.0f, fDist));
+  }
+}
+
+double GetElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+TEST_CASE(AabbTree, InsertRemoveRefit) {
+  const UINT uCount = 2000;
+  std::mt19937 rng(1234);
+  std::vector<BoundingBox> aBoxes(uCount);
+  std::vector<int> aProxies(uCount);
+  AabbTree tree;
+
+  tree.SetFatMargin(1.0f);
+  for (UINT i = 0; i < uCount; ++i) {
+    aBoxes[i] = GenerateBox(&rng);
+    aProxies[i] = tree.Insert(aBoxes[i], i);
+  }
+  CHECK(tree.GetProxyCount() == uCount);
+  // Balanced by the rotations, well below a list
+  CHECK(tree.GetHeight() < 32);
+  for (UINT i = 0; i < uCount; ++i)
+    CHECK(tree.GetUserData(aProxies[i]) == i);
+  CheckQueries(tree, aProxies, &rng);
+
+  // Every other leaf removed
+  for (UINT i = 0; i < uCount; i += 2) {
+    tree.Remove(aProxies[i]);
+    aProxies[i] = AabbTree::NULL_NODE;
+  }
+  CHECK(tree.GetProxyCount() == uCount / 2);
+  CheckQueries(tree, aProxies, &rng);
+
+  // Moves within the margin keep the fat box, larger ones reinsert the leaf
+  const XMFLOAT3 vNoDisplacement(0.0f, 0.0f, 0.0f);
+  BoundingBox box = aBoxes[1];
+  box.Center.x += 0.5f;
+  CHECK(!tree.Move(aProxies[1], box, vNoDisplacement));
+  box.Center.x += 50.0f;
+  CHECK(tree.Move(aProxies[1], box, vNoDisplacement));
+  BoundingBox fatBox;
+  tree.GetFatBox(aProxies[1], &fatBox);
+  CHECK(fabsf(fatBox.Center.x - box.Center.x) < 1e-3f);
+  CheckQueries(tree, aProxies, &rng);
+
+  // The leaves moved in bulk, the topology kept and the nodes refitted
+  for (UINT i = 1; i < uCount; i += 2) {
+    aBoxes[i].Center.y += 100.0f;
+    tree.SetLeafBox(aProxies[i], aBoxes[i]);
+  }
+  tree.Refit();
+  for (UINT i = 1; i < uCount; i += 2) {
+    tree.GetFatBox(aProxies[i], &fatBox);
+    CHECK(fabsf(fatBox.Center.y - aBoxes[i].Center.y) < 1e-3f);
+  }
+  CheckQueries(tree, aProxies, &rng);
+
+  // The same leaves after a rebuild
+  const float fCost = tree.GetCost();
+  tree.Rebuild();
+  CHECK(tree.GetProxyCount() == uCount / 2);
+  CHECK(tree.GetCost() <= fCost * 1.01f);
+  CHECK(!tree.RebuildIfDegraded());
+  CheckQueries(tree, aProxies, &rng);
+}
+
+TEST_CASE(AabbTree, ParallelFrustumQueryMatchesSerial) {
+  const UINT uCount = 5000;
+  std::mt19937 rng(5678);
+  AabbTree tree;
+  JobSystem jobSystem;
+  SDKMESH_FRUSTUM frustum;
+  std::vector<UINT> aSerial, aParallel;
+
+  jobSystem.Initialize(3);
+  for (UINT i = 0; i < uCount; ++i)
+    tree.Insert(GenerateBox(&rng), i);
+
+  GetFrustum(0.0f, &frustum);
+  tree.QueryFrustum(frustum.Planes, &aSerial);
+  tree.QueryFrustumParallel(frustum.Planes, &jobSystem, &aParallel);
+  CHECK(Sorted(aParallel) == Sorted(aSerial));
+
+  aParallel.clear();
+  tree.QueryFrustumParallel(frustum.Planes, nullptr, &aParallel);
+  CHECK(Sorted(aParallel) == Sorted(aSerial));
+}
+
+// Times the tree against the equivalent linear scans at growing instance counts; the tree
+// costs should grow with the result size rather than the instance count
+TEST_CASE(AabbTree, QueryBenchmark) {
+  const UINT uMaxObjects = s_aBenchmarkSizes[sizeof(s_aBenchmarkSizes) / sizeof(s_aBenchmarkSizes[0]) - 1];
+  std::mt19937 rng(1234);
+  std::vector<BoundingBox> aBoxes(uMaxObjects);
+  std::vector<BoundingSphere> aSpheres;
+  std::vector<XMFLOAT3> aRayDirs;
+  std::vector<UINT> aResults;
+  SDKMESH_FRUSTUM frustum;
+  FrustumCuller culler;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize();
+  for (auto &box : aBoxes)
+    box = GenerateBox(&rng);
+  GenerateQueries(s_uBenchmarkQueries, &rng, &aSpheres, &aRayDirs);
+  GetFrustum(0.0f, &frustum);
+  aResults.reserve(uMaxObjects);
+
+  for (UINT uNumObjects : s_aBenchmarkSizes) {
+    double aMs[s_iNumBenchmarkItems];
+    AabbTree tree;
+    UINT uUserData, uSphereHits = 0, uTreeSphereHits = 0, uRayHits = 0, uTreeRayHits = 0;
+    float fDist;
+    size_t uSerialCount;
+
+    auto start = std::chrono::steady_clock::now();
+    for (UINT j = 0; j < uNumObjects; ++j)
+      tree.Insert(aBoxes[j], j);
+    aMs[0] = GetElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    tree.Rebuild();
+    aMs[1] = GetElapsedMs(start);
+
+    culler.Resize(uNumObjects);
+    for (UINT j = 0; j < uNumObjects; ++j)
+      culler.SetBox(j, aBoxes[j]);
+
+    aResults.resize(uNumObjects);
+    start = std::chrono::steady_clock::now();
+    culler.Cull(frustum.Planes, 0, uNumObjects, aResults.data());
+    aMs[2] = GetElapsedMs(start);
+
+    aResults.clear();
+    start = std::chrono::steady_clock::now();
+    tree.QueryFrustum(frustum.Planes, &aResults);
+    aMs[3] = GetElapsedMs(start);
+    uSerialCount = aResults.size();
+
+    aResults.clear();
+    start = std::chrono::steady_clock::now();
+    tree.QueryFrustumParallel(frustum.Planes, &jobSystem, &aResults);
+    aMs[4] = GetElapsedMs(start);
+    CHECK(aResults.size() == uSerialCount);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &sphere : aSpheres) {
+      for (UINT j = 0; j < uNumObjects; ++j)
+        uSphereHits += aBoxes[j].Intersects(sphere);
+    }
+    aMs[5] = GetElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &sphere : aSpheres) {
+      aResults.clear();
+      tree.QuerySphere(sphere, &aResults);
+      uTreeSphereHits += (UINT)aResults.size();
+    }
+    aMs[6] = GetElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &vDir : aRayDirs) {
+      float fNearest = FLT_MAX;
+      for (UINT j = 0; j < uNumObjects; ++j) {
+        if (aBoxes[j].Intersects(XMLoadFloat3(&s_vEye), XMLoadFloat3(&vDir), fDist) && fNearest > fDist)
+          fNearest = fDist;
+      }
+      uRayHits += fNearest < FLT_MAX;
+    }
+    aMs[7] = GetElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &vDir : aRayDirs)
+      uTreeRayHits += tree.RayCast(s_vEye, vDir, FLT_MAX, &uUserData, &fDist);
+    aMs[8] = GetElapsedMs(start);
+
+    // The tree tests the fattened boxes, so it may only find more
+    CHECK(uTreeSphereHits >= uSphereHits);
+    CHECK(uTreeRayHits >= uRayHits);
+
+    printf("  %u instances, tree height %d, %u queries:\n", uNumObjects, tree.GetHeight(), s_uBenchmarkQueries);
+    for (int j = 0; j < s_iNumBenchmarkItems; ++j)
+      printf("    %s: %.3f ms\n", s_aBenchmarkItems[j], aMs[j]);
+    printf("    hits: spheres linear %u, tree %u; rays linear %u, tree %u\n", uSphereHits, uTreeSphereHits, uRayHits,
+           uTreeRayHits);
+  }
+}
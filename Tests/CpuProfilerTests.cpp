@@ -0,0 +1,207 @@
+#include "TestHarness.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+const char *s_pTraceFileName = "CpuProfilerTests.json";
+
+// The overhead benchmark: markers timed back to back, best of the repeats. They fit in the
+// buffer of one thread, so none is dropped.
+const uint32_t s_uBenchmarkMarkers = 1 << 14;
+const int s_iBenchmarkRepeats = 5;
+const char *s_aBenchmarkPaths[] = {"Capture off", "Capture on"};
+const int s_iNumBenchmarkPaths = sizeof(s_aBenchmarkPaths) / sizeof(s_aBenchmarkPaths[0]);
+// Ten times the target of about 50 ns a marker, slack for loaded machines
+const double s_fMaxMarkerNs = 500.0;
+
+struct TRACE_EVENT {
+  std::string Name;
+  unsigned uThread;
+  double fStartUs;
+  double fDurationUs;
+};
+
+std::string ReadFile(const char *pFileName) {
+  std::string text;
+  FILE *fp;
+  char buffer[4096];
+  size_t uRead;
+
+#if defined(_MSC_VER)
+  if (fopen_s(&fp, pFileName, "r") != 0)
+    fp = nullptr;
+#else
+  fp = fopen(pFileName, "r");
+#endif
+  if (fp == nullptr)
+    return text;
+  while ((uRead = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    text.append(buffer, uRead);
+  fclose(fp);
+  return text;
+}
+
+// The exporter writes one event a line, so the duration events are read back line by line
+std::vector<TRACE_EVENT> ParseCompleteEvents(const std::string &trace) {
+  std::vector<TRACE_EVENT> aEvents;
+  size_t uLine = 0;
+
+  while (uLine < trace.size()) {
+    size_t uEnd = trace.find('\n', uLine);
+    std::string line = trace.substr(uLine, uEnd == std::string::npos ? std::string::npos : uEnd - uLine);
+    size_t uPhase = line.find("\",\"ph\":\"X\"");
+    uLine = uEnd == std::string::npos ? trace.size() : uEnd + 1;
+
+    TRACE_EVENT event;
+    if (line.compare(0, 9, "{\"name\":\"") != 0 || uPhase == std::string::npos ||
+        sscanf(line.c_str() + uPhase, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lf,\"dur\":%lf}", &event.uThread,
+               &event.fStartUs, &event.fDurationUs) != 3)
+      continue;
+    event.Name = line.substr(9, uPhase - 9);
+    aEvents.push_back(event);
+  }
+  return aEvents;
+}
+
+const TRACE_EVENT *FindEvent(const std::vector<TRACE_EVENT> &aEvents, const char *pName) {
+  for (const auto &event : aEvents) {
+    if (event.Name == pName)
+      return &event;
+  }
+  return nullptr;
+}
+
+void Spin(std::chrono::microseconds duration) {
+  auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end)
+    ;
+}
+
+double GetElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+TEST_CASE(CpuProfiler, NestedScopesAreRecordedInsideOut) {
+  CpuProfiler::BeginCapture();
+  {
+    CPU_PROFILE_SCOPE("Outer");
+    Spin(std::chrono::microseconds(50));
+    {
+      CPU_PROFILE_SCOPE("Inner");
+      Spin(std::chrono::microseconds(50));
+    }
+    {
+      CPU_PROFILE_SCOPE("Second inner");
+      Spin(std::chrono::microseconds(50));
+    }
+    Spin(std::chrono::microseconds(50));
+  }
+  CpuProfiler::EndCapture();
+
+  // Not recorded, the capture ended
+  { CPU_PROFILE_SCOPE("After the capture"); }
+
+  REQUIRE(CpuProfiler::GetEventCount() == 3);
+  CHECK(CpuProfiler::GetDroppedEventCount() == 0);
+  REQUIRE(CpuProfiler::ExportChromeTrace(s_pTraceFileName));
+  std::vector<TRACE_EVENT> aEvents = ParseCompleteEvents(ReadFile(s_pTraceFileName));
+  remove(s_pTraceFileName);
+
+  // A scope is recorded as it closes, the inner ones first
+  REQUIRE(aEvents.size() == 3);
+  CHECK(aEvents[0].Name == "Inner");
+  CHECK(aEvents[1].Name == "Second inner");
+  CHECK(aEvents[2].Name == "Outer");
+
+  const TRACE_EVENT &outer = aEvents[2];
+  for (int i = 0; i < 2; ++i) {
+    CHECK(aEvents[i].uThread == outer.uThread);
+    CHECK(aEvents[i].fStartUs >= outer.fStartUs);
+    CHECK(aEvents[i].fStartUs + aEvents[i].fDurationUs <= outer.fStartUs + outer.fDurationUs);
+  }
+  CHECK(aEvents[0].fStartUs + aEvents[0].fDurationUs <= aEvents[1].fStartUs);
+  CHECK(outer.fDurationUs >= 200.0);
+}
+
+TEST_CASE(CpuProfiler, ChromeTraceOutput) {
+  // Nothing to write while the capture runs
+  CpuProfiler::BeginCapture();
+  CHECK(!CpuProfiler::ExportChromeTrace(s_pTraceFileName));
+
+  {
+    // Opened before the capture, so left out of the trace
+    CpuProfiler::EndCapture();
+    CPU_PROFILE_SCOPE("Opened before");
+    CpuProfiler::BeginCapture();
+    CPU_PROFILE_SCOPE("Quote \" and backslash \\");
+  }
+  std::thread worker([]() {
+    CpuProfiler::SetThreadName("Profiler \"worker\"");
+    CPU_PROFILE_SCOPE("Worker scope");
+  });
+  worker.join();
+  CpuProfiler::EndCapture();
+
+  REQUIRE(CpuProfiler::ExportChromeTrace(s_pTraceFileName));
+  std::string trace = ReadFile(s_pTraceFileName);
+  remove(s_pTraceFileName);
+
+  const char *pHeader = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  CHECK(trace.compare(0, strlen(pHeader), pHeader) == 0);
+  CHECK(trace.size() >= 4 && trace.compare(trace.size() - 4, 4, "\n]}\n") == 0);
+  CHECK(std::count(trace.begin(), trace.end(), '{') == std::count(trace.begin(), trace.end(), '}'));
+
+  // Strings are escaped, and every thread that recorded is named
+  std::vector<TRACE_EVENT> aEvents = ParseCompleteEvents(trace);
+  REQUIRE(aEvents.size() == 2);
+  const TRACE_EVENT *pQuoted = FindEvent(aEvents, "Quote \\\" and backslash \\\\");
+  const TRACE_EVENT *pWorker = FindEvent(aEvents, "Worker scope");
+  REQUIRE(pQuoted && pWorker);
+  CHECK(pQuoted->uThread != pWorker->uThread);
+  CHECK(pQuoted->fStartUs >= 0.0);
+  CHECK(trace.find("\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(pWorker->uThread) +
+                   ",\"args\":{\"name\":\"Profiler \\\"worker\\\"\"}}") != std::string::npos);
+  CHECK(trace.find("Opened before") == std::string::npos);
+}
+
+// Times a marker with the capture off, where it only reads the flag, and on, where it also
+// reads the time stamp counter twice and appends an event
+TEST_CASE(CpuProfiler, MarkerOverhead) {
+  double aBestNs[s_iNumBenchmarkPaths];
+
+  for (int j = 0; j < s_iNumBenchmarkPaths; ++j) {
+    const bool bCapture = j == 1;
+    aBestNs[j] = 1e30;
+
+    for (int r = 0; r < s_iBenchmarkRepeats; ++r) {
+      // Every capture starts with an empty buffer
+      if (bCapture)
+        CpuProfiler::BeginCapture();
+
+      auto start = std::chrono::steady_clock::now();
+      for (uint32_t k = 0; k < s_uBenchmarkMarkers; ++k) {
+        CPU_PROFILE_SCOPE("Profiler benchmark");
+      }
+      double fNs = GetElapsedMs(start) * 1e6 / s_uBenchmarkMarkers;
+
+      if (bCapture) {
+        CpuProfiler::EndCapture();
+        CHECK(CpuProfiler::GetEventCount() == s_uBenchmarkMarkers);
+        CHECK(CpuProfiler::GetDroppedEventCount() == 0);
+      }
+      aBestNs[j] = (std::min)(aBestNs[j], fNs);
+    }
+    CHECK(aBestNs[j] < s_fMaxMarkerNs);
+  }
+
+  printf("  %u markers:", s_uBenchmarkMarkers);
+  for (int j = 0; j < s_iNumBenchmarkPaths; ++j)
+    printf(" %s %.1f ns/marker%s", s_aBenchmarkPaths[j], aBestNs[j], j + 1 < s_iNumBenchmarkPaths ? "," : "\n");
+}
@@ -0,0 +1,69 @@
+#include "TestHarness.h"
+#include "DepthRasterizer.h"
+
+using namespace DirectX;
+
+namespace {
+// A camera at the origin looking down +z, 90 degrees wide, so the screen spans x and y in
+// [-z, z] at distance z
+XMMATRIX GetViewProj() {
+  return XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.1f, 100.0f);
+}
+
+// Rasterizes the quad [fX0, fX1] x [-20, 20] at distance fZ
+void RasterizeQuad(DepthRasterizer *pRasterizer, float fX0, float fX1, float fZ) {
+  const XMFLOAT3 aPositions[] = {{fX0, -20.0f, fZ}, {fX1, -20.0f, fZ}, {fX1, 20.0f, fZ}, {fX0, 20.0f, fZ}};
+  const UINT aIndices[] = {0, 1, 2, 0, 2, 3};
+
+  pRasterizer->Clear();
+  pRasterizer->RasterizeTriangles(aPositions, 4, aIndices, 6, GetViewProj());
+  pRasterizer->UpdateTileDepths();
+}
+} // namespace
+
+TEST_CASE(DepthRasterizer, BoxBehindAQuadIsCulled) {
+  DepthRasterizer rasterizer;
+  rasterizer.Resize(64, 64);
+  RasterizeQuad(&rasterizer, -20.0f, 20.0f, 5.0f);
+
+  BoundingBox box(XMFLOAT3(0.0f, 0.0f, 10.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+  CHECK(!rasterizer.IsVisible(box, GetViewProj()));
+
+  // In front of the quad it is not
+  box.Center.z = 3.0f;
+  CHECK(rasterizer.IsVisible(box, GetViewProj()));
+}
+
+TEST_CASE(DepthRasterizer, PartlyUncoveredBoxIsVisible) {
+  DepthRasterizer rasterizer;
+  rasterizer.Resize(64, 64);
+  // Covers the left half of the screen only
+  RasterizeQuad(&rasterizer, -20.0f, 0.0f, 5.0f);
+
+  BoundingBox box(XMFLOAT3(0.0f, 0.0f, 10.0f), XMFLOAT3(2.0f, 2.0f, 1.0f));
+  CHECK(rasterizer.IsVisible(box, GetViewProj()));
+
+  // Moved left it is entirely behind the quad
+  box.Center.x = -6.0f;
+  CHECK(!rasterizer.IsVisible(box, GetViewProj()));
+}
+
+TEST_CASE(DepthRasterizer, BoxCrossingTheNearPlaneStaysVisible) {
+  DepthRasterizer rasterizer;
+  rasterizer.Resize(64, 64);
+  RasterizeQuad(&rasterizer, -20.0f, 20.0f, 5.0f);
+
+  // Reaches behind the camera and through the quad
+  BoundingBox box(XMFLOAT3(0.0f, 0.0f, 3.0f), XMFLOAT3(1.0f, 1.0f, 4.0f));
+  CHECK(rasterizer.IsVisible(box, GetViewProj()));
+
+  // A quad crossing the near plane is dropped rather than clipped, so it hides nothing
+  const XMFLOAT3 aPositions[] = {{-20.0f, -1.0f, -1.0f}, {20.0f, -1.0f, -1.0f}, {20.0f, 1.0f, 50.0f},
+                                 {-20.0f, 1.0f, 50.0f}};
+  const UINT aIndices[] = {0, 1, 2, 0, 2, 3};
+  rasterizer.Clear();
+  rasterizer.RasterizeTriangles(aPositions, 4, aIndices, 6, GetViewProj());
+  rasterizer.UpdateTileDepths();
+  box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 60.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+  CHECK(rasterizer.IsVisible(box, GetViewProj()));
+}
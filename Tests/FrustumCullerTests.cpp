@@ -0,0 +1,193 @@
+#include "TestHarness.h"
+#include "FrustumCuller.h"
+#include "SDKmeshPackets.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace DirectX;
+
+namespace {
+// The culling benchmark: object counts, and the paths timed against each other
+const UINT s_aBenchmarkSizes[] = {10000, 100000, 1000000};
+const char *s_aBenchmarkPaths[] = {"BoundingBox::Intersects", "SoA scalar", "SoA SSE", "SoA AVX2"};
+const int s_iNumBenchmarkPaths = sizeof(s_aBenchmarkPaths) / sizeof(s_aBenchmarkPaths[0]);
+
+// Boxes scattered around the origin, seen from z = -fDistance looking down +z
+const float s_fSceneRadius = 600.0f;
+const float s_fCameraDistance = 900.0f;
+
+XMMATRIX GetViewProj() {
+  return XMMatrixTranslation(0.0f, 0.0f, s_fCameraDistance) *
+         XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 2000.0f);
+}
+
+void GenerateBoxes(UINT uCount, std::mt19937 *pRng, std::vector<BoundingBox> *pBoxes) {
+  std::uniform_real_distribution<float> posDist(-s_fSceneRadius, s_fSceneRadius);
+  std::uniform_real_distribution<float> extentDist(0.5f, 10.0f);
+
+  pBoxes->resize(uCount);
+  for (auto &box : *pBoxes) {
+    box.Center = XMFLOAT3(posDist(*pRng), posDist(*pRng), posDist(*pRng));
+    box.Extents = XMFLOAT3(extentDist(*pRng), extentDist(*pRng), extentDist(*pRng));
+  }
+}
+
+// Moves every other box onto one of the planes, so that it straddles it
+void StraddlePlanes(const SDKMESH_FRUSTUM &frustum, std::vector<BoundingBox> *pBoxes) {
+  for (size_t i = 0; i < pBoxes->size(); i += 2) {
+    const XMFLOAT4 &P = frustum.Planes[(i / 2) % 6];
+    XMFLOAT3 &c = (*pBoxes)[i].Center;
+    float fDist = c.x * P.x + c.y * P.y + c.z * P.z + P.w;
+    c = XMFLOAT3(c.x - fDist * P.x, c.y - fDist * P.y, c.z - fDist * P.z);
+  }
+}
+
+// Whether the center of the box is on the inner side of every plane, such a box is never culled
+bool IsCenterInside(const SDKMESH_FRUSTUM &frustum, const BoundingBox &box) {
+  for (const XMFLOAT4 &P : frustum.Planes) {
+    if ((double)box.Center.x * P.x + (double)box.Center.y * P.y + (double)box.Center.z * P.z + P.w > 1e-3)
+      return false;
+  }
+  return true;
+}
+
+FrustumCuller::KERNEL GetKernel(int iPath) {
+  return static_cast<FrustumCuller::KERNEL>(FrustumCuller::KERNEL_SCALAR + iPath);
+}
+
+double GetElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+TEST_CASE(FrustumCuller, KernelsAgree) {
+  // Neither multiples of 4 nor of 8, so every kernel runs a partial group
+  const UINT aCounts[] = {1, 3, 5, 7, 13, 29, 1003};
+  const UINT aFirsts[] = {0, 1, 3};
+  std::mt19937 rng(1234);
+  SDKMESH_FRUSTUM frustum;
+  std::vector<BoundingBox> aBoxes;
+
+  frustum.CreateFromMatrix(GetViewProj());
+
+  for (UINT uCount : aCounts) {
+    GenerateBoxes(uCount, &rng, &aBoxes);
+    StraddlePlanes(frustum, &aBoxes);
+
+    FrustumCuller culler;
+    culler.Resize(uCount);
+    for (UINT i = 0; i < uCount; ++i)
+      culler.SetBox(i, aBoxes[i]);
+
+    for (UINT uFirst : aFirsts) {
+      if (uFirst >= uCount)
+        continue;
+
+      std::vector<UINT> aVisible[3];
+      for (int k = 0; k < 3; ++k) {
+        aVisible[k].resize(uCount);
+        aVisible[k].resize(culler.Cull(frustum.Planes, uFirst, uCount, aVisible[k].data(), GetKernel(k)));
+      }
+      CHECK(aVisible[1] == aVisible[0]);
+      CHECK(aVisible[2] == aVisible[0]);
+
+      // Nor do they cull a box straddling a face of the frustum
+      for (UINT i = uFirst; i < uCount; i += 2) {
+        if (IsCenterInside(frustum, aBoxes[i]))
+          CHECK(std::find(aVisible[0].begin(), aVisible[0].end(), i) != aVisible[0].end());
+      }
+    }
+  }
+}
+
+TEST_CASE(FrustumCuller, ViewKernelsAgree) {
+  const UINT uCount = 1003;
+  const UINT uNumViews = 3;
+  std::mt19937 rng(5678);
+  SDKMESH_FRUSTUM aFrustums[uNumViews];
+  XMFLOAT4 aPlanes[6 * uNumViews];
+  std::vector<BoundingBox> aBoxes;
+
+  // The same camera turned, so that the views overlap partly
+  for (UINT v = 0; v < uNumViews; ++v) {
+    aFrustums[v].CreateFromMatrix(XMMatrixRotationY(v * 0.5f) * GetViewProj());
+    std::copy(aFrustums[v].Planes, aFrustums[v].Planes + 6, aPlanes + 6 * v);
+  }
+
+  GenerateBoxes(uCount, &rng, &aBoxes);
+  StraddlePlanes(aFrustums[0], &aBoxes);
+
+  FrustumCuller culler;
+  culler.Resize(uCount);
+  for (UINT i = 0; i < uCount; ++i)
+    culler.SetBox(i, aBoxes[i]);
+
+  std::vector<UINT> aMasks[3];
+  for (int k = 0; k < 3; ++k) {
+    aMasks[k].resize(uCount);
+    culler.CullViews(aPlanes, uNumViews, 0, uCount, aMasks[k].data(), GetKernel(k));
+  }
+  CHECK(aMasks[1] == aMasks[0]);
+  CHECK(aMasks[2] == aMasks[0]);
+
+  // A view's bit matches the single view cull
+  std::vector<UINT> aVisible(uCount);
+  for (UINT v = 0; v < uNumViews; ++v) {
+    aVisible.resize(uCount);
+    aVisible.resize(culler.Cull(aFrustums[v].Planes, 0, uCount, aVisible.data(), FrustumCuller::KERNEL_SCALAR));
+    UINT uNumSet = 0;
+    for (UINT i = 0; i < uCount; ++i)
+      uNumSet += (aMasks[0][i] >> v) & 1;
+    CHECK(uNumSet == aVisible.size());
+  }
+}
+
+// Times the SoA culler kernels against per-object DirectX::BoundingBox::Intersects on
+// random boxes scattered in front of the camera
+TEST_CASE(FrustumCuller, CullBenchmark) {
+  const UINT uMaxObjects = s_aBenchmarkSizes[sizeof(s_aBenchmarkSizes) / sizeof(s_aBenchmarkSizes[0]) - 1];
+  std::mt19937 rng(1234);
+  std::vector<BoundingBox> aBoxes;
+  std::vector<UINT> aVisible(uMaxObjects);
+  FrustumCuller culler;
+  SDKMESH_FRUSTUM frustum;
+  BoundingFrustum viewFrustum;
+
+  GenerateBoxes(uMaxObjects, &rng, &aBoxes);
+
+  frustum.CreateFromMatrix(GetViewProj());
+  BoundingFrustum::CreateFromMatrix(viewFrustum, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 2000.0f));
+  viewFrustum.Transform(viewFrustum, XMMatrixTranslation(0.0f, 0.0f, -s_fCameraDistance));
+
+  for (UINT uNumObjects : s_aBenchmarkSizes) {
+    double aMs[s_iNumBenchmarkPaths];
+    UINT aNumVisible[s_iNumBenchmarkPaths];
+
+    culler.Resize(uNumObjects);
+    for (UINT j = 0; j < uNumObjects; ++j)
+      culler.SetBox(j, aBoxes[j]);
+
+    // Intersects also runs the separating axis test, so it may reject a few more boxes
+    auto start = std::chrono::steady_clock::now();
+    aNumVisible[0] = 0;
+    for (UINT j = 0; j < uNumObjects; ++j) {
+      if (viewFrustum.Intersects(aBoxes[j]))
+        aVisible[aNumVisible[0]++] = j;
+    }
+    aMs[0] = GetElapsedMs(start);
+
+    for (int j = 1; j < s_iNumBenchmarkPaths; ++j) {
+      start = std::chrono::steady_clock::now();
+      aNumVisible[j] = culler.Cull(frustum.Planes, 0, uNumObjects, aVisible.data(), GetKernel(j - 1));
+      aMs[j] = GetElapsedMs(start);
+      CHECK(aNumVisible[j] == aNumVisible[1]);
+    }
+    CHECK(aNumVisible[0] <= aNumVisible[1]);
+
+    printf("  %u objects, %u visible:", uNumObjects, aNumVisible[1]);
+    for (int j = 0; j < s_iNumBenchmarkPaths; ++j)
+      printf(" %s %.3f ms%s", s_aBenchmarkPaths[j], aMs[j], j + 1 < s_iNumBenchmarkPaths ? "," : "");
+    printf("%s\n", FrustumCuller::IsAVX2Supported() ? "" : " (AVX2 unsupported, ran SSE)");
+  }
+}
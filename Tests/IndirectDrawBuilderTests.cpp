@@ -0,0 +1,109 @@
+#include "TestHarness.h"
+#include "IndirectDrawBuilder.h"
+#include <cstddef>
+
+namespace {
+D3D12_VERTEX_BUFFER_VIEW MakeVBV(D3D12_GPU_VIRTUAL_ADDRESS Location) {
+  return {Location, 0x10000, 32};
+}
+
+D3D12_INDEX_BUFFER_VIEW MakeIBV(D3D12_GPU_VIRTUAL_ADDRESS Location) {
+  return {Location, 0x10000, DXGI_FORMAT_R32_UINT};
+}
+} // namespace
+
+TEST_CASE(IndirectDrawBuilder, StrideMatchesTheSignature) {
+  D3D12_INDIRECT_ARGUMENT_DESC aDescs[IndirectDrawBuilder::NUM_ARGUMENT_DESCS];
+  IndirectDrawBuilder::GetArgumentDescs(5, aDescs);
+
+  // The arguments follow each other in the order of the descs without padding
+  const size_t aOffsets[] = {offsetof(INDIRECT_DRAW_ARGS, VBV), offsetof(INDIRECT_DRAW_ARGS, IBV),
+                             offsetof(INDIRECT_DRAW_ARGS, RootConstant), offsetof(INDIRECT_DRAW_ARGS, Draw)};
+  size_t uStride = 0;
+  for (UINT i = 0; i < IndirectDrawBuilder::NUM_ARGUMENT_DESCS; ++i) {
+    CHECK(aOffsets[i] == uStride);
+    switch (aDescs[i].Type) {
+    case D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW:
+      uStride += sizeof(D3D12_VERTEX_BUFFER_VIEW);
+      break;
+    case D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW:
+      uStride += sizeof(D3D12_INDEX_BUFFER_VIEW);
+      break;
+    case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT:
+      CHECK(aDescs[i].Constant.RootParameterIndex == 5);
+      uStride += aDescs[i].Constant.Num32BitValuesToSet * sizeof(UINT);
+      break;
+    case D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED:
+      uStride += sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
+      break;
+    default:
+      CHECK(!"Unexpected argument type");
+    }
+  }
+  CHECK(sizeof(INDIRECT_DRAW_ARGS) == uStride);
+}
+
+TEST_CASE(IndirectDrawBuilder, ContinuingDrawsMerge) {
+  IndirectDrawBuilder builder;
+
+  builder.SetBuffers(MakeVBV(0x1000), MakeIBV(0x2000));
+  builder.AddDraw(7, 30, 0, 100);
+  builder.AddDraw(7, 60, 30, 100);
+  // The same views set again still continue the draw
+  builder.SetBuffers(MakeVBV(0x1000), MakeIBV(0x2000));
+  builder.AddDraw(7, 90, 90, 100);
+
+  REQUIRE(builder.GetDrawCount() == 1);
+  CHECK(builder.GetAddedDrawCount() == 3);
+
+  const INDIRECT_DRAW_ARGS &args = builder.GetDraws()[0];
+  CHECK(args.VBV.BufferLocation == 0x1000);
+  CHECK(args.IBV.BufferLocation == 0x2000);
+  CHECK(args.RootConstant == 7);
+  CHECK(args.Draw.IndexCountPerInstance == 180);
+  CHECK(args.Draw.StartIndexLocation == 0);
+  CHECK(args.Draw.BaseVertexLocation == 100);
+  CHECK(args.Draw.InstanceCount == 1);
+  CHECK(args.Draw.StartInstanceLocation == 0);
+}
+
+TEST_CASE(IndirectDrawBuilder, DifferingDrawsDoNotMerge) {
+  IndirectDrawBuilder builder;
+
+  builder.SetBuffers(MakeVBV(0x1000), MakeIBV(0x2000));
+  builder.AddDraw(1, 30, 0, 0);
+  builder.AddDraw(2, 30, 30, 0);        // Root constant
+  builder.AddDraw(2, 30, 60, 8);        // Base vertex
+  builder.AddDraw(2, 30, 90, 8, 2);     // Instances
+  builder.AddDraw(2, 30, 120, 8, 2, 4); // First instance
+  builder.AddDraw(2, 30, 180, 8, 2, 4); // Gap in the index range
+  builder.AddDraw(2, 30, 180, 8, 2, 4); // Overlapping index range
+  builder.SetBuffers(MakeVBV(0x3000), MakeIBV(0x2000));
+  builder.AddDraw(2, 30, 210, 8, 2, 4); // Vertex buffer
+  builder.SetBuffers(MakeVBV(0x3000), MakeIBV(0x4000));
+  builder.AddDraw(2, 30, 240, 8, 2, 4); // Index buffer
+
+  CHECK(builder.GetDrawCount() == 9);
+  CHECK(builder.GetAddedDrawCount() == 9);
+}
+
+TEST_CASE(IndirectDrawBuilder, EmptyDrawsAreDropped) {
+  IndirectDrawBuilder builder;
+
+  builder.SetBuffers(MakeVBV(0x1000), MakeIBV(0x2000));
+  builder.AddDraw(0, 0, 0, 0);
+  builder.AddDraw(0, 30, 0, 0, 0);
+  CHECK(builder.GetDrawCount() == 0);
+
+  // Nor do they break a merge
+  builder.AddDraw(0, 30, 0, 0);
+  builder.AddDraw(0, 0, 30, 0);
+  builder.AddDraw(0, 30, 30, 0);
+  REQUIRE(builder.GetDrawCount() == 1);
+  CHECK(builder.GetDraws()[0].Draw.IndexCountPerInstance == 60);
+  CHECK(builder.GetAddedDrawCount() == 5);
+
+  builder.Reset();
+  CHECK(builder.GetDrawCount() == 0);
+  CHECK(builder.GetAddedDrawCount() == 0);
+}
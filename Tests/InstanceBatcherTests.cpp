@@ -0,0 +1,157 @@
+#include "TestHarness.h"
+#include "InstanceBatcher.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+// Never dereferenced, the batcher only compares them
+ID3D12Resource *const s_pPredicationBuffer = reinterpret_cast<ID3D12Resource *>(uintptr_t(0x1000));
+ID3D12Resource *const s_pOtherPredicationBuffer = reinterpret_cast<ID3D12Resource *>(uintptr_t(0x2000));
+ID3D12QueryHeap *const s_pQueryHeap = reinterpret_cast<ID3D12QueryHeap *>(uintptr_t(0x3000));
+
+INSTANCE_DRAW_STATE GetPredicatedState(ID3D12Resource *pBuffer, UINT64 uOffset) {
+  INSTANCE_DRAW_STATE State = {};
+  State.pPredicationBuffer = pBuffer;
+  State.uPredicationOffset = uOffset;
+  State.PredicationOp = D3D12_PREDICATION_OP_EQUAL_ZERO;
+  return State;
+}
+
+INSTANCE_DRAW_STATE GetQueriedState(UINT uQueryIndex) {
+  INSTANCE_DRAW_STATE State = {};
+  State.pQueryHeap = s_pQueryHeap;
+  State.QueryType = D3D12_QUERY_TYPE_OCCLUSION;
+  State.uQueryIndex = uQueryIndex;
+  return State;
+}
+
+// The instance data of every draw is its index in the order of Add
+void AddDraw(InstanceBatcher *pBatcher, UINT uMeshKey, const INSTANCE_DRAW_STATE &State, UINT *puNumDraws) {
+  UINT uData = (*puNumDraws)++;
+  pBatcher->Add(uMeshKey, State, &uData);
+}
+
+UINT GetInstanceData(const InstanceBatcher &batcher, UINT uInstance) {
+  UINT uData;
+  memcpy(&uData, batcher.GetInstanceData() + uInstance * batcher.GetInstanceDataSize(), sizeof(uData));
+  return uData;
+}
+} // namespace
+
+TEST_CASE(InstanceBatcher, GroupsByKeyAndState) {
+  const INSTANCE_DRAW_STATE unpredicated = {};
+  InstanceBatcher batcher;
+  UINT uNumDraws = 0;
+
+  batcher.Begin(sizeof(UINT));
+  AddDraw(&batcher, 1, unpredicated, &uNumDraws);
+  AddDraw(&batcher, 2, unpredicated, &uNumDraws);
+  AddDraw(&batcher, 1, unpredicated, &uNumDraws);
+  AddDraw(&batcher, 1, GetPredicatedState(s_pPredicationBuffer, 0), &uNumDraws);
+  AddDraw(&batcher, 1, GetPredicatedState(s_pPredicationBuffer, 0), &uNumDraws);
+  AddDraw(&batcher, 1, GetPredicatedState(s_pPredicationBuffer, 8), &uNumDraws);      // Offset
+  AddDraw(&batcher, 1, GetPredicatedState(s_pOtherPredicationBuffer, 0), &uNumDraws); // Buffer
+  AddDraw(&batcher, 2, GetPredicatedState(s_pPredicationBuffer, 0), &uNumDraws);      // Key
+  // The offset of an unpredicated draw means nothing, it still joins the first batch
+  INSTANCE_DRAW_STATE unpredicatedOffset = {};
+  unpredicatedOffset.uPredicationOffset = 16;
+  AddDraw(&batcher, 1, unpredicatedOffset, &uNumDraws);
+  batcher.End();
+
+  const UINT aKeys[] = {1, 2, 1, 1, 1, 2};
+  const UINT aNumInstances[] = {3, 1, 2, 1, 1, 1};
+  const UINT uNumBatches = sizeof(aKeys) / sizeof(aKeys[0]);
+  REQUIRE(batcher.GetBatchCount() == uNumBatches);
+  CHECK(batcher.GetInstanceCount() == uNumDraws);
+  for (UINT b = 0; b < uNumBatches; ++b) {
+    CHECK(batcher.GetBatch(b).MeshKey == aKeys[b]);
+    CHECK(batcher.GetBatch(b).NumInstances == aNumInstances[b]);
+  }
+  CHECK(!batcher.GetBatch(0).State.pPredicationBuffer);
+  CHECK(batcher.GetBatch(2).State.uPredicationOffset == 0);
+  CHECK(batcher.GetBatch(3).State.uPredicationOffset == 8);
+  CHECK(batcher.GetBatch(4).State.pPredicationBuffer == s_pOtherPredicationBuffer);
+}
+
+TEST_CASE(InstanceBatcher, QueriedDrawsStayAlone) {
+  InstanceBatcher batcher;
+  UINT uNumDraws = 0;
+
+  batcher.Begin(sizeof(UINT));
+  AddDraw(&batcher, 1, GetQueriedState(0), &uNumDraws);
+  AddDraw(&batcher, 1, GetQueriedState(1), &uNumDraws);
+  // Even with the same query, and next to an unqueried draw of the same key
+  AddDraw(&batcher, 1, GetQueriedState(1), &uNumDraws);
+  AddDraw(&batcher, 1, INSTANCE_DRAW_STATE{}, &uNumDraws);
+  AddDraw(&batcher, 1, INSTANCE_DRAW_STATE{}, &uNumDraws);
+  batcher.End();
+
+  REQUIRE(batcher.GetBatchCount() == 4);
+  for (UINT b = 0; b < 3; ++b) {
+    CHECK(batcher.GetBatch(b).State.pQueryHeap == s_pQueryHeap);
+    CHECK(batcher.GetBatch(b).NumInstances == 1);
+    CHECK(GetInstanceData(batcher, batcher.GetBatch(b).FirstInstance) == b);
+  }
+  CHECK(batcher.GetBatch(1).State.uQueryIndex == 1);
+  CHECK(!batcher.GetBatch(3).State.pQueryHeap);
+  CHECK(batcher.GetBatch(3).NumInstances == 2);
+}
+
+TEST_CASE(InstanceBatcher, BatchesKeepFirstAppearanceOrder) {
+  const UINT aKeys[] = {3, 1, 3, 2, 1, 3, 2};
+  InstanceBatcher batcher;
+  UINT uNumDraws = 0;
+
+  batcher.Begin(sizeof(UINT));
+  for (UINT uKey : aKeys)
+    AddDraw(&batcher, uKey, INSTANCE_DRAW_STATE{}, &uNumDraws);
+  batcher.End();
+
+  REQUIRE(batcher.GetBatchCount() == 3);
+  CHECK(batcher.GetBatch(0).MeshKey == 3);
+  CHECK(batcher.GetBatch(1).MeshKey == 1);
+  CHECK(batcher.GetBatch(2).MeshKey == 2);
+
+  // Without batching every draw is a batch of its own, in the order it was added
+  batcher.End(FALSE);
+  REQUIRE(batcher.GetBatchCount() == uNumDraws);
+  for (UINT b = 0; b < uNumDraws; ++b) {
+    CHECK(batcher.GetBatch(b).MeshKey == aKeys[b]);
+    CHECK(batcher.GetBatch(b).FirstInstance == b);
+    CHECK(batcher.GetBatch(b).NumInstances == 1);
+    CHECK(GetInstanceData(batcher, b) == b);
+  }
+}
+
+TEST_CASE(InstanceBatcher, InstanceDataIsPackedStably) {
+  const UINT aKeys[] = {1, 2, 1, 3, 2, 1, 3, 1};
+  InstanceBatcher batcher;
+  UINT uNumDraws = 0;
+
+  batcher.Begin(sizeof(UINT));
+  for (UINT uKey : aKeys)
+    AddDraw(&batcher, uKey, INSTANCE_DRAW_STATE{}, &uNumDraws);
+  batcher.End();
+
+  // Each batch reads the range right after the previous one, holding the draws of its key
+  // in the order they were added
+  const UINT aExpected[] = {0, 2, 5, 7, 1, 4, 3, 6};
+  UINT uFirstInstance = 0;
+  REQUIRE(batcher.GetBatchCount() == 3);
+  for (UINT b = 0; b < batcher.GetBatchCount(); ++b) {
+    const INSTANCE_BATCH &batch = batcher.GetBatch(b);
+    CHECK(batch.FirstInstance == uFirstInstance);
+    for (UINT i = 0; i < batch.NumInstances; ++i)
+      CHECK(aKeys[GetInstanceData(batcher, batch.FirstInstance + i)] == batch.MeshKey);
+    uFirstInstance += batch.NumInstances;
+  }
+  REQUIRE(uFirstInstance == uNumDraws);
+  for (UINT i = 0; i < uNumDraws; ++i)
+    CHECK(GetInstanceData(batcher, i) == aExpected[i]);
+
+  // Begin drops the previous draws
+  batcher.Begin(sizeof(UINT));
+  batcher.End();
+  CHECK(batcher.GetBatchCount() == 0);
+  CHECK(batcher.GetInstanceCount() == 0);
+}
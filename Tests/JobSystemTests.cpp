@@ -0,0 +1,344 @@
+#include "TestHarness.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// The data a test's jobs touch is declared before its JobSystem, so a failed REQUIRE
+// shuts the system down, running what is left, while that data is still alive.
+
+namespace {
+// Spins without running jobs, so only background threads can bring the counter down
+bool WaitWithoutHelping(const JobCounter &counter) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+  while (!counter.IsDone()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+// Workers notice a new active count the next time they look for work
+void LetWorkersSettle() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+} // namespace
+
+TEST_CASE(JobSystem, DequeContention) {
+  const uint32_t uNumRoots = 64;
+  const uint32_t uNumChildren = 512;
+  std::vector<std::atomic<uint32_t>> aRuns(uNumRoots * uNumChildren);
+  JobCounter counter;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(4);
+
+  // Every root pushes its children on the deque of whichever worker runs it, the owner
+  // pops them while the other workers steal, and deques overflowing run jobs inline
+  for (uint32_t r = 0; r < uNumRoots; ++r) {
+    jobSystem.Run(
+        [&, r]() {
+          for (uint32_t c = 0; c < uNumChildren; ++c)
+            jobSystem.Run([&, r, c]() { aRuns[r * uNumChildren + c].fetch_add(1); }, &counter);
+        },
+        &counter);
+  }
+  jobSystem.Wait(&counter);
+
+  CHECK(counter.IsDone());
+  CHECK(std::all_of(aRuns.begin(), aRuns.end(), [](const std::atomic<uint32_t> &uRuns) { return uRuns == 1; }));
+}
+
+TEST_CASE(JobSystem, StealFromBlockedOwner) {
+  const uint32_t uNumJobs = 1000;
+  std::vector<std::atomic<uint32_t>> aRuns(uNumJobs);
+  std::atomic<uint32_t> uRunByOwner(0);
+  JobCounter counter;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(3);
+
+  // The jobs go on the deque of the initializing thread, which never pops them
+  for (uint32_t i = 0; i < uNumJobs; ++i) {
+    jobSystem.Run(
+        [&, i]() {
+          aRuns[i].fetch_add(1);
+          if (jobSystem.GetCurrentWorkerIndex() == 0)
+            uRunByOwner.fetch_add(1);
+        },
+        &counter);
+  }
+  REQUIRE(WaitWithoutHelping(counter));
+
+  CHECK(uRunByOwner == 0);
+  CHECK(std::all_of(aRuns.begin(), aRuns.end(), [](const std::atomic<uint32_t> &uRuns) { return uRuns == 1; }));
+}
+
+TEST_CASE(JobSystem, ExternalThreadSubmits) {
+  const uint32_t uNumJobs = 2000;
+  std::atomic<uint32_t> uRuns(0);
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(2);
+
+  // Threads outside the system go through the injection queue and still help in Wait
+  std::thread external([&]() {
+    JobCounter counter;
+
+    CHECK(jobSystem.GetCurrentWorkerIndex() == -1);
+    for (uint32_t i = 0; i < uNumJobs; ++i)
+      jobSystem.Run([&]() { uRuns.fetch_add(1); }, &counter);
+    jobSystem.Wait(&counter);
+    CHECK(counter.IsDone());
+  });
+  external.join();
+
+  CHECK(uRuns == uNumJobs);
+}
+
+TEST_CASE(JobSystem, ParallelForGrainAndCoverage) {
+  struct RANGE {
+    uint32_t uBegin;
+    uint32_t uEnd;
+    uint32_t uGrain;
+  };
+  const RANGE aRanges[] = {{0, 0, 1},     {10, 5, 1},     {7, 8, 1},      {0, 1000, 1}, {100, 1100, 7},
+                           {0, 1000, 64}, {3, 1003, 1000}, {0, 4096, 5000}, {0, 500, 0}};
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(3);
+
+  for (const RANGE &range : aRanges) {
+    uint32_t uGrain = (std::max)(range.uGrain, 1u);
+    uint32_t uLength = range.uEnd > range.uBegin ? range.uEnd - range.uBegin : 0;
+    std::vector<std::atomic<uint32_t>> aVisits((std::max)(range.uBegin, range.uEnd));
+    std::atomic<uint32_t> uNumCalls(0);
+
+    jobSystem.ParallelFor(range.uBegin, range.uEnd, range.uGrain, [&](uint32_t uBegin, uint32_t uEnd) {
+      CHECK(uBegin < uEnd);
+      CHECK(uBegin >= range.uBegin && uEnd <= range.uEnd);
+      // Halving stops at the grain, so no piece is under half of it either
+      CHECK(uEnd - uBegin <= uGrain);
+      CHECK(uLength <= uGrain || uEnd - uBegin >= (uGrain + 1) / 2);
+
+      for (uint32_t i = uBegin; i < uEnd; ++i)
+        aVisits[i].fetch_add(1);
+      uNumCalls.fetch_add(1);
+    });
+
+    for (uint32_t i = 0; i < (uint32_t)aVisits.size(); ++i)
+      CHECK(aVisits[i] == (i >= range.uBegin && i < range.uEnd ? 1u : 0u));
+    CHECK(uNumCalls >= (uLength + uGrain - 1) / uGrain);
+  }
+}
+
+TEST_CASE(JobSystem, NestedParallelFor) {
+  const uint32_t uNumRows = 64;
+  const uint32_t uNumColumns = 256;
+  std::vector<std::atomic<uint32_t>> aVisits(uNumRows * uNumColumns);
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(3);
+
+  // The inner loops wait on workers, helping with whatever else is queued
+  jobSystem.ParallelFor(0, uNumRows, 1, [&](uint32_t uRowBegin, uint32_t uRowEnd) {
+    for (uint32_t r = uRowBegin; r < uRowEnd; ++r) {
+      jobSystem.ParallelFor(0, uNumColumns, 16, [&, r](uint32_t uBegin, uint32_t uEnd) {
+        for (uint32_t c = uBegin; c < uEnd; ++c)
+          aVisits[r * uNumColumns + c].fetch_add(1);
+      });
+    }
+  });
+
+  CHECK(std::all_of(aVisits.begin(), aVisits.end(), [](const std::atomic<uint32_t> &uVisits) { return uVisits == 1; }));
+}
+
+TEST_CASE(JobSystem, CountersAndDependencies) {
+  const uint32_t uNumFirst = 8;
+  const uint32_t uNumSecond = 16;
+  const uint32_t uNumThird = 4;
+  std::atomic<bool> bGateOpen(false);
+  std::atomic<uint32_t> uFirstDone(0);
+  std::atomic<uint32_t> uSecondDone(0);
+  std::atomic<uint32_t> uThirdDone(0);
+  JobCounter first;
+  JobCounter second;
+  JobCounter third;
+  JobCounter late;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(3);
+
+  for (uint32_t i = 0; i < uNumFirst; ++i) {
+    jobSystem.Run(
+        [&]() {
+          while (!bGateOpen.load())
+            std::this_thread::yield();
+          uFirstDone.fetch_add(1);
+        },
+        &first);
+  }
+  for (uint32_t i = 0; i < uNumSecond; ++i) {
+    jobSystem.Run(
+        [&]() {
+          CHECK(uFirstDone == uNumFirst);
+          uSecondDone.fetch_add(1);
+        },
+        &second, &first);
+  }
+  for (uint32_t i = 0; i < uNumThird; ++i) {
+    jobSystem.Run(
+        [&]() {
+          CHECK(uSecondDone == uNumSecond);
+          uThirdDone.fetch_add(1);
+        },
+        &third, &second);
+  }
+
+  // Counters are raised when the jobs are queued, dependent jobs are parked meanwhile
+  CHECK(first.GetValue() == uNumFirst);
+  CHECK(second.GetValue() == uNumSecond);
+  CHECK(third.GetValue() == uNumThird);
+  CHECK(uSecondDone == 0 && uThirdDone == 0);
+
+  bGateOpen.store(true);
+  jobSystem.Wait(&third);
+
+  CHECK(first.IsDone() && second.IsDone() && third.IsDone());
+  CHECK(uFirstDone == uNumFirst && uSecondDone == uNumSecond && uThirdDone == uNumThird);
+
+  // A dependency already done does not hold the job back
+  jobSystem.Run([&]() { uThirdDone.fetch_add(1); }, &late, &first);
+  jobSystem.Wait(&late);
+  CHECK(uThirdDone == uNumThird + 1);
+}
+
+TEST_CASE(JobSystem, WaitWhileHelping) {
+  const uint32_t uNumJobs = 100;
+  const uint32_t uNumChildren = 16;
+  std::atomic<uint32_t> uRuns(0);
+  std::atomic<uint32_t> uRunElsewhere(0);
+  JobCounter counter;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(2);
+  jobSystem.SetActiveWorkerCount(0);
+  LetWorkersSettle();
+
+  // Only the waiting thread is left to run the jobs, including those a job waits on
+  for (uint32_t i = 0; i < uNumJobs; ++i) {
+    jobSystem.Run(
+        [&]() {
+          JobCounter children;
+
+          for (uint32_t c = 0; c < uNumChildren; ++c) {
+            jobSystem.Run(
+                [&]() {
+                  uRuns.fetch_add(1);
+                  if (jobSystem.GetCurrentWorkerIndex() != 0)
+                    uRunElsewhere.fetch_add(1);
+                },
+                &children);
+          }
+          jobSystem.Wait(&children);
+          uRuns.fetch_add(1);
+        },
+        &counter);
+  }
+  jobSystem.Wait(&counter);
+
+  CHECK(uRuns == uNumJobs * (uNumChildren + 1));
+  CHECK(uRunElsewhere == 0);
+}
+
+TEST_CASE(JobSystem, SetActiveWorkerCountParking) {
+  const uint32_t uNumJobs = 200;
+  std::mutex workersLock;
+  std::vector<int> aWorkers;
+  JobCounter counter;
+  JobCounter parked;
+  JobCounter unparked;
+  JobSystem jobSystem;
+
+  auto RecordWorker = [&]() {
+    std::lock_guard<std::mutex> lock(workersLock);
+    aWorkers.push_back(jobSystem.GetCurrentWorkerIndex());
+  };
+
+  jobSystem.Initialize(3);
+  CHECK(jobSystem.GetActiveWorkerCount() == 3);
+  jobSystem.SetActiveWorkerCount(100);
+  CHECK(jobSystem.GetActiveWorkerCount() == jobSystem.GetWorkerCount());
+
+  // Only the first background thread takes jobs
+  jobSystem.SetActiveWorkerCount(1);
+  LetWorkersSettle();
+  for (uint32_t i = 0; i < uNumJobs; ++i)
+    jobSystem.Run(RecordWorker, &counter);
+  REQUIRE(WaitWithoutHelping(counter));
+  CHECK(aWorkers.size() == uNumJobs);
+  CHECK(std::all_of(aWorkers.begin(), aWorkers.end(), [](int iWorker) { return iWorker == 1; }));
+
+  // With every thread parked nothing runs until the caller helps
+  jobSystem.SetActiveWorkerCount(0);
+  LetWorkersSettle();
+  jobSystem.Run(RecordWorker, &parked);
+  LetWorkersSettle();
+  CHECK(parked.GetValue() == 1);
+  jobSystem.Wait(&parked);
+  CHECK(aWorkers.back() == 0);
+
+  // Let back in, the threads pick jobs up again
+  jobSystem.SetActiveWorkerCount(3);
+  aWorkers.clear();
+  for (uint32_t i = 0; i < uNumJobs; ++i)
+    jobSystem.Run(RecordWorker, &unparked);
+  REQUIRE(WaitWithoutHelping(unparked));
+  CHECK(aWorkers.size() == uNumJobs);
+  CHECK(std::none_of(aWorkers.begin(), aWorkers.end(), [](int iWorker) { return iWorker == 0; }));
+}
+
+TEST_CASE(JobSystem, ShutdownWithPendingJobs) {
+  const uint32_t uNumRoots = 256;
+  const uint32_t uNumChildren = 4;
+  const uint32_t uNumDependents = 32;
+  std::atomic<uint32_t> uRuns(0);
+  JobCounter counter;
+  JobCounter dependents;
+  JobCounter external;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(2);
+
+  // Jobs that queue more jobs, jobs parked on a counter and jobs from outside the system,
+  // none of them waited on
+  for (uint32_t r = 0; r < uNumRoots; ++r) {
+    jobSystem.Run(
+        [&]() {
+          for (uint32_t c = 0; c < uNumChildren; ++c)
+            jobSystem.Run([&]() { uRuns.fetch_add(1); }, &counter);
+          uRuns.fetch_add(1);
+        },
+        &counter);
+  }
+  for (uint32_t i = 0; i < uNumDependents; ++i)
+    jobSystem.Run([&]() { uRuns.fetch_add(1); }, &dependents, &counter);
+  std::thread([&]() { jobSystem.Run([&]() { uRuns.fetch_add(1); }, &external); }).join();
+
+  jobSystem.Shutdown();
+
+  CHECK(counter.IsDone() && dependents.IsDone() && external.IsDone());
+  CHECK(uRuns == uNumRoots * (uNumChildren + 1) + uNumDependents + 1);
+  CHECK(jobSystem.GetWorkerCount() == 0);
+  CHECK(jobSystem.GetCurrentWorkerIndex() == -1);
+
+  // A system shut down can be initialized again
+  JobCounter again;
+  jobSystem.Initialize(1);
+  jobSystem.Run([&]() { uRuns.fetch_add(1); }, &again);
+  jobSystem.Wait(&again);
+  CHECK(again.IsDone());
+}
@@ -0,0 +1,69 @@
+#include "TestHarness.h"
+#include "JobSystem.h"
+#include "RadixSort.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+namespace {
+// Sorts with the sorter and checks the result against a stable sort of the same pairs
+void CheckSort(RadixSorter &sorter, std::vector<uint64_t> aKeys, JobSystem *pJobSystem) {
+  std::vector<uint32_t> aValues(aKeys.size());
+  std::iota(aValues.begin(), aValues.end(), 0u);
+
+  std::vector<uint32_t> aExpected = aValues;
+  std::stable_sort(aExpected.begin(), aExpected.end(), [&](uint32_t a, uint32_t b) { return aKeys[a] < aKeys[b]; });
+
+  sorter.Sort(aKeys.data(), aValues.data(), (uint32_t)aKeys.size(), pJobSystem);
+
+  CHECK(std::is_sorted(aKeys.begin(), aKeys.end()));
+  CHECK(aValues == aExpected);
+}
+} // namespace
+
+TEST_CASE(RadixSort, SmallInputs) {
+  RadixSorter sorter;
+
+  CheckSort(sorter, {}, nullptr);
+  CheckSort(sorter, {42}, nullptr);
+  CHECK(sorter.GetLastPassCount() == 0);
+  CheckSort(sorter, {3, 1, 2, 1, 0, ~0ull, 1ull << 63}, nullptr);
+}
+
+TEST_CASE(RadixSort, UniformDigitsSkipPasses) {
+  std::mt19937_64 random(1);
+  std::vector<uint64_t> aKeys(5000);
+  RadixSorter sorter;
+
+  // Only the second byte varies
+  for (uint64_t &uKey : aKeys)
+    uKey = 0xAB00000000000000ull | ((random() & 0xFF) << 8);
+  CheckSort(sorter, aKeys, nullptr);
+  CHECK(sorter.GetLastPassCount() == 1);
+
+  // Equal keys keep their order, no pass is needed
+  std::fill(aKeys.begin(), aKeys.end(), 7ull);
+  CheckSort(sorter, aKeys, nullptr);
+  CHECK(sorter.GetLastPassCount() == 0);
+}
+
+TEST_CASE(RadixSort, ParallelMatchesSerial) {
+  std::mt19937_64 random(2);
+  std::vector<uint64_t> aKeys(RadixSorter::PARALLEL_THRESHOLD * 4 + 123);
+  RadixSorter sorter;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(3);
+
+  // Few distinct values in the low bits keep many duplicates, so stability across the
+  // blocks is checked too
+  for (uint64_t &uKey : aKeys)
+    uKey = (random() & 0xFFFF00000000ull) | (random() % 37);
+  CheckSort(sorter, aKeys, &jobSystem);
+  CheckSort(sorter, aKeys, nullptr);
+
+  for (uint64_t &uKey : aKeys)
+    uKey = random();
+  CheckSort(sorter, aKeys, &jobSystem);
+  CHECK(sorter.GetLastPassCount() == RadixSorter::NUM_PASSES);
+}
@@ -0,0 +1,256 @@
+#include "TestHarness.h"
+#include "IndirectDrawBuilder.h"
+#include "SDKmeshPackets.h"
+#include "CommandRecorder.h"
+
+namespace {
+enum {
+  MESH_SINGLE_STREAM,   // One vertex buffer, triangle lists
+  MESH_TWO_STREAMS,     // Two vertex buffers, no position stream
+  MESH_SPLIT_POSITIONS, // Two vertex buffers and a position stream
+  MESH_STRIP,           // One vertex buffer, a triangle strip among its draws
+  NUM_MESHES
+};
+
+void AddMesh(SDKMESH_PACKET_SET *pPackets, UINT uNumVertexBuffers, D3D12_GPU_VIRTUAL_ADDRESS PositionLocation,
+             D3D12_PRIMITIVE_TOPOLOGY SecondPrimType) {
+  const D3D12_GPU_VIRTUAL_ADDRESS Base = 0x100000 * (pPackets->NumMeshes() + 1);
+  SDKMESH_MESH_PACKET meshPacket = {};
+
+  meshPacket.NumVertexBuffers = uNumVertexBuffers;
+  for (UINT i = 0; i < uNumVertexBuffers; ++i)
+    meshPacket.VBV[i] = {Base + i * 0x10000, 0x10000, 16};
+  meshPacket.IBV = {Base + 0x80000, 0x10000, DXGI_FORMAT_R16_UINT};
+  if (PositionLocation)
+    meshPacket.PositionVBV = {PositionLocation, 0x10000, 12};
+  pPackets->AddMesh(meshPacket);
+
+  // Two materials over consecutive index ranges, so the packets keep both draws
+  SDKMESH_DRAW_PACKET draw = {D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, 36, 0, 0, 1};
+  pPackets->AddDraw(draw);
+  draw = {SecondPrimType, 24, 36, 0, 2};
+  pPackets->AddDraw(draw);
+}
+
+void BuildPackets(SDKMESH_PACKET_SET *pPackets) {
+  AddMesh(pPackets, 1, 0, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  AddMesh(pPackets, 2, 0, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  AddMesh(pPackets, 2, 0x900000, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  AddMesh(pPackets, 1, 0, D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+}
+
+// A mesh of one triangle list draw, for the sorting tests. The index buffer is shared by all.
+void AddSortMesh(SDKMESH_PACKET_SET *pPackets, D3D12_GPU_VIRTUAL_ADDRESS VBLocation, float fDepth, UINT MaterialID) {
+  SDKMESH_MESH_PACKET meshPacket = {};
+
+  meshPacket.NumVertexBuffers = 1;
+  meshPacket.VBV[0] = {VBLocation, 0x10000, 16};
+  meshPacket.IBV = {0x800000, 0x10000, DXGI_FORMAT_R16_UINT};
+  meshPacket.BoundsCenter = DirectX::XMFLOAT3(0.0f, 0.0f, fDepth);
+  pPackets->AddMesh(meshPacket);
+
+  SDKMESH_DRAW_PACKET draw = {D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, 36, 0, 0, MaterialID};
+  pPackets->AddDraw(draw);
+}
+
+// Depth along +z, bucketed over [0, 100]
+SDKMESH_SORT_PARAMS GetSortParams(UINT Pass, UINT PipelineState, bool bDepthOnly) {
+  SDKMESH_SORT_PARAMS params;
+  params.Pass = Pass;
+  params.PipelineState = PipelineState;
+  params.DepthPlane = DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f);
+  params.MaxDepth = 100.0f;
+  params.DepthOnly = bDepthOnly;
+  return params;
+}
+
+UINT64 GetKeyField(UINT64 Key, UINT Shift, UINT Bits) {
+  return (Key >> Shift) & ((1ull << Bits) - 1);
+}
+} // namespace
+
+TEST_CASE(SDKmeshPackets, IndirectDrawsRouteUnsupportedMeshesDirect) {
+  SDKMESH_PACKET_SET packets;
+  BuildPackets(&packets);
+  REQUIRE(packets.NumMeshes() == NUM_MESHES);
+  REQUIRE(packets.DrawPackets.size() == 2 * NUM_MESHES);
+
+  // A mesh without packets is drawn directly as well
+  const std::vector<UINT> aMeshes = {MESH_SINGLE_STREAM, MESH_TWO_STREAMS, MESH_SPLIT_POSITIONS, MESH_STRIP,
+                                     NUM_MESHES};
+  IndirectDrawBuilder builder;
+  std::vector<UINT> aDirect;
+
+  packets.BuildIndirectDraws(aMeshes.data(), (UINT)aMeshes.size(), false, &builder, &aDirect);
+
+  // Only the single stream triangle lists go indirect, a draw per material
+  CHECK(aDirect == std::vector<UINT>({MESH_TWO_STREAMS, MESH_SPLIT_POSITIONS, MESH_STRIP, NUM_MESHES}));
+  REQUIRE(builder.GetDrawCount() == 2);
+  CHECK(builder.GetAddedDrawCount() == 2);
+  for (UINT i = 0; i < 2; ++i) {
+    const INDIRECT_DRAW_ARGS &args = builder.GetDraws()[i];
+    CHECK(args.VBV.BufferLocation == packets.MeshPackets[MESH_SINGLE_STREAM].VBV[0].BufferLocation);
+    CHECK(args.IBV.BufferLocation == packets.MeshPackets[MESH_SINGLE_STREAM].IBV.BufferLocation);
+    CHECK(args.RootConstant == packets.DrawPackets[i].MaterialID);
+    CHECK(args.Draw.IndexCountPerInstance == packets.DrawPackets[i].IndexCount);
+    CHECK(args.Draw.StartIndexLocation == packets.DrawPackets[i].IndexStart);
+  }
+}
+
+TEST_CASE(SDKmeshPackets, DepthIndirectDrawsUsePositionStreams) {
+  SDKMESH_PACKET_SET packets;
+  BuildPackets(&packets);
+
+  const std::vector<UINT> aMeshes = {MESH_SINGLE_STREAM, MESH_TWO_STREAMS, MESH_SPLIT_POSITIONS, MESH_STRIP};
+  IndirectDrawBuilder builder;
+  std::vector<UINT> aDirect;
+
+  packets.BuildIndirectDraws(aMeshes.data(), (UINT)aMeshes.size(), true, &builder, &aDirect);
+
+  // Depth draws bind no material, so the draws of a mesh merge into one
+  CHECK(aDirect == std::vector<UINT>({MESH_TWO_STREAMS, MESH_STRIP}));
+  REQUIRE(builder.GetDrawCount() == 2);
+  CHECK(builder.GetAddedDrawCount() == 4);
+
+  const INDIRECT_DRAW_ARGS *pDraws = builder.GetDraws();
+  CHECK(pDraws[0].VBV.BufferLocation == packets.MeshPackets[MESH_SINGLE_STREAM].VBV[0].BufferLocation);
+  CHECK(pDraws[1].VBV.BufferLocation == packets.MeshPackets[MESH_SPLIT_POSITIONS].PositionVBV.BufferLocation);
+  for (UINT i = 0; i < 2; ++i) {
+    CHECK(pDraws[i].RootConstant == 0);
+    CHECK(pDraws[i].Draw.StartIndexLocation == 0);
+    CHECK(pDraws[i].Draw.IndexCountPerInstance == 60);
+  }
+}
+
+TEST_CASE(SDKmeshPackets, AddDrawMergeRules) {
+  const D3D12_PRIMITIVE_TOPOLOGY LIST = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+  const D3D12_PRIMITIVE_TOPOLOGY STRIP = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+  SDKMESH_PACKET_SET packets;
+
+  // Starts with a list draw of material 1 over indices [0, 36)
+  AddSortMesh(&packets, 0x100000, 0.0f, 1);
+  packets.AddDraw({LIST, 24, 36, 0, 1});   // Continues it
+  packets.AddDraw({LIST, 12, 60, 0, 1});   // And again
+  packets.AddDraw({LIST, 12, 72, 0, 2});   // Material
+  packets.AddDraw({LIST, 12, 84, 4, 2});   // Base vertex
+  packets.AddDraw({LIST, 12, 99, 4, 2});   // Gap in the index range
+  packets.AddDraw({LIST, 12, 99, 4, 2});   // Overlapping index range
+  packets.AddDraw({STRIP, 12, 111, 4, 2}); // Topology
+  packets.AddDraw({STRIP, 12, 123, 4, 2}); // Strips never merge
+
+  const UINT aIndexCounts[] = {72, 12, 12, 12, 12, 12, 12};
+  const UINT uNumDraws = sizeof(aIndexCounts) / sizeof(aIndexCounts[0]);
+  REQUIRE(packets.MeshPackets[0].NumDrawPackets == uNumDraws);
+  REQUIRE(packets.DrawPackets.size() == uNumDraws);
+  for (UINT i = 0; i < uNumDraws; ++i)
+    CHECK(packets.DrawPackets[i].IndexCount == aIndexCounts[i]);
+
+  // Nor do the draws of two meshes, even when the next mesh continues the range
+  packets.AddDraw({LIST, 12, 135, 4, 2});
+  const SDKMESH_MESH_PACKET meshPacket = packets.MeshPackets[0];
+  packets.AddMesh(meshPacket);
+  packets.AddDraw({LIST, 12, 147, 4, 2});
+  REQUIRE(packets.MeshPackets[1].FirstDrawPacket == uNumDraws + 1);
+  CHECK(packets.MeshPackets[1].NumDrawPackets == 1);
+  CHECK(packets.DrawPackets.size() == uNumDraws + 2);
+  CHECK(packets.DrawPackets.back().IndexStart == 147);
+}
+
+TEST_CASE(SDKmeshPackets, SortKeyFieldOrder) {
+  const UINT MESH_SHIFT = 0;
+  const UINT DEPTH_SHIFT = MESH_SHIFT + SDKMESH_SORT_MESH_BITS;
+  const UINT MATERIAL_SHIFT = DEPTH_SHIFT + SDKMESH_SORT_DEPTH_BITS;
+  const UINT PIPELINE_SHIFT = MATERIAL_SHIFT + SDKMESH_SORT_MATERIAL_BITS;
+  const UINT PASS_SHIFT = PIPELINE_SHIFT + SDKMESH_SORT_PIPELINE_BITS;
+
+  SDKMESH_PACKET_SET packets;
+  AddSortMesh(&packets, 0x100000, 30.0f, 1);
+  AddSortMesh(&packets, 0x200000, 10.0f, 2);
+  AddSortMesh(&packets, 0x300000, 20.0f, 1);
+  AddSortMesh(&packets, 0x400000, 20.0f, 1);
+
+  const std::vector<UINT> aMeshes = {3, 2, 1, 0};
+  SDKMESH_SORTED_DRAW_LIST sortedList;
+  packets.BuildSortedDrawList(aMeshes.data(), (UINT)aMeshes.size(), GetSortParams(3, 5, false), &sortedList);
+
+  // The material outranks the depth, which outranks the mesh
+  REQUIRE(sortedList.NumDraws() == 4);
+  CHECK(sortedList.Draws == std::vector<UINT>({2, 3, 0, 1}));
+  const float fDepthScale = ((1u << SDKMESH_SORT_DEPTH_BITS) - 1) / 100.0f;
+  for (UINT i = 0; i < 4; ++i) {
+    const UINT64 Key = sortedList.Keys[i];
+    const UINT iDraw = sortedList.Draws[i];
+    const UINT64 DepthBucket = (UINT64)(packets.MeshPackets[iDraw].BoundsCenter.z * fDepthScale);
+
+    CHECK(GetKeyField(Key, PASS_SHIFT, SDKMESH_SORT_PASS_BITS) == 3);
+    CHECK(GetKeyField(Key, PIPELINE_SHIFT, SDKMESH_SORT_PIPELINE_BITS) == 5);
+    CHECK(GetKeyField(Key, MATERIAL_SHIFT, SDKMESH_SORT_MATERIAL_BITS) == packets.DrawPackets[iDraw].MaterialID);
+    CHECK(GetKeyField(Key, DEPTH_SHIFT, SDKMESH_SORT_DEPTH_BITS) == DepthBucket);
+    CHECK(GetKeyField(Key, MESH_SHIFT, SDKMESH_SORT_MESH_BITS) == iDraw);
+  }
+
+  // The pass outranks the pipeline, which outranks the material
+  SDKMESH_SORTED_DRAW_LIST passList, pipelineList;
+  packets.BuildSortedDrawList(aMeshes.data(), (UINT)aMeshes.size(), GetSortParams(2, 255, false), &passList);
+  packets.BuildSortedDrawList(aMeshes.data(), (UINT)aMeshes.size(), GetSortParams(3, 4, false), &pipelineList);
+  CHECK(passList.Keys.back() < sortedList.Keys.front());
+  CHECK(pipelineList.Keys.back() < sortedList.Keys.front());
+}
+
+TEST_CASE(SDKmeshPackets, DepthOnlySortKeysLeaveOutTheMaterial) {
+  SDKMESH_PACKET_SET packets;
+  AddSortMesh(&packets, 0x100000, 30.0f, 1);
+  AddSortMesh(&packets, 0x200000, 10.0f, 2);
+  AddSortMesh(&packets, 0x300000, 20.0f, 1);
+
+  const std::vector<UINT> aMeshes = {0, 1, 2};
+  SDKMESH_SORTED_DRAW_LIST sortedList;
+  packets.BuildSortedDrawList(aMeshes.data(), (UINT)aMeshes.size(), GetSortParams(0, 0, true), &sortedList);
+
+  // Front to back, whatever the material
+  REQUIRE(sortedList.NumDraws() == 3);
+  CHECK(sortedList.Draws == std::vector<UINT>({1, 2, 0}));
+  for (UINT64 Key : sortedList.Keys)
+    CHECK(GetKeyField(Key, SDKMESH_SORT_DEPTH_BITS + SDKMESH_SORT_MESH_BITS, SDKMESH_SORT_MATERIAL_BITS) == 0);
+}
+
+TEST_CASE(SDKmeshPackets, SortedPlaybackSkipsRedundantState) {
+  SDKMESH_PACKET_SET packets;
+  packets.CbvSrvUavDescriptorSize = 32;
+  // Materials 0 and 1 share their diffuse texture
+  packets.MaterialTable.TextureMask = {1u << TS_DIFFUSE, 1u << TS_DIFFUSE};
+  packets.MaterialTable.HeapIndex[TS_DIFFUSE] = {4, 4};
+  for (UINT t = TS_DIFFUSE + 1; t < TS_COUNT; ++t)
+    packets.MaterialTable.HeapIndex[t] = {0, 0};
+
+  // Meshes 0 and 1 share their vertex buffer, all of them the index buffer
+  AddSortMesh(&packets, 0x100000, 10.0f, 0);
+  AddSortMesh(&packets, 0x100000, 20.0f, 0);
+  AddSortMesh(&packets, 0x200000, 30.0f, 1);
+
+  const std::vector<UINT> aMeshes = {0, 1, 2};
+  SDKMESH_SORTED_DRAW_LIST sortedList;
+  packets.BuildSortedDrawList(aMeshes.data(), (UINT)aMeshes.size(), GetSortParams(0, 0, false), &sortedList);
+  REQUIRE(sortedList.NumDraws() == 3);
+
+  NullCommandRecorder recorder;
+  D3D12_GPU_DESCRIPTOR_HANDLE hDescriptorStart = {0x10000};
+  packets.RenderSortedDrawList(&sortedList, 0, sortedList.NumDraws(), &recorder, hDescriptorStart, 2,
+                               INVALID_SAMPLER_SLOT, INVALID_SAMPLER_SLOT);
+
+  CHECK(recorder.GetDrawCount() == 3);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_IA_SET_VERTEX_BUFFERS) == 2);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_IA_SET_INDEX_BUFFER) == 1);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_IA_SET_PRIMITIVE_TOPOLOGY) == 1);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE) == 1);
+
+  // The depth playback binds no material at all
+  recorder.Reset();
+  packets.RenderSortedDrawListDepth(&sortedList, 0, sortedList.NumDraws(), &recorder);
+
+  CHECK(recorder.GetDrawCount() == 3);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_IA_SET_VERTEX_BUFFERS) == 2);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_IA_SET_INDEX_BUFFER) == 1);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_IA_SET_PRIMITIVE_TOPOLOGY) == 1);
+  CHECK(recorder.GetCommandCount(NULL_COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE) == 0);
+}
@@ -0,0 +1,85 @@
+#include "TestHarness.h"
+#include "TaskGraph.h"
+#include <cstring>
+#include <mutex>
+
+TEST_CASE(TaskGraph, DependenciesOrderNodes) {
+  const uint32_t uNumExecutions = 50;
+  std::mutex orderLock;
+  std::vector<TaskGraph::NodeId> aOrder;
+  TaskGraph graph;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(3);
+
+  auto Record = [&](TaskGraph::NodeId iNode) {
+    return [&, iNode]() {
+      std::lock_guard<std::mutex> lock(orderLock);
+      aOrder.push_back(iNode);
+    };
+  };
+
+  // Two diamonds sharing their root, with a tail that waits on both and a node on its own
+  TaskGraph::NodeId iRoot = graph.AddNode("Root", Record(0));
+  TaskGraph::NodeId iLeftA = graph.AddNode("LeftA", Record(1));
+  TaskGraph::NodeId iLeftB = graph.AddNode("LeftB", Record(2));
+  TaskGraph::NodeId iLeftJoin = graph.AddNode("LeftJoin", Record(3));
+  TaskGraph::NodeId iRightA = graph.AddNode("RightA", Record(4));
+  TaskGraph::NodeId iRightJoin = graph.AddNode("RightJoin", Record(5));
+  TaskGraph::NodeId iTail = graph.AddNode("Tail", Record(6));
+  graph.AddNode("Lone", Record(7));
+
+  graph.AddDependency(iLeftA, iRoot);
+  graph.AddDependency(iLeftB, iRoot);
+  graph.AddDependency(iLeftJoin, iLeftA);
+  graph.AddDependency(iLeftJoin, iLeftB);
+  graph.AddDependency(iRightA, iRoot);
+  graph.AddDependency(iRightJoin, iRightA);
+  graph.AddDependency(iTail, iLeftJoin);
+  graph.AddDependency(iTail, iRightJoin);
+
+  CHECK(graph.GetNodeCount() == 8);
+  CHECK(strcmp(graph.GetNodeName(iTail), "Tail") == 0);
+
+  const std::pair<TaskGraph::NodeId, TaskGraph::NodeId> aEdges[] = {
+      {iLeftA, iRoot},     {iLeftB, iRoot},       {iLeftJoin, iLeftA}, {iLeftJoin, iLeftB},
+      {iRightA, iRoot},    {iRightJoin, iRightA}, {iTail, iLeftJoin},  {iTail, iRightJoin}};
+
+  // The same graph runs again, as it does once per frame
+  for (uint32_t e = 0; e < uNumExecutions; ++e) {
+    aOrder.clear();
+    graph.Execute(&jobSystem);
+
+    REQUIRE(aOrder.size() == graph.GetNodeCount());
+    std::vector<size_t> aPosition(graph.GetNodeCount(), 0);
+    for (size_t i = 0; i < aOrder.size(); ++i)
+      aPosition[aOrder[i]] = i;
+    for (const auto &edge : aEdges)
+      CHECK(aPosition[edge.first] > aPosition[edge.second]);
+  }
+}
+
+TEST_CASE(TaskGraph, ClearAndRebuild) {
+  std::atomic<uint32_t> uRuns(0);
+  TaskGraph graph;
+  JobSystem jobSystem;
+
+  jobSystem.Initialize(2);
+
+  // An empty graph returns at once
+  graph.Execute(&jobSystem);
+
+  // A wide graph grows the pending counts past what the first one needed
+  graph.AddNode("Small", [&]() { uRuns.fetch_add(1); });
+  graph.Execute(&jobSystem);
+  CHECK(uRuns == 1);
+
+  graph.Clear();
+  CHECK(graph.GetNodeCount() == 0);
+
+  TaskGraph::NodeId iJoin = graph.AddNode("Join", [&]() { CHECK(uRuns == 1 + 64); });
+  for (uint32_t i = 0; i < 64; ++i)
+    graph.AddDependency(iJoin, graph.AddNode("Wide", [&]() { uRuns.fetch_add(1); }));
+  graph.Execute(&jobSystem);
+  CHECK(uRuns == 1 + 64);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+///
+/// Minimal test registry for the libraries that build without a device, dependency free so
+/// the tests run wherever the libraries build. TEST_CASE registers a function under a suite,
+/// CHECK reports a failure and carries on while REQUIRE also ends the test case. Both may be
+/// used from job system workers.
+///
+struct TEST_CASE_DESC {
+  const char *pSuite;
+  const char *pName;
+  void (*pFunction)();
+};
+
+namespace TestHarness {
+std::vector<TEST_CASE_DESC> &GetTestCases();
+void ReportFailure(const char *pFile, int iLine, const char *pExpression);
+
+struct RequireFailed {};
+
+struct Registrar {
+  Registrar(const char *pSuite, const char *pName, void (*pFunction)()) {
+    GetTestCases().push_back({pSuite, pName, pFunction});
+  }
+};
+} // namespace TestHarness
+
+#define TEST_CASE(Suite, Name)                                                                                         \
+  static void Suite##_##Name();                                                                                        \
+  static TestHarness::Registrar s_##Suite##_##Name##Registrar(#Suite, #Name, &Suite##_##Name);                         \
+  static void Suite##_##Name()
+
+#define CHECK(Expression)                                                                                              \
+  ((Expression) ? (void)0 : TestHarness::ReportFailure(__FILE__, __LINE__, #Expression))
+
+#define REQUIRE(Expression)                                                                                            \
+  do {                                                                                                                 \
+    if (!(Expression)) {                                                                                               \
+      TestHarness::ReportFailure(__FILE__, __LINE__, #Expression);                                                     \
+      throw TestHarness::RequireFailed();                                                                              \
+    }                                                                                                                  \
+  } while (0)
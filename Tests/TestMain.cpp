@@ -0,0 +1,53 @@
+#include "TestHarness.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+namespace {
+std::atomic<uint32_t> s_uFailures(0);
+std::mutex s_OutputLock;
+} // namespace
+
+std::vector<TEST_CASE_DESC> &TestHarness::GetTestCases() {
+  static std::vector<TEST_CASE_DESC> s_aTestCases;
+  return s_aTestCases;
+}
+
+void TestHarness::ReportFailure(const char *pFile, int iLine, const char *pExpression) {
+  s_uFailures.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(s_OutputLock);
+  fprintf(stderr, "%s(%d): check failed: %s\n", pFile, iLine, pExpression);
+}
+
+/// CommonTests [suite], runs every test case of the suite or all of them.
+int main(int argc, char **argv) {
+  const char *pSuite = argc > 1 ? argv[1] : nullptr;
+  uint32_t uNumRun = 0;
+  uint32_t uNumFailed = 0;
+
+  for (const TEST_CASE_DESC &test : TestHarness::GetTestCases()) {
+    if (pSuite && strcmp(pSuite, test.pSuite) != 0)
+      continue;
+
+    uint32_t uFailuresBefore = s_uFailures.load();
+    printf("[ RUN    ] %s.%s\n", test.pSuite, test.pName);
+    fflush(stdout);
+
+    try {
+      test.pFunction();
+    } catch (const TestHarness::RequireFailed &) {
+    }
+
+    bool bPassed = s_uFailures.load() == uFailuresBefore;
+    printf("[ %s ] %s.%s\n", bPassed ? "    OK" : "FAILED", test.pSuite, test.pName);
+    fflush(stdout);
+
+    ++uNumRun;
+    uNumFailed += bPassed ? 0 : 1;
+  }
+
+  printf("%u test cases, %u failed\n", uNumRun, uNumFailed);
+  return uNumRun == 0 || uNumFailed != 0 ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+#include "TestHarness.h"
+#include "UploadBufferStack.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace {
+// The push benchmark: threads pushing 256 byte constants, locked around Push as the stack
+// used to be and lock-free, best of the repeats
+const UINT s_uBenchmarkPushes = 1024;
+const int s_iBenchmarkRepeats = 5;
+
+struct PUSHED {
+  D3D12_CONSTANT_BUFFER_VIEW_DESC CBV;
+  UINT *pData;
+  UINT uValue;
+};
+
+// Pushes uNumPushes constants from every thread and returns the ns per push, from the first
+// thread starting to the last one ending
+double TimePushes(UploadBufferStack *pStack, UINT uNumThreads, UINT uNumPushes, std::mutex *pPushLock) {
+  std::atomic<UINT> uReady(0);
+  std::atomic<bool> bGo(false);
+  std::vector<std::chrono::steady_clock::time_point> aStart(uNumThreads), aEnd(uNumThreads);
+  std::vector<std::thread> aThreads;
+
+  for (UINT t = 0; t < uNumThreads; ++t) {
+    aThreads.emplace_back([&, t]() {
+      DirectX::XMFLOAT4 aConstants[16] = {};
+      D3D12_CONSTANT_BUFFER_VIEW_DESC CBV;
+
+      ++uReady;
+      while (!bGo.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+      aStart[t] = std::chrono::steady_clock::now();
+      for (UINT k = 0; k < uNumPushes; ++k) {
+        aConstants[0].x = (float)k;
+        if (pPushLock) {
+          std::lock_guard<std::mutex> lock(*pPushLock);
+          CHECK(SUCCEEDED(pStack->Push(aConstants, sizeof(aConstants), &CBV)));
+        } else {
+          CHECK(SUCCEEDED(pStack->Push(aConstants, sizeof(aConstants), &CBV)));
+        }
+      }
+      aEnd[t] = std::chrono::steady_clock::now();
+    });
+  }
+
+  while (uReady.load() < uNumThreads)
+    std::this_thread::yield();
+  bGo.store(true, std::memory_order_release);
+  for (auto &thread : aThreads)
+    thread.join();
+
+  auto first = *std::min_element(aStart.begin(), aStart.end());
+  auto last = *std::max_element(aEnd.begin(), aEnd.end());
+  return std::chrono::duration<double, std::nano>(last - first).count() / (uNumThreads * uNumPushes);
+}
+} // namespace
+
+TEST_CASE(UploadBufferStack, PushesAreAlignedAndKeepTheirData) {
+  UploadBufferStack stack;
+  std::vector<PUSHED> aPushed;
+
+  REQUIRE(SUCCEEDED(stack.Initialize(nullptr, 1000, 0)));
+  CHECK(stack.GetBlockSize() == 1024);
+
+  for (UINT i = 0; i < 20; ++i) {
+    UINT aData[80];
+    std::fill(std::begin(aData), std::end(aData), i);
+
+    PUSHED pushed;
+    UINT uSize = (i % 3 + 1) * 100;
+    REQUIRE(SUCCEEDED(stack.Push(uSize, (void **)&pushed.pData, &pushed.CBV)));
+    memcpy(pushed.pData, aData, uSize);
+    pushed.uValue = i;
+    aPushed.push_back(pushed);
+
+    CHECK(pushed.CBV.BufferLocation % 256 == 0);
+    CHECK(pushed.CBV.SizeInBytes == ((uSize + 255) & ~255u));
+  }
+
+  // No two pushes overlap and none was overwritten
+  std::sort(aPushed.begin(), aPushed.end(),
+            [](const PUSHED &a, const PUSHED &b) { return a.CBV.BufferLocation < b.CBV.BufferLocation; });
+  for (size_t i = 0; i < aPushed.size(); ++i) {
+    CHECK(aPushed[i].pData[0] == aPushed[i].uValue);
+    if (i > 0)
+      CHECK(aPushed[i - 1].CBV.BufferLocation + aPushed[i - 1].CBV.SizeInBytes <= aPushed[i].CBV.BufferLocation);
+  }
+}
+
+TEST_CASE(UploadBufferStack, ClearKeepsTheBlocks) {
+  UploadBufferStack stack;
+  D3D12_CONSTANT_BUFFER_VIEW_DESC CBV;
+
+  REQUIRE(SUCCEEDED(stack.Initialize(nullptr, 1024, 1)));
+
+  for (UINT i = 0; i < 12; ++i)
+    REQUIRE(SUCCEEDED(stack.Push(256, nullptr, &CBV)));
+  CHECK(stack.GetBlockCount() == 3);
+  CHECK(stack.GetUsedBlockCount() == 3);
+
+  // The same pushes again create nothing
+  stack.Clear();
+  CHECK(stack.GetUsedBlockCount() == 0);
+  REQUIRE(SUCCEEDED(stack.Push(256, nullptr, &CBV)));
+  CHECK(CBV.BufferLocation == 0);
+  for (UINT i = 1; i < 12; ++i)
+    REQUIRE(SUCCEEDED(stack.Push(256, nullptr, &CBV)));
+  CHECK(stack.GetBlockCount() == 3);
+
+  stack.ClearCapacity();
+  CHECK(stack.GetBlockCount() == 1);
+  CHECK(stack.GetUsedBlockCount() == 0);
+}
+
+TEST_CASE(UploadBufferStack, FailedPushes) {
+  UploadBufferStack stack;
+  D3D12_CONSTANT_BUFFER_VIEW_DESC CBV;
+
+  CHECK(FAILED(stack.Push(256, nullptr, &CBV)));
+  CHECK(stack.Initialize(nullptr, 0, 0) == E_INVALIDARG);
+
+  REQUIRE(SUCCEEDED(stack.Initialize(nullptr, 512, 0, 2)));
+  CHECK(stack.Push(1024, nullptr, &CBV) == E_INVALIDARG);
+
+  for (UINT i = 0; i < 4; ++i)
+    CHECK(SUCCEEDED(stack.Push(256, nullptr, &CBV)));
+  CHECK(stack.Push(256, nullptr, &CBV) == E_OUTOFMEMORY);
+
+  stack.Clear();
+  CHECK(SUCCEEDED(stack.Push(256, nullptr, &CBV)));
+}
+
+TEST_CASE(UploadBufferStack, ConcurrentPushesAreDisjoint) {
+  const UINT uNumThreads = 8;
+  const UINT uNumPushes = 500;
+  UploadBufferStack stack;
+  std::vector<std::vector<PUSHED>> aPushed(uNumThreads);
+  std::vector<std::thread> aThreads;
+
+  REQUIRE(SUCCEEDED(stack.Initialize(nullptr, 4096, 0)));
+
+  for (UINT t = 0; t < uNumThreads; ++t) {
+    aThreads.emplace_back([&, t]() {
+      for (UINT k = 0; k < uNumPushes; ++k) {
+        PUSHED pushed;
+        pushed.uValue = t * uNumPushes + k;
+        CHECK(SUCCEEDED(stack.Push(&pushed.uValue, sizeof(pushed.uValue), &pushed.CBV)));
+        aPushed[t].push_back(pushed);
+      }
+    });
+  }
+  for (auto &thread : aThreads)
+    thread.join();
+
+  std::vector<PUSHED> aAll;
+  for (auto &a : aPushed)
+    aAll.insert(aAll.end(), a.begin(), a.end());
+  std::sort(aAll.begin(), aAll.end(),
+            [](const PUSHED &a, const PUSHED &b) { return a.CBV.BufferLocation < b.CBV.BufferLocation; });
+  for (size_t i = 1; i < aAll.size(); ++i)
+    CHECK(aAll[i - 1].CBV.BufferLocation + aAll[i - 1].CBV.SizeInBytes <= aAll[i].CBV.BufferLocation);
+  CHECK(stack.GetBlockCount() <= uNumThreads * uNumPushes * 256 / 4096 + uNumThreads);
+}
+
+// Reports the locked and the lock-free push, from one thread to twice the hardware threads
+TEST_CASE(UploadBufferStack, PushBenchmark) {
+  UploadBufferStack stack;
+  std::mutex pushLock;
+
+  // Blocks are kept across Clear, so only the first repeat of a wider run creates any
+  REQUIRE(SUCCEEDED(stack.Initialize(nullptr, 1 << 16, 0)));
+
+  const UINT uMaxThreads = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u) * 2, 64u);
+  for (UINT uNumThreads = 1; uNumThreads <= uMaxThreads; uNumThreads *= 2) {
+    double aBestNs[2] = {1e30, 1e30};
+
+    for (int j = 0; j < 2; ++j) {
+      for (int r = 0; r < s_iBenchmarkRepeats; ++r) {
+        stack.Clear();
+        double fNs = TimePushes(&stack, uNumThreads, s_uBenchmarkPushes, j == 0 ? &pushLock : nullptr);
+        aBestNs[j] = (std::min)(aBestNs[j], fNs);
+      }
+    }
+
+    printf("  %u threads: locked %.1f ns/push, lock-free %.1f ns/push, %u blocks\n", uNumThreads, aBestNs[0],
+           aBestNs[1], stack.GetBlockCount());
+  }
+}
@@ -0,0 +1,177 @@
+#include "TestHarness.h"
+#include "UploadRingBuffer.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+const UINT s_uPageSize = 256;
+
+// Completes whatever is waited for, the tests complete the rest by hand
+class FakeFence final : public IUploadRingFence {
+public:
+  UINT64 uCompleted = 0;
+  std::vector<UINT64> aWaits;
+
+  UINT64 GetCompletedFencePoint() const override {
+    return uCompleted;
+  }
+
+  HRESULT WaitForFencePoint(_In_ UINT64 uFencePoint) override {
+    aWaits.push_back(uFencePoint);
+    uCompleted = (std::max)(uCompleted, uFencePoint);
+    return S_OK;
+  }
+};
+
+// Larger than a quarter page, so every allocation takes whole pages of its own
+D3D12_GPU_VIRTUAL_ADDRESS AllocatePages(UploadRingBuffer *pRing, UINT uNumPages, BYTE **ppMappedData = nullptr) {
+  void *pMappedData = nullptr;
+  D3D12_GPU_VIRTUAL_ADDRESS Location = ~0ull;
+
+  CHECK(SUCCEEDED(pRing->Allocate(uNumPages * s_uPageSize, 256, &pMappedData, &Location)));
+  if (ppMappedData)
+    *ppMappedData = (BYTE *)pMappedData;
+  return Location;
+}
+} // namespace
+
+TEST_CASE(UploadRingBuffer, WrapsAround) {
+  FakeFence fence;
+  UploadRingBuffer ring;
+  BYTE *pRingStart;
+
+  REQUIRE(SUCCEEDED(ring.Initialize(nullptr, &fence, 4 * s_uPageSize, 4 * s_uPageSize, s_uPageSize)));
+  CHECK(ring.GetSize() == 4 * s_uPageSize);
+
+  CHECK(AllocatePages(&ring, 2, &pRingStart) == 0);
+  ring.FinishFrame(1);
+  CHECK(AllocatePages(&ring, 1) == 2 * s_uPageSize);
+  ring.FinishFrame(2);
+  CHECK(ring.GetUsedSize() == 3 * s_uPageSize);
+
+  // Two pages do not fit after the head, the last page is skipped and the allocation wraps
+  // into the pages of the first frame once it completes
+  fence.uCompleted = 1;
+  BYTE *pMappedData;
+  CHECK(AllocatePages(&ring, 2, &pMappedData) == 0);
+  CHECK(pMappedData == pRingStart);
+  CHECK(ring.GetUsedSize() == 4 * s_uPageSize);
+  CHECK(fence.aWaits.empty());
+  CHECK(ring.GetGrowCount() == 0);
+
+  // The skipped page goes back with the frame that skipped it
+  ring.FinishFrame(3);
+  fence.uCompleted = 3;
+  ring.FinishFrame(4);
+  CHECK(ring.GetUsedSize() == 0);
+}
+
+TEST_CASE(UploadRingBuffer, ReuseWaitsForTheFence) {
+  FakeFence fence;
+  UploadRingBuffer ring;
+
+  REQUIRE(SUCCEEDED(ring.Initialize(nullptr, &fence, 2 * s_uPageSize, 2 * s_uPageSize, s_uPageSize)));
+
+  // The open frame holding every page has nothing to wait for
+  CHECK(AllocatePages(&ring, 2) == 0);
+  CHECK(ring.Allocate(s_uPageSize, 256, nullptr, nullptr) == E_OUTOFMEMORY);
+  CHECK(fence.aWaits.empty());
+  ring.FinishFrame(1);
+
+  // At its largest the full ring waits for the oldest frame rather than growing
+  CHECK(AllocatePages(&ring, 1) == 0);
+  CHECK(fence.aWaits == std::vector<UINT64>({1}));
+  ring.FinishFrame(2);
+
+  // A completed frame's pages come back without waiting
+  fence.uCompleted = 2;
+  CHECK(AllocatePages(&ring, 2) == 0);
+  CHECK(fence.aWaits.size() == 1);
+  CHECK(ring.GetGrowCount() == 0);
+}
+
+TEST_CASE(UploadRingBuffer, SmallAllocationsSharePagesWithinAFrame) {
+  FakeFence fence;
+  UploadRingBuffer ring;
+  D3D12_GPU_VIRTUAL_ADDRESS aLocations[3];
+  D3D12_CONSTANT_BUFFER_VIEW_DESC CBV;
+  const UINT aData[4] = {1, 2, 3, 4};
+
+  REQUIRE(SUCCEEDED(ring.Initialize(nullptr, &fence, 4 * s_uPageSize, 4 * s_uPageSize, s_uPageSize)));
+
+  // A page of the thread's own, bump allocated in alignment
+  CHECK(SUCCEEDED(ring.Allocate(16, 16, nullptr, &aLocations[0])));
+  CHECK(SUCCEEDED(ring.Allocate(4, 4, nullptr, &aLocations[1])));
+  CHECK(SUCCEEDED(ring.Allocate(16, 16, nullptr, &aLocations[2])));
+  CHECK(aLocations[1] == aLocations[0] + 16);
+  CHECK(aLocations[2] == aLocations[0] + 32);
+  CHECK(ring.GetUsedSize() == s_uPageSize);
+
+  // A finished frame's page is not continued, even with room left
+  ring.FinishFrame(1);
+  CHECK(SUCCEEDED(ring.Push(aData, sizeof(aData), &CBV)));
+  CHECK(CBV.BufferLocation == aLocations[0] + s_uPageSize);
+  CHECK(CBV.SizeInBytes == 256);
+  CHECK(ring.GetUsedSize() == 2 * s_uPageSize);
+
+  CHECK(ring.Allocate(16, 3, nullptr, nullptr) == E_INVALIDARG);
+  CHECK(ring.Allocate(16, 512, nullptr, nullptr) == E_INVALIDARG);
+}
+
+TEST_CASE(UploadRingBuffer, GrowsUpToTheMaximum) {
+  FakeFence fence;
+  UploadRingBuffer ring;
+  BYTE *pOldData;
+
+  REQUIRE(SUCCEEDED(ring.Initialize(nullptr, &fence, 2 * s_uPageSize, 8 * s_uPageSize, s_uPageSize)));
+
+  CHECK(AllocatePages(&ring, 2, &pOldData) == 0);
+  pOldData[0] = 42;
+  ring.FinishFrame(1);
+
+  // Growing is preferred over waiting, the old buffer stays mapped for the frame using it
+  CHECK(AllocatePages(&ring, 1) == 0);
+  CHECK(ring.GetGrowCount() == 1);
+  CHECK(ring.GetSize() == 4 * s_uPageSize);
+  CHECK(fence.aWaits.empty());
+  CHECK(pOldData[0] == 42);
+
+  // Grows past double when a single allocation needs it, never past the maximum
+  CHECK(AllocatePages(&ring, 6) == 0);
+  CHECK(ring.GetGrowCount() == 2);
+  CHECK(ring.GetSize() == 8 * s_uPageSize);
+  CHECK(ring.Allocate(9 * s_uPageSize, 256, nullptr, nullptr) == E_OUTOFMEMORY);
+
+  fence.uCompleted = 2;
+  ring.FinishFrame(2);
+  CHECK(ring.GetUsedSize() == 0);
+}
+
+TEST_CASE(UploadRingBuffer, ThreadsAllocateDisjointRanges) {
+  const UINT uNumThreads = 4;
+  const UINT uNumAllocations = 256;
+  FakeFence fence;
+  UploadRingBuffer ring;
+  std::vector<D3D12_GPU_VIRTUAL_ADDRESS> aLocations(uNumThreads * uNumAllocations);
+  std::vector<std::thread> aThreads;
+
+  REQUIRE(SUCCEEDED(ring.Initialize(nullptr, &fence, 256 * s_uPageSize, 256 * s_uPageSize, s_uPageSize)));
+
+  for (UINT t = 0; t < uNumThreads; ++t) {
+    aThreads.emplace_back([&, t]() {
+      for (UINT k = 0; k < uNumAllocations; ++k)
+        CHECK(SUCCEEDED(ring.Allocate(48, 16, nullptr, &aLocations[t * uNumAllocations + k])));
+    });
+  }
+  for (auto &thread : aThreads)
+    thread.join();
+
+  std::sort(aLocations.begin(), aLocations.end());
+  for (size_t i = 0; i < aLocations.size(); ++i) {
+    CHECK(aLocations[i] % 16 == 0);
+    if (i > 0)
+      CHECK(aLocations[i] >= aLocations[i - 1] + 48);
+  }
+  CHECK(fence.aWaits.empty());
+}